@@ -21,6 +21,7 @@
 #include <assert.h>
 #include <algorithm>
 #include <memory>
+#include <vector>
 #include <wrl.h>
 
 #include "DDSTextureLoader.h" 
@@ -128,6 +129,10 @@ struct handle_closer { void operator()(HANDLE h) { if (h) CloseHandle(h); } };
 
 typedef public std::unique_ptr<void, handle_closer> ScopedHandle;
 
+struct view_closer { void operator()(void* p) { if (p) UnmapViewOfFile(p); } };
+
+typedef public std::unique_ptr<void, view_closer> ScopedView;
+
 inline HANDLE safe_handle( HANDLE h ) { return (h == INVALID_HANDLE_VALUE) ? 0 : h; }
 
 template<UINT TNameLength>
@@ -1669,16 +1674,18 @@ static HRESULT CreateTextureFromDDS( _In_ ID3D11Device* d3dDevice,
     return hr;
 }
 
-static HRESULT CreateTextureFromDDS12(
-	_In_ ID3D12Device* device,
-	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+//--------------------------------------------------------------------------------------
+// Validates the header and fills out the resource description and subresource data of
+// a DDS texture without touching the device.
+//--------------------------------------------------------------------------------------
+static HRESULT GetTextureDescFromDDS12(
 	_In_ const DDS_HEADER* header,
 	_In_reads_bytes_(bitSize) const uint8_t* bitData,
 	_In_ size_t bitSize,
 	_In_ size_t maxsize,
-	_In_ bool forceSRGB,
-	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	_Out_ D3D12_RESOURCE_DESC& texDesc,
+	_Out_ bool& isCubeMap,
+	std::vector<D3D12_SUBRESOURCE_DATA>& subresources)
 {
 	HRESULT hr = S_OK;
 
@@ -1689,7 +1696,7 @@ static HRESULT CreateTextureFromDDS12(
 	uint32_t resDim = D3D12_RESOURCE_DIMENSION_UNKNOWN;
 	UINT arraySize = 1;
 	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
-	bool isCubeMap = false;
+	isCubeMap = false;
 
 	size_t mipCount = header->mipMapCount;
 	if (0 == mipCount) mipCount = 1;
@@ -1835,15 +1842,7 @@ static HRESULT CreateTextureFromDDS12(
 		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
 	}
 
-	// Create the texture
-	std::unique_ptr<D3D12_SUBRESOURCE_DATA[]> initData(
-		new (std::nothrow) D3D12_SUBRESOURCE_DATA[mipCount * arraySize]
-		);
-
-	if (!initData)
-	{
-		return E_OUTOFMEMORY;
-	}
+	subresources.resize(mipCount * arraySize);
 
 	size_t skipMip = 0;
 	size_t twidth = 0;
@@ -1852,20 +1851,64 @@ static HRESULT CreateTextureFromDDS12(
 
 	hr = FillInitData12(
 		width, height, depth, mipCount, arraySize, format, maxsize, bitSize, bitData,
-		twidth, theight, tdepth, skipMip, initData.get()
+		twidth, theight, tdepth, skipMip, subresources.data()
 		);
 
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	subresources.resize((mipCount - skipMip) * arraySize);
+
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = (D3D12_RESOURCE_DIMENSION)resDim;
+	texDesc.Alignment = 0;
+	texDesc.Width = twidth;
+	texDesc.Height = (uint32_t)theight;
+	texDesc.DepthOrArraySize = (resDim == D3D12_RESOURCE_DIMENSION_TEXTURE3D) ? (uint16_t)tdepth : (uint16_t)arraySize;
+	texDesc.MipLevels = (uint16_t)(mipCount - skipMip);
+	texDesc.Format = format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT CreateTextureFromDDS12(
+	_In_ ID3D12Device* device,
+	_In_opt_ ID3D12GraphicsCommandList* cmdList,
+	_In_ const DDS_HEADER* header,
+	_In_reads_bytes_(bitSize) const uint8_t* bitData,
+	_In_ size_t bitSize,
+	_In_ size_t maxsize,
+	_In_ bool forceSRGB,
+	ComPtr<ID3D12Resource>& texture,
+	ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	D3D12_RESOURCE_DESC texDesc;
+	bool isCubeMap = false;
+	std::vector<D3D12_SUBRESOURCE_DATA> initData;
+
+	HRESULT hr = GetTextureDescFromDDS12(header, bitData, bitSize, maxsize, texDesc, isCubeMap, initData);
+
 	if (SUCCEEDED(hr))
 	{
+		bool isVolume = texDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+
 		hr = CreateD3DResources12(
 			device, cmdList,
-			resDim, twidth, theight, tdepth,
-			mipCount - skipMip,
-			arraySize,
-			format,
+			texDesc.Dimension, (size_t)texDesc.Width, texDesc.Height,
+			isVolume ? texDesc.DepthOrArraySize : 1,
+			texDesc.MipLevels,
+			isVolume ? 1 : texDesc.DepthOrArraySize,
+			texDesc.Format,
 			false, // forceSRGB
 			isCubeMap,
-			initData.get(),
+			initData.data(),
 			texture, 
 			textureUploadHeap);
 	}
@@ -2134,6 +2177,280 @@ HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                        texture, textureView, alphaMode );
 }
 
+//--------------------------------------------------------------------------------------
+// A DDS file mapped read-only into memory.  Header and BitData point into the view and
+// stay valid while the object lives.
+//--------------------------------------------------------------------------------------
+namespace
+{
+
+struct MappedDDSFile
+{
+	ScopedHandle File;
+	ScopedHandle Mapping;
+	ScopedView View;
+
+	const DDS_HEADER* Header = nullptr;
+	const uint8_t* BitData = nullptr;
+	size_t BitSize = 0;
+};
+
+}
+
+//--------------------------------------------------------------------------------------
+static HRESULT MapDDSFile(_In_z_ const wchar_t* fileName, MappedDDSFile& file)
+{
+	// open the file and map a read-only view of all of it
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+	file.File.reset(safe_handle(CreateFile2(fileName,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		OPEN_EXISTING,
+		nullptr)));
+#else
+	file.File.reset(safe_handle(CreateFileW(fileName,
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr)));
+#endif
+
+	if (!file.File)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	LARGE_INTEGER FileSize = { 0 };
+	if (!GetFileSizeEx(file.File.get(), &FileSize))
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	// File is too big for a 32-bit view, so reject it
+	if (FileSize.HighPart > 0)
+	{
+		return E_FAIL;
+	}
+
+	// Need at least enough data to fill the header and magic number to be a valid DDS
+	if (FileSize.LowPart < (sizeof(DDS_HEADER) + sizeof(uint32_t)))
+	{
+		return E_FAIL;
+	}
+
+	file.Mapping.reset(safe_handle(CreateFileMappingW(file.File.get(), nullptr, PAGE_READONLY, 0, 0, nullptr)));
+	if (!file.Mapping)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	file.View.reset(MapViewOfFile(file.Mapping.get(), FILE_MAP_READ, 0, 0, 0));
+	if (!file.View)
+	{
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	const uint8_t* ddsData = static_cast<const uint8_t*>(file.View.get());
+	const size_t ddsDataSize = FileSize.LowPart;
+
+	// DDS files always start with the same magic number ("DDS ")
+	if (*(const uint32_t*)(ddsData) != DDS_MAGIC)
+	{
+		return E_FAIL;
+	}
+
+	auto header = reinterpret_cast<const DDS_HEADER*>(ddsData + sizeof(uint32_t));
+
+	// Verify header to validate DDS file
+	if (header->size != sizeof(DDS_HEADER) ||
+		header->ddspf.size != sizeof(DDS_PIXELFORMAT))
+	{
+		return E_FAIL;
+	}
+
+	// Check for DX10 extension
+	bool bDXT10Header = false;
+	if ((header->ddspf.flags & DDS_FOURCC) &&
+		(MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
+	{
+		// Must be long enough for both headers and magic value
+		if (ddsDataSize < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
+		{
+			return E_FAIL;
+		}
+
+		bDXT10Header = true;
+	}
+
+	ptrdiff_t offset = sizeof(uint32_t)
+		+ sizeof(DDS_HEADER)
+		+ (bDXT10Header ? sizeof(DDS_HEADER_DXT10) : 0);
+
+	file.Header = header;
+	file.BitData = ddsData + offset;
+	file.BitSize = ddsDataSize - offset;
+
+	return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+// Copies numSubresources subresources starting at firstSubresource into upload memory
+// returned by allocateUpload.  layouts receives footprints relative to that memory.
+//--------------------------------------------------------------------------------------
+static HRESULT CopySubresourcesToUpload(
+	_In_ ID3D12Device* device,
+	_In_ const D3D12_RESOURCE_DESC& texDesc,
+	_In_ const std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+	_In_ UINT firstSubresource,
+	_In_ UINT numSubresources,
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+	const std::function<uint8_t*(UINT64 uploadSize)>& allocateUpload)
+{
+	layouts.resize(numSubresources);
+	std::vector<UINT> numRows(numSubresources);
+	std::vector<UINT64> rowSizes(numSubresources);
+	UINT64 uploadSize = 0;
+	device->GetCopyableFootprints(&texDesc, firstSubresource, numSubresources, 0,
+		layouts.data(), numRows.data(), rowSizes.data(), &uploadSize);
+
+	uint8_t* uploadData = allocateUpload(uploadSize);
+	if (!uploadData)
+	{
+		layouts.clear();
+		return E_OUTOFMEMORY;
+	}
+
+	for (UINT i = 0; i < numSubresources; ++i)
+	{
+		D3D12_MEMCPY_DEST dest = {
+			uploadData + layouts[i].Offset,
+			layouts[i].Footprint.RowPitch,
+			SIZE_T(layouts[i].Footprint.RowPitch) * numRows[i] };
+		MemcpySubresource(&dest, &subresources[firstSubresource + i], (SIZE_T)rowSizes[i], numRows[i], layouts[i].Footprint.Depth);
+	}
+
+	return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::CreateDDSTextureFromFileMapped12(
+	ID3D12Device* device,
+	_In_z_ const wchar_t* szFileName,
+	ComPtr<ID3D12Resource>& texture,
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+	const std::function<uint8_t*(UINT64 uploadSize)>& allocateUpload,
+	_In_ size_t maxsize)
+{
+	texture = nullptr;
+	layouts.clear();
+
+	if (!device || !szFileName || !allocateUpload)
+	{
+		return E_INVALIDARG;
+	}
+
+	MappedDDSFile file;
+	HRESULT hr = MapDDSFile(szFileName, file);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// The subresources point straight into the mapped view.
+	D3D12_RESOURCE_DESC texDesc;
+	bool isCubeMap = false;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	hr = GetTextureDescFromDDS12(file.Header, file.BitData, file.BitSize, maxsize,
+		texDesc, isCubeMap, subresources);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (texDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+
+	// Created in the COMMON state so the copy can be recorded on any queue type.
+	hr = device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&texture));
+	if (FAILED(hr))
+	{
+		texture = nullptr;
+		return hr;
+	}
+
+	hr = CopySubresourcesToUpload(device, texDesc, subresources,
+		0, (UINT)subresources.size(), layouts, allocateUpload);
+	if (FAILED(hr))
+	{
+		texture = nullptr;
+	}
+
+	return hr;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT DirectX::LoadDDSMipsFromFileMapped12(
+	ID3D12Device* device,
+	_In_z_ const wchar_t* szFileName,
+	D3D12_RESOURCE_DESC& texDesc,
+	_In_ UINT firstMip,
+	_In_ UINT numMips,
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+	const std::function<uint8_t*(UINT64 uploadSize)>& allocateUpload)
+{
+	layouts.clear();
+
+	if (!device || !szFileName || (numMips > 0 && !allocateUpload))
+	{
+		return E_INVALIDARG;
+	}
+
+	MappedDDSFile file;
+	HRESULT hr = MapDDSFile(szFileName, file);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// Only the pages holding the requested mips are touched.
+	bool isCubeMap = false;
+	std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+	hr = GetTextureDescFromDDS12(file.Header, file.BitData, file.BitSize, 0,
+		texDesc, isCubeMap, subresources);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	if (texDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || texDesc.DepthOrArraySize != 1)
+	{
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+
+	if (numMips == 0)
+	{
+		return S_OK;
+	}
+
+	if (firstMip + numMips > texDesc.MipLevels)
+	{
+		return E_INVALIDARG;
+	}
+
+	return CopySubresourcesToUpload(device, texDesc, subresources,
+		firstMip, numMips, layouts, allocateUpload);
+}
+
 HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	_In_ ID3D12GraphicsCommandList* cmdList,
 	_In_z_ const wchar_t* szFileName,
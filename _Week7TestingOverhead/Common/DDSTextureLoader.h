@@ -22,6 +22,9 @@
 #pragma once
 #endif
 
+#include <functional>
+#include <memory>
+#include <vector>
 #include <wrl.h>
 #include <d3d11_1.h>
 #include "d3dx12.h"
@@ -92,6 +95,32 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Memory-maps a 2D DDS file, creates the texture in the COMMON state and copies every
+	// subresource straight from the mapping into the upload memory returned by
+	// allocateUpload(uploadSize), which must be aligned to D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT.
+	// layouts receives the footprints relative to the start of that memory.  No commands
+	// are recorded, so it can be called from any thread.
+	HRESULT CreateDDSTextureFromFileMapped12(_In_ ID3D12Device* device,
+		                                     _In_z_ const wchar_t* szFileName,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                                     _Out_ std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+		                                     _In_ const std::function<uint8_t*(UINT64 uploadSize)>& allocateUpload,
+		                                     _In_ size_t maxsize = 0
+		                                     );
+
+	// Memory-maps a single 2D DDS texture and fills out the description of the full mip
+	// chain.  Mips [firstMip, firstMip + numMips) are copied into the upload memory
+	// returned by allocateUpload(uploadSize), with layouts relative to that memory.  With
+	// numMips == 0 only the description is read.  Used to stream mips one at a time.
+	HRESULT LoadDDSMipsFromFileMapped12(_In_ ID3D12Device* device,
+		                                _In_z_ const wchar_t* szFileName,
+		                                _Out_ D3D12_RESOURCE_DESC& texDesc,
+		                                _In_ UINT firstMip,
+		                                _In_ UINT numMips,
+		                                _Out_ std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT>& layouts,
+		                                _In_ const std::function<uint8_t*(UINT64 uploadSize)>& allocateUpload
+		                                );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -7,7 +7,8 @@
 
 GameTimer::GameTimer()
 : mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+  mPausedTime(0), mPrevTime(0), mCurrTime(0),
+  mFixedDeltaTime(0.0), mFixedTotalTime(0.0), mStopped(false)
 {
 	__int64 countsPerSec;
 	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
@@ -18,6 +19,11 @@ GameTimer::GameTimer()
 // time when the clock is stopped.
 float GameTimer::TotalTime()const
 {
+	if( mFixedDeltaTime > 0.0 )
+	{
+		return (float)mFixedTotalTime;
+	}
+
 	// If we are stopped, do not count the time that has passed since we stopped.
 	// Moreover, if we previously already had a pause, the distance 
 	// mStopTime - mBaseTime includes paused time, which we do not want to count.
@@ -62,6 +68,7 @@ void GameTimer::Reset()
 	mPrevTime = currTime;
 	mStopTime = 0;
 	mStopped  = false;
+	mFixedTotalTime = 0.0;
 }
 
 void GameTimer::Start()
@@ -106,6 +113,13 @@ void GameTimer::Tick()
 		return;
 	}
 
+	if( mFixedDeltaTime > 0.0 )
+	{
+		mDeltaTime = mFixedDeltaTime;
+		mFixedTotalTime += mFixedDeltaTime;
+		return;
+	}
+
 	__int64 currTime;
 	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
 	mCurrTime = currTime;
@@ -125,6 +139,13 @@ void GameTimer::Tick()
 	}
 }
 
+void GameTimer::SetFixedDeltaTime(double seconds)
+{
+	// Carry on from the current time rather than jumping.
+	mFixedTotalTime = (double)TotalTime();
+	mFixedDeltaTime = seconds;
+}
+
 
 
 
@@ -18,6 +18,10 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// With a positive step every Tick advances the clock by exactly that many seconds,
+	// whatever the real time, so runs are reproducible.  Zero goes back to real time.
+	void SetFixedDeltaTime(double seconds);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
@@ -28,6 +32,9 @@ private:
 	__int64 mPrevTime;
 	__int64 mCurrTime;
 
+	double mFixedDeltaTime;
+	double mFixedTotalTime;
+
 	bool mStopped;
 };
 
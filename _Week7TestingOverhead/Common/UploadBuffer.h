@@ -1,6 +1,7 @@
 #pragma once
 
 #include "d3dUtil.h"
+#include "UploadRing.h"
 
 template<typename T>
 class UploadBuffer
@@ -33,13 +34,33 @@ public:
 
         // We do not need to unmap until we are done with the resource.  However, we must not write to
         // the resource while it is in use by the GPU (so we must use synchronization techniques).
+        mGpuAddress = mUploadBuffer->GetGPUVirtualAddress();
+        mOwnsMapping = true;
+    }
+
+    // Places the buffer in a persistent suballocation of uploadRing instead of its own
+    // committed resource.  Resource() is then the ring's heap, so address the buffer
+    // with GpuVirtualAddress().
+    UploadBuffer(UploadRing& uploadRing, UINT elementCount, bool isConstantBuffer) :
+        mIsConstantBuffer(isConstantBuffer)
+    {
+        mElementByteSize = sizeof(T);
+        if(isConstantBuffer)
+            mElementByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(T));
+
+        UploadRing::Allocation allocation = uploadRing.AllocatePersistent(
+            (UINT64)mElementByteSize*elementCount, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+
+        mUploadBuffer = allocation.Resource;
+        mMappedData = allocation.CpuAddress;
+        mGpuAddress = allocation.GpuAddress;
     }
 
     UploadBuffer(const UploadBuffer& rhs) = delete;
     UploadBuffer& operator=(const UploadBuffer& rhs) = delete;
     ~UploadBuffer()
     {
-        if(mUploadBuffer != nullptr)
+        if(mUploadBuffer != nullptr && mOwnsMapping)
             mUploadBuffer->Unmap(0, nullptr);
 
         mMappedData = nullptr;
@@ -50,15 +71,31 @@ public:
         return mUploadBuffer.Get();
     }
 
+    D3D12_GPU_VIRTUAL_ADDRESS GpuVirtualAddress()const
+    {
+        return mGpuAddress;
+    }
+
     void CopyData(int elementIndex, const T& data)
     {
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Direct access to the mapped memory, for filling many elements in one pass.  Only
+    // for buffers that are not constant buffers, so the elements are tightly packed.
+    // Upload heap memory is write-combined: write it sequentially and never read it.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS mGpuAddress = 0;
 
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
+    bool mOwnsMapping = false;
 };
\ No newline at end of file
@@ -0,0 +1,182 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 capacityBytes)
+{
+	mCapacity = capacityBytes;
+	mRingEnd = capacityBytes;
+	mStats.CapacityBytes = capacityBytes;
+
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(capacityBytes),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mUploadHeap)));
+
+	// Mapped for the lifetime of the ring.  Upload heap memory is write-combined:
+	// write it sequentially and never read it.
+	ThrowIfFailed(mUploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+	mGpuAddress = mUploadHeap->GetGPUVirtualAddress();
+}
+
+UploadRing::~UploadRing()
+{
+	if(mUploadHeap != nullptr)
+		mUploadHeap->Unmap(0, nullptr);
+
+	mMappedData = nullptr;
+}
+
+bool UploadRing::TryAllocate(UINT64 byteSize, UINT64 alignment, Allocation& allocation)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if(!TryAllocateLocked(byteSize, alignment, allocation))
+	{
+		ReclaimLocked();
+		if(!TryAllocateLocked(byteSize, alignment, allocation))
+		{
+			mStats.FailedAllocationCount++;
+			return false;
+		}
+	}
+
+	mStats.AllocationCount++;
+	return true;
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 byteSize, UINT64 alignment)
+{
+	Allocation allocation;
+	if(!TryAllocate(byteSize, alignment, allocation))
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	return allocation;
+}
+
+void UploadRing::Free(const Allocation& allocation, ID3D12Fence* fence, UINT64 fenceValue)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	assert(allocation.Id >= mFrontId && allocation.Id - mFrontId < mBlocks.size());
+
+	Block& block = mBlocks[(size_t)(allocation.Id - mFrontId)];
+	block.Freed = true;
+	block.Fence = fence;
+	block.FenceValue = fenceValue;
+}
+
+UploadRing::Allocation UploadRing::AllocatePersistent(UINT64 byteSize, UINT64 alignment)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	ReclaimLocked();
+
+	if(byteSize > mRingEnd)
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	UINT64 offset = (mRingEnd - byteSize) & ~(alignment - 1);
+
+	// The ring's live blocks must all lie below the new end.  Once the ring has
+	// wrapped they extend up to the old end.
+	if(!mBlocks.empty() && (mTail < mBlocks.front().Offset || mTail > offset))
+		ThrowIfFailed(E_OUTOFMEMORY);
+
+	mStats.PersistentBytes += mRingEnd - offset;
+	mRingEnd = offset;
+
+	return MakeAllocation(offset, byteSize, 0);
+}
+
+void UploadRing::Reclaim()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	ReclaimLocked();
+}
+
+UploadRing::Statistics UploadRing::GetStatistics()const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+bool UploadRing::TryAllocateLocked(UINT64 byteSize, UINT64 alignment, Allocation& allocation)
+{
+	if(mBlocks.empty())
+		mTail = 0;
+
+	UINT64 offset = (mTail + alignment - 1) & ~(alignment - 1);
+
+	if(mBlocks.empty() || mTail > mBlocks.front().Offset)
+	{
+		// Free space is [mTail, mRingEnd) and, after wrapping, [0, head).
+		if(offset + byteSize > mRingEnd)
+		{
+			UINT64 head = mBlocks.empty() ? mRingEnd : mBlocks.front().Offset;
+			if(byteSize > head)
+				return false;
+
+			// Pad out the end of the ring so blocks stay contiguous.
+			if(mTail < mRingEnd && !mBlocks.empty())
+				PushBlock(mTail, mRingEnd - mTail, true);
+
+			mTail = 0;
+			offset = 0;
+		}
+	}
+	else
+	{
+		// The ring has wrapped; free space is [mTail, head).
+		if(offset + byteSize > mBlocks.front().Offset)
+			return false;
+	}
+
+	PushBlock(mTail, offset + byteSize - mTail, false);
+	mTail = offset + byteSize;
+
+	allocation = MakeAllocation(offset, byteSize, mFrontId + mBlocks.size() - 1);
+	return true;
+}
+
+void UploadRing::ReclaimLocked()
+{
+	while(!mBlocks.empty())
+	{
+		Block& block = mBlocks.front();
+		if(!block.Freed || (block.Fence != nullptr && block.Fence->GetCompletedValue() < block.FenceValue))
+			break;
+
+		mStats.UsedBytes -= block.Size;
+		mBlocks.pop_front();
+		mFrontId++;
+	}
+}
+
+void UploadRing::PushBlock(UINT64 offset, UINT64 size, bool freed)
+{
+	Block block;
+	block.Offset = offset;
+	block.Size = size;
+	block.Freed = freed;
+	mBlocks.push_back(block);
+
+	mStats.UsedBytes += size;
+	mStats.HighWaterBytes = std::max(mStats.HighWaterBytes, mStats.UsedBytes);
+}
+
+UploadRing::Allocation UploadRing::MakeAllocation(UINT64 offset, UINT64 byteSize, UINT64 id)const
+{
+	Allocation allocation;
+	allocation.Resource = mUploadHeap.Get();
+	allocation.Offset = offset;
+	allocation.CpuAddress = mMappedData + offset;
+	allocation.GpuAddress = mGpuAddress + offset;
+	allocation.Size = byteSize;
+	allocation.Id = id;
+	return allocation;
+}
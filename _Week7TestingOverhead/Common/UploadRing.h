@@ -0,0 +1,112 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// One persistently mapped upload heap shared by everything that writes data for the
+// GPU.  Transient suballocations (geometry, texture and other one-off uploads) are
+// handed out from a ring and reclaimed in allocation order once the fence each one
+// was freed with has completed.  Long-lived suballocations, such as the per-frame
+// constant buffers, are taken from the top of the heap and shrink the ring.
+//
+// All methods are thread safe, so worker threads can fill upload memory directly.
+//***************************************************************************************
+
+#ifndef UPLOADRING_H
+#define UPLOADRING_H
+
+#include "d3dUtil.h"
+#include <deque>
+#include <mutex>
+
+class UploadRing
+{
+public:
+	struct Allocation
+	{
+		ID3D12Resource* Resource = nullptr;
+
+		// Offset of the allocation in Resource, and its CPU and GPU addresses.
+		UINT64 Offset = 0;
+		BYTE* CpuAddress = nullptr;
+		D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+		UINT64 Size = 0;
+
+		// Identifies a transient allocation to Free.  Zero for persistent ones.
+		UINT64 Id = 0;
+	};
+
+	struct Statistics
+	{
+		UINT64 CapacityBytes = 0;
+		UINT64 PersistentBytes = 0;
+
+		// Bytes of the ring held by allocations that are not reclaimed yet, and the
+		// largest that has been since the ring was created.
+		UINT64 UsedBytes = 0;
+		UINT64 HighWaterBytes = 0;
+
+		UINT64 AllocationCount = 0;
+		UINT64 FailedAllocationCount = 0;
+	};
+
+	UploadRing(ID3D12Device* device, UINT64 capacityBytes);
+	UploadRing(const UploadRing& rhs) = delete;
+	UploadRing& operator=(const UploadRing& rhs) = delete;
+	~UploadRing();
+
+	// Suballocates byteSize bytes at the given alignment from the ring.  Returns false
+	// if the ring is full even after reclaiming completed allocations.
+	bool TryAllocate(UINT64 byteSize, UINT64 alignment, Allocation& allocation);
+
+	// As TryAllocate, but throws if the ring is full.
+	Allocation Allocate(UINT64 byteSize, UINT64 alignment);
+
+	// Releases a transient allocation once fence reaches fenceValue, that is once
+	// the GPU work reading it is done.  A null fence releases it right away.
+	void Free(const Allocation& allocation, ID3D12Fence* fence, UINT64 fenceValue);
+
+	// Suballocates from the top of the heap for the lifetime of the ring.  Throws if
+	// that memory is in use by the ring.
+	Allocation AllocatePersistent(UINT64 byteSize, UINT64 alignment);
+
+	// Releases the allocations at the front of the ring whose fences have completed.
+	void Reclaim();
+
+	Statistics GetStatistics()const;
+
+private:
+	struct Block
+	{
+		UINT64 Offset = 0;
+		UINT64 Size = 0;
+
+		bool Freed = false;
+		ID3D12Fence* Fence = nullptr;
+		UINT64 FenceValue = 0;
+	};
+
+	bool TryAllocateLocked(UINT64 byteSize, UINT64 alignment, Allocation& allocation);
+	void ReclaimLocked();
+	void PushBlock(UINT64 offset, UINT64 size, bool freed);
+	Allocation MakeAllocation(UINT64 offset, UINT64 byteSize, UINT64 id)const;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Resource> mUploadHeap;
+	BYTE* mMappedData = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS mGpuAddress = 0;
+
+	mutable std::mutex mMutex;
+
+	UINT64 mCapacity = 0;
+
+	// The ring covers [0, mRingEnd); persistent allocations sit above it.
+	UINT64 mRingEnd = 0;
+
+	// Live blocks in allocation order.  The id of mBlocks[i] is mFrontId + i.
+	std::deque<Block> mBlocks;
+	UINT64 mFrontId = 1;
+	UINT64 mTail = 0;
+
+	Statistics mStats;
+};
+
+#endif // UPLOADRING_H
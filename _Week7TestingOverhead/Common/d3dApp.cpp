@@ -35,6 +35,11 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitable != nullptr)
+		CloseHandle(mFrameLatencyWaitable);
+	if(mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -69,6 +74,34 @@ void D3DApp::Set4xMsaaState(bool value)
     }
 }
 
+bool D3DApp::GetVsyncState()const
+{
+	return mVsyncState;
+}
+
+void D3DApp::SetVsyncState(bool value)
+{
+	mVsyncState = value;
+}
+
+UINT D3DApp::GetMaxFrameLatency()const
+{
+	return mMaxFrameLatency;
+}
+
+void D3DApp::SetMaxFrameLatency(UINT latency)
+{
+	// DXGI accepts 1 to 16 queued frames.
+	mMaxFrameLatency = (std::max)(1u, (std::min)(latency, 16u));
+
+	if(mSwapChain != nullptr)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+	}
+}
+
 int D3DApp::Run()
 {
 	MSG msg = {0};
@@ -90,6 +123,9 @@ int D3DApp::Run()
 
 			if( !mAppPaused )
 			{
+				// Wait for the display before sampling input, rather than after.
+				WaitForFrameLatency();
+
 				CalculateFrameStats();
 				Update(mTimer);	
                 Draw(mTimer);
@@ -159,7 +195,7 @@ void D3DApp::OnResize()
 		SwapChainBufferCount, 
 		mClientWidth, mClientHeight, 
 		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		mSwapChainFlags));
 
 	mCurrBackBuffer = 0;
  
@@ -457,6 +493,23 @@ bool D3DApp::InitDirect3D()
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
 
+	mFenceEvent = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+	if(mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	// Tearing lets presents with vsync off reach variable refresh rate displays
+	// without waiting for the next refresh.
+	ComPtr<IDXGIFactory5> factory5;
+	if(SUCCEEDED(mdxgiFactory.As(&factory5)))
+	{
+		BOOL allowTearing = FALSE;
+		if(SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+			&allowTearing, sizeof(allowTearing))))
+		{
+			mTearingSupported = allowTearing == TRUE;
+		}
+	}
+
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
 	mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -535,13 +588,31 @@ void D3DApp::CreateSwapChain()
     sd.OutputWindow = mhMainWnd;
     sd.Windowed = true;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+
+	// The flags must be passed the same way to every ResizeBuffers.
+	mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH | DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+	if(mTearingSupported)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
     ThrowIfFailed(mdxgiFactory->CreateSwapChain(
 		mCommandQueue.Get(),
 		&sd, 
 		mSwapChain.GetAddressOf()));
+
+	// Tearing presents are not allowed in exclusive fullscreen, so keep the window
+	// in borderless mode.
+	if(mTearingSupported)
+		ThrowIfFailed(mdxgiFactory->MakeWindowAssociation(mhMainWnd, DXGI_MWA_NO_ALT_ENTER));
+
+	if(mFrameLatencyWaitable != nullptr)
+		CloseHandle(mFrameLatencyWaitable);
+
+	ComPtr<IDXGISwapChain2> swapChain2;
+	ThrowIfFailed(mSwapChain.As(&swapChain2));
+	ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+	mFrameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
 }
 
 void D3DApp::FlushCommandQueue()
@@ -555,17 +626,34 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	// Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
+	WaitForFence(mCurrentFence);
+}
+
+void D3DApp::WaitForFence(UINT64 fenceValue)
+{
+    if(mFence->GetCompletedValue() < fenceValue)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+        // Fire event when GPU hits the fence value.  
+        ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, mFenceEvent));
+		WaitForSingleObject(mFenceEvent, INFINITE);
+	}
+}
 
-        // Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+void D3DApp::WaitForFrameLatency()
+{
+	// The timeout keeps a lost present (e.g. the window was occluded) from hanging
+	// the message loop.
+	if(mFrameLatencyWaitable != nullptr)
+		WaitForSingleObjectEx(mFrameLatencyWaitable, 1000, TRUE);
+}
 
-        // Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-	}
+void D3DApp::PresentFrame()
+{
+	UINT syncInterval = mVsyncState ? 1 : 0;
+	UINT presentFlags = !mVsyncState && mTearingSupported ? DXGI_PRESENT_ALLOW_TEARING : 0;
+
+	ThrowIfFailed(mSwapChain->Present(syncInterval, presentFlags));
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 }
 
 
@@ -35,6 +35,16 @@ public:
     bool Get4xMsaaState()const;
     void Set4xMsaaState(bool value);
 
+	// With vsync off, frames are presented immediately, tearing if the display allows it.
+	bool GetVsyncState()const;
+	void SetVsyncState(bool value);
+
+	// Number of frames the CPU may queue ahead of the display.  Run waits on the swap
+	// chain before each Update, so input is sampled at most this many frames before the
+	// frame is shown.
+	UINT GetMaxFrameLatency()const;
+	void SetMaxFrameLatency(UINT latency);
+
 	int Run();
  
     virtual bool Initialize();
@@ -60,6 +70,15 @@ protected:
 
 	void FlushCommandQueue();
 
+	// Blocks until mFence reaches fenceValue.
+	void WaitForFence(UINT64 fenceValue);
+
+	// Blocks until the swap chain is ready to accept another frame.
+	void WaitForFrameLatency();
+
+	// Presents the current back buffer with the vsync setting and moves on to the next one.
+	void PresentFrame();
+
 	ID3D12Resource* CurrentBackBuffer()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE CurrentBackBufferView()const;
 	D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView()const;
@@ -95,6 +114,17 @@ protected:
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+
+	// Reused by every wait on mFence.
+	HANDLE mFenceEvent = nullptr;
+
+	// Signaled by the swap chain when it can queue another frame.
+	HANDLE mFrameLatencyWaitable = nullptr;
+	UINT mMaxFrameLatency = 2;
+
+	bool mVsyncState = false;
+	bool mTearingSupported = false;
+	UINT mSwapChainFlags = 0;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
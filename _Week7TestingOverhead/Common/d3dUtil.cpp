@@ -1,5 +1,6 @@
 
 #include "d3dUtil.h"
+#include "UploadRing.h"
 #include <comdef.h>
 #include <fstream>
 
@@ -35,6 +36,20 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
     return blob;
 }
 
+void d3dUtil::SaveBinary(const std::wstring& filename, ID3DBlob* blob)
+{
+    const std::wstring tempFilename = filename + L".tmp";
+    {
+        std::ofstream fout(tempFilename, std::ios::binary);
+        fout.write((const char*)blob->GetBufferPointer(), blob->GetBufferSize());
+        if(!fout)
+            ThrowIfFailed(E_FAIL);
+    }
+
+    if(!MoveFileExW(tempFilename.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+        ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     ID3D12Device* device,
     ID3D12GraphicsCommandList* cmdList,
@@ -87,6 +102,41 @@ Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
     return defaultBuffer;
 }
 
+Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
+    ID3D12Device* device,
+    ID3D12GraphicsCommandList* cmdList,
+    const void* initData,
+    UINT64 byteSize,
+    UploadRing& uploadRing,
+    ID3D12Fence* fence,
+    UINT64 fenceValue)
+{
+    ComPtr<ID3D12Resource> defaultBuffer;
+
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+
+    // Stage the data in the shared upload ring rather than a heap of its own.
+    UploadRing::Allocation upload = uploadRing.Allocate(byteSize, 16);
+    memcpy(upload.CpuAddress, initData, (size_t)byteSize);
+
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+    cmdList->CopyBufferRegion(defaultBuffer.Get(), 0, upload.Resource, upload.Offset, byteSize);
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+    // The ring reuses the memory once the copy has executed.
+    uploadRing.Free(upload, fence, fenceValue);
+
+    return defaultBuffer;
+}
+
 ComPtr<ID3DBlob> d3dUtil::CompileShader(
 	const std::wstring& filename,
 	const D3D_SHADER_MACRO* defines,
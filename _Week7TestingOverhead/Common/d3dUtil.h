@@ -4,7 +4,7 @@
 
 #include <windows.h>
 #include <wrl.h>
-#include <dxgi1_4.h>
+#include <dxgi1_5.h>
 #include <d3d12.h>
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
@@ -25,7 +25,9 @@
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
 
-extern const int gNumFrameResources;
+extern int gNumFrameResources;
+
+class UploadRing;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -110,6 +112,22 @@ public:
 
 	static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
+	// Writes to a temporary file renamed over filename once complete, so a partly
+	// written file is never read back.
+	static void SaveBinary(const std::wstring& filename, ID3DBlob* blob);
+
+	// 64-bit FNV-1a.  Pass a previous result as hash to continue it over more bytes.
+	static UINT64 HashBytes(const void* data, size_t byteSize, UINT64 hash = 14695981039346656037ull)
+	{
+		const BYTE* bytes = reinterpret_cast<const BYTE*>(data);
+		for(size_t i = 0; i < byteSize; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
 	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
 		ID3D12Device* device,
 		ID3D12GraphicsCommandList* cmdList,
@@ -117,6 +135,17 @@ public:
 		UINT64 byteSize,
 		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer);
 
+	// Stages initData in uploadRing instead of a new upload heap.  fenceValue is the
+	// value fence reaches once cmdList has executed.
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+		ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList,
+		const void* initData,
+		UINT64 byteSize,
+		UploadRing& uploadRing,
+		ID3D12Fence* fence,
+		UINT64 fenceValue);
+
 	static Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
 		const std::wstring& filename,
 		const D3D_SHADER_MACRO* defines,
@@ -260,6 +289,13 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Most detailed mip of the diffuse map that is resident.
+	float MinLod = 0.0f;
+
+	// Index of the diffuse map in the shader visible SRV heap.
+	UINT DiffuseMapIndex = 0;
+	DirectX::XMFLOAT2 MatPad0;
 };
 
 // Simple struct to represent a material for our demos.  A production 3D engine
@@ -289,6 +325,11 @@ struct Material
 	DirectX::XMFLOAT3 FresnelR0 = { 0.01f, 0.01f, 0.01f };
 	float Roughness = .25f;
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+	float MinLod = 0.0f;
+
+	// SRV heap slot the shaders sample for the diffuse texture: a placeholder until
+	// the texture at DiffuseSrvHeapIndex is resident.
+	UINT DiffuseMapIndex = 0;
 };
 
 struct Texture
@@ -300,6 +341,12 @@ struct Texture
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+
+	// Streaming state: only mips [ResidentMip, MipLevels) are resident, using
+	// ResidentBytes of GPU memory.
+	UINT MipLevels = 0;
+	UINT ResidentMip = 0;
+	UINT64 ResidentBytes = 0;
 };
 
 #ifndef ThrowIfFailed
@@ -0,0 +1,134 @@
+//***************************************************************************************
+// BindlessHeap.cpp
+//***************************************************************************************
+
+#include "BindlessHeap.h"
+
+using Microsoft::WRL::ComPtr;
+
+BindlessHeap::BindlessHeap(ID3D12Device* device, UINT capacity)
+	: md3dDevice(device),
+	mCapacity(capacity)
+{
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = capacity;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+	mDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	Range all;
+	all.First = 0;
+	all.Count = capacity;
+	mFreeRanges.push_back(all);
+
+	WriteNullDescriptors(0, capacity);
+}
+
+UINT BindlessHeap::Allocate(UINT count)
+{
+	assert(count > 0);
+
+	// First fit.  The heap only holds a few long lived allocations, so the free list
+	// stays short.
+	for(size_t i = 0; i < mFreeRanges.size(); ++i)
+	{
+		Range& range = mFreeRanges[i];
+		if(range.Count < count)
+			continue;
+
+		const UINT index = range.First;
+		range.First += count;
+		range.Count -= count;
+		if(range.Count == 0)
+			mFreeRanges.erase(mFreeRanges.begin() + i);
+
+		mAllocatedCount += count;
+		return index;
+	}
+
+	ThrowIfFailed(E_OUTOFMEMORY);
+	return 0;
+}
+
+void BindlessHeap::Free(UINT index, UINT count)
+{
+	assert(count > 0 && index + count <= mCapacity);
+
+	WriteNullDescriptors(index, count);
+
+	// Insert in order, then merge with the neighbours it touches.
+	auto next = std::find_if(mFreeRanges.begin(), mFreeRanges.end(),
+		[index](const Range& range) { return range.First > index; });
+	assert(next == mFreeRanges.end() || index + count <= next->First);
+
+	Range freed;
+	freed.First = index;
+	freed.Count = count;
+	auto it = mFreeRanges.insert(next, freed);
+
+	auto following = it + 1;
+	if(following != mFreeRanges.end() && it->First + it->Count == following->First)
+	{
+		it->Count += following->Count;
+		it = mFreeRanges.erase(following) - 1;
+	}
+
+	if(it != mFreeRanges.begin())
+	{
+		auto previous = it - 1;
+		assert(previous->First + previous->Count <= it->First);
+		if(previous->First + previous->Count == it->First)
+		{
+			previous->Count += it->Count;
+			mFreeRanges.erase(it);
+		}
+	}
+
+	mAllocatedCount -= count;
+}
+
+ID3D12DescriptorHeap* BindlessHeap::GetHeap()const
+{
+	return mHeap.Get();
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE BindlessHeap::CpuHandle(UINT index)const
+{
+	assert(index < mCapacity);
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(mHeap->GetCPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE BindlessHeap::GpuHandle(UINT index)const
+{
+	assert(index < mCapacity);
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mHeap->GetGPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+UINT BindlessHeap::Capacity()const
+{
+	return mCapacity;
+}
+
+UINT BindlessHeap::AllocatedCount()const
+{
+	return mAllocatedCount;
+}
+
+UINT BindlessHeap::DescriptorSize()const
+{
+	return mDescriptorSize;
+}
+
+void BindlessHeap::WriteNullDescriptors(UINT index, UINT count)
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	for(UINT i = index; i < index + count; ++i)
+		md3dDevice->CreateShaderResourceView(nullptr, &srvDesc, CpuHandle(i));
+}
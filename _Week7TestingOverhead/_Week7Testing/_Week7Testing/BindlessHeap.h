@@ -0,0 +1,64 @@
+//***************************************************************************************
+// BindlessHeap.h
+//
+// The shader visible CBV/SRV/UAV heap.  Descriptors are handed out in contiguous
+// ranges from a free list, so the texture streamer, the wave simulation and the Hi-Z
+// pyramid each take the slots they need instead of agreeing on fixed offsets.  The
+// shaders read the textures through one table over the whole heap and index it with
+// the heap index the material supplies, so draws do not bind a table each.
+//
+// Systems keep GPU handles into the heap, so it cannot be recreated larger: its
+// capacity is reserved up front and only the allocations grow into it.  Free slots
+// hold null SRVs, so every descriptor a table covers is always valid.
+//***************************************************************************************
+
+#ifndef BINDLESSHEAP_H
+#define BINDLESSHEAP_H
+
+#include "../../Common/d3dUtil.h"
+
+class BindlessHeap
+{
+public:
+	BindlessHeap(ID3D12Device* device, UINT capacity);
+	BindlessHeap(const BindlessHeap& rhs) = delete;
+	BindlessHeap& operator=(const BindlessHeap& rhs) = delete;
+	~BindlessHeap() = default;
+
+	// Returns the heap index of count free contiguous descriptors.  Throws
+	// E_OUTOFMEMORY when no free range is large enough.
+	UINT Allocate(UINT count);
+
+	// Returns a range from Allocate to the free list.  The GPU must be done with its
+	// descriptors.
+	void Free(UINT index, UINT count);
+
+	ID3D12DescriptorHeap* GetHeap()const;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE CpuHandle(UINT index)const;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE GpuHandle(UINT index)const;
+
+	UINT Capacity()const;
+	UINT AllocatedCount()const;
+	UINT DescriptorSize()const;
+
+private:
+	void WriteNullDescriptors(UINT index, UINT count);
+
+private:
+	// Free ranges in ascending order, never adjacent to each other.
+	struct Range
+	{
+		UINT First = 0;
+		UINT Count = 0;
+	};
+
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mHeap;
+	UINT mCapacity = 0;
+	UINT mAllocatedCount = 0;
+	UINT mDescriptorSize = 0;
+
+	std::vector<Range> mFreeRanges;
+};
+
+#endif // BINDLESSHEAP_H
@@ -0,0 +1,57 @@
+//***************************************************************************************
+// CameraPath.cpp
+//***************************************************************************************
+
+#include "CameraPath.h"
+
+using namespace DirectX;
+
+void CameraPath::AddKey(float time, const XMFLOAT3& position, const XMFLOAT3& target)
+{
+	assert(mKeys.empty() || time > mKeys.back().Time);
+
+	Key key;
+	key.Time = time;
+	key.Position = position;
+	key.Target = target;
+	mKeys.push_back(key);
+}
+
+float CameraPath::Duration()const
+{
+	return mKeys.empty() ? 0.0f : mKeys.back().Time;
+}
+
+void CameraPath::Apply(float time, Camera& camera)const
+{
+	assert(!mKeys.empty());
+
+	time = MathHelper::Clamp(time, mKeys.front().Time, mKeys.back().Time);
+
+	// The segment [i, i + 1] holding time.
+	size_t i = 0;
+	while(i + 2 < mKeys.size() && mKeys[i + 1].Time <= time)
+		++i;
+
+	XMVECTOR position = XMLoadFloat3(&mKeys[i].Position);
+	XMVECTOR target = XMLoadFloat3(&mKeys[i].Target);
+	if(i + 1 < mKeys.size())
+	{
+		const Key& k1 = mKeys[i];
+		const Key& k2 = mKeys[i + 1];
+
+		// The end keys stand in for the missing neighbours at either end of the path.
+		const Key& k0 = mKeys[i > 0 ? i - 1 : i];
+		const Key& k3 = mKeys[i + 2 < mKeys.size() ? i + 2 : i + 1];
+
+		float s = (time - k1.Time) / (k2.Time - k1.Time);
+
+		position = XMVectorCatmullRom(XMLoadFloat3(&k0.Position), XMLoadFloat3(&k1.Position),
+			XMLoadFloat3(&k2.Position), XMLoadFloat3(&k3.Position), s);
+		target = XMVectorCatmullRom(XMLoadFloat3(&k0.Target), XMLoadFloat3(&k1.Target),
+			XMLoadFloat3(&k2.Target), XMLoadFloat3(&k3.Target), s);
+	}
+
+	camera.LookAt(position, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+	camera.UpdateViewMatrix();
+}
@@ -0,0 +1,38 @@
+//***************************************************************************************
+// CameraPath.h
+//
+// A scripted camera flight through timed keys.  Both the eye position and the point
+// looked at follow Catmull-Rom splines through the keys, so the camera moves and
+// turns smoothly and the same time always gives the same view.
+//***************************************************************************************
+
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include "../../Common/Camera.h"
+
+class CameraPath
+{
+public:
+	struct Key
+	{
+		// Seconds from the start of the path; keys must be added in increasing time.
+		float Time = 0.0f;
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 Target = { 0.0f, 0.0f, 1.0f };
+	};
+
+	void AddKey(float time, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& target);
+
+	// Time of the last key.
+	float Duration()const;
+
+	// Points camera along the path at time, clamped to the first and last keys, and
+	// updates its view matrix.
+	void Apply(float time, Camera& camera)const;
+
+private:
+	std::vector<Key> mKeys;
+};
+
+#endif // CAMERAPATH_H
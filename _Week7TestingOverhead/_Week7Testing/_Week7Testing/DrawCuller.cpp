@@ -0,0 +1,300 @@
+//***************************************************************************************
+// DrawCuller.cpp
+//***************************************************************************************
+
+#include "DrawCuller.h"
+
+using namespace DirectX;
+
+// Indirect arguments are read back to back, so the struct must not be padded.
+static_assert(sizeof(D3D12_VERTEX_BUFFER_VIEW) + sizeof(D3D12_INDEX_BUFFER_VIEW) + sizeof(D3D12_GPU_VIRTUAL_ADDRESS) +
+	sizeof(UINT) + sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) == 64, "IndirectCommand must be tightly packed.");
+
+// Must match the DRAW_ITEM_* and CULL_* defines in DrawCulling.hlsl.
+static const UINT gDrawItemInstanced = 0x1;
+static const UINT gDrawItemOccluder = 0x2;
+
+static const UINT gCullFrustum = 0x1;
+static const UINT gCullOcclusion = 0x2;
+static const UINT gCullOccludersOnly = 0x4;
+
+DrawCuller::DrawCuller(ID3D12Device* device, ID3D12RootSignature* drawRootSig,
+	UINT objectIndexRootParameter, UINT instanceDataRootParameter)
+	: md3dDevice(device)
+{
+	BuildCommandSignature(drawRootSig, objectIndexRootParameter, instanceDataRootParameter);
+}
+
+UINT DrawCuller::AddBatch()
+{
+	assert(mDrawItems == nullptr);
+
+	mBatchItems.emplace_back();
+	return (UINT)mBatchItems.size() - 1;
+}
+
+void DrawCuller::AddItem(UINT batch, const DrawItem& item)
+{
+	assert(mDrawItems == nullptr);
+
+	BatchItem batchItem;
+	batchItem.Item = item;
+	mBatchItems[batch].push_back(batchItem);
+}
+
+void DrawCuller::AddInstancedItem(UINT batch, const DrawItem& item, const std::vector<InstanceData>& instances)
+{
+	assert(mDrawItems == nullptr);
+
+	for(auto& instance : instances)
+	{
+		// Stored as the vertex shader reads it.
+		InstanceData instData;
+		XMStoreFloat4x4(&instData.World, XMMatrixTranspose(XMLoadFloat4x4(&instance.World)));
+		XMStoreFloat4x4(&instData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&instance.TexTransform)));
+
+		BatchItem batchItem;
+		batchItem.Item = item;
+		batchItem.InstanceIndex = (INT)mInstances.size();
+		mBatchItems[batch].push_back(batchItem);
+
+		mInstances.push_back(instData);
+	}
+}
+
+void DrawCuller::Build(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue)
+{
+	// The commands hold the address of their instance, so the instances go first.
+	D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = 0;
+	if(!mInstances.empty())
+	{
+		mInstanceData = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+			mInstances.data(), mInstances.size() * sizeof(InstanceData), uploadRing, fence, fenceValue);
+		instanceAddress = mInstanceData->GetGPUVirtualAddress();
+	}
+
+	// Each batch owns a range of the command buffers large enough for all of its items.
+	std::vector<GpuDrawItem> gpuItems;
+	mBatchOffsets.clear();
+	for(UINT batch = 0; batch < (UINT)mBatchItems.size(); ++batch)
+	{
+		const UINT offset = (UINT)gpuItems.size();
+		mBatchOffsets.push_back(offset);
+
+		for(auto& batchItem : mBatchItems[batch])
+		{
+			const DrawItem& item = batchItem.Item;
+			const bool instanced = batchItem.InstanceIndex >= 0;
+
+			GpuDrawItem gpuItem;
+			gpuItem.Command.VertexBufferView = item.VertexBufferView;
+			gpuItem.Command.IndexBufferView = item.IndexBufferView;
+			gpuItem.Command.InstanceData = instanced ? instanceAddress + batchItem.InstanceIndex * sizeof(InstanceData) : instanceAddress;
+			gpuItem.Command.ObjectIndex = item.ObjectIndex;
+			gpuItem.Command.DrawArguments.IndexCountPerInstance = item.IndexCount;
+			gpuItem.Command.DrawArguments.InstanceCount = 1;
+			gpuItem.Command.DrawArguments.StartIndexLocation = item.StartIndexLocation;
+			gpuItem.Command.DrawArguments.BaseVertexLocation = item.BaseVertexLocation;
+			gpuItem.Command.DrawArguments.StartInstanceLocation = 0;
+			gpuItem.BoundsCenter = item.Bounds.Center;
+			gpuItem.Batch = batch;
+			gpuItem.BoundsExtents = item.Bounds.Extents;
+			gpuItem.CommandOffset = offset;
+			gpuItem.InstanceIndex = instanced ? (UINT)batchItem.InstanceIndex : 0;
+			gpuItem.Flags = (instanced ? gDrawItemInstanced : 0) | (item.Occluder ? gDrawItemOccluder : 0);
+			gpuItems.push_back(gpuItem);
+		}
+	}
+	mBatchOffsets.push_back((UINT)gpuItems.size());
+
+	mItemCount = (UINT)gpuItems.size();
+	if(mItemCount == 0)
+		return;
+
+	mDrawItems = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		gpuItems.data(), gpuItems.size() * sizeof(GpuDrawItem), uploadRing, fence, fenceValue);
+
+	std::vector<UINT> zeros(mBatchItems.size(), 0);
+	mCommandCountsReset = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		zeros.data(), zeros.size() * sizeof(UINT), uploadRing, fence, fenceValue);
+
+	// The commands are rebuilt from scratch every frame before they are read, so
+	// one copy is shared by all frame resources.
+	Microsoft::WRL::ComPtr<ID3D12Resource>* buffers[] = { &mCommands, &mOccluderCommands, &mCommandCounts, &mOccluderCommandCounts };
+	const UINT64 byteSizes[] =
+	{
+		mItemCount * sizeof(IndirectCommand),
+		mItemCount * sizeof(IndirectCommand),
+		zeros.size() * sizeof(UINT),
+		zeros.size() * sizeof(UINT)
+	};
+
+	for(int i = 0; i < _countof(buffers); ++i)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(byteSizes[i], D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+			D3D12_RESOURCE_STATE_COMMON,
+			nullptr,
+			IID_PPV_ARGS(buffers[i]->GetAddressOf())));
+	}
+}
+
+UINT DrawCuller::BatchCount()const
+{
+	return (UINT)mBatchItems.size();
+}
+
+UINT DrawCuller::ItemCount()const
+{
+	return mItemCount;
+}
+
+void DrawCuller::Execute(ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	D3D12_GPU_VIRTUAL_ADDRESS passCB,
+	D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+	const BoundingFrustum& worldFrustum,
+	bool cullingEnabled,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ,
+	bool occlusionEnabled)
+{
+	UINT cullFlags = (cullingEnabled ? gCullFrustum : 0) | (occlusionEnabled ? gCullOcclusion : 0);
+
+	Dispatch(cmdList, rootSig, pso, passCB, objectBuffer, worldFrustum, cullFlags, 0.0f, hiZ,
+		mCommands.Get(), mCommandCounts.Get());
+}
+
+void DrawCuller::CullOccluders(ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	D3D12_GPU_VIRTUAL_ADDRESS passCB,
+	D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+	const BoundingFrustum& worldFrustum,
+	float occluderDistance,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ)
+{
+	Dispatch(cmdList, rootSig, pso, passCB, objectBuffer, worldFrustum, gCullFrustum | gCullOccludersOnly,
+		occluderDistance, hiZ, mOccluderCommands.Get(), mOccluderCommandCounts.Get());
+}
+
+void DrawCuller::DrawBatch(ID3D12GraphicsCommandList* cmdList, UINT batch)const
+{
+	DrawCommands(cmdList, batch, mCommands.Get(), mCommandCounts.Get());
+}
+
+void DrawCuller::DrawOccluderBatch(ID3D12GraphicsCommandList* cmdList, UINT batch)const
+{
+	DrawCommands(cmdList, batch, mOccluderCommands.Get(), mOccluderCommandCounts.Get());
+}
+
+void DrawCuller::Dispatch(ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	D3D12_GPU_VIRTUAL_ADDRESS passCB,
+	D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+	const BoundingFrustum& worldFrustum,
+	UINT cullFlags,
+	float occluderDistance,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ,
+	ID3D12Resource* commands,
+	ID3D12Resource* commandCounts)
+{
+	if(mItemCount == 0)
+		return;
+
+	// Same layout as cbCull in DrawCulling.hlsl.
+	struct
+	{
+		XMFLOAT4 Planes[6];
+		UINT ItemCount;
+		UINT CullFlags;
+		float OccluderDistance;
+		UINT Pad0;
+	} cullConstants;
+
+	XMVECTOR planes[6];
+	worldFrustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	for(int i = 0; i < 6; ++i)
+		XMStoreFloat4(&cullConstants.Planes[i], planes[i]);
+	cullConstants.ItemCount = mItemCount;
+	cullConstants.CullFlags = cullFlags;
+	cullConstants.OccluderDistance = occluderDistance;
+	cullConstants.Pad0 = 0;
+
+	// Buffers decay back to the common state after every ExecuteCommandLists, so the
+	// counts are implicitly promoted to COPY_DEST by the reset copy and the commands to
+	// UNORDERED_ACCESS by the dispatch.
+	cmdList->CopyBufferRegion(commandCounts, 0, mCommandCountsReset.Get(), 0, mBatchItems.size() * sizeof(UINT));
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(commandCounts,
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetPipelineState(pso);
+
+	cmdList->SetComputeRoot32BitConstants(0, sizeof(cullConstants) / sizeof(UINT), &cullConstants, 0);
+	cmdList->SetComputeRootConstantBufferView(1, passCB);
+	cmdList->SetComputeRootShaderResourceView(2, mDrawItems->GetGPUVirtualAddress());
+	cmdList->SetComputeRootShaderResourceView(3, objectBuffer);
+	cmdList->SetComputeRootShaderResourceView(4, mInstanceData != nullptr ? mInstanceData->GetGPUVirtualAddress() : mDrawItems->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(5, commands->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(6, commandCounts->GetGPUVirtualAddress());
+	cmdList->SetComputeRootDescriptorTable(7, hiZ);
+
+	// One thread per item; must match the numthreads of DrawCulling.hlsl.
+	UINT numGroups = (mItemCount + 63) / 64;
+	cmdList->Dispatch(numGroups, 1, 1);
+
+	D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(commands,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT),
+		CD3DX12_RESOURCE_BARRIER::Transition(commandCounts,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+void DrawCuller::DrawCommands(ID3D12GraphicsCommandList* cmdList, UINT batch,
+	ID3D12Resource* commands, ID3D12Resource* commandCounts)const
+{
+	const UINT maxCommandCount = mBatchOffsets[batch + 1] - mBatchOffsets[batch];
+	if(maxCommandCount == 0)
+		return;
+
+	// The GPU draws as many commands as the culling pass wrote to the batch's count.
+	cmdList->ExecuteIndirect(
+		mCommandSignature.Get(),
+		maxCommandCount,
+		commands,
+		(UINT64)mBatchOffsets[batch] * sizeof(IndirectCommand),
+		commandCounts,
+		(UINT64)batch * sizeof(UINT));
+}
+
+void DrawCuller::BuildCommandSignature(ID3D12RootSignature* drawRootSig,
+	UINT objectIndexRootParameter, UINT instanceDataRootParameter)
+{
+	// In the order of the IndirectCommand members.
+	D3D12_INDIRECT_ARGUMENT_DESC arguments[5] = {};
+	arguments[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	arguments[0].VertexBuffer.Slot = 0;
+	arguments[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	arguments[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+	arguments[2].ShaderResourceView.RootParameterIndex = instanceDataRootParameter;
+	arguments[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	arguments[3].Constant.RootParameterIndex = objectIndexRootParameter;
+	arguments[3].Constant.DestOffsetIn32BitValues = 0;
+	arguments[3].Constant.Num32BitValuesToSet = 1;
+	arguments[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+
+	D3D12_COMMAND_SIGNATURE_DESC desc = {};
+	desc.ByteStride = sizeof(IndirectCommand);
+	desc.NumArgumentDescs = _countof(arguments);
+	desc.pArgumentDescs = arguments;
+
+	// The signature changes root arguments, so it is tied to the draw root signature.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&desc, drawRootSig, IID_PPV_ARGS(&mCommandSignature)));
+}
@@ -0,0 +1,180 @@
+//***************************************************************************************
+// DrawCuller.h
+//
+// GPU-driven drawing of static render items.  The draw arguments of every item are
+// uploaded once.  Each frame a compute shader frustum tests the items against their
+// current world transforms and compacts the ones that pass into an indirect argument
+// buffer, which ExecuteIndirect then draws.  Items are grouped into batches that share
+// the state an indirect command cannot change (PSO, material, textures); the CPU cost
+// per frame is one dispatch plus one ExecuteIndirect per batch, however many items
+// there are.
+//
+// Items can also be tested against a Hi-Z pyramid.  The occluders among them are then
+// culled in a first pass of their own so the pyramid can be built from their depth
+// before the main pass.
+//***************************************************************************************
+
+#ifndef DRAWCULLER_H
+#define DRAWCULLER_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/UploadRing.h"
+#include "FrameResource.h"
+
+class DrawCuller
+{
+public:
+	struct DrawItem
+	{
+		D3D12_VERTEX_BUFFER_VIEW VertexBufferView = {};
+		D3D12_INDEX_BUFFER_VIEW IndexBufferView = {};
+
+		// Index of the item's data in the object buffer.
+		UINT ObjectIndex = 0;
+
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+		INT BaseVertexLocation = 0;
+
+		// Bounding box in local space; the object's world matrix places it.
+		DirectX::BoundingBox Bounds;
+
+		// Drawn into the Hi-Z occluder depth when near the camera.
+		bool Occluder = false;
+	};
+
+	// objectIndexRootParameter is the slot of drawRootSig that takes the object index
+	// as a single root constant and instanceDataRootParameter the root SRV of the
+	// instance data; the indirect commands set both per draw.
+	DrawCuller(ID3D12Device* device, ID3D12RootSignature* drawRootSig,
+		UINT objectIndexRootParameter, UINT instanceDataRootParameter);
+	DrawCuller(const DrawCuller& rhs) = delete;
+	DrawCuller& operator=(const DrawCuller& rhs) = delete;
+	~DrawCuller() = default;
+
+	// Returns the index of a new, empty batch.
+	UINT AddBatch();
+	void AddItem(UINT batch, const DrawItem& item);
+
+	// Adds one draw per instance, culled on its own.  The instance data is bound at the
+	// instance so SV_InstanceID 0 reads it; item.Bounds is in the instance's local space.
+	void AddInstancedItem(UINT batch, const DrawItem& item, const std::vector<InstanceData>& instances);
+
+	// Creates the GPU buffers and records the upload of the items on cmdList.  fenceValue
+	// is the value fence reaches once cmdList has executed.  Add every item first.
+	void Build(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue);
+
+	UINT BatchCount()const;
+	UINT ItemCount()const;
+
+	// Records the culling dispatch.  The root signature expects 28 root constants in
+	// slot 0 (the six world space frustum planes, the item count, the cull flags and the
+	// occluder distance), the pass constants in slot 1, the item, object and instance
+	// buffers in slots 2 to 4, the command and count buffers as UAVs in slots 5 and 6
+	// and the Hi-Z pyramid SRV table in slot 7.  Afterwards the batches are ready to be
+	// drawn.  The pyramid is only read when occlusionEnabled is set.
+	void Execute(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		D3D12_GPU_VIRTUAL_ADDRESS passCB,
+		D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+		const DirectX::BoundingFrustum& worldFrustum,
+		bool cullingEnabled,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ,
+		bool occlusionEnabled);
+
+	// As Execute, but selects the occluders in the frustum within occluderDistance of
+	// the eye, for DrawOccluderBatch.
+	void CullOccluders(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		D3D12_GPU_VIRTUAL_ADDRESS passCB,
+		D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+		const DirectX::BoundingFrustum& worldFrustum,
+		float occluderDistance,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ);
+
+	// Draws the items of batch that passed the last Execute, or the occluders of batch
+	// selected by the last CullOccluders.  Sets the vertex and index buffers, the object
+	// index and the instance data; the caller binds the rest of the state.
+	void DrawBatch(ID3D12GraphicsCommandList* cmdList, UINT batch)const;
+	void DrawOccluderBatch(ID3D12GraphicsCommandList* cmdList, UINT batch)const;
+
+private:
+	// Layout of one argument of the command signature.  Must match DrawCulling.hlsl.
+	struct IndirectCommand
+	{
+		D3D12_VERTEX_BUFFER_VIEW VertexBufferView;
+		D3D12_INDEX_BUFFER_VIEW IndexBufferView;
+		D3D12_GPU_VIRTUAL_ADDRESS InstanceData;
+		UINT ObjectIndex;
+		D3D12_DRAW_INDEXED_ARGUMENTS DrawArguments;
+	};
+
+	// An item as read by the culling shader.  Must match DrawCulling.hlsl.
+	struct GpuDrawItem
+	{
+		IndirectCommand Command;
+		DirectX::XMFLOAT3 BoundsCenter;
+		UINT Batch;
+		DirectX::XMFLOAT3 BoundsExtents;
+
+		// First command of the item's batch in the command buffers.
+		UINT CommandOffset;
+
+		// Index of the item's instance, if its flags say it is instanced.
+		UINT InstanceIndex;
+		UINT Flags;
+	};
+
+	struct BatchItem
+	{
+		DrawItem Item;
+
+		// Index into mInstances, or -1 for items placed by the object buffer.
+		INT InstanceIndex = -1;
+	};
+
+	void BuildCommandSignature(ID3D12RootSignature* drawRootSig,
+		UINT objectIndexRootParameter, UINT instanceDataRootParameter);
+
+	void Dispatch(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		D3D12_GPU_VIRTUAL_ADDRESS passCB,
+		D3D12_GPU_VIRTUAL_ADDRESS objectBuffer,
+		const DirectX::BoundingFrustum& worldFrustum,
+		UINT cullFlags,
+		float occluderDistance,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hiZ,
+		ID3D12Resource* commands,
+		ID3D12Resource* commandCounts);
+
+	void DrawCommands(ID3D12GraphicsCommandList* cmdList, UINT batch,
+		ID3D12Resource* commands, ID3D12Resource* commandCounts)const;
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+	std::vector<std::vector<BatchItem>> mBatchItems;
+	std::vector<InstanceData> mInstances;
+
+	// Range of each batch in the command buffers.
+	std::vector<UINT> mBatchOffsets;
+	UINT mItemCount = 0;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawItems = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mInstanceData = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCommands = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCommandCounts = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mOccluderCommands = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mOccluderCommandCounts = nullptr;
+
+	// Zeros copied over the command counts before every dispatch.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCommandCountsReset = nullptr;
+};
+
+#endif // DRAWCULLER_H
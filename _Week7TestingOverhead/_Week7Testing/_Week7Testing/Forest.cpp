@@ -0,0 +1,171 @@
+//***************************************************************************************
+// Forest.cpp
+//***************************************************************************************
+
+#include "Forest.h"
+
+using namespace DirectX;
+
+// Read by the shaders as a structured buffer, so it must not be padded.
+static_assert(sizeof(XMFLOAT3) + sizeof(float) + sizeof(XMFLOAT2) + 2 * sizeof(UINT) == 32, "GpuTree must be tightly packed.");
+
+Forest::Forest(ID3D12Device* device)
+	: md3dDevice(device)
+{
+	BuildCommandSignature();
+}
+
+void Forest::Build(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue,
+	const std::vector<Tree>& trees)
+{
+	assert(mTrees == nullptr);
+
+	mTreeCount = (UINT)trees.size();
+	if(mTreeCount == 0)
+		return;
+
+	std::vector<GpuTree> gpuTrees(mTreeCount);
+	for(UINT i = 0; i < mTreeCount; ++i)
+	{
+		gpuTrees[i].Position = trees[i].Position;
+		gpuTrees[i].Fade = 1.0f;
+		gpuTrees[i].Size = trees[i].Size;
+		gpuTrees[i].TextureIndex = trees[i].TextureIndex;
+		gpuTrees[i].Pad0 = 0;
+	}
+
+	// The billboards turn to face the eye, so grow the box by half the largest size
+	// in every direction.
+	float maxSize = 0.0f;
+	for(auto& tree : trees)
+		maxSize = (std::max)(maxSize, (std::max)(tree.Size.x, tree.Size.y));
+
+	BoundingBox::CreateFromPoints(mBounds, trees.size(), &trees[0].Position, sizeof(Tree));
+	mBounds.Extents.x += 0.5f * maxSize;
+	mBounds.Extents.y += 0.5f * maxSize;
+	mBounds.Extents.z += 0.5f * maxSize;
+
+	mTrees = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		gpuTrees.data(), gpuTrees.size() * sizeof(GpuTree), uploadRing, fence, fenceValue);
+
+	// Four strip vertices per instance; the culling pass fills in the instance count.
+	D3D12_DRAW_ARGUMENTS resetArgs = { 4, 0, 0, 0 };
+	mDrawArgsReset = d3dUtil::CreateDefaultBuffer(md3dDevice, cmdList,
+		&resetArgs, sizeof(resetArgs), uploadRing, fence, fenceValue);
+
+	// Rebuilt from scratch every frame before they are read, so one copy is shared
+	// by all frame resources.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(mTreeCount * sizeof(GpuTree), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mVisibleTrees)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(sizeof(D3D12_DRAW_ARGUMENTS), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mDrawArgs)));
+}
+
+UINT Forest::TreeCount()const
+{
+	return mTreeCount;
+}
+
+const BoundingBox& Forest::Bounds()const
+{
+	return mBounds;
+}
+
+void Forest::Execute(ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	const BoundingFrustum& worldFrustum,
+	const XMFLOAT3& eyePosW,
+	float fadeStart,
+	float maxDistance,
+	bool cullingEnabled)
+{
+	if(mTreeCount == 0)
+		return;
+
+	// Same layout as cbCull in TreeCulling.hlsl.
+	struct
+	{
+		XMFLOAT4 Planes[6];
+		XMFLOAT3 EyePosW;
+		UINT TreeCount;
+		float FadeStart;
+		float MaxDistance;
+	} cullConstants;
+
+	// With culling off the planes are zero, which no tree is outside of.
+	XMVECTOR planes[6] = {};
+	if(cullingEnabled)
+		worldFrustum.GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+	for(int i = 0; i < 6; ++i)
+		XMStoreFloat4(&cullConstants.Planes[i], planes[i]);
+	cullConstants.EyePosW = eyePosW;
+	cullConstants.TreeCount = mTreeCount;
+	cullConstants.FadeStart = fadeStart;
+	cullConstants.MaxDistance = maxDistance;
+
+	// Buffers decay back to the common state after every ExecuteCommandLists, so the
+	// arguments are implicitly promoted to COPY_DEST by the reset copy and the visible
+	// trees to UNORDERED_ACCESS by the dispatch.
+	cmdList->CopyBufferRegion(mDrawArgs.Get(), 0, mDrawArgsReset.Get(), 0, sizeof(D3D12_DRAW_ARGUMENTS));
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetPipelineState(pso);
+
+	cmdList->SetComputeRoot32BitConstants(0, sizeof(cullConstants) / sizeof(UINT), &cullConstants, 0);
+	cmdList->SetComputeRootShaderResourceView(1, mTrees->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(2, mVisibleTrees->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(3, mDrawArgs->GetGPUVirtualAddress());
+
+	// One thread per tree; must match the numthreads of TreeCulling.hlsl.
+	UINT numGroups = (mTreeCount + 63) / 64;
+	cmdList->Dispatch(numGroups, 1, 1);
+
+	D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mVisibleTrees.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mDrawArgs.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+void Forest::Draw(ID3D12GraphicsCommandList* cmdList, UINT visibleTreesRootParameter)const
+{
+	if(mTreeCount == 0)
+		return;
+
+	// The quads are expanded from SV_VertexID, so no vertex or index buffer is bound.
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	cmdList->SetGraphicsRootShaderResourceView(visibleTreesRootParameter, mVisibleTrees->GetGPUVirtualAddress());
+
+	cmdList->ExecuteIndirect(mCommandSignature.Get(), 1, mDrawArgs.Get(), 0, nullptr, 0);
+}
+
+void Forest::BuildCommandSignature()
+{
+	D3D12_INDIRECT_ARGUMENT_DESC argument = {};
+	argument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+
+	D3D12_COMMAND_SIGNATURE_DESC desc = {};
+	desc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+	desc.NumArgumentDescs = 1;
+	desc.pArgumentDescs = &argument;
+
+	// Only the draw arguments change, so no root signature is needed.
+	ThrowIfFailed(md3dDevice->CreateCommandSignature(&desc, nullptr, IID_PPV_ARGS(&mCommandSignature)));
+}
@@ -0,0 +1,97 @@
+//***************************************************************************************
+// Forest.h
+//
+// Billboarded trees drawn as instanced quads.  The trees are uploaded once into a
+// structured buffer.  Each frame a compute shader culls them by distance and against
+// the frustum, compacts the survivors into a second buffer together with their fade
+// factor, and writes the instance count of a single indirect draw.  The vertex shader
+// expands each instance into a camera facing quad, so no geometry shader is needed
+// and the CPU cost does not grow with the number of trees.
+//***************************************************************************************
+
+#ifndef FOREST_H
+#define FOREST_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/UploadRing.h"
+
+class Forest
+{
+public:
+	struct Tree
+	{
+		// Center of the billboard in world space.
+		DirectX::XMFLOAT3 Position = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT2 Size = { 1.0f, 1.0f };
+
+		// Slice of the tree texture array.
+		UINT TextureIndex = 0;
+	};
+
+	Forest(ID3D12Device* device);
+	Forest(const Forest& rhs) = delete;
+	Forest& operator=(const Forest& rhs) = delete;
+	~Forest() = default;
+
+	// Creates the GPU buffers and records the upload of the trees on cmdList.  fenceValue
+	// is the value fence reaches once cmdList has executed.
+	void Build(ID3D12GraphicsCommandList* cmdList, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue,
+		const std::vector<Tree>& trees);
+
+	UINT TreeCount()const;
+
+	// World space box enclosing every billboard.
+	const DirectX::BoundingBox& Bounds()const;
+
+	// Records the culling dispatch.  The root signature expects 30 root constants in
+	// slot 0 (the six world space frustum planes, the eye position, the tree count and
+	// the fade distances), the tree buffer in slot 1 and the visible tree and draw
+	// argument buffers as UAVs in slots 2 and 3.  Trees fade out between fadeStart and
+	// maxDistance from the eye and are culled beyond it.
+	void Execute(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		const DirectX::BoundingFrustum& worldFrustum,
+		const DirectX::XMFLOAT3& eyePosW,
+		float fadeStart,
+		float maxDistance,
+		bool cullingEnabled);
+
+	// Draws the trees that passed the last Execute as triangle strip quads.  Binds the
+	// visible trees to the root SRV in visibleTreesRootParameter; the caller binds the
+	// rest of the state.
+	void Draw(ID3D12GraphicsCommandList* cmdList, UINT visibleTreesRootParameter)const;
+
+private:
+	// A tree as read by the shaders.  Must match TreeCulling.hlsl and TreeSprite.hlsl.
+	struct GpuTree
+	{
+		DirectX::XMFLOAT3 Position;
+
+		// 1 when fully visible, towards 0 as the tree fades out.  Written by the culling pass.
+		float Fade;
+
+		DirectX::XMFLOAT2 Size;
+		UINT TextureIndex;
+		UINT Pad0;
+	};
+
+	void BuildCommandSignature();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> mCommandSignature = nullptr;
+
+	UINT mTreeCount = 0;
+	DirectX::BoundingBox mBounds;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mTrees = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mVisibleTrees = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgs = nullptr;
+
+	// Draw arguments with a zero instance count, copied over mDrawArgs before every dispatch.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mDrawArgsReset = nullptr;
+};
+
+#endif // FOREST_H
@@ -0,0 +1,293 @@
+//***************************************************************************************
+// FrameProfiler.cpp
+//***************************************************************************************
+
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+FrameProfiler::FrameProfiler(ID3D12Device* device, ID3D12CommandQueue* queue,
+	UINT frameResourceCount, UINT maxGpuTimers, UINT historyLength)
+	: md3dDevice(device),
+	mFrameResourceCount(frameResourceCount),
+	mMaxGpuTimers(maxGpuTimers),
+	mHistoryLength(historyLength)
+{
+	ThrowIfFailed(queue->GetTimestampFrequency(&mTimestampFrequency));
+
+	// Two timestamps per timer per frame resource.
+	const UINT queryCount = mFrameResourceCount * mMaxGpuTimers * 2;
+
+	D3D12_QUERY_HEAP_DESC heapDesc = {};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = queryCount;
+	ThrowIfFailed(md3dDevice->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(&mQueryHeap)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(queryCount * sizeof(UINT64)),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&mReadback)));
+
+	mGpuTimerRecorded.assign(mFrameResourceCount * mMaxGpuTimers, 0);
+	mFrameResolved.assign(mFrameResourceCount, false);
+}
+
+UINT FrameProfiler::AddGpuTimer(const std::string& name)
+{
+	assert(mGpuTimerSeries.size() < mMaxGpuTimers);
+
+	mGpuTimerSeries.push_back(FindOrAddSeries(name, true));
+	return (UINT)mGpuTimerSeries.size() - 1;
+}
+
+UINT FrameProfiler::AddCpuTimer(const std::string& name)
+{
+	mCpuTimerSeries.push_back(FindOrAddSeries(name, false));
+	return (UINT)mCpuTimerSeries.size() - 1;
+}
+
+void FrameProfiler::BeginFrame(UINT frameIndex)
+{
+	assert(frameIndex < mFrameResourceCount);
+
+	if(mFrameResolved[frameIndex])
+		CollectGpuTimes(frameIndex);
+
+	{
+		std::lock_guard<std::mutex> lock(mCpuMutex);
+		for(auto& series : mSeries)
+		{
+			if(!series.Gpu && series.Pending)
+			{
+				AddSample(series, (float)series.PendingTime);
+				series.PendingTime = 0.0;
+				series.Pending = false;
+			}
+		}
+	}
+
+	std::fill_n(mGpuTimerRecorded.begin() + frameIndex * mMaxGpuTimers, mMaxGpuTimers, (UINT8)0);
+	mFrameResolved[frameIndex] = false;
+	mCurrFrame = frameIndex;
+}
+
+void FrameProfiler::BeginGpuTimer(ID3D12GraphicsCommandList* cmdList, UINT timer)
+{
+	assert(timer < mGpuTimerSeries.size());
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrFrame * mMaxGpuTimers + timer) * 2);
+}
+
+void FrameProfiler::EndGpuTimer(ID3D12GraphicsCommandList* cmdList, UINT timer)
+{
+	assert(timer < mGpuTimerSeries.size());
+
+	cmdList->EndQuery(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (mCurrFrame * mMaxGpuTimers + timer) * 2 + 1);
+	mGpuTimerRecorded[mCurrFrame * mMaxGpuTimers + timer] = 1;
+}
+
+void FrameProfiler::ResolveGpuTimers(ID3D12GraphicsCommandList* cmdList)
+{
+	// Queries that were never written this frame must not be resolved, so resolve each
+	// run of recorded timers with its own call.
+	const UINT firstTimer = mCurrFrame * mMaxGpuTimers;
+	const UINT timerCount = (UINT)mGpuTimerSeries.size();
+	for(UINT timer = 0; timer < timerCount; )
+	{
+		if(!mGpuTimerRecorded[firstTimer + timer])
+		{
+			++timer;
+			continue;
+		}
+
+		UINT runEnd = timer + 1;
+		while(runEnd < timerCount && mGpuTimerRecorded[firstTimer + runEnd])
+			++runEnd;
+
+		const UINT firstQuery = (firstTimer + timer) * 2;
+		cmdList->ResolveQueryData(mQueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+			firstQuery, (runEnd - timer) * 2, mReadback.Get(), firstQuery * sizeof(UINT64));
+
+		timer = runEnd;
+	}
+
+	mFrameResolved[mCurrFrame] = true;
+}
+
+void FrameProfiler::AddCpuTime(UINT timer, double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(mCpuMutex);
+
+	Series& series = mSeries[mCpuTimerSeries[timer]];
+	series.PendingTime += milliseconds;
+	series.Pending = true;
+}
+
+void FrameProfiler::Clear()
+{
+	std::lock_guard<std::mutex> lock(mCpuMutex);
+
+	for(auto& series : mSeries)
+	{
+		series.NextSample = 0;
+		series.SampleCount = 0;
+		series.PendingTime = 0.0;
+		series.Pending = false;
+	}
+}
+
+std::vector<FrameProfiler::TimerStats> FrameProfiler::GetStats()const
+{
+	std::vector<TimerStats> stats;
+	for(auto& series : mSeries)
+	{
+		if(series.Gpu)
+			stats.push_back(ComputeStats(series));
+	}
+	for(auto& series : mSeries)
+	{
+		if(!series.Gpu)
+			stats.push_back(ComputeStats(series));
+	}
+	return stats;
+}
+
+FrameProfiler::TimerStats FrameProfiler::GetStats(const std::string& name, bool gpu)const
+{
+	auto& seriesByName = gpu ? mGpuSeriesByName : mCpuSeriesByName;
+
+	auto it = seriesByName.find(name);
+	if(it == seriesByName.end())
+	{
+		TimerStats stats;
+		stats.Name = name;
+		stats.Gpu = gpu;
+		return stats;
+	}
+
+	return ComputeStats(mSeries[it->second]);
+}
+
+void FrameProfiler::WriteCsv(const std::string& path)const
+{
+	std::ofstream file(path);
+	WriteCsv(file);
+}
+
+void FrameProfiler::WriteCsv(std::ostream& out)const
+{
+	out << "timer,type,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+	for(auto& stats : GetStats())
+	{
+		out << stats.Name << "," << (stats.Gpu ? "gpu" : "cpu") << "," << stats.SampleCount << ","
+			<< stats.Mean << "," << stats.P50 << "," << stats.P95 << "," << stats.P99 << "," << stats.Max << "\n";
+	}
+}
+
+UINT FrameProfiler::FindOrAddSeries(const std::string& name, bool gpu)
+{
+	auto& seriesByName = gpu ? mGpuSeriesByName : mCpuSeriesByName;
+
+	auto it = seriesByName.find(name);
+	if(it != seriesByName.end())
+		return it->second;
+
+	Series series;
+	series.Name = name;
+	series.Gpu = gpu;
+	series.Samples.resize(mHistoryLength);
+	mSeries.push_back(series);
+
+	seriesByName[name] = (UINT)mSeries.size() - 1;
+	return (UINT)mSeries.size() - 1;
+}
+
+void FrameProfiler::AddSample(Series& series, float milliseconds)
+{
+	series.Samples[series.NextSample] = milliseconds;
+	series.NextSample = (series.NextSample + 1) % mHistoryLength;
+	series.SampleCount = (std::min)(series.SampleCount + 1, mHistoryLength);
+}
+
+FrameProfiler::TimerStats FrameProfiler::ComputeStats(const Series& series)const
+{
+	TimerStats stats;
+	stats.Name = series.Name;
+	stats.Gpu = series.Gpu;
+	stats.SampleCount = series.SampleCount;
+	if(series.SampleCount == 0)
+		return stats;
+
+	// Until the ring is full, the samples are the front of it.
+	std::vector<float> sorted(series.Samples.begin(), series.Samples.begin() + series.SampleCount);
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0.0;
+	for(float sample : sorted)
+		sum += sample;
+	stats.Mean = sum / sorted.size();
+
+	// Nearest rank percentiles.
+	auto percentile = [&sorted](double p)
+	{
+		size_t rank = (size_t)std::ceil(p * sorted.size());
+		return (double)sorted[(std::max)(rank, (size_t)1) - 1];
+	};
+	stats.P50 = percentile(0.50);
+	stats.P95 = percentile(0.95);
+	stats.P99 = percentile(0.99);
+	stats.Max = sorted.back();
+
+	return stats;
+}
+
+void FrameProfiler::CollectGpuTimes(UINT frameIndex)
+{
+	const UINT firstTimer = frameIndex * mMaxGpuTimers;
+
+	D3D12_RANGE readRange = { firstTimer * 2 * sizeof(UINT64), (firstTimer + mMaxGpuTimers) * 2 * sizeof(UINT64) };
+	UINT8* mapped = nullptr;
+	ThrowIfFailed(mReadback->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+	const UINT64* timestamps = reinterpret_cast<const UINT64*>(mapped) + firstTimer * 2;
+
+	// The span of every GPU series over the timers recorded this frame.
+	std::vector<UINT64> begin(mSeries.size(), UINT64_MAX);
+	std::vector<UINT64> end(mSeries.size(), 0);
+	for(UINT timer = 0; timer < (UINT)mGpuTimerSeries.size(); ++timer)
+	{
+		if(!mGpuTimerRecorded[firstTimer + timer])
+			continue;
+
+		const UINT series = mGpuTimerSeries[timer];
+		begin[series] = (std::min)(begin[series], timestamps[timer * 2]);
+		end[series] = (std::max)(end[series], timestamps[timer * 2 + 1]);
+	}
+
+	D3D12_RANGE writeRange = { 0, 0 };
+	mReadback->Unmap(0, &writeRange);
+
+	for(UINT series = 0; series < (UINT)mSeries.size(); ++series)
+	{
+		if(begin[series] > end[series])
+			continue;
+
+		double ms = 1000.0 * (double)(end[series] - begin[series]) / (double)mTimestampFrequency;
+		AddSample(mSeries[series], (float)ms);
+	}
+}
+
+ScopedCpuTimer::ScopedCpuTimer(FrameProfiler& profiler, UINT timer)
+	: mProfiler(profiler), mTimer(timer),
+	mStart(std::chrono::high_resolution_clock::now())
+{
+}
+
+ScopedCpuTimer::~ScopedCpuTimer()
+{
+	auto end = std::chrono::high_resolution_clock::now();
+	mProfiler.AddCpuTime(mTimer, std::chrono::duration<double, std::milli>(end - mStart).count());
+}
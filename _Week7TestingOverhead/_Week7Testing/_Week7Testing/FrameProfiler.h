@@ -0,0 +1,149 @@
+//***************************************************************************************
+// FrameProfiler.h
+//
+// Per-pass GPU and CPU timings with rolling percentiles.  GPU timers are pairs of
+// timestamp queries recorded around a pass; every frame resource has its own range of
+// the query heap and of the readback buffer, so a frame's timestamps are read once its
+// fence has passed, without stalling.  CPU timers are measured with ScopedCpuTimer.
+// The last historyLength samples of every timer are kept, and their percentiles can
+// be shown or written to a CSV file for regression tracking.
+//***************************************************************************************
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include "../../Common/d3dUtil.h"
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <mutex>
+
+class FrameProfiler
+{
+public:
+	struct TimerStats
+	{
+		std::string Name;
+		bool Gpu = false;
+		UINT SampleCount = 0;
+
+		// Milliseconds over the samples in the history.
+		double Mean = 0.0;
+		double P50 = 0.0;
+		double P95 = 0.0;
+		double P99 = 0.0;
+		double Max = 0.0;
+	};
+
+	// maxGpuTimers bounds the number of AddGpuTimer calls.
+	FrameProfiler(ID3D12Device* device, ID3D12CommandQueue* queue,
+		UINT frameResourceCount, UINT maxGpuTimers, UINT historyLength);
+	FrameProfiler(const FrameProfiler& rhs) = delete;
+	FrameProfiler& operator=(const FrameProfiler& rhs) = delete;
+	~FrameProfiler() = default;
+
+	// Timers that share a name are reported as one: GPU timers as the span from the
+	// first begin to the last end, CPU timers as the sum of their times.  Passes split
+	// across several command lists get one GPU timer per list under the same name.
+	UINT AddGpuTimer(const std::string& name);
+	UINT AddCpuTimer(const std::string& name);
+
+	// Collects the timestamps of the frame last recorded with frameIndex, whose fence
+	// must have completed, and the CPU times measured since the last call, then starts
+	// recording frameIndex again.
+	void BeginFrame(UINT frameIndex);
+
+	// A timer may be recorded once per frame.  Different timers may be recorded from
+	// different threads at the same time.
+	void BeginGpuTimer(ID3D12GraphicsCommandList* cmdList, UINT timer);
+	void EndGpuTimer(ID3D12GraphicsCommandList* cmdList, UINT timer);
+
+	// Copies the frame's timestamps to the readback buffer.  Must be recorded after the
+	// last EndGpuTimer of the frame.
+	void ResolveGpuTimers(ID3D12GraphicsCommandList* cmdList);
+
+	// Thread safe.
+	void AddCpuTime(UINT timer, double milliseconds);
+
+	// Drops the samples of every timer, e.g. once a warmup is over.
+	void Clear();
+
+	// All timers, GPU ones first.
+	std::vector<TimerStats> GetStats()const;
+
+	// Zeroed stats for a name that was never added.
+	TimerStats GetStats(const std::string& name, bool gpu)const;
+
+	// One row per timer with the sample count, mean, percentiles and maximum in
+	// milliseconds, after a header row.
+	void WriteCsv(const std::string& path)const;
+	void WriteCsv(std::ostream& out)const;
+
+private:
+	// The samples of every timer with the same name.
+	struct Series
+	{
+		std::string Name;
+		bool Gpu = false;
+
+		// Ring of the last historyLength samples.
+		std::vector<float> Samples;
+		UINT NextSample = 0;
+		UINT SampleCount = 0;
+
+		// CPU only: time accumulated since the last BeginFrame.
+		double PendingTime = 0.0;
+		bool Pending = false;
+	};
+
+	UINT FindOrAddSeries(const std::string& name, bool gpu);
+	void AddSample(Series& series, float milliseconds);
+	TimerStats ComputeStats(const Series& series)const;
+
+	void CollectGpuTimes(UINT frameIndex);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mFrameResourceCount = 0;
+	UINT mMaxGpuTimers = 0;
+	UINT mHistoryLength = 0;
+	UINT64 mTimestampFrequency = 1;
+
+	Microsoft::WRL::ComPtr<ID3D12QueryHeap> mQueryHeap = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mReadback = nullptr;
+
+	std::vector<Series> mSeries;
+	std::map<std::string, UINT> mGpuSeriesByName;
+	std::map<std::string, UINT> mCpuSeriesByName;
+
+	// Series of every GPU and CPU timer.
+	std::vector<UINT> mGpuTimerSeries;
+	std::vector<UINT> mCpuTimerSeries;
+
+	// Indexed by frame * mMaxGpuTimers + timer; set once both timestamps are recorded.
+	// Bytes rather than bools so that timers recorded on different threads do not share
+	// storage.
+	std::vector<UINT8> mGpuTimerRecorded;
+	std::vector<bool> mFrameResolved;
+	UINT mCurrFrame = 0;
+
+	std::mutex mCpuMutex;
+};
+
+// Adds the time from construction to destruction to a CPU timer.
+class ScopedCpuTimer
+{
+public:
+	ScopedCpuTimer(FrameProfiler& profiler, UINT timer);
+	ScopedCpuTimer(const ScopedCpuTimer& rhs) = delete;
+	ScopedCpuTimer& operator=(const ScopedCpuTimer& rhs) = delete;
+	~ScopedCpuTimer();
+
+private:
+	FrameProfiler& mProfiler;
+	UINT mTimer = 0;
+	std::chrono::high_resolution_clock::time_point mStart;
+};
+
+#endif // FRAMEPROFILER_H
@@ -1,29 +1,57 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UploadRing& uploadRing, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT waveVertCount, UINT workerCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_DIRECT,
+        IID_PPV_ARGS(PostCmdListAlloc.GetAddressOf())));
+
+    WorkerCmdListAllocs.resize(workerCount);
+    for(UINT i = 0; i < workerCount; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+    }
+
   //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    PassCB = std::make_unique<UploadBuffer<PassConstants>>(uploadRing, passCount, true);
+    MaterialBuffer = std::make_unique<UploadBuffer<MaterialConstants>>(uploadRing, materialCount, false);
+    ObjectBuffer = std::make_unique<UploadBuffer<ObjectData>>(uploadRing, objectCount, false);
+    InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(uploadRing, instanceCount, false);
+    LightBuffer = std::make_unique<UploadBuffer<Light>>(uploadRing, lightCount, false);
 
     WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
 }
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
+FrameResource::FrameResource(ID3D12Device* device, UploadRing& uploadRing, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT workerCount)
 {
 	ThrowIfFailed(device->CreateCommandAllocator(
 		D3D12_COMMAND_LIST_TYPE_DIRECT,
 		IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
+	ThrowIfFailed(device->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_DIRECT,
+		IID_PPV_ARGS(PostCmdListAlloc.GetAddressOf())));
+
+	WorkerCmdListAllocs.resize(workerCount);
+	for(UINT i = 0; i < workerCount; ++i)
+	{
+		ThrowIfFailed(device->CreateCommandAllocator(
+			D3D12_COMMAND_LIST_TYPE_DIRECT,
+			IID_PPV_ARGS(WorkerCmdListAllocs[i].GetAddressOf())));
+	}
+
 	//  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+	PassCB = std::make_unique<UploadBuffer<PassConstants>>(uploadRing, passCount, true);
+	MaterialBuffer = std::make_unique<UploadBuffer<MaterialConstants>>(uploadRing, materialCount, false);
+	ObjectBuffer = std::make_unique<UploadBuffer<ObjectData>>(uploadRing, objectCount, false);
+	InstanceBuffer = std::make_unique<UploadBuffer<InstanceData>>(uploadRing, instanceCount, false);
+	LightBuffer = std::make_unique<UploadBuffer<Light>>(uploadRing, lightCount, false);
 
 }
 
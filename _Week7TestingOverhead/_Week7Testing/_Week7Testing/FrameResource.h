@@ -4,10 +4,28 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 
-struct ObjectConstants
+// Per-object data of the render items.  Read in the vertex shader from a structured
+// buffer indexed by the item's handle, which is set as a root constant, so the
+// elements are packed back to back instead of padded to 256 bytes.
+struct ObjectData
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Only used by items drawn with a displacement map (the GPU waves).
+	DirectX::XMFLOAT2 DisplacementMapTexelSize = { 1.0f, 1.0f };
+	float GridSpatialStep = 1.0f;
+
+	// Element of the frame's MaterialBuffer the item is shaded with.
+	UINT MaterialIndex = 0;
+};
+
+// Per-instance data for hardware instanced render items.  Read in the vertex shader
+// from a structured buffer indexed by SV_InstanceID.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
 };
 
 struct PassConstants
@@ -34,11 +52,13 @@ struct PassConstants
 	float gFogRange = 150.0f;
 	DirectX::XMFLOAT2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light Lights[MaxLights];
+    // Counts of the lights in the frame's LightBuffer.  Indices [0, NumDirLights) are
+    // directional lights, the next NumPointLights are point lights and the next
+    // NumSpotLights are spot lights.
+    UINT NumDirLights = 0;
+    UINT NumPointLights = 0;
+    UINT NumSpotLights = 0;
+    UINT cbPerObjectPad3 = 0;
 };
 
 struct Vertex
@@ -54,8 +74,8 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
-	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
+    FrameResource(ID3D12Device* device, UploadRing& uploadRing, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT waveVertCount, UINT workerCount);
+	FrameResource(ID3D12Device* device, UploadRing& uploadRing, UINT passCount, UINT objectCount, UINT instanceCount, UINT materialCount, UINT lightCount, UINT workerCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -64,15 +84,36 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
+    // Draw jobs are recorded in parallel, and an allocator must not be used by two
+    // threads at once, so every worker command list gets its own allocator.  The post
+    // allocator records the back buffer transition submitted after the workers.
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> WorkerCmdListAllocs;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> PostCmdListAlloc;
+
     // We cannot update a cbuffer until the GPU is done processing the commands
     // that reference it.  So each frame needs their own cbuffers.
+    // They are persistent suballocations of the shared upload ring, so address
+    // them with GpuVirtualAddress().
    // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+    std::unique_ptr<UploadBuffer<ObjectData>> ObjectBuffer = nullptr;
+
+    // Material data of every material, indexed by MatCBIndex.  A structured buffer
+    // the shaders index, not a constant buffer bound per draw.
+    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialBuffer = nullptr;
+
+    // Instance transforms of every instanced render item, packed back to back.
+    // Not a constant buffer, so elements are not padded to 256 bytes.
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
+    // Scene lights, read by the shaders as a structured buffer so the count is not
+    // limited to MaxLights.  Filled by LightManager.
+    std::unique_ptr<UploadBuffer<Light>> LightBuffer = nullptr;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
+    // Kept as its own resource since MeshGeometry addresses its vertex buffer
+    // from the start of VertexBufferGPU.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
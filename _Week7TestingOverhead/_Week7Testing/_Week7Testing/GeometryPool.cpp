@@ -0,0 +1,138 @@
+//***************************************************************************************
+// GeometryPool.cpp
+//***************************************************************************************
+
+#include "GeometryPool.h"
+
+using Microsoft::WRL::ComPtr;
+
+void GeometryPool::Add(MeshGeometry* geo)
+{
+	assert(geo->VertexBufferCPU != nullptr && geo->IndexBufferCPU != nullptr);
+	assert(mHeap == nullptr);
+
+	UINT indexSize = geo->IndexFormat == DXGI_FORMAT_R32_UINT ? 4 : 2;
+
+	Entry entry;
+	entry.Geo = geo;
+	entry.VertexPool = FindPool(mVertexPools, geo->VertexByteStride, DXGI_FORMAT_UNKNOWN);
+	entry.IndexPool = FindPool(mIndexPools, indexSize, geo->IndexFormat);
+
+	// Indices stay relative to the geometry's own vertices; the draws add the base vertex.
+	PoolBuffer& vertexPool = mVertexPools[entry.VertexPool];
+	entry.BaseVertex = (UINT)(vertexPool.Data.size() / vertexPool.Stride);
+	const BYTE* vertices = (const BYTE*)geo->VertexBufferCPU->GetBufferPointer();
+	vertexPool.Data.insert(vertexPool.Data.end(), vertices, vertices + geo->VertexBufferCPU->GetBufferSize());
+
+	PoolBuffer& indexPool = mIndexPools[entry.IndexPool];
+	entry.StartIndex = (UINT)(indexPool.Data.size() / indexPool.Stride);
+	const BYTE* indices = (const BYTE*)geo->IndexBufferCPU->GetBufferPointer();
+	indexPool.Data.insert(indexPool.Data.end(), indices, indices + geo->IndexBufferCPU->GetBufferSize());
+
+	mEntries.push_back(entry);
+}
+
+void GeometryPool::Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue)
+{
+	// Lay the buffers out back to back in one heap.
+	std::vector<PoolBuffer*> pools;
+	for(auto& p : mVertexPools)
+		pools.push_back(&p);
+	for(auto& p : mIndexPools)
+		pools.push_back(&p);
+
+	mHeapByteSize = 0;
+	for(auto p : pools)
+	{
+		D3D12_RESOURCE_DESC desc = CD3DX12_RESOURCE_DESC::Buffer(p->Data.size());
+		D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &desc);
+
+		p->HeapOffset = (mHeapByteSize + info.Alignment - 1) & ~(info.Alignment - 1);
+		mHeapByteSize = p->HeapOffset + info.SizeInBytes;
+	}
+
+	if(mHeapByteSize == 0)
+		return;
+
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = mHeapByteSize;
+	heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+	ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+	for(auto& p : mVertexPools)
+		CreateBuffer(device, cmdList, p, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, uploadRing, fence, fenceValue);
+	for(auto& p : mIndexPools)
+		CreateBuffer(device, cmdList, p, D3D12_RESOURCE_STATE_INDEX_BUFFER, uploadRing, fence, fenceValue);
+
+	for(auto& e : mEntries)
+	{
+		PoolBuffer& vertexPool = mVertexPools[e.VertexPool];
+		PoolBuffer& indexPool = mIndexPools[e.IndexPool];
+
+		e.Geo->VertexBufferGPU = vertexPool.Buffer;
+		e.Geo->VertexBufferByteSize = (UINT)vertexPool.Data.size();
+		e.Geo->IndexBufferGPU = indexPool.Buffer;
+		e.Geo->IndexBufferByteSize = (UINT)indexPool.Data.size();
+
+		for(auto& arg : e.Geo->DrawArgs)
+		{
+			arg.second.StartIndexLocation += e.StartIndex;
+			arg.second.BaseVertexLocation += e.BaseVertex;
+		}
+	}
+
+	// The data now lives in the default heap.
+	for(auto p : pools)
+		std::vector<BYTE>().swap(p->Data);
+}
+
+UINT GeometryPool::BufferCount()const
+{
+	return (UINT)(mVertexPools.size() + mIndexPools.size());
+}
+
+UINT64 GeometryPool::HeapByteSize()const
+{
+	return mHeapByteSize;
+}
+
+size_t GeometryPool::FindPool(std::vector<PoolBuffer>& pools, UINT stride, DXGI_FORMAT format)
+{
+	for(size_t i = 0; i < pools.size(); ++i)
+	{
+		if(pools[i].Stride == stride && pools[i].Format == format)
+			return i;
+	}
+
+	PoolBuffer pool;
+	pool.Stride = stride;
+	pool.Format = format;
+	pools.push_back(pool);
+	return pools.size() - 1;
+}
+
+void GeometryPool::CreateBuffer(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, PoolBuffer& pool,
+	D3D12_RESOURCE_STATES finalState, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue)
+{
+	UINT64 byteSize = pool.Data.size();
+
+	ThrowIfFailed(device->CreatePlacedResource(
+		mHeap.Get(),
+		pool.HeapOffset,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&pool.Buffer)));
+
+	UploadRing::Allocation upload = uploadRing.Allocate(byteSize, 16);
+	memcpy(upload.CpuAddress, pool.Data.data(), (size_t)byteSize);
+
+	cmdList->CopyBufferRegion(pool.Buffer.Get(), 0, upload.Resource, upload.Offset, byteSize);
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(pool.Buffer.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, finalState));
+
+	uploadRing.Free(upload, fence, fenceValue);
+}
@@ -0,0 +1,72 @@
+//***************************************************************************************
+// GeometryPool.h
+//
+// Packs the static vertex and index data of many MeshGeometry objects into one vertex
+// buffer per vertex stride and one index buffer per index format, all placed in a
+// single default heap.  Geometries in the same pool share their buffers, and their
+// submeshes are rebased so StartIndexLocation and BaseVertexLocation address the
+// shared buffers; one IA binding then serves the draws of all of them.
+//***************************************************************************************
+
+#ifndef GEOMETRYPOOL_H
+#define GEOMETRYPOOL_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/UploadRing.h"
+
+class GeometryPool
+{
+public:
+	GeometryPool() = default;
+	GeometryPool(const GeometryPool& rhs) = delete;
+	GeometryPool& operator=(const GeometryPool& rhs) = delete;
+	~GeometryPool() = default;
+
+	// Adds geo's VertexBufferCPU and IndexBufferCPU to the pool.  geo's GPU buffers and
+	// draw args are only set by Build, so add every geometry before building it.
+	void Add(MeshGeometry* geo);
+
+	// Creates the heap and its buffers, records the copies from uploadRing on cmdList,
+	// and points the added geometries at the shared buffers.  fenceValue is the value
+	// fence reaches once cmdList has executed.
+	void Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue);
+
+	UINT BufferCount()const;
+	UINT64 HeapByteSize()const;
+
+private:
+	struct PoolBuffer
+	{
+		// Vertex stride for vertex buffers, index format for index buffers.
+		UINT Stride = 0;
+		DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+
+		std::vector<BYTE> Data;
+		UINT64 HeapOffset = 0;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Buffer = nullptr;
+	};
+
+	struct Entry
+	{
+		MeshGeometry* Geo = nullptr;
+		size_t VertexPool = 0;
+		size_t IndexPool = 0;
+		UINT BaseVertex = 0;
+		UINT StartIndex = 0;
+	};
+
+	size_t FindPool(std::vector<PoolBuffer>& pools, UINT stride, DXGI_FORMAT format);
+	void CreateBuffer(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, PoolBuffer& pool,
+		D3D12_RESOURCE_STATES finalState, UploadRing& uploadRing, ID3D12Fence* fence, UINT64 fenceValue);
+
+private:
+	std::vector<PoolBuffer> mVertexPools;
+	std::vector<PoolBuffer> mIndexPools;
+	std::vector<Entry> mEntries;
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> mHeap = nullptr;
+	UINT64 mHeapByteSize = 0;
+};
+
+#endif // GEOMETRYPOOL_H
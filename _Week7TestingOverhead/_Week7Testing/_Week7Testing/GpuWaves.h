@@ -0,0 +1,96 @@
+//***************************************************************************************
+// GpuWaves.h
+//
+// Performs the calculations for the wave simulation on the GPU using compute shaders.
+// The solution is kept in floating-point UAV textures, and the current solution is
+// sampled as a displacement map by the vertex shader, so no vertex data has to be
+// copied from the CPU each frame.
+//***************************************************************************************
+
+#ifndef GPUWAVES_H
+#define GPUWAVES_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/GameTimer.h"
+
+class GpuWaves
+{
+public:
+	// Note that m and n should be divisible by 16 so there is no
+	// remainder when we divide into thread groups.
+	GpuWaves(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+		int m, int n, float dx, float dt, float speed, float damping);
+	GpuWaves(const GpuWaves& rhs) = delete;
+	GpuWaves& operator=(const GpuWaves& rhs) = delete;
+	~GpuWaves() = default;
+
+	UINT RowCount()const;
+	UINT ColumnCount()const;
+	UINT VertexCount()const;
+	UINT TriangleCount()const;
+	float Width()const;
+	float Depth()const;
+	float SpatialStep()const;
+
+	// SRV of the current solution, in the NON_PIXEL_SHADER_RESOURCE state between calls.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE DisplacementMap()const;
+
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	void Update(
+		const GameTimer& gt,
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso);
+
+	void Disturb(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		UINT i, UINT j,
+		float magnitude);
+
+private:
+	void BuildResources(ID3D12GraphicsCommandList* cmdList);
+
+private:
+	UINT mNumRows = 0;
+	UINT mNumCols = 0;
+
+	UINT mVertexCount = 0;
+	UINT mTriangleCount = 0;
+
+	// Simulation constants we can precompute.
+	float mK[3];
+
+	float mTimeStep = 0.0f;
+	float mSpatialStep = 0.0f;
+
+	// Time accumulated since the last simulation step.
+	float mTimeSinceStep = 0.0f;
+
+	ID3D12Device* md3dDevice = nullptr;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolSrv;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolSrv;
+
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mPrevSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mCurrSolUav;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mNextSolUav;
+
+	// Two for ping-ponging the textures.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrSol = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mNextSol = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPrevUploadBuffer = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mCurrUploadBuffer = nullptr;
+};
+
+#endif // GPUWAVES_H
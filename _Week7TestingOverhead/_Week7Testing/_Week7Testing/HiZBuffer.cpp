@@ -0,0 +1,212 @@
+//***************************************************************************************
+// HiZBuffer.cpp
+//***************************************************************************************
+
+#include "HiZBuffer.h"
+
+// Descriptor layout: occluder depth SRV, one SRV per pyramid mip, one UAV per pyramid
+// mip, then the SRV of the whole pyramid.
+static const UINT gDepthSrvDescriptor = 0;
+static const UINT gMipSrvDescriptor = 1;
+static const UINT gMipUavDescriptor = gMipSrvDescriptor + HiZBuffer::MaxMipLevels;
+static const UINT gPyramidSrvDescriptor = gMipUavDescriptor + HiZBuffer::MaxMipLevels;
+
+HiZBuffer::HiZBuffer(ID3D12Device* device, UINT width, UINT height)
+	: md3dDevice(device)
+{
+	D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
+	dsvHeapDesc.NumDescriptors = 1;
+	dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+	dsvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&dsvHeapDesc, IID_PPV_ARGS(&mDsvHeap)));
+
+	mWidth = width;
+	mHeight = height;
+	BuildResources();
+}
+
+UINT HiZBuffer::Width()const
+{
+	return mWidth;
+}
+
+UINT HiZBuffer::Height()const
+{
+	return mHeight;
+}
+
+UINT HiZBuffer::MipLevels()const
+{
+	return mMipLevels;
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE HiZBuffer::Srv()const
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mhGpuDescriptor, gPyramidSrvDescriptor, mDescriptorSize);
+}
+
+UINT HiZBuffer::DescriptorCount()const
+{
+	return gPyramidSrvDescriptor + 1;
+}
+
+void HiZBuffer::BuildDescriptors(
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+	CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+	UINT descriptorSize)
+{
+	// Save references to the descriptors so they can be rewritten on resize.
+	mhCpuDescriptor = hCpuDescriptor;
+	mhGpuDescriptor = hGpuDescriptor;
+	mDescriptorSize = descriptorSize;
+
+	WriteDescriptors();
+}
+
+void HiZBuffer::OnResize(UINT width, UINT height)
+{
+	if(mWidth == width && mHeight == height)
+		return;
+
+	mWidth = width;
+	mHeight = height;
+	BuildResources();
+
+	if(mDescriptorSize != 0)
+		WriteDescriptors();
+}
+
+void HiZBuffer::BeginOccluders(ID3D12GraphicsCommandList* cmdList)
+{
+	D3D12_CPU_DESCRIPTOR_HANDLE dsv = mDsvHeap->GetCPUDescriptorHandleForHeapStart();
+
+	cmdList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+	cmdList->OMSetRenderTargets(0, nullptr, false, &dsv);
+}
+
+void HiZBuffer::BuildPyramid(
+	ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* copyPso,
+	ID3D12PipelineState* downsamplePso)
+{
+	D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mOccluderDepth.Get(),
+			D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+
+	cmdList->SetComputeRootSignature(rootSig);
+
+	// Mip 0 is a copy of the occluder depth; every other mip reduces the one above it.
+	// Each mip is moved to the read state as soon as it is written.
+	for(UINT mip = 0; mip < mMipLevels; ++mip)
+	{
+		UINT srcDescriptor = mip == 0 ? gDepthSrvDescriptor : gMipSrvDescriptor + mip - 1;
+
+		cmdList->SetPipelineState(mip == 0 ? copyPso : downsamplePso);
+		cmdList->SetComputeRootDescriptorTable(0, CD3DX12_GPU_DESCRIPTOR_HANDLE(mhGpuDescriptor, srcDescriptor, mDescriptorSize));
+		cmdList->SetComputeRootDescriptorTable(1, CD3DX12_GPU_DESCRIPTOR_HANDLE(mhGpuDescriptor, gMipUavDescriptor + mip, mDescriptorSize));
+
+		// 8x8 threads per group; must match HiZ.hlsl.
+		UINT width = (std::max)(mWidth >> mip, 1u);
+		UINT height = (std::max)(mHeight >> mip, 1u);
+		cmdList->Dispatch((width + 7) / 8, (height + 7) / 8, 1);
+
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mPyramid.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, mip));
+	}
+
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mOccluderDepth.Get(),
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE));
+}
+
+void HiZBuffer::BuildResources()
+{
+	mMipLevels = 1;
+	while(mMipLevels < MaxMipLevels && ((std::max)(mWidth, mHeight) >> mMipLevels) > 0)
+		mMipLevels++;
+
+	D3D12_RESOURCE_DESC texDesc;
+	ZeroMemory(&texDesc, sizeof(D3D12_RESOURCE_DESC));
+	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	texDesc.Alignment = 0;
+	texDesc.Width = mWidth;
+	texDesc.Height = mHeight;
+	texDesc.DepthOrArraySize = 1;
+	texDesc.MipLevels = 1;
+	texDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+
+	D3D12_CLEAR_VALUE optClear;
+	optClear.Format = DXGI_FORMAT_D32_FLOAT;
+	optClear.DepthStencil.Depth = 1.0f;
+	optClear.DepthStencil.Stencil = 0;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_DEPTH_WRITE,
+		&optClear,
+		IID_PPV_ARGS(mOccluderDepth.ReleaseAndGetAddressOf())));
+
+	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
+	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.Texture2D.MipSlice = 0;
+	md3dDevice->CreateDepthStencilView(mOccluderDepth.Get(), &dsvDesc, mDsvHeap->GetCPUDescriptorHandleForHeapStart());
+
+	texDesc.MipLevels = (UINT16)mMipLevels;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+		nullptr,
+		IID_PPV_ARGS(mPyramid.ReleaseAndGetAddressOf())));
+}
+
+void HiZBuffer::WriteDescriptors()
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = 1;
+
+	md3dDevice->CreateShaderResourceView(mOccluderDepth.Get(), &srvDesc,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mhCpuDescriptor, gDepthSrvDescriptor, mDescriptorSize));
+
+	D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+
+	// Descriptors past the last mip are never used.
+	for(UINT mip = 0; mip < mMipLevels; ++mip)
+	{
+		srvDesc.Texture2D.MostDetailedMip = mip;
+		md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc,
+			CD3DX12_CPU_DESCRIPTOR_HANDLE(mhCpuDescriptor, gMipSrvDescriptor + mip, mDescriptorSize));
+
+		uavDesc.Texture2D.MipSlice = mip;
+		md3dDevice->CreateUnorderedAccessView(mPyramid.Get(), nullptr, &uavDesc,
+			CD3DX12_CPU_DESCRIPTOR_HANDLE(mhCpuDescriptor, gMipUavDescriptor + mip, mDescriptorSize));
+	}
+
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = mMipLevels;
+	md3dDevice->CreateShaderResourceView(mPyramid.Get(), &srvDesc,
+		CD3DX12_CPU_DESCRIPTOR_HANDLE(mhCpuDescriptor, gPyramidSrvDescriptor, mDescriptorSize));
+}
@@ -0,0 +1,78 @@
+//***************************************************************************************
+// HiZBuffer.h
+//
+// Hierarchical depth buffer for occlusion culling.  The nearest occluders are drawn
+// into a depth buffer of their own, which a compute shader then reduces into a mip
+// pyramid where every texel holds the farthest depth of the texels it covers.  A box
+// whose nearest depth is farther than the pyramid over its screen rectangle is hidden
+// behind the occluders.
+//***************************************************************************************
+
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+
+#include "../../Common/d3dUtil.h"
+
+class HiZBuffer
+{
+public:
+	// Enough for a 16384 texel wide pyramid.
+	static const UINT MaxMipLevels = 15;
+
+	HiZBuffer(ID3D12Device* device, UINT width, UINT height);
+	HiZBuffer(const HiZBuffer& rhs) = delete;
+	HiZBuffer& operator=(const HiZBuffer& rhs) = delete;
+	~HiZBuffer() = default;
+
+	UINT Width()const;
+	UINT Height()const;
+	UINT MipLevels()const;
+
+	// SRV of the whole pyramid, in the NON_PIXEL_SHADER_RESOURCE state between calls.
+	CD3DX12_GPU_DESCRIPTOR_HANDLE Srv()const;
+
+	UINT DescriptorCount()const;
+
+	void BuildDescriptors(
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hCpuDescriptor,
+		CD3DX12_GPU_DESCRIPTOR_HANDLE hGpuDescriptor,
+		UINT descriptorSize);
+
+	// Recreates the buffers at the new size and rewrites their descriptors.  The GPU
+	// must be idle.
+	void OnResize(UINT width, UINT height);
+
+	// Clears the occluder depth buffer and binds it with no render targets.
+	void BeginOccluders(ID3D12GraphicsCommandList* cmdList);
+
+	// Builds the pyramid from the occluder depth.  The root signature expects the
+	// source SRV table in slot 0 and the destination UAV table in slot 1.
+	void BuildPyramid(
+		ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* copyPso,
+		ID3D12PipelineState* downsamplePso);
+
+private:
+	void BuildResources();
+	void WriteDescriptors();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	UINT mWidth = 0;
+	UINT mHeight = 0;
+	UINT mMipLevels = 0;
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE mhCpuDescriptor;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE mhGpuDescriptor;
+	UINT mDescriptorSize = 0;
+
+	// Depth of the occluders, and its DSV heap.
+	Microsoft::WRL::ComPtr<ID3D12Resource> mOccluderDepth = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mDsvHeap = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mPyramid = nullptr;
+};
+
+#endif // HIZBUFFER_H
@@ -0,0 +1,81 @@
+//***************************************************************************************
+// LightCuller.cpp
+//***************************************************************************************
+
+#include "LightCuller.h"
+
+LightCuller::LightCuller(ID3D12Device* device)
+	: md3dDevice(device)
+{
+	BuildResources();
+}
+
+UINT LightCuller::ClusterCount()const
+{
+	return ClusterCountX * ClusterCountY * ClusterCountZ;
+}
+
+ID3D12Resource* LightCuller::ClusterLightCounts()const
+{
+	return mClusterLightCounts.Get();
+}
+
+ID3D12Resource* LightCuller::ClusterLightIndices()const
+{
+	return mClusterLightIndices.Get();
+}
+
+void LightCuller::Execute(ID3D12GraphicsCommandList* cmdList,
+	ID3D12RootSignature* rootSig,
+	ID3D12PipelineState* pso,
+	D3D12_GPU_VIRTUAL_ADDRESS passCB,
+	D3D12_GPU_VIRTUAL_ADDRESS lightBuffer)
+{
+	cmdList->SetComputeRootSignature(rootSig);
+	cmdList->SetPipelineState(pso);
+
+	cmdList->SetComputeRootConstantBufferView(0, passCB);
+	cmdList->SetComputeRootShaderResourceView(1, lightBuffer);
+	cmdList->SetComputeRootUnorderedAccessView(2, mClusterLightCounts->GetGPUVirtualAddress());
+	cmdList->SetComputeRootUnorderedAccessView(3, mClusterLightIndices->GetGPUVirtualAddress());
+
+	// One thread per cluster; must match the numthreads of LightCulling.hlsl.
+	UINT numGroups = (ClusterCount() + 63) / 64;
+	cmdList->Dispatch(numGroups, 1, 1);
+
+	// Buffers decay back to the common state after every ExecuteCommandLists and are
+	// implicitly promoted to UNORDERED_ACCESS by the dispatch, so only the transition
+	// to the read state needs a barrier.
+	D3D12_RESOURCE_BARRIER barriers[] =
+	{
+		CD3DX12_RESOURCE_BARRIER::Transition(mClusterLightCounts.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(mClusterLightIndices.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+void LightCuller::BuildResources()
+{
+	// The clusters are rebuilt from scratch every frame before they are read, so
+	// one copy is shared by all frame resources.
+	UINT64 countsByteSize = (UINT64)ClusterCount() * sizeof(UINT);
+	UINT64 indicesByteSize = countsByteSize * MaxLightsPerCluster;
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(countsByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mClusterLightCounts)));
+
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(indicesByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mClusterLightIndices)));
+}
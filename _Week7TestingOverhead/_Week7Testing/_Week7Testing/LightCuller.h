@@ -0,0 +1,54 @@
+//***************************************************************************************
+// LightCuller.h
+//
+// Bins the point and spot lights into view space clusters with a compute shader.
+// The screen is split into ClusterCountX by ClusterCountY tiles and the view depth
+// into ClusterCountZ exponential slices.  Each cluster stores the indices of up to
+// MaxLightsPerCluster lights whose range reaches it, so the pixel shader only has
+// to evaluate the lights of its own cluster.
+//***************************************************************************************
+
+#ifndef LIGHTCULLER_H
+#define LIGHTCULLER_H
+
+#include "../../Common/d3dUtil.h"
+
+class LightCuller
+{
+public:
+	// Must match the CLUSTER_COUNT_* and MAX_LIGHTS_PER_CLUSTER defines in LightingUtil.hlsl.
+	static const UINT ClusterCountX = 16;
+	static const UINT ClusterCountY = 9;
+	static const UINT ClusterCountZ = 24;
+	static const UINT MaxLightsPerCluster = 64;
+
+	LightCuller(ID3D12Device* device);
+	LightCuller(const LightCuller& rhs) = delete;
+	LightCuller& operator=(const LightCuller& rhs) = delete;
+	~LightCuller() = default;
+
+	UINT ClusterCount()const;
+
+	ID3D12Resource* ClusterLightCounts()const;
+	ID3D12Resource* ClusterLightIndices()const;
+
+	// Records the culling dispatch.  The root signature expects the pass constants in
+	// slot 0, the light buffer in slot 1 and the two cluster buffers as UAVs in slots 2
+	// and 3.  Afterwards the cluster buffers are ready to be read by the pixel shader.
+	void Execute(ID3D12GraphicsCommandList* cmdList,
+		ID3D12RootSignature* rootSig,
+		ID3D12PipelineState* pso,
+		D3D12_GPU_VIRTUAL_ADDRESS passCB,
+		D3D12_GPU_VIRTUAL_ADDRESS lightBuffer);
+
+private:
+	void BuildResources();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> mClusterLightCounts = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mClusterLightIndices = nullptr;
+};
+
+#endif // LIGHTCULLER_H
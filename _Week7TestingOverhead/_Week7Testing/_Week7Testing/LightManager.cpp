@@ -0,0 +1,138 @@
+//***************************************************************************************
+// LightManager.cpp
+//***************************************************************************************
+
+#include "LightManager.h"
+#include <cassert>
+
+using namespace DirectX;
+
+LightManager::LightManager(int numFrameResources, UINT capacity)
+	: mNumFrameResources(numFrameResources), mCapacity(capacity)
+{
+	mEntries.reserve(capacity);
+	mPackedLights.reserve(capacity);
+}
+
+LightManager::~LightManager()
+{
+}
+
+UINT LightManager::Capacity()const
+{
+	return mCapacity;
+}
+
+UINT LightManager::LightCount()const
+{
+	return (UINT)mPackedLights.size();
+}
+
+UINT LightManager::LightCount(LightType type)const
+{
+	return mTypeCounts[(int)type];
+}
+
+UINT LightManager::AddDirectionalLight(const XMFLOAT3& direction, const XMFLOAT3& strength)
+{
+	Light light;
+	light.Direction = direction;
+	light.Strength = strength;
+
+	return AddLight(LightType::Directional, light);
+}
+
+UINT LightManager::AddPointLight(const XMFLOAT3& position, const XMFLOAT3& strength,
+	float falloffStart, float falloffEnd)
+{
+	Light light;
+	light.Position = position;
+	light.Strength = strength;
+	light.FalloffStart = falloffStart;
+	light.FalloffEnd = falloffEnd;
+
+	return AddLight(LightType::Point, light);
+}
+
+UINT LightManager::AddSpotLight(const XMFLOAT3& position, const XMFLOAT3& direction,
+	const XMFLOAT3& strength, float falloffStart, float falloffEnd, float spotPower)
+{
+	Light light;
+	light.Position = position;
+	light.Direction = direction;
+	light.Strength = strength;
+	light.FalloffStart = falloffStart;
+	light.FalloffEnd = falloffEnd;
+	light.SpotPower = spotPower;
+
+	return AddLight(LightType::Spot, light);
+}
+
+const Light& LightManager::GetLight(UINT id)const
+{
+	assert(id < mEntries.size());
+
+	return mPackedLights[mEntries[id].PackedIndex];
+}
+
+void LightManager::SetLight(UINT id, const Light& light)
+{
+	assert(id < mEntries.size());
+
+	mPackedLights[mEntries[id].PackedIndex] = light;
+	mNumFramesDirty = mNumFrameResources;
+}
+
+void LightManager::Update(FrameResource* frameResource, PassConstants& passConstants)
+{
+	passConstants.NumDirLights = mTypeCounts[(int)LightType::Directional];
+	passConstants.NumPointLights = mTypeCounts[(int)LightType::Point];
+	passConstants.NumSpotLights = mTypeCounts[(int)LightType::Spot];
+
+	// Only upload if the lights changed.  If they did, we need to update
+	// each FrameResource.
+	if(mNumFramesDirty > 0)
+	{
+		auto lightBuffer = frameResource->LightBuffer.get();
+		for(UINT i = 0; i < (UINT)mPackedLights.size(); ++i)
+			lightBuffer->CopyData(i, mPackedLights[i]);
+
+		// Next FrameResource need to be updated too.
+		mNumFramesDirty--;
+	}
+}
+
+UINT LightManager::AddLight(LightType type, const Light& light)
+{
+	assert(mPackedLights.size() < mCapacity);
+
+	LightEntry entry;
+	entry.Type = type;
+	mEntries.push_back(entry);
+
+	// Keep the light with the others of its type; the ids of the lights behind it
+	// are patched up by Repack.
+	UINT insertAt = 0;
+	for(int t = 0; t <= (int)type; ++t)
+		insertAt += mTypeCounts[t];
+
+	mPackedLights.insert(mPackedLights.begin() + insertAt, light);
+	mTypeCounts[(int)type]++;
+
+	Repack();
+
+	mNumFramesDirty = mNumFrameResources;
+
+	return (UINT)mEntries.size() - 1;
+}
+
+void LightManager::Repack()
+{
+	// Lights of the same type keep the order they were added in.
+	UINT next[(int)LightType::Count] = { 0, 0, 0 };
+	for(int t = 1; t < (int)LightType::Count; ++t)
+		next[t] = next[t - 1] + mTypeCounts[t - 1];
+
+	for(auto& e : mEntries)
+		e.PackedIndex = next[(int)e.Type]++;
+}
@@ -0,0 +1,74 @@
+//***************************************************************************************
+// LightManager.h
+//
+// Owns the scene lights.  Lights are kept packed in the order the shaders expect
+// (directional, then point, then spot) and are copied into a frame resource's light
+// buffer only when they changed since that frame resource was last filled.
+//***************************************************************************************
+
+#ifndef LIGHTMANAGER_H
+#define LIGHTMANAGER_H
+
+#include "FrameResource.h"
+
+enum class LightType : int
+{
+	Directional = 0,
+	Point,
+	Spot,
+	Count
+};
+
+class LightManager
+{
+public:
+	LightManager(int numFrameResources, UINT capacity);
+	LightManager(const LightManager& rhs) = delete;
+	LightManager& operator=(const LightManager& rhs) = delete;
+	~LightManager();
+
+	// Maximum number of lights; each frame resource's light buffer holds this many.
+	UINT Capacity()const;
+	UINT LightCount()const;
+	UINT LightCount(LightType type)const;
+
+	// Each Add returns an id that stays valid for GetLight/SetLight.
+	UINT AddDirectionalLight(const DirectX::XMFLOAT3& direction, const DirectX::XMFLOAT3& strength);
+	UINT AddPointLight(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& strength,
+		float falloffStart, float falloffEnd);
+	UINT AddSpotLight(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& direction,
+		const DirectX::XMFLOAT3& strength, float falloffStart, float falloffEnd, float spotPower);
+
+	const Light& GetLight(UINT id)const;
+	void SetLight(UINT id, const Light& light);
+
+	// Uploads the packed lights to the frame's LightBuffer if that frame resource has
+	// not seen the latest change, and writes the light counts into passConstants.
+	void Update(FrameResource* frameResource, PassConstants& passConstants);
+
+private:
+	UINT AddLight(LightType type, const Light& light);
+	void Repack();
+
+private:
+	struct LightEntry
+	{
+		LightType Type = LightType::Directional;
+		UINT PackedIndex = 0;
+	};
+
+	int mNumFrameResources = 0;
+	UINT mCapacity = 0;
+
+	// Indexed by light id.
+	std::vector<LightEntry> mEntries;
+
+	// Grouped by type in the order the shaders walk them.
+	std::vector<Light> mPackedLights;
+	UINT mTypeCounts[(int)LightType::Count] = { 0, 0, 0 };
+
+	// Same scheme as Material::NumFramesDirty: every frame resource gets the update.
+	int mNumFramesDirty = 0;
+};
+
+#endif // LIGHTMANAGER_H
@@ -0,0 +1,314 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+#include <atomic>
+#include <iomanip>
+#include <ppl.h>
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	template<typename T>
+	UINT64 HashValue(const T& value, UINT64 hash)
+	{
+		return d3dUtil::HashBytes(&value, sizeof(T), hash);
+	}
+
+	UINT64 HashString(const char* text, UINT64 hash)
+	{
+		return text != nullptr ? d3dUtil::HashBytes(text, strlen(text) + 1, hash) : HashValue(0, hash);
+	}
+
+	UINT64 HashShader(const D3D12_SHADER_BYTECODE& shader, UINT64 hash)
+	{
+		hash = HashValue(shader.BytecodeLength, hash);
+		return d3dUtil::HashBytes(shader.pShaderBytecode, shader.BytecodeLength, hash);
+	}
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& filename)
+	: md3dDevice(device), mFilename(filename)
+{
+	D3D12_FEATURE_DATA_SHADER_CACHE shaderCache = {};
+	if(FAILED(md3dDevice->QueryInterface(IID_PPV_ARGS(&mDevice1))) ||
+		FAILED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &shaderCache, sizeof(shaderCache))) ||
+		(shaderCache.SupportFlags & D3D12_SHADER_CACHE_SUPPORT_LIBRARY) == 0)
+	{
+		mDevice1 = nullptr;
+		return;
+	}
+
+	if(GetFileAttributesW(mFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+		return;
+
+	mLibraryData = d3dUtil::LoadBinary(mFilename);
+
+	// D3D12_ERROR_DRIVER_VERSION_MISMATCH, D3D12_ERROR_ADAPTER_NOT_FOUND or E_INVALIDARG
+	// for a damaged file.  Every PSO is then created and the file replaced on Save.
+	HRESULT hr = mDevice1->CreatePipelineLibrary(mLibraryData->GetBufferPointer(),
+		mLibraryData->GetBufferSize(), IID_PPV_ARGS(&mLibrary));
+	if(FAILED(hr))
+	{
+		mLibrary = nullptr;
+		mLibraryData = nullptr;
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	mRequests.wait();
+}
+
+bool PipelineCache::LibrarySupported()const
+{
+	return mDevice1 != nullptr;
+}
+
+void PipelineCache::AddGraphics(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Key = MakeKey(name, HashDesc(desc));
+	entry.GraphicsDesc = desc;
+	mEntries.push_back(entry);
+}
+
+void PipelineCache::AddCompute(const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Key = MakeKey(name, HashDesc(desc));
+	entry.Compute = true;
+	entry.ComputeDesc = desc;
+	mEntries.push_back(entry);
+}
+
+void PipelineCache::Build(PsoRegistry& psos)
+{
+	std::vector<ComPtr<ID3D12PipelineState>> results(mEntries.size());
+	std::atomic<UINT> loadedCount(0);
+	concurrency::parallel_for(0, (int)mEntries.size(), [&](int i)
+	{
+		if(LoadOrCreate(mEntries[i], results[i]))
+			loadedCount++;
+	});
+
+	for(size_t i = 0; i < mEntries.size(); ++i)
+		psos.Add(mEntries[i].Name, results[i]);
+
+	mLoadedCount = loadedCount;
+	mCreatedCount = (UINT)mEntries.size() - mLoadedCount;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(size_t i = 0; i < mEntries.size(); ++i)
+		mPipelines.push_back({ mEntries[i].Key, results[i] });
+	mDirty = mDirty || mCreatedCount > 0;
+	mEntries.clear();
+}
+
+ComPtr<ID3D12PipelineState> PipelineCache::RequestGraphics(const std::string& name,
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto it = mRequestEntries.find(name);
+		if(it != mRequestEntries.end())
+			return it->second.State == RequestState::Ready ? it->second.Pipeline : nullptr;
+
+		mRequestEntries[name].State = RequestState::Building;
+	}
+
+	Entry entry;
+	entry.Name = name;
+	entry.Key = MakeKey(name, HashDesc(desc));
+	entry.GraphicsDesc = desc;
+
+	mRequests.run([this, entry]()
+	{
+		try
+		{
+			ComPtr<ID3D12PipelineState> pipeline;
+			bool loaded = LoadOrCreate(entry, pipeline);
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			RequestEntry& request = mRequestEntries[entry.Name];
+			request.State = RequestState::Ready;
+			request.Pipeline = pipeline;
+			mPipelines.push_back({ entry.Key, pipeline });
+			mDirty = mDirty || !loaded;
+		}
+		catch(DxException& e)
+		{
+			OutputDebugString((L"Pipeline state failed to be created: " + e.ToString() + L"\n").c_str());
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			mRequestEntries[entry.Name].State = RequestState::Failed;
+		}
+	});
+
+	return nullptr;
+}
+
+bool PipelineCache::RequestsPending()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(auto& e : mRequestEntries)
+	{
+		if(e.second.State == RequestState::Building)
+			return true;
+	}
+	return false;
+}
+
+bool PipelineCache::RequestFailed(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mRequestEntries.find(name);
+	return it != mRequestEntries.end() && it->second.State == RequestState::Failed;
+}
+
+UINT PipelineCache::LoadedCount()const
+{
+	return mLoadedCount;
+}
+
+UINT PipelineCache::CreatedCount()const
+{
+	return mCreatedCount;
+}
+
+void PipelineCache::Save()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if(!mDirty || mDevice1 == nullptr)
+		return;
+
+	// Some tools, such as graphics debuggers, report library support but refuse to
+	// create one; the PSOs are then simply not cached.
+	ComPtr<ID3D12PipelineLibrary> library;
+	if(FAILED(mDevice1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&library))))
+		return;
+
+	for(auto& pipeline : mPipelines)
+		ThrowIfFailed(library->StorePipeline(pipeline.first.c_str(), pipeline.second.Get()));
+
+	ComPtr<ID3DBlob> data;
+	ThrowIfFailed(D3DCreateBlob(library->GetSerializedSize(), &data));
+	ThrowIfFailed(library->Serialize(data->GetBufferPointer(), data->GetBufferSize()));
+	d3dUtil::SaveBinary(mFilename, data.Get());
+
+	mDirty = false;
+}
+
+bool PipelineCache::LoadOrCreate(const Entry& entry, ComPtr<ID3D12PipelineState>& pipeline)
+{
+	// A PSO missing from the library, or stored with a different desc, fails to load
+	// with E_INVALIDARG.  Different names may be loaded concurrently.
+	if(mLibrary != nullptr)
+	{
+		HRESULT hr = entry.Compute ?
+			mLibrary->LoadComputePipeline(entry.Key.c_str(), &entry.ComputeDesc, IID_PPV_ARGS(&pipeline)) :
+			mLibrary->LoadGraphicsPipeline(entry.Key.c_str(), &entry.GraphicsDesc, IID_PPV_ARGS(&pipeline));
+		if(SUCCEEDED(hr))
+			return true;
+	}
+
+	if(entry.Compute)
+		ThrowIfFailed(md3dDevice->CreateComputePipelineState(&entry.ComputeDesc, IID_PPV_ARGS(&pipeline)));
+	else
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&entry.GraphicsDesc, IID_PPV_ARGS(&pipeline)));
+	return false;
+}
+
+UINT64 PipelineCache::HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	UINT64 hash = HashShader(desc.VS, d3dUtil::HashBytes(nullptr, 0));
+	hash = HashShader(desc.PS, hash);
+	hash = HashShader(desc.DS, hash);
+	hash = HashShader(desc.HS, hash);
+	hash = HashShader(desc.GS, hash);
+
+	hash = HashValue(desc.StreamOutput.NumEntries, hash);
+	for(UINT i = 0; i < desc.StreamOutput.NumEntries; ++i)
+	{
+		const D3D12_SO_DECLARATION_ENTRY& entry = desc.StreamOutput.pSODeclaration[i];
+		hash = HashValue(entry.Stream, hash);
+		hash = HashString(entry.SemanticName, hash);
+		hash = HashValue(entry.SemanticIndex, hash);
+		hash = HashValue(entry.StartComponent, hash);
+		hash = HashValue(entry.ComponentCount, hash);
+		hash = HashValue(entry.OutputSlot, hash);
+	}
+	hash = d3dUtil::HashBytes(desc.StreamOutput.pBufferStrides, desc.StreamOutput.NumStrides * sizeof(UINT), hash);
+	hash = HashValue(desc.StreamOutput.RasterizedStream, hash);
+
+	// Blend and depth stencil descs have padding, so they are hashed field by field.
+	hash = HashValue(desc.BlendState.AlphaToCoverageEnable, hash);
+	hash = HashValue(desc.BlendState.IndependentBlendEnable, hash);
+	for(const D3D12_RENDER_TARGET_BLEND_DESC& blend : desc.BlendState.RenderTarget)
+	{
+		hash = HashValue(blend.BlendEnable, hash);
+		hash = HashValue(blend.LogicOpEnable, hash);
+		hash = HashValue(blend.SrcBlend, hash);
+		hash = HashValue(blend.DestBlend, hash);
+		hash = HashValue(blend.BlendOp, hash);
+		hash = HashValue(blend.SrcBlendAlpha, hash);
+		hash = HashValue(blend.DestBlendAlpha, hash);
+		hash = HashValue(blend.BlendOpAlpha, hash);
+		hash = HashValue(blend.LogicOp, hash);
+		hash = HashValue(blend.RenderTargetWriteMask, hash);
+	}
+	hash = HashValue(desc.SampleMask, hash);
+	hash = HashValue(desc.RasterizerState, hash);
+
+	hash = HashValue(desc.DepthStencilState.DepthEnable, hash);
+	hash = HashValue(desc.DepthStencilState.DepthWriteMask, hash);
+	hash = HashValue(desc.DepthStencilState.DepthFunc, hash);
+	hash = HashValue(desc.DepthStencilState.StencilEnable, hash);
+	hash = HashValue(desc.DepthStencilState.StencilReadMask, hash);
+	hash = HashValue(desc.DepthStencilState.StencilWriteMask, hash);
+	hash = HashValue(desc.DepthStencilState.FrontFace, hash);
+	hash = HashValue(desc.DepthStencilState.BackFace, hash);
+
+	hash = HashValue(desc.InputLayout.NumElements, hash);
+	for(UINT i = 0; i < desc.InputLayout.NumElements; ++i)
+	{
+		const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+		hash = HashString(element.SemanticName, hash);
+		hash = HashValue(element.SemanticIndex, hash);
+		hash = HashValue(element.Format, hash);
+		hash = HashValue(element.InputSlot, hash);
+		hash = HashValue(element.AlignedByteOffset, hash);
+		hash = HashValue(element.InputSlotClass, hash);
+		hash = HashValue(element.InstanceDataStepRate, hash);
+	}
+
+	hash = HashValue(desc.IBStripCutValue, hash);
+	hash = HashValue(desc.PrimitiveTopologyType, hash);
+	hash = HashValue(desc.NumRenderTargets, hash);
+	hash = HashValue(desc.RTVFormats, hash);
+	hash = HashValue(desc.DSVFormat, hash);
+	hash = HashValue(desc.SampleDesc, hash);
+	hash = HashValue(desc.NodeMask, hash);
+	return HashValue(desc.Flags, hash);
+}
+
+UINT64 PipelineCache::HashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc)
+{
+	UINT64 hash = HashShader(desc.CS, d3dUtil::HashBytes(nullptr, 0));
+	hash = HashValue(desc.NodeMask, hash);
+	return HashValue(desc.Flags, hash);
+}
+
+std::wstring PipelineCache::MakeKey(const std::string& name, UINT64 hash)
+{
+	std::wostringstream key;
+	key << std::wstring(name.begin(), name.end()) << L"_"
+		<< std::hex << std::setw(16) << std::setfill(L'0') << hash;
+	return key.str();
+}
@@ -0,0 +1,124 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Pipeline state objects kept on disk between runs in an ID3D12PipelineLibrary.  Every
+// PSO is stored under its name and a hash of its desc, shader bytecode included, so a
+// changed shader or state simply misses and the PSO is created again.  The library also
+// checks the desc itself, which covers the root signature the hash cannot see.  PSOs
+// are loaded or created on worker threads, either in a batch or one at a time on a
+// background task while the caller keeps drawing with another PSO.  Without pipeline
+// library support, or when the file was written by another driver or adapter, every
+// PSO is created.
+//***************************************************************************************
+
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "../../Common/d3dUtil.h"
+#include "ResourceRegistry.h"
+#include <map>
+#include <mutex>
+#include <ppl.h>
+
+typedef ResourceRegistry<Microsoft::WRL::ComPtr<ID3D12PipelineState>> PsoRegistry;
+
+class PipelineCache
+{
+public:
+	PipelineCache(ID3D12Device* device, const std::wstring& filename);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+	// Waits for the PSOs still being requested.
+	~PipelineCache();
+
+	bool LibrarySupported()const;
+
+	// Queue a PSO for Build.  The desc is copied, but the shaders, input layout and root
+	// signature it points to must stay alive until Build returns.
+	void AddGraphics(const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	void AddCompute(const std::string& name, const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+
+	// Loads or creates every queued PSO into psos under its name, then empties the queue.
+	// A PSO replacing one of the same name keeps its handle.
+	void Build(PsoRegistry& psos);
+
+	// The PSO if it is ready.  Otherwise it is loaded or created on a background task,
+	// if that is not already running, and null is returned.  Only the first request of
+	// a name is built, so a changed desc needs a new name.  The desc is copied, but what
+	// it points to must stay alive until the PSO is returned.  A PSO that failed to be
+	// created stays null.
+	Microsoft::WRL::ComPtr<ID3D12PipelineState> RequestGraphics(const std::string& name,
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Whether a requested PSO is still being loaded or created.
+	bool RequestsPending();
+
+	// Whether the PSO requested under name failed to be created.
+	bool RequestFailed(const std::string& name);
+
+	// PSOs of the last Build that were loaded from the library and that were created.
+	UINT LoadedCount()const;
+	UINT CreatedCount()const;
+
+	// Writes every PSO built or requested so far to the file if any of them had to be
+	// created.  The file is rewritten from scratch, so PSOs of old descs do not pile up
+	// in it.  It is slow, so callers batch it rather than saving after each PSO.
+	void Save();
+
+private:
+	struct Entry
+	{
+		std::string Name;
+		std::wstring Key;
+		bool Compute = false;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC GraphicsDesc = {};
+		D3D12_COMPUTE_PIPELINE_STATE_DESC ComputeDesc = {};
+	};
+
+	enum class RequestState
+	{
+		Building,
+		Ready,
+		Failed
+	};
+
+	struct RequestEntry
+	{
+		RequestState State = RequestState::Building;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> Pipeline = nullptr;
+	};
+
+	// Loads entry's PSO from the library, or creates it.  Returns whether it was loaded.
+	bool LoadOrCreate(const Entry& entry, Microsoft::WRL::ComPtr<ID3D12PipelineState>& pipeline);
+
+	static UINT64 HashDesc(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+	static UINT64 HashDesc(const D3D12_COMPUTE_PIPELINE_STATE_DESC& desc);
+	static std::wstring MakeKey(const std::string& name, UINT64 hash);
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12Device1> mDevice1 = nullptr;
+	std::wstring mFilename;
+
+	// The library reads its PSOs from the file contents, which must outlive it.
+	Microsoft::WRL::ComPtr<ID3DBlob> mLibraryData = nullptr;
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary = nullptr;
+
+	std::vector<Entry> mEntries;
+
+	// Every PSO built so far by key, for Save.  Guarded by mMutex with mDirty and
+	// mRequestEntries, as RequestGraphics fills them from the background.
+	std::vector<std::pair<std::wstring, Microsoft::WRL::ComPtr<ID3D12PipelineState>>> mPipelines;
+	bool mDirty = false;
+
+	// By name.
+	std::map<std::string, RequestEntry> mRequestEntries;
+	std::mutex mMutex;
+
+	concurrency::task_group mRequests;
+
+	UINT mLoadedCount = 0;
+	UINT mCreatedCount = 0;
+};
+
+#endif // PIPELINECACHE_H
@@ -0,0 +1,104 @@
+//***************************************************************************************
+// ResourceRegistry.h
+//
+// Named resources of one type kept in a dense array.  Names are resolved to handles
+// once, when the resources are loaded; code that runs every frame keeps the handles
+// and indexes the array instead of hashing the names again.  Each registry type has its
+// own handle type, so a handle cannot be used with the wrong registry.
+//***************************************************************************************
+
+#ifndef RESOURCEREGISTRY_H
+#define RESOURCEREGISTRY_H
+
+#include "../../Common/d3dUtil.h"
+
+template<typename T>
+class ResourceRegistry
+{
+public:
+	struct Handle
+	{
+		UINT Index = UINT_MAX;
+
+		bool IsValid()const { return Index != UINT_MAX; }
+	};
+
+	ResourceRegistry() = default;
+	ResourceRegistry(const ResourceRegistry& rhs) = delete;
+	ResourceRegistry& operator=(const ResourceRegistry& rhs) = delete;
+	~ResourceRegistry() = default;
+
+	// Adds resource under name and returns its handle.  A resource already added under
+	// name is replaced and keeps its handle.  Handles are handed out in order from 0.
+	Handle Add(const std::string& name, T resource)
+	{
+		auto it = mHandles.find(name);
+		if(it != mHandles.end())
+		{
+			mResources[it->second] = std::move(resource);
+			return Handle{ it->second };
+		}
+
+		const UINT index = (UINT)mResources.size();
+		mHandles.insert(std::make_pair(name, index));
+		mNames.push_back(name);
+		mResources.push_back(std::move(resource));
+		return Handle{ index };
+	}
+
+	// The handle of name, invalid if nothing was added under it.
+	Handle Find(const std::string& name)const
+	{
+		auto it = mHandles.find(name);
+		return it != mHandles.end() ? Handle{ it->second } : Handle();
+	}
+
+	// The handle of name, which must have been added.
+	Handle Get(const std::string& name)const
+	{
+		Handle handle = Find(name);
+		assert(handle.IsValid());
+		return handle;
+	}
+
+	T& operator[](Handle handle)
+	{
+		assert(handle.Index < mResources.size());
+		return mResources[handle.Index];
+	}
+
+	const T& operator[](Handle handle)const
+	{
+		assert(handle.Index < mResources.size());
+		return mResources[handle.Index];
+	}
+
+	// Looks name up on every call, so it is meant for code that runs at load time.
+	T& operator[](const std::string& name)
+	{
+		return mResources[Get(name).Index];
+	}
+
+	const std::string& Name(Handle handle)const
+	{
+		return mNames[handle.Index];
+	}
+
+	UINT Count()const
+	{
+		return (UINT)mResources.size();
+	}
+
+	// Iterates the resources in handle order.
+	typename std::vector<T>::iterator begin() { return mResources.begin(); }
+	typename std::vector<T>::iterator end() { return mResources.end(); }
+	typename std::vector<T>::const_iterator begin()const { return mResources.begin(); }
+	typename std::vector<T>::const_iterator end()const { return mResources.end(); }
+
+private:
+	std::vector<T> mResources;
+	std::vector<std::string> mNames;
+	std::unordered_map<std::string, UINT> mHandles;
+};
+
+#endif // RESOURCEREGISTRY_H
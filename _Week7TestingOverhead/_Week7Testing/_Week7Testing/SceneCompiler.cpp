@@ -0,0 +1,292 @@
+//***************************************************************************************
+// SceneCompiler.cpp
+//***************************************************************************************
+
+#include "SceneCompiler.h"
+#include "SceneFile.h"
+#include <fstream>
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+namespace
+{
+	void SyntaxError(const std::wstring& sourceFilename, UINT line, const wchar_t* message)
+	{
+		std::wostringstream out;
+		out << sourceFilename << L"(" << line << L"): " << message << L"\n";
+		OutputDebugStringW(out.str().c_str());
+
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+	}
+
+	bool ReadFloats(std::istream& in, float* values, int count)
+	{
+		for(int i = 0; i < count; ++i)
+		{
+			if(!(in >> values[i]))
+				return false;
+		}
+		return true;
+	}
+
+	// Reads the optional "tex <x y z>" and "occluder" at the end of a line.  Either is
+	// rejected where its pointer is null.
+	bool ReadOptions(std::istream& in, XMFLOAT3* texScale, bool* occluder)
+	{
+		std::string option;
+		while(in >> option)
+		{
+			if(option == "tex" && texScale != nullptr)
+			{
+				if(!ReadFloats(in, &texScale->x, 3))
+					return false;
+			}
+			else if(option == "occluder" && occluder != nullptr)
+			{
+				*occluder = true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename T>
+	UINT32 Append(std::vector<BYTE>& bytes, const T* data, size_t count)
+	{
+		const UINT32 offset = (UINT32)bytes.size();
+		const BYTE* begin = reinterpret_cast<const BYTE*>(data);
+		bytes.insert(bytes.end(), begin, begin + count * sizeof(T));
+		return offset;
+	}
+}
+
+void SceneCompiler::Compile(const std::wstring& sourceFilename, const std::wstring& sceneFilename)
+{
+	CompileSource(ReadSource(sourceFilename), sourceFilename, sceneFilename);
+}
+
+bool SceneCompiler::CompileIfStale(const std::wstring& sourceFilename, const std::wstring& sceneFilename)
+{
+	if(GetFileAttributesW(sourceFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+		return false;
+
+	const std::string source = ReadSource(sourceFilename);
+
+	{
+		SceneFile::Header header = {};
+		std::ifstream scene(sceneFilename, std::ios::binary);
+		if(scene.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+			header.Magic == SceneFile::Magic && header.Version == SceneFile::Version &&
+			header.SourceHash == d3dUtil::HashBytes(source.data(), source.size()))
+			return false;
+	}
+
+	CompileSource(source, sourceFilename, sceneFilename);
+	return true;
+}
+
+std::string SceneCompiler::ReadSource(const std::wstring& sourceFilename)
+{
+	std::ifstream fin(sourceFilename, std::ios::binary);
+	if(!fin)
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+	std::ostringstream text;
+	text << fin.rdbuf();
+	return text.str();
+}
+
+void SceneCompiler::CompileSource(const std::string& source, const std::wstring& sourceFilename,
+	const std::wstring& sceneFilename)
+{
+	std::vector<std::string> names;
+	std::unordered_map<std::string, UINT32> nameIndices;
+	auto nameIndex = [&](const std::string& name)
+	{
+		auto it = nameIndices.find(name);
+		if(it != nameIndices.end())
+			return it->second;
+
+		names.push_back(name);
+		nameIndices[name] = (UINT32)names.size() - 1;
+		return (UINT32)names.size() - 1;
+	};
+
+	std::vector<SceneFile::Material> materials;
+	std::unordered_map<std::string, UINT32> materialIndices;
+	std::vector<SceneFile::Region> regions;
+	std::unordered_map<std::string, UINT32> regionIndices;
+	std::vector<SceneFile::Item> items;
+	std::vector<SceneFile::Transform> transforms;
+
+	// Set between an instanced line and its end line.
+	bool inInstanced = false;
+
+	std::istringstream lines(source);
+	std::string line;
+	UINT lineNumber = 0;
+	while(std::getline(lines, line))
+	{
+		++lineNumber;
+
+		std::istringstream tokens(line.substr(0, line.find('#')));
+		std::string keyword;
+		if(!(tokens >> keyword))
+			continue;
+
+		if(inInstanced && keyword != "instance" && keyword != "end")
+			SyntaxError(sourceFilename, lineNumber, L"expected instance or end");
+
+		if(keyword == "material")
+		{
+			std::string name;
+			SceneFile::Material material = {};
+			if(!(tokens >> name >> material.DiffuseSrvHeapIndex) ||
+				!ReadFloats(tokens, &material.DiffuseAlbedo.x, 4) ||
+				!ReadFloats(tokens, &material.FresnelR0.x, 3) ||
+				!(tokens >> material.Roughness) || !ReadOptions(tokens, nullptr, nullptr))
+				SyntaxError(sourceFilename, lineNumber, L"bad material");
+
+			if(materialIndices.count(name) != 0)
+				SyntaxError(sourceFilename, lineNumber, L"material declared twice");
+
+			material.Name = nameIndex(name);
+			materialIndices[name] = (UINT32)materials.size();
+			materials.push_back(material);
+		}
+		else if(keyword == "region")
+		{
+			std::string name;
+			SceneFile::Region region = {};
+			if(!(tokens >> name) || !ReadFloats(tokens, &region.Center.x, 3) ||
+				!ReadFloats(tokens, &region.Extents.x, 3) || !ReadOptions(tokens, nullptr, nullptr))
+				SyntaxError(sourceFilename, lineNumber, L"bad region");
+
+			if(regionIndices.count(name) != 0)
+				SyntaxError(sourceFilename, lineNumber, L"region declared twice");
+
+			region.Name = nameIndex(name);
+			region.FirstItem = (UINT32)items.size();
+			region.ItemCount = 0;
+			regionIndices[name] = (UINT32)regions.size();
+			regions.push_back(region);
+		}
+		else if(keyword == "item" || keyword == "instanced")
+		{
+			const bool instanced = keyword == "instanced";
+			if(regions.empty())
+				SyntaxError(sourceFilename, lineNumber, L"item outside a region");
+
+			std::string layer, geometry, submesh, material;
+			if(!(tokens >> layer >> geometry >> submesh >> material))
+				SyntaxError(sourceFilename, lineNumber, L"bad item");
+
+			auto it = materialIndices.find(material);
+			if(it == materialIndices.end())
+				SyntaxError(sourceFilename, lineNumber, L"undeclared material");
+
+			SceneFile::Transform transform = {};
+			transform.TexScale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+			bool occluder = false;
+			if(!instanced)
+			{
+				if(!ReadFloats(tokens, &transform.Scale.x, 3) || !ReadFloats(tokens, &transform.Translation.x, 3))
+					SyntaxError(sourceFilename, lineNumber, L"bad item transform");
+			}
+			if(!ReadOptions(tokens, instanced ? nullptr : &transform.TexScale, &occluder))
+				SyntaxError(sourceFilename, lineNumber, L"bad item option");
+
+			SceneFile::Item item = {};
+			item.Layer = nameIndex(layer);
+			item.Geometry = nameIndex(geometry);
+			item.Submesh = nameIndex(submesh);
+			item.Material = it->second;
+			item.Flags = (occluder ? SceneFile::ItemOccluder : 0) | (instanced ? SceneFile::ItemInstanced : 0);
+			item.FirstTransform = (UINT32)transforms.size();
+			item.TransformCount = instanced ? 0 : 1;
+			items.push_back(item);
+			regions.back().ItemCount++;
+
+			if(instanced)
+				inInstanced = true;
+			else
+				transforms.push_back(transform);
+		}
+		else if(keyword == "instance")
+		{
+			if(!inInstanced)
+				SyntaxError(sourceFilename, lineNumber, L"instance outside an instanced item");
+
+			SceneFile::Transform transform = {};
+			transform.TexScale = XMFLOAT3(1.0f, 1.0f, 1.0f);
+			if(!ReadFloats(tokens, &transform.Scale.x, 3) || !ReadFloats(tokens, &transform.Translation.x, 3) ||
+				!ReadOptions(tokens, &transform.TexScale, nullptr))
+				SyntaxError(sourceFilename, lineNumber, L"bad instance");
+
+			transforms.push_back(transform);
+			items.back().TransformCount++;
+		}
+		else if(keyword == "end")
+		{
+			if(!inInstanced)
+				SyntaxError(sourceFilename, lineNumber, L"end outside an instanced item");
+			if(items.back().TransformCount == 0)
+				SyntaxError(sourceFilename, lineNumber, L"instanced item without instances");
+
+			inInstanced = false;
+		}
+		else
+		{
+			SyntaxError(sourceFilename, lineNumber, L"unknown keyword");
+		}
+	}
+
+	if(inInstanced)
+		SyntaxError(sourceFilename, lineNumber, L"missing end");
+
+	// Names are packed back to back and the table padded, so every array that follows
+	// stays 4 byte aligned.
+	std::vector<UINT32> nameOffsets;
+	std::string nameBytes;
+	for(auto& name : names)
+	{
+		nameOffsets.push_back((UINT32)nameBytes.size());
+		nameBytes += name;
+		nameBytes += '\0';
+	}
+	if(nameBytes.empty())
+		nameBytes += '\0';
+	while(nameBytes.size() % 4 != 0)
+		nameBytes += '\0';
+
+	SceneFile::Header header = {};
+	header.Magic = SceneFile::Magic;
+	header.Version = SceneFile::Version;
+	header.SourceHash = d3dUtil::HashBytes(source.data(), source.size());
+	header.NameCount = (UINT32)names.size();
+	header.MaterialCount = (UINT32)materials.size();
+	header.RegionCount = (UINT32)regions.size();
+	header.ItemCount = (UINT32)items.size();
+	header.TransformCount = (UINT32)transforms.size();
+	header.NamesByteSize = (UINT32)nameBytes.size();
+
+	std::vector<BYTE> bytes(sizeof(SceneFile::Header));
+	header.NameOffsetsOffset = Append(bytes, nameOffsets.data(), nameOffsets.size());
+	header.NamesOffset = Append(bytes, nameBytes.data(), nameBytes.size());
+	header.MaterialsOffset = Append(bytes, materials.data(), materials.size());
+	header.RegionsOffset = Append(bytes, regions.data(), regions.size());
+	header.ItemsOffset = Append(bytes, items.data(), items.size());
+	header.TransformsOffset = Append(bytes, transforms.data(), transforms.size());
+	header.FileSize = (UINT32)bytes.size();
+	CopyMemory(bytes.data(), &header, sizeof(header));
+
+	ComPtr<ID3DBlob> blob;
+	ThrowIfFailed(D3DCreateBlob(bytes.size(), &blob));
+	CopyMemory(blob->GetBufferPointer(), bytes.data(), bytes.size());
+	d3dUtil::SaveBinary(sceneFilename, blob.Get());
+}
@@ -0,0 +1,46 @@
+//***************************************************************************************
+// SceneCompiler.h
+//
+// Compiles a text scene source to a SceneFile.  The source is a list of lines; '#'
+// starts a comment.
+//
+//   material <name> <srv heap slot> <albedo r g b a> <fresnel r g b> <roughness>
+//   region <name> <center x y z> <extents x y z>
+//   item <layer> <geometry> <submesh> <material> <scale x y z> <position x y z>
+//       [tex <x y z>] [occluder]
+//   instanced <layer> <geometry> <submesh> <material> [occluder]
+//   instance <scale x y z> <position x y z> [tex <x y z>]
+//   end
+//
+// A material's srv heap slot is the position of its diffuse texture among the app's
+// textures, counted from the start of their SRV range.  Items belong to the region
+// above them.  An instanced item takes the instance lines up to its end line.
+// Materials must be declared before the items that use them; layer, geometry and
+// submesh names are resolved, and srv heap slots checked, by the app when it loads
+// the scene.
+//***************************************************************************************
+
+#ifndef SCENECOMPILER_H
+#define SCENECOMPILER_H
+
+#include "../../Common/d3dUtil.h"
+
+class SceneCompiler
+{
+public:
+	// Compiles sourceFilename to sceneFilename.  Syntax errors are written to the
+	// debugger output with their line, then thrown.
+	static void Compile(const std::wstring& sourceFilename, const std::wstring& sceneFilename);
+
+	// Compiles the scene unless it is up to date with its source.  A missing source
+	// leaves the scene as it is, so a shipped scene does not need its source.  Returns
+	// whether the scene was compiled.
+	static bool CompileIfStale(const std::wstring& sourceFilename, const std::wstring& sceneFilename);
+
+private:
+	static std::string ReadSource(const std::wstring& sourceFilename);
+	static void CompileSource(const std::string& source, const std::wstring& sourceFilename,
+		const std::wstring& sceneFilename);
+};
+
+#endif // SCENECOMPILER_H
@@ -0,0 +1,164 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+
+using namespace DirectX;
+
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+void SceneFile::Open(const std::wstring& filename)
+{
+	Close();
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(mFile == INVALID_HANDLE_VALUE)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	LARGE_INTEGER fileSize = {};
+	if(!GetFileSizeEx(mFile, &fileSize))
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	if((UINT64)fileSize.QuadPart < sizeof(Header))
+	{
+		Close();
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	mView = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if(mView == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	if(!Validate((UINT64)fileSize.QuadPart))
+	{
+		Close();
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+	}
+}
+
+void SceneFile::Close()
+{
+	if(mView != nullptr)
+		UnmapViewOfFile(mView);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mView = nullptr;
+	mMapping = nullptr;
+	mFile = INVALID_HANDLE_VALUE;
+}
+
+const SceneFile::Header& SceneFile::GetHeader()const
+{
+	assert(mView != nullptr);
+	return *Array<Header>(0);
+}
+
+const char* SceneFile::Name(UINT32 name)const
+{
+	assert(name < GetHeader().NameCount);
+	return Array<char>(GetHeader().NamesOffset) + Array<UINT32>(GetHeader().NameOffsetsOffset)[name];
+}
+
+const SceneFile::Material* SceneFile::Materials()const
+{
+	return Array<Material>(GetHeader().MaterialsOffset);
+}
+
+const SceneFile::Region* SceneFile::Regions()const
+{
+	return Array<Region>(GetHeader().RegionsOffset);
+}
+
+const SceneFile::Item* SceneFile::Items()const
+{
+	return Array<Item>(GetHeader().ItemsOffset);
+}
+
+const SceneFile::Transform* SceneFile::Transforms()const
+{
+	return Array<Transform>(GetHeader().TransformsOffset);
+}
+
+XMMATRIX SceneFile::World(const Transform& transform)
+{
+	return XMMatrixScaling(transform.Scale.x, transform.Scale.y, transform.Scale.z) *
+		XMMatrixTranslation(transform.Translation.x, transform.Translation.y, transform.Translation.z);
+}
+
+XMMATRIX SceneFile::TexTransform(const Transform& transform)
+{
+	return XMMatrixScaling(transform.TexScale.x, transform.TexScale.y, transform.TexScale.z);
+}
+
+bool SceneFile::Validate(UINT64 fileSize)const
+{
+	const Header& header = GetHeader();
+	if(header.Magic != Magic || header.Version != Version || header.FileSize != fileSize)
+		return false;
+
+	// Sizes are computed in 64 bits, so a corrupt count cannot wrap around.
+	auto inFile = [fileSize](UINT32 offset, UINT32 count, size_t stride)
+	{
+		return offset % 4 == 0 && (UINT64)offset + (UINT64)count * stride <= fileSize;
+	};
+
+	if(!inFile(header.NameOffsetsOffset, header.NameCount, sizeof(UINT32)) ||
+		!inFile(header.NamesOffset, header.NamesByteSize, 1) ||
+		!inFile(header.MaterialsOffset, header.MaterialCount, sizeof(Material)) ||
+		!inFile(header.RegionsOffset, header.RegionCount, sizeof(Region)) ||
+		!inFile(header.ItemsOffset, header.ItemCount, sizeof(Item)) ||
+		!inFile(header.TransformsOffset, header.TransformCount, sizeof(Transform)))
+		return false;
+
+	// Every name must start inside the table, which must end with a terminator.
+	const char* names = Array<char>(header.NamesOffset);
+	if(header.NamesByteSize == 0 || names[header.NamesByteSize - 1] != '\0')
+		return false;
+
+	const UINT32* nameOffsets = Array<UINT32>(header.NameOffsetsOffset);
+	for(UINT32 i = 0; i < header.NameCount; ++i)
+	{
+		if(nameOffsets[i] >= header.NamesByteSize)
+			return false;
+	}
+
+	for(UINT32 i = 0; i < header.MaterialCount; ++i)
+	{
+		if(Materials()[i].Name >= header.NameCount)
+			return false;
+	}
+
+	for(UINT32 i = 0; i < header.RegionCount; ++i)
+	{
+		const Region& region = Regions()[i];
+		if(region.Name >= header.NameCount ||
+			(UINT64)region.FirstItem + region.ItemCount > header.ItemCount)
+			return false;
+	}
+
+	for(UINT32 i = 0; i < header.ItemCount; ++i)
+	{
+		const Item& item = Items()[i];
+		if(item.Layer >= header.NameCount || item.Geometry >= header.NameCount ||
+			item.Submesh >= header.NameCount || item.Material >= header.MaterialCount ||
+			(UINT64)item.FirstTransform + item.TransformCount > header.TransformCount)
+			return false;
+
+		if((item.Flags & ItemInstanced) == 0 && item.TransformCount != 1)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,137 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Compact binary scene, memory-mapped and read in place.  A scene holds its materials
+// and a list of regions.  Every region owns a contiguous range of items and every item
+// a contiguous range of transforms: one for a plain item, one per instance for an
+// instanced one.  Layers, geometries and submeshes are referenced by name through a
+// string table, so a scene does not depend on the app's enum values or load order.
+// Region bounds let the app load the regions near the camera first.
+//
+// Scene files are compiled from a text source by SceneCompiler.
+//***************************************************************************************
+
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include "../../Common/d3dUtil.h"
+
+class SceneFile
+{
+public:
+	static const UINT32 Magic = 0x314e4353; // "SCN1"
+	static const UINT32 Version = 1;
+
+	enum ItemFlags : UINT32
+	{
+		ItemOccluder = 0x1,
+		ItemInstanced = 0x2,
+	};
+
+	// The file starts with the header, followed by the arrays it points to.  Offsets
+	// are in bytes from the start of the file and aligned to 4 bytes.
+	struct Header
+	{
+		UINT32 Magic;
+		UINT32 Version;
+
+		// Hash of the text source, so a stale scene can be recompiled.
+		UINT64 SourceHash;
+		UINT32 FileSize;
+
+		UINT32 NameCount;
+		UINT32 MaterialCount;
+		UINT32 RegionCount;
+		UINT32 ItemCount;
+		UINT32 TransformCount;
+
+		// NameOffsets holds one offset into Names per name; names are null terminated.
+		UINT32 NameOffsetsOffset;
+		UINT32 NamesOffset;
+		UINT32 NamesByteSize;
+		UINT32 MaterialsOffset;
+		UINT32 RegionsOffset;
+		UINT32 ItemsOffset;
+		UINT32 TransformsOffset;
+	};
+
+	struct Material
+	{
+		UINT32 Name;
+		INT32 DiffuseSrvHeapIndex;
+		DirectX::XMFLOAT4 DiffuseAlbedo;
+		DirectX::XMFLOAT3 FresnelR0;
+		float Roughness;
+	};
+
+	struct Region
+	{
+		UINT32 Name;
+		DirectX::XMFLOAT3 Center;
+		DirectX::XMFLOAT3 Extents;
+		UINT32 FirstItem;
+		UINT32 ItemCount;
+	};
+
+	struct Item
+	{
+		// Names of the render layer, geometry and submesh, and index of the material.
+		UINT32 Layer;
+		UINT32 Geometry;
+		UINT32 Submesh;
+		UINT32 Material;
+
+		UINT32 Flags;
+		UINT32 FirstTransform;
+
+		// 1 unless the item is instanced.
+		UINT32 TransformCount;
+	};
+
+	// World is the scaling followed by the translation; the texture transform is a
+	// scaling.
+	struct Transform
+	{
+		DirectX::XMFLOAT3 Scale;
+		DirectX::XMFLOAT3 Translation;
+		DirectX::XMFLOAT3 TexScale;
+	};
+
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+	~SceneFile();
+
+	// Maps filename.  Throws if it cannot be opened or is not a valid scene of this
+	// version.
+	void Open(const std::wstring& filename);
+	void Close();
+
+	const Header& GetHeader()const;
+	const char* Name(UINT32 name)const;
+
+	const Material* Materials()const;
+	const Region* Regions()const;
+	const Item* Items()const;
+	const Transform* Transforms()const;
+
+	static DirectX::XMMATRIX World(const Transform& transform);
+	static DirectX::XMMATRIX TexTransform(const Transform& transform);
+
+private:
+	template<typename T>
+	const T* Array(UINT32 offset)const
+	{
+		return reinterpret_cast<const T*>(mView + offset);
+	}
+
+	// Checks that the arrays lie in the file and every index is in range.
+	bool Validate(UINT64 fileSize)const;
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mView = nullptr;
+};
+
+#endif // SCENEFILE_H
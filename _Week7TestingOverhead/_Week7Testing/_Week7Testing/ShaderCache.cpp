@@ -0,0 +1,179 @@
+//***************************************************************************************
+// ShaderCache.cpp
+//***************************************************************************************
+
+#include "ShaderCache.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <ppl.h>
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+
+ShaderCache::ShaderCache(const std::wstring& cacheDirectory)
+	: mCacheDirectory(cacheDirectory)
+{
+	if(!CreateDirectoryW(mCacheDirectory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+void ShaderCache::Add(const std::string& name, const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+	const std::string& entrypoint, const std::string& target)
+{
+	Entry entry;
+	entry.Name = name;
+	entry.Filename = filename;
+	for(const D3D_SHADER_MACRO* define = defines; define != nullptr && define->Name != nullptr; ++define)
+		entry.Defines.push_back({ define->Name, define->Definition != nullptr ? define->Definition : "" });
+	entry.Entrypoint = entrypoint;
+	entry.Target = target;
+	mEntries.push_back(entry);
+}
+
+void ShaderCache::Build(std::unordered_map<std::string, ComPtr<ID3DBlob>>& shaders)
+{
+#if defined(DEBUG) || defined(_DEBUG)
+	const std::string configuration = "debug";
+#else
+	const std::string configuration = "release";
+#endif
+
+	// Keys are computed up front, as the source hashes are shared between shaders.
+	mSourceHashes.clear();
+	std::vector<UINT64> keys(mEntries.size());
+	for(size_t i = 0; i < mEntries.size(); ++i)
+	{
+		const Entry& entry = mEntries[i];
+
+		std::vector<std::wstring> visited;
+		UINT64 key = HashSource(entry.Filename, visited);
+		for(auto& define : entry.Defines)
+		{
+			// Separators keep e.g. ("AB", "") and ("A", "B") apart.
+			std::string text = define.first + "=" + define.second + ";";
+			key = d3dUtil::HashBytes(text.data(), text.size(), key);
+		}
+		std::string text = entry.Entrypoint + ";" + entry.Target + ";" + configuration;
+		keys[i] = d3dUtil::HashBytes(text.data(), text.size(), key);
+	}
+
+	std::vector<ComPtr<ID3DBlob>> blobs(mEntries.size());
+	std::atomic<UINT> loadedCount(0);
+	concurrency::parallel_for(0, (int)mEntries.size(), [&](int i)
+	{
+		const Entry& entry = mEntries[i];
+		const std::wstring blobFilename = BlobFilename(entry, keys[i]);
+
+		if(GetFileAttributesW(blobFilename.c_str()) != INVALID_FILE_ATTRIBUTES)
+		{
+			blobs[i] = d3dUtil::LoadBinary(blobFilename);
+			if(blobs[i]->GetBufferSize() > 0)
+			{
+				loadedCount++;
+				return;
+			}
+		}
+
+		std::vector<D3D_SHADER_MACRO> defines;
+		for(auto& define : entry.Defines)
+			defines.push_back({ define.first.c_str(), define.second.c_str() });
+		defines.push_back({ nullptr, nullptr });
+
+		blobs[i] = d3dUtil::CompileShader(entry.Filename, defines.data(), entry.Entrypoint, entry.Target);
+
+		RemoveStaleBlobs(entry, blobFilename);
+		d3dUtil::SaveBinary(blobFilename, blobs[i].Get());
+	});
+
+	for(size_t i = 0; i < mEntries.size(); ++i)
+		shaders[mEntries[i].Name] = blobs[i];
+
+	mLoadedCount = loadedCount;
+	mCompiledCount = (UINT)mEntries.size() - mLoadedCount;
+	mEntries.clear();
+}
+
+UINT ShaderCache::LoadedCount()const
+{
+	return mLoadedCount;
+}
+
+UINT ShaderCache::CompiledCount()const
+{
+	return mCompiledCount;
+}
+
+UINT64 ShaderCache::HashSource(const std::wstring& filename, std::vector<std::wstring>& visited)
+{
+	// Guards against include cycles; the compiler reports those itself.
+	if(std::find(visited.begin(), visited.end(), filename) != visited.end())
+		return 0;
+	visited.push_back(filename);
+
+	auto it = mSourceHashes.find(filename);
+	if(it != mSourceHashes.end())
+		return it->second;
+
+	std::ifstream fin(filename, std::ios::binary);
+	std::string source((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+	std::wstring filenameText(filename);
+	UINT64 hash = d3dUtil::HashBytes(filenameText.data(), filenameText.size() * sizeof(wchar_t));
+	hash = d3dUtil::HashBytes(source.data(), source.size(), hash);
+
+	// Includes are resolved against the including file's directory, as
+	// D3D_COMPILE_STANDARD_FILE_INCLUDE does.
+	const size_t slash = filename.find_last_of(L"\\/");
+	const std::wstring directory = slash == std::wstring::npos ? L"" : filename.substr(0, slash + 1);
+
+	std::istringstream lines(source);
+	std::string line;
+	while(std::getline(lines, line))
+	{
+		const size_t directive = line.find_first_not_of(" \t");
+		if(directive == std::string::npos || line.compare(directive, 8, "#include") != 0)
+			continue;
+
+		const size_t open = line.find('"', directive + 8);
+		const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if(close == std::string::npos)
+			continue;
+
+		const std::string include = line.substr(open + 1, close - open - 1);
+		UINT64 includeHash = HashSource(directory + std::wstring(include.begin(), include.end()), visited);
+		hash = d3dUtil::HashBytes(&includeHash, sizeof(includeHash), hash);
+	}
+
+	mSourceHashes[filename] = hash;
+	return hash;
+}
+
+void ShaderCache::RemoveStaleBlobs(const Entry& entry, const std::wstring& blobFilename)const
+{
+	const std::wstring directory = mCacheDirectory + L"\\";
+	const std::wstring pattern = directory + std::wstring(entry.Name.begin(), entry.Name.end()) + L"_*.cso";
+
+	WIN32_FIND_DATAW findData;
+	HANDLE find = FindFirstFileW(pattern.c_str(), &findData);
+	if(find == INVALID_HANDLE_VALUE)
+		return;
+
+	do
+	{
+		const std::wstring filename = directory + findData.cFileName;
+		if(filename != blobFilename)
+			DeleteFileW(filename.c_str());
+	} while(FindNextFileW(find, &findData));
+
+	FindClose(find);
+}
+
+std::wstring ShaderCache::BlobFilename(const Entry& entry, UINT64 key)const
+{
+	std::wostringstream filename;
+	filename << mCacheDirectory << L"\\" << std::wstring(entry.Name.begin(), entry.Name.end())
+		<< L"_" << std::hex << std::setw(16) << std::setfill(L'0') << key << L".cso";
+	return filename.str();
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// ShaderCache.h
+//
+// Compiled shader bytecode kept on disk between runs.  Every shader is keyed by a hash
+// of its source file and the files it includes, its defines, entry point, target and
+// build configuration, and its blob is stored in the cache directory under its name
+// and key.  A blob whose key matches is loaded with d3dUtil::LoadBinary; any change to
+// the key compiles the shader again, saves its blob and deletes the one saved under the
+// old key.  Shaders are loaded or compiled on worker threads.
+//***************************************************************************************
+
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include "../../Common/d3dUtil.h"
+
+class ShaderCache
+{
+public:
+	// cacheDirectory is created if it does not exist.
+	explicit ShaderCache(const std::wstring& cacheDirectory);
+	ShaderCache(const ShaderCache& rhs) = delete;
+	ShaderCache& operator=(const ShaderCache& rhs) = delete;
+	~ShaderCache() = default;
+
+	// Queues a shader for Build, with the same arguments as d3dUtil::CompileShader.
+	// defines may be null and is copied.
+	void Add(const std::string& name, const std::wstring& filename, const D3D_SHADER_MACRO* defines,
+		const std::string& entrypoint, const std::string& target);
+
+	// Loads or compiles every queued shader into shaders under its name, then empties
+	// the queue.  Throws if a shader fails to compile.
+	void Build(std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3DBlob>>& shaders);
+
+	// Shaders of the last Build that were loaded from the cache and that were compiled.
+	UINT LoadedCount()const;
+	UINT CompiledCount()const;
+
+private:
+	struct Entry
+	{
+		std::string Name;
+		std::wstring Filename;
+		std::vector<std::pair<std::string, std::string>> Defines;
+		std::string Entrypoint;
+		std::string Target;
+	};
+
+	// Hash of filename's text and, recursively, of the files it includes with quotes.
+	UINT64 HashSource(const std::wstring& filename, std::vector<std::wstring>& visited);
+
+	std::wstring BlobFilename(const Entry& entry, UINT64 key)const;
+
+	// Deletes the blobs saved for entry under keys other than blobFilename's.
+	void RemoveStaleBlobs(const Entry& entry, const std::wstring& blobFilename)const;
+
+private:
+	std::wstring mCacheDirectory;
+	std::vector<Entry> mEntries;
+
+	// Source hashes by file, so a file shared by several shaders is read once per Build.
+	std::unordered_map<std::wstring, UINT64> mSourceHashes;
+
+	UINT mLoadedCount = 0;
+	UINT mCompiledCount = 0;
+};
+
+#endif // SHADERCACHE_H
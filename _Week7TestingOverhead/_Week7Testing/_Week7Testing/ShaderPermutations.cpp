@@ -0,0 +1,202 @@
+//***************************************************************************************
+// ShaderPermutations.cpp
+//***************************************************************************************
+
+#include "ShaderPermutations.h"
+#include "ShaderCache.h"
+#include <iomanip>
+#include <sstream>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	struct FeatureDefine
+	{
+		UINT Feature;
+		const char* Define;
+	};
+
+	const FeatureDefine gFeatureDefines[] =
+	{
+		{ ShaderPermutations::Fog, "FOG" },
+		{ ShaderPermutations::AlphaTest, "ALPHA_TEST" },
+		{ ShaderPermutations::Instanced, "INSTANCED" },
+		{ ShaderPermutations::DisplacementMap, "DISPLACEMENT_MAP" },
+		{ ShaderPermutations::MinLodClamp, "MIN_LOD_CLAMP" },
+		{ ShaderPermutations::NoPointLights, "NO_POINT_LIGHTS" },
+		{ ShaderPermutations::NoSpotLights, "NO_SPOT_LIGHTS" },
+		{ ShaderPermutations::DepthOnly, "DEPTH_ONLY" },
+	};
+
+	// The features take the low 16 bits of a key, and the directional light count plus
+	// one, or zero for none fixed, the bits above.
+	const UINT gDirLightCountShift = 16;
+}
+
+UINT ShaderPermutations::MakeKey(UINT features)
+{
+	assert(features < (1u << gDirLightCountShift));
+
+	return features;
+}
+
+UINT ShaderPermutations::MakeKey(UINT features, UINT dirLightCount)
+{
+	assert(features < (1u << gDirLightCountShift));
+	assert(dirLightCount <= MaxSpecializedDirLights);
+
+	return features | ((dirLightCount + 1) << gDirLightCountShift);
+}
+
+ShaderPermutations::ShaderPermutations(const std::wstring& cacheDirectory)
+	: mCacheDirectory(cacheDirectory)
+{
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	mRequests.wait();
+}
+
+void ShaderPermutations::AddProgram(const std::string& name, const std::wstring& filename,
+	const std::string& entrypoint, const std::string& target)
+{
+	Program program;
+	program.Filename = filename;
+	program.Entrypoint = entrypoint;
+	program.Target = target;
+	mPrograms[name] = program;
+}
+
+void ShaderPermutations::Compile(const std::vector<Variant>& variants)
+{
+	ShaderCache cache(mCacheDirectory);
+	CompileVariants(variants, cache);
+
+	mLoadedCount = cache.LoadedCount();
+	mCompiledCount = cache.CompiledCount();
+}
+
+ComPtr<ID3DBlob> ShaderPermutations::Get(const std::string& program, UINT key)
+{
+	const std::string name = VariantName(program, key);
+
+	// Compiling the variant here as well would race the request for its blob file.
+	bool requested = false;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mVariants.find(name);
+		requested = it != mVariants.end() && it->second.State == VariantState::Compiling;
+	}
+	if(requested)
+		mRequests.wait();
+
+	ShaderCache cache(mCacheDirectory);
+	CompileVariants({ { program, key } }, cache);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mVariants[name].Blob;
+}
+
+ComPtr<ID3DBlob> ShaderPermutations::Request(const std::string& program, UINT key)
+{
+	const std::string name = VariantName(program, key);
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		auto it = mVariants.find(name);
+		if(it != mVariants.end())
+			return it->second.State == VariantState::Ready ? it->second.Blob : nullptr;
+
+		mVariants[name].State = VariantState::Compiling;
+	}
+
+	mRequests.run([this, program, key, name]()
+	{
+		try
+		{
+			ShaderCache cache(mCacheDirectory);
+			CompileVariants({ { program, key } }, cache);
+		}
+		catch(DxException& e)
+		{
+			OutputDebugString((L"Shader variant failed to compile: " + e.ToString() + L"\n").c_str());
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			mVariants[name].State = VariantState::Failed;
+		}
+	});
+
+	return nullptr;
+}
+
+bool ShaderPermutations::Failed(const std::string& program, UINT key)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	auto it = mVariants.find(VariantName(program, key));
+	return it != mVariants.end() && it->second.State == VariantState::Failed;
+}
+
+UINT ShaderPermutations::LoadedCount()const
+{
+	return mLoadedCount;
+}
+
+UINT ShaderPermutations::CompiledCount()const
+{
+	return mCompiledCount;
+}
+
+void ShaderPermutations::CompileVariants(const std::vector<Variant>& variants, ShaderCache& cache)
+{
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for(auto& variant : variants)
+		{
+			const std::string name = VariantName(variant.Program, variant.Key);
+
+			auto it = mVariants.find(name);
+			if(it != mVariants.end() && it->second.State == VariantState::Ready)
+				continue;
+
+			const Program& program = mPrograms.at(variant.Program);
+
+			std::vector<D3D_SHADER_MACRO> defines;
+			for(auto& featureDefine : gFeatureDefines)
+			{
+				if((variant.Key & featureDefine.Feature) != 0)
+					defines.push_back({ featureDefine.Define, "1" });
+			}
+
+			const UINT dirLightField = variant.Key >> gDirLightCountShift;
+			const std::string dirLightCount = std::to_string(dirLightField - 1);
+			if(dirLightField > 0)
+				defines.push_back({ "NUM_DIR_LIGHTS", dirLightCount.c_str() });
+			defines.push_back({ nullptr, nullptr });
+
+			// Add copies the defines.
+			cache.Add(name, program.Filename, defines.data(), program.Entrypoint, program.Target);
+			names.push_back(name);
+		}
+	}
+
+	std::unordered_map<std::string, ComPtr<ID3DBlob>> blobs;
+	cache.Build(blobs);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	for(auto& name : names)
+	{
+		VariantEntry& entry = mVariants[name];
+		entry.State = VariantState::Ready;
+		entry.Blob = blobs[name];
+	}
+}
+
+std::string ShaderPermutations::VariantName(const std::string& program, UINT key)
+{
+	std::ostringstream name;
+	name << program << "_" << std::hex << std::setw(8) << std::setfill('0') << key;
+	return name.str();
+}
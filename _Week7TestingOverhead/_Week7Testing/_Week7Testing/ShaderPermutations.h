@@ -0,0 +1,124 @@
+//***************************************************************************************
+// ShaderPermutations.h
+//
+// Variants of the shader programs, keyed on feature bits and, for the lit pixel
+// shaders, a directional light count fixed at compile time.  Every feature sets a
+// define of the program, so a variant only pays for the features it uses and the
+// light loops of a specialized variant only visit the lights the scene has.
+// Variants are compiled through ShaderCache, either up front in a batch or lazily on a
+// background task, while the caller keeps drawing with a more general variant.
+//***************************************************************************************
+
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include "../../Common/d3dUtil.h"
+#include <map>
+#include <mutex>
+#include <ppl.h>
+
+class ShaderCache;
+
+class ShaderPermutations
+{
+public:
+	// Feature bits of a key and the define each one sets.
+	enum Feature : UINT
+	{
+		Fog             = 0x01, // FOG
+		AlphaTest       = 0x02, // ALPHA_TEST
+		Instanced       = 0x04, // INSTANCED
+		DisplacementMap = 0x08, // DISPLACEMENT_MAP
+		MinLodClamp     = 0x10, // MIN_LOD_CLAMP
+		NoPointLights   = 0x20, // NO_POINT_LIGHTS
+		NoSpotLights    = 0x40, // NO_SPOT_LIGHTS
+		DepthOnly       = 0x80, // DEPTH_ONLY
+	};
+
+	// Scenes with more directional lights than this use a variant that loops over the
+	// count in the pass constants.
+	static const UINT MaxSpecializedDirLights = 4;
+
+	// Key of a variant that takes the light counts from the pass constants, and of one
+	// with dirLightCount fixed at compile time (NUM_DIR_LIGHTS).
+	static UINT MakeKey(UINT features);
+	static UINT MakeKey(UINT features, UINT dirLightCount);
+
+	explicit ShaderPermutations(const std::wstring& cacheDirectory);
+	ShaderPermutations(const ShaderPermutations& rhs) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations& rhs) = delete;
+
+	// Waits for the variants still compiling.
+	~ShaderPermutations();
+
+	// Programs must all be added before the first Compile, Get or Request.
+	void AddProgram(const std::string& name, const std::wstring& filename,
+		const std::string& entrypoint, const std::string& target);
+
+	struct Variant
+	{
+		std::string Program;
+		UINT Key = 0;
+	};
+
+	// Compiles the given variants that are not ready yet, in parallel, before returning.
+	// Throws if one fails to compile.
+	void Compile(const std::vector<Variant>& variants);
+
+	// The variant, compiled first if it is not ready yet.
+	Microsoft::WRL::ComPtr<ID3DBlob> Get(const std::string& program, UINT key);
+
+	// The variant if it is ready.  Otherwise its compilation is started on a background
+	// task, if it is not already running, and null is returned.  A variant that failed
+	// to compile stays null.
+	Microsoft::WRL::ComPtr<ID3DBlob> Request(const std::string& program, UINT key);
+
+	// Whether the variant failed to compile.
+	bool Failed(const std::string& program, UINT key);
+
+	// Variants of the last Compile that were loaded from the shader cache and that were
+	// compiled.
+	UINT LoadedCount()const;
+	UINT CompiledCount()const;
+
+private:
+	struct Program
+	{
+		std::wstring Filename;
+		std::string Entrypoint;
+		std::string Target;
+	};
+
+	enum class VariantState
+	{
+		Compiling,
+		Ready,
+		Failed
+	};
+
+	struct VariantEntry
+	{
+		VariantState State = VariantState::Compiling;
+		Microsoft::WRL::ComPtr<ID3DBlob> Blob = nullptr;
+	};
+
+	// Compiles the variants not already ready into mVariants through cache.
+	void CompileVariants(const std::vector<Variant>& variants, ShaderCache& cache);
+
+	static std::string VariantName(const std::string& program, UINT key);
+
+private:
+	std::wstring mCacheDirectory;
+	std::map<std::string, Program> mPrograms;
+
+	// By VariantName.  Guarded by mMutex, as Request fills it from the background.
+	std::map<std::string, VariantEntry> mVariants;
+	std::mutex mMutex;
+
+	concurrency::task_group mRequests;
+
+	UINT mLoadedCount = 0;
+	UINT mCompiledCount = 0;
+};
+
+#endif // SHADERPERMUTATIONS_H
@@ -4,23 +4,18 @@
 // Default shader, currently supports lighting.
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-    #define NUM_DIR_LIGHTS 3
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 9
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 0
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
-Texture2D    gDiffuseMap : register(t0);
+// The textures at the start of the SRV heap, indexed by the heap slot the material
+// supplies.  The slot is the same for a whole draw, so it needs no
+// NonUniformResourceIndex.  Same size as gTextureTableSize in the app.
+Texture2D    gTextureMaps[60] : register(t0, space2);
+
+#ifdef DISPLACEMENT_MAP
+// Wave heights from the GPU wave simulation.
+Texture2D    gDisplacementMap : register(t1);
+#endif
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -30,11 +25,22 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
+struct ObjectData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+	float2   DisplacementMapTexelSize;
+	float    GridSpatialStep;
+	uint     MaterialIndex;
+};
+
+// Per-object data of every render item, packed back to back.  The draw sets the
+// index of its item as a root constant.
+StructuredBuffer<ObjectData> gObjectData : register(t4, space1);
+
 cbuffer cbPerObject : register(b0)
 {
-    float4x4 gWorld;
-	float4x4 gTexTransform;
+	uint gObjectIndex;
 };
 
 // Constant data that varies per material.
@@ -61,21 +67,48 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+    // Light counts for gLights.  Indices [0, gNumDirLights) are directional lights,
+    // the next gNumPointLights are point lights and the next gNumSpotLights are spot lights.
+    uint gNumDirLights;
+    uint gNumPointLights;
+    uint gNumSpotLights;
+    uint cbPerObjectPad3;
+};
+
+// Scene lights, uploaded by LightManager.  A structured buffer rather than a cbuffer
+// array so the light count is not limited to MaxLights.
+StructuredBuffer<Light> gLights : register(t1, space1);
+
+// Per-cluster light lists built by LightCulling.hlsl.
+StructuredBuffer<uint> gClusterLightCounts  : register(t2, space1);
+StructuredBuffer<uint> gClusterLightIndices : register(t3, space1);
+
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+    float3   FresnelR0;
+    float    Roughness;
+	float4x4 MatTransform;
+	float    MinLod;
+	uint     DiffuseMapIndex;
+	float2   MatPad0;
 };
 
-cbuffer cbMaterial : register(b2)
+// Every material, indexed by the MaterialIndex of the item's object data.
+StructuredBuffer<MaterialData> gMaterialData : register(t5, space1);
+
+#ifdef INSTANCED
+struct InstanceData
 {
-	float4   gDiffuseAlbedo;
-    float3   gFresnelR0;
-    float    gRoughness;
-	float4x4 gMatTransform;
+	float4x4 World;
+	float4x4 TexTransform;
 };
 
+// Per-instance data for hardware instanced render items.  The buffer is bound at the
+// render item's first instance, so SV_InstanceID indexes it directly.
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
+
 struct VertexIn
 {
 	float3 PosL    : POSITION;
@@ -91,30 +124,68 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
+#ifdef INSTANCED
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+#else
 VertexOut VS(VertexIn vin)
+#endif
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef INSTANCED
+	float4x4 world = gInstanceData[instanceID].World;
+	float4x4 texTransform = gInstanceData[instanceID].TexTransform;
+#else
+	float4x4 world = gObjectData[gObjectIndex].World;
+	float4x4 texTransform = gObjectData[gObjectIndex].TexTransform;
+#endif
+
+#ifdef DISPLACEMENT_MAP
+	// Sample the displacement map using non-transformed [0,1]^2 tex-coords.
+	vin.PosL.y += gDisplacementMap.SampleLevel(gsamLinearClamp, vin.TexC, 0.0f).r;
+
+	// Estimate normal using finite difference.
+	ObjectData objData = gObjectData[gObjectIndex];
+	float du = objData.DisplacementMapTexelSize.x;
+	float dv = objData.DisplacementMapTexelSize.y;
+	float l = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(du, 0.0f), 0.0f).r;
+	float r = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(du, 0.0f), 0.0f).r;
+	float t = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC - float2(0.0f, dv), 0.0f).r;
+	float b = gDisplacementMap.SampleLevel(gsamPointClamp, vin.TexC + float2(0.0f, dv), 0.0f).r;
+	vin.NormalL = normalize(float3(-r + l, 2.0f*objData.GridSpatialStep, b - t));
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
-	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
-	vout.TexC = mul(texC, gMatTransform).xy;
+#ifndef DEPTH_ONLY
+	// Output vertex attributes for interpolation across triangle.  Depth only passes
+	// bind no material, so they leave them out.
+	MaterialData matData = gMaterialData[gObjectData[gObjectIndex].MaterialIndex];
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
+	vout.TexC = mul(texC, matData.MatTransform).xy;
+#endif
 
     return vout;
 }
 
 float4 PS(VertexOut pin) : SV_Target
 {
-    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+	MaterialData matData = gMaterialData[gObjectData[gObjectIndex].MaterialIndex];
+
+#ifdef MIN_LOD_CLAMP
+    // Never sample finer mips than the streamer has made resident.
+    float4 diffuseAlbedo = gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC, int2(0, 0), matData.MinLod) * matData.DiffuseAlbedo;
+#else
+    float4 diffuseAlbedo = gTextureMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC) * matData.DiffuseAlbedo;
+#endif
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
@@ -134,11 +205,14 @@ float4 PS(VertexOut pin) : SV_Target
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
-    const float shininess = 1.0f - gRoughness;
-    Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+    const float shininess = 1.0f - matData.Roughness;
+    Material mat = { diffuseAlbedo, matData.FresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint clusterIndex = ComputeClusterIndex(pin.PosH.xy, viewZ, gRenderTargetSize, gNearZ, gFarZ);
+    float4 directLight = ComputeLightingClustered(gLights, gNumDirLights, gNumPointLights,
+        gClusterLightCounts, gClusterLightIndices, clusterIndex,
+        mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
 
@@ -0,0 +1,217 @@
+//***************************************************************************************
+// DrawCulling.hlsl
+//
+// Culls the GPU-driven render items.  One thread per item transforms the item's local
+// bounding box by its current world matrix and, if it intersects the frustum and is
+// not hidden behind the Hi-Z occluders, appends the item's draw command to its batch
+// in the indirect argument buffer.
+//***************************************************************************************
+
+// Must match the flags in DrawCuller.cpp.
+#define DRAW_ITEM_INSTANCED 0x1
+#define DRAW_ITEM_OCCLUDER  0x2
+
+#define CULL_FRUSTUM        0x1
+#define CULL_OCCLUSION      0x2
+#define CULL_OCCLUDERS_ONLY 0x4
+
+// Same layout as DrawCuller::IndirectCommand.
+struct IndirectCommand
+{
+	uint2 VertexBufferLocation;
+	uint  VertexSizeInBytes;
+	uint  VertexStrideInBytes;
+	uint2 IndexBufferLocation;
+	uint  IndexSizeInBytes;
+	uint  IndexFormat;
+	uint2 InstanceDataLocation;
+	uint  ObjectIndex;
+	uint  IndexCountPerInstance;
+	uint  InstanceCount;
+	uint  StartIndexLocation;
+	int   BaseVertexLocation;
+	uint  StartInstanceLocation;
+};
+
+// Same layout as DrawCuller::GpuDrawItem.
+struct DrawItem
+{
+	IndirectCommand Command;
+	float3 BoundsCenter;
+	uint   Batch;
+	float3 BoundsExtents;
+	uint   CommandOffset;
+	uint   InstanceIndex;
+	uint   Flags;
+};
+
+// Same layout as ObjectData in Default.hlsl.
+struct ObjectData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+	float2   DisplacementMapTexelSize;
+	float    GridSpatialStep;
+	uint     MaterialIndex;
+};
+
+// Same layout as InstanceData in Default.hlsl.
+struct InstanceData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+};
+
+// Set as root constants by DrawCuller.  The planes are in world space with their
+// normals pointing out of the frustum.
+cbuffer cbCull : register(b0)
+{
+	float4 gFrustumPlanes[6];
+	uint gItemCount;
+	uint gCullFlags;
+	float gOccluderDistance;
+	uint gCullPad0;
+};
+
+// Same layout as cbPass in Default.hlsl.
+cbuffer cbPass : register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float gNearZ;
+    float gFarZ;
+    float gTotalTime;
+    float gDeltaTime;
+    float4 gAmbientLight;
+
+	float4 gFogColor;
+	float gFogStart;
+	float gFogRange;
+	float2 cbPerObjectPad2;
+
+    uint gNumDirLights;
+    uint gNumPointLights;
+    uint gNumSpotLights;
+    uint cbPerObjectPad3;
+};
+
+StructuredBuffer<DrawItem> gDrawItems : register(t0);
+StructuredBuffer<ObjectData> gObjectData : register(t1);
+StructuredBuffer<InstanceData> gInstanceData : register(t2);
+
+// Farthest occluder depth, reduced over each mip's texels.
+Texture2D<float> gHiZ : register(t3);
+
+RWStructuredBuffer<IndirectCommand> gCommands : register(u0);
+RWStructuredBuffer<uint> gCommandCounts : register(u1);
+
+bool OutsideFrustum(float3 center, float3 extents)
+{
+	[unroll]
+	for(int i = 0; i < 6; ++i)
+	{
+		float distance = dot(gFrustumPlanes[i].xyz, center) + gFrustumPlanes[i].w;
+		float radius = dot(extents, abs(gFrustumPlanes[i].xyz));
+		if(distance > radius)
+			return true;
+	}
+
+	return false;
+}
+
+bool Occluded(float3 center, float3 extents)
+{
+	// Screen rectangle and nearest depth of the box.
+	float2 ndcMin = float2(1.0f, 1.0f);
+	float2 ndcMax = float2(-1.0f, -1.0f);
+	float nearestDepth = 1.0f;
+
+	[unroll]
+	for(int i = 0; i < 8; ++i)
+	{
+		float3 corner = center + extents * float3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+		float4 posH = mul(float4(corner, 1.0f), gViewProj);
+
+		// A box reaching behind the near plane covers the camera; keep it.
+		if(posH.w <= gNearZ)
+			return false;
+
+		float3 ndc = posH.xyz / posH.w;
+		ndcMin = min(ndcMin, ndc.xy);
+		ndcMax = max(ndcMax, ndc.xy);
+		nearestDepth = min(nearestDepth, ndc.z);
+	}
+
+	// NDC y points up and texture v down.
+	float2 uvMin = saturate(float2(ndcMin.x, -ndcMax.y) * 0.5f + 0.5f);
+	float2 uvMax = saturate(float2(ndcMax.x, -ndcMin.y) * 0.5f + 0.5f);
+
+	uint width, height, mipCount;
+	gHiZ.GetDimensions(0, width, height, mipCount);
+
+	// Pick the mip at which the rectangle spans at most two texels each way, so four
+	// loads cover it.
+	uint2 texelMax = min(uint2(uvMax * float2(width, height)), uint2(width - 1, height - 1));
+	uint2 texelMin = min(uint2(uvMin * float2(width, height)), texelMax);
+	uint2 size = texelMax - texelMin + 1;
+	uint mip = min(firstbithigh(max(max(size.x, size.y), 1u)) + 1, mipCount - 1);
+
+	// Texel x of a mip covers texels [x << mip, (x + 1) << mip) of mip 0.
+	uint2 mipSize = max(uint2(width, height) >> mip, uint2(1, 1));
+	uint2 c0 = min(texelMin >> mip, mipSize - 1);
+	uint2 c1 = min(texelMax >> mip, mipSize - 1);
+
+	float occluderDepth = max(
+		max(gHiZ.Load(int3(c0.x, c0.y, mip)), gHiZ.Load(int3(c1.x, c0.y, mip))),
+		max(gHiZ.Load(int3(c0.x, c1.y, mip)), gHiZ.Load(int3(c1.x, c1.y, mip))));
+
+	return nearestDepth > occluderDepth;
+}
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if(dispatchThreadID.x >= gItemCount)
+		return;
+
+	DrawItem item = gDrawItems[dispatchThreadID.x];
+
+	if((gCullFlags & CULL_OCCLUDERS_ONLY) != 0 && (item.Flags & DRAW_ITEM_OCCLUDER) == 0)
+		return;
+
+	float4x4 world = (item.Flags & DRAW_ITEM_INSTANCED) != 0 ?
+		gInstanceData[item.InstanceIndex].World :
+		gObjectData[item.Command.ObjectIndex].World;
+
+	// World space box that encloses the transformed local box.
+	float3 center = mul(float4(item.BoundsCenter, 1.0f), world).xyz;
+	float3 extents = abs(item.BoundsExtents.x * world[0].xyz) +
+		abs(item.BoundsExtents.y * world[1].xyz) +
+		abs(item.BoundsExtents.z * world[2].xyz);
+
+	if((gCullFlags & CULL_FRUSTUM) != 0 && OutsideFrustum(center, extents))
+		return;
+
+	if((gCullFlags & CULL_OCCLUDERS_ONLY) != 0)
+	{
+		// Only occluders near the eye cover enough of the screen to be worth drawing.
+		float3 offset = max(abs(gEyePosW - center) - extents, 0.0f);
+		if(dot(offset, offset) > gOccluderDistance * gOccluderDistance)
+			return;
+	}
+
+	if((gCullFlags & CULL_OCCLUSION) != 0 && Occluded(center, extents))
+		return;
+
+	uint slot;
+	InterlockedAdd(gCommandCounts[item.Batch], 1, slot);
+	gCommands[item.CommandOffset + slot] = item.Command;
+}
@@ -0,0 +1,53 @@
+//***************************************************************************************
+// HiZ.hlsl
+//
+// Builds the hierarchical depth pyramid.  CopyDepthCS copies the occluder depth into
+// mip 0 and DownsampleCS writes each further mip from the one above it, keeping the
+// farthest depth so the pyramid never claims more occlusion than the occluders give.
+//***************************************************************************************
+
+Texture2D<float>   gSrc : register(t0);
+RWTexture2D<float> gDst : register(u0);
+
+[numthreads(8, 8, 1)]
+void CopyDepthCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint width, height;
+	gDst.GetDimensions(width, height);
+
+	if(dispatchThreadID.x >= width || dispatchThreadID.y >= height)
+		return;
+
+	gDst[dispatchThreadID.xy] = gSrc[dispatchThreadID.xy];
+}
+
+[numthreads(8, 8, 1)]
+void DownsampleCS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	uint width, height;
+	gDst.GetDimensions(width, height);
+
+	if(dispatchThreadID.x >= width || dispatchThreadID.y >= height)
+		return;
+
+	uint srcWidth, srcHeight;
+	gSrc.GetDimensions(srcWidth, srcHeight);
+
+	// Mip sizes round down, so when the source is odd the last row and column of the
+	// destination also cover the texels the halving drops.
+	uint2 srcCoord = dispatchThreadID.xy * 2;
+	uint countX = (dispatchThreadID.x == width - 1 && (srcWidth & 1) != 0) ? 3 : 2;
+	uint countY = (dispatchThreadID.y == height - 1 && (srcHeight & 1) != 0) ? 3 : 2;
+
+	float depth = 0.0f;
+	for(uint y = 0; y < countY; ++y)
+	{
+		for(uint x = 0; x < countX; ++x)
+		{
+			uint2 coord = min(srcCoord + uint2(x, y), uint2(srcWidth - 1, srcHeight - 1));
+			depth = max(depth, gSrc[coord]);
+		}
+	}
+
+	gDst[dispatchThreadID.xy] = depth;
+}
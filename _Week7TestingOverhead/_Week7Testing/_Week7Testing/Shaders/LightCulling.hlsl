@@ -0,0 +1,120 @@
+//***************************************************************************************
+// LightCulling.hlsl
+//
+// Bins the point and spot lights into view space clusters.  One thread per cluster
+// builds the cluster's bounding box in view space and tests every light's range
+// against it.  Lights beyond MAX_LIGHTS_PER_CLUSTER in one cluster are dropped.
+//***************************************************************************************
+
+// Include structures and functions for lighting.
+#include "LightingUtil.hlsl"
+
+// Same layout as cbPass in Default.hlsl.
+cbuffer cbPass : register(b1)
+{
+    float4x4 gView;
+    float4x4 gInvView;
+    float4x4 gProj;
+    float4x4 gInvProj;
+    float4x4 gViewProj;
+    float4x4 gInvViewProj;
+    float3 gEyePosW;
+    float cbPerObjectPad1;
+    float2 gRenderTargetSize;
+    float2 gInvRenderTargetSize;
+    float gNearZ;
+    float gFarZ;
+    float gTotalTime;
+    float gDeltaTime;
+    float4 gAmbientLight;
+
+	float4 gFogColor;
+	float gFogStart;
+	float gFogRange;
+	float2 cbPerObjectPad2;
+
+    uint gNumDirLights;
+    uint gNumPointLights;
+    uint gNumSpotLights;
+    uint cbPerObjectPad3;
+};
+
+StructuredBuffer<Light> gLights : register(t1, space1);
+
+RWStructuredBuffer<uint> gClusterLightCounts  : register(u0);
+RWStructuredBuffer<uint> gClusterLightIndices : register(u1);
+
+// Returns the view space point at depth viewZ on the ray through a pixel.
+float3 ScreenToView(float2 pixel, float viewZ)
+{
+    float2 ndc = pixel * gInvRenderTargetSize * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f);
+    float4 p = mul(float4(ndc, 1.0f, 1.0f), gInvProj);
+    p.xyz /= p.w;
+
+    return p.xyz * (viewZ / p.z);
+}
+
+[numthreads(64, 1, 1)]
+void CS(int3 dispatchThreadID : SV_DispatchThreadID)
+{
+    const uint clusterCount = CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z;
+    const uint clusterIndex = dispatchThreadID.x;
+    if(clusterIndex >= clusterCount)
+        return;
+
+    uint x = clusterIndex % CLUSTER_COUNT_X;
+    uint y = (clusterIndex / CLUSTER_COUNT_X) % CLUSTER_COUNT_Y;
+    uint z = clusterIndex / (CLUSTER_COUNT_X * CLUSTER_COUNT_Y);
+
+    // Screen rectangle of the tile, and the depth range of the slice.  Must agree
+    // with ComputeClusterIndex.
+    float2 tileSize = gRenderTargetSize / float2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y);
+    float2 minPixel = float2(x, y) * tileSize;
+    float2 maxPixel = minPixel + tileSize;
+
+    float nearZ = gNearZ * pow(gFarZ / gNearZ, (float)z / CLUSTER_COUNT_Z);
+    float farZ = gNearZ * pow(gFarZ / gNearZ, (float)(z + 1) / CLUSTER_COUNT_Z);
+
+    // Bounding box of the eight corners of the cluster.
+    float3 corners[8] =
+    {
+        ScreenToView(minPixel, nearZ),
+        ScreenToView(float2(maxPixel.x, minPixel.y), nearZ),
+        ScreenToView(float2(minPixel.x, maxPixel.y), nearZ),
+        ScreenToView(maxPixel, nearZ),
+        ScreenToView(minPixel, farZ),
+        ScreenToView(float2(maxPixel.x, minPixel.y), farZ),
+        ScreenToView(float2(minPixel.x, maxPixel.y), farZ),
+        ScreenToView(maxPixel, farZ)
+    };
+
+    float3 boxMin = corners[0];
+    float3 boxMax = corners[0];
+    [unroll]
+    for(int c = 1; c < 8; ++c)
+    {
+        boxMin = min(boxMin, corners[c]);
+        boxMax = max(boxMax, corners[c]);
+    }
+
+    // Spot lights are tested with the sphere bounding their cone.
+    uint count = 0;
+    uint firstLight = gNumDirLights;
+    uint lastLight = gNumDirLights + gNumPointLights + gNumSpotLights;
+    for(uint i = firstLight; i < lastLight && count < MAX_LIGHTS_PER_CLUSTER; ++i)
+    {
+        Light L = gLights[i];
+
+        float3 centerV = mul(float4(L.Position, 1.0f), gView).xyz;
+        float3 closest = clamp(centerV, boxMin, boxMax);
+        float3 d = centerV - closest;
+
+        if(dot(d, d) <= L.FalloffEnd * L.FalloffEnd)
+        {
+            gClusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + count] = i;
+            count++;
+        }
+    }
+
+    gClusterLightCounts[clusterIndex] = count;
+}
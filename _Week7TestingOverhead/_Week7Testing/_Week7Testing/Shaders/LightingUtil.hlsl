@@ -167,4 +167,85 @@ float4 ComputeLighting(Light gLights[MaxLights], Material mat,
     return float4(result, 0.0f);
 }
 
+//---------------------------------------------------------------------------------------
+// Clustered light lists built by LightCulling.hlsl.  Must match LightCuller.h.
+//---------------------------------------------------------------------------------------
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 64
+
+// Depth slices are spaced exponentially so near clusters stay small.
+uint ComputeClusterSlice(float viewZ, float nearZ, float farZ)
+{
+    float slice = log(max(viewZ, nearZ) / nearZ) / log(farZ / nearZ) * CLUSTER_COUNT_Z;
+    return min((uint)slice, CLUSTER_COUNT_Z - 1);
+}
+
+uint ComputeClusterIndex(float2 pixel, float viewZ, float2 renderTargetSize, float nearZ, float farZ)
+{
+    uint x = min((uint)(pixel.x / renderTargetSize.x * CLUSTER_COUNT_X), CLUSTER_COUNT_X - 1);
+    uint y = min((uint)(pixel.y / renderTargetSize.y * CLUSTER_COUNT_Y), CLUSTER_COUNT_Y - 1);
+    uint z = ComputeClusterSlice(viewZ, nearZ, farZ);
+
+    return (z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x;
+}
+
+//---------------------------------------------------------------------------------------
+// Same as ComputeLighting, but with the lights in a structured buffer.  Directional
+// lights are applied everywhere; point and spot lights only if they were binned into
+// the pixel's cluster.  The buffer holds the directional lights first, then the point
+// lights, then the spot lights.
+//
+// Shader permutations may specialize this for the scene's lights: NUM_DIR_LIGHTS fixes
+// the directional light count at compile time, and NO_POINT_LIGHTS and NO_SPOT_LIGHTS
+// drop a light type from the cluster loop, or the loop itself when both are defined.
+//---------------------------------------------------------------------------------------
+float4 ComputeLightingClustered(StructuredBuffer<Light> lights,
+                                uint numDirLights, uint numPointLights,
+                                StructuredBuffer<uint> clusterLightCounts,
+                                StructuredBuffer<uint> clusterLightIndices,
+                                uint clusterIndex,
+                                Material mat, float3 pos, float3 normal, float3 toEye,
+                                float3 shadowFactor)
+{
+    float3 result = 0.0f;
+
+    uint i = 0;
+
+#ifdef NUM_DIR_LIGHTS
+    numDirLights = NUM_DIR_LIGHTS;
+    [unroll]
+    for(i = 0; i < NUM_DIR_LIGHTS; ++i)
+#else
+    for(i = 0; i < numDirLights; ++i)
+#endif
+    {
+        float shadow = i < 3 ? shadowFactor[i] : 1.0f;
+        result += shadow * ComputeDirectionalLight(lights[i], mat, normal, toEye);
+    }
+
+#if !defined(NO_POINT_LIGHTS) || !defined(NO_SPOT_LIGHTS)
+    const uint firstSpotLight = numDirLights + numPointLights;
+    const uint count = clusterLightCounts[clusterIndex];
+    for(i = 0; i < count; ++i)
+    {
+        uint lightIndex = clusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + i];
+
+#if defined(NO_SPOT_LIGHTS)
+        result += ComputePointLight(lights[lightIndex], mat, pos, normal, toEye);
+#elif defined(NO_POINT_LIGHTS)
+        result += ComputeSpotLight(lights[lightIndex], mat, pos, normal, toEye);
+#else
+        if(lightIndex < firstSpotLight)
+            result += ComputePointLight(lights[lightIndex], mat, pos, normal, toEye);
+        else
+            result += ComputeSpotLight(lights[lightIndex], mat, pos, normal, toEye);
+#endif
+    }
+#endif
+
+    return float4(result, 0.0f);
+}
+
 
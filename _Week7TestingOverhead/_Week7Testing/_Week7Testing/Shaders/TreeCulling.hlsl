@@ -0,0 +1,66 @@
+//***************************************************************************************
+// TreeCulling.hlsl
+//
+// Culls the forest.  One thread per tree tests the billboard's bounding sphere against
+// the frustum and the maximum draw distance, and appends the trees that pass, with
+// their fade factor, to the visible tree buffer drawn by TreeSprite.hlsl.
+//***************************************************************************************
+
+// Same layout as Forest::GpuTree.
+struct TreeData
+{
+	float3 PosW;
+	float  Fade;
+	float2 SizeW;
+	uint   TextureIndex;
+	uint   TreePad0;
+};
+
+// Set as root constants by Forest.  The planes are in world space with their normals
+// pointing out of the frustum.
+cbuffer cbCull : register(b0)
+{
+	float4 gFrustumPlanes[6];
+	float3 gEyePosW;
+	uint gTreeCount;
+	float gFadeStart;
+	float gMaxDistance;
+};
+
+StructuredBuffer<TreeData> gTrees : register(t0);
+
+RWStructuredBuffer<TreeData> gVisibleTrees : register(u0);
+
+// D3D12_DRAW_ARGUMENTS; element 1 is the instance count.
+RWStructuredBuffer<uint> gDrawArgs : register(u1);
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dispatchThreadID : SV_DispatchThreadID)
+{
+	if(dispatchThreadID.x >= gTreeCount)
+		return;
+
+	TreeData tree = gTrees[dispatchThreadID.x];
+
+	// The billboard turns about its center, so its sphere bounds it from every side.
+	float radius = 0.5f * length(tree.SizeW);
+
+	float distToEye = length(tree.PosW - gEyePosW);
+	if(distToEye - radius > gMaxDistance)
+		return;
+
+	[unroll]
+	for(int i = 0; i < 6; ++i)
+	{
+		if(dot(gFrustumPlanes[i].xyz, tree.PosW) + gFrustumPlanes[i].w > radius)
+			return;
+	}
+
+	tree.Fade = saturate((gMaxDistance - distToEye) / max(gMaxDistance - gFadeStart, 1e-3f));
+	if(tree.Fade <= 0.0f)
+		return;
+
+	uint slot;
+	InterlockedAdd(gDrawArgs[1], 1, slot);
+	gVisibleTrees[slot] = tree;
+}
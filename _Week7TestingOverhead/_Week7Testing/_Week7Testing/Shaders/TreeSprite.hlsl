@@ -2,26 +2,11 @@
 // TreeSprite.hlsl.
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-    #define NUM_DIR_LIGHTS 3
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 9
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 0
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
-//step5
-Texture2DArray gTreeMapArray : register(t0);
-
-//you can use dynamic indexing as well. Pay attention how we changed the sampler!
-//Texture2D gTreeMapArray[3] : register(t0);
+// The texture arrays at the start of the SRV heap, indexed by the heap slot the
+// material supplies.  Same size as gTextureTableSize in the app.
+Texture2DArray gTextureArrayMaps[60] : register(t0, space3);
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -34,8 +19,7 @@ SamplerState gsamAnisotropicClamp : register(s5);
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
-    float4x4 gWorld;
-	float4x4 gTexTransform;
+	uint gObjectIndex;
 };
 
 // Constant data that varies per material.
@@ -62,119 +46,123 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-   // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-   //  indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    //indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+    // Light counts for gLights.  Indices [0, gNumDirLights) are directional lights,
+    // the next gNumPointLights are point lights and the next gNumSpotLights are spot lights.
+    uint gNumDirLights;
+    uint gNumPointLights;
+    uint gNumSpotLights;
+    uint cbPerObjectPad3;
 };
 
-cbuffer cbMaterial : register(b2)
+// Scene lights, uploaded by LightManager.  A structured buffer rather than a cbuffer
+// array so the light count is not limited to MaxLights.
+StructuredBuffer<Light> gLights : register(t1, space1);
+
+// Per-cluster light lists built by LightCulling.hlsl.
+StructuredBuffer<uint> gClusterLightCounts  : register(t2, space1);
+StructuredBuffer<uint> gClusterLightIndices : register(t3, space1);
+
+// Same layout as ObjectData in Default.hlsl.
+struct ObjectData
 {
-	float4   gDiffuseAlbedo;
-    float3   gFresnelR0;
-    float    gRoughness;
-	float4x4 gMatTransform;
+	float4x4 World;
+	float4x4 TexTransform;
+	float2   DisplacementMapTexelSize;
+	float    GridSpatialStep;
+	uint     MaterialIndex;
 };
- 
-struct VertexIn
+
+// The forest's render item only supplies the material.
+StructuredBuffer<ObjectData> gObjectData : register(t4, space1);
+
+// Same layout as MaterialData in Default.hlsl.
+struct MaterialData
 {
-	float3 PosW  : POSITION;
-	float2 SizeW : SIZE;
+	float4   DiffuseAlbedo;
+    float3   FresnelR0;
+    float    Roughness;
+	float4x4 MatTransform;
+	float    MinLod;
+	uint     DiffuseMapIndex;
+	float2   MatPad0;
 };
 
-struct VertexOut
+StructuredBuffer<MaterialData> gMaterialData : register(t5, space1);
+ 
+// Same layout as Forest::GpuTree.
+struct TreeData
 {
-	float3 CenterW : POSITION;
-	float2 SizeW   : SIZE;
+	float3 PosW;
+	float  Fade;
+	float2 SizeW;
+	uint   TextureIndex;
+	uint   TreePad0;
 };
 
-struct GeoOut
+// Trees that passed TreeCulling.hlsl, one per instance.
+StructuredBuffer<TreeData> gVisibleTrees : register(t0, space1);
+
+struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
     float2 TexC    : TEXCOORD;
-    uint   PrimID  : SV_PrimitiveID;
+    nointerpolation uint  TexIndex : TEXINDEX;
+    nointerpolation float Fade     : FADE;
 };
 
-VertexOut VS(VertexIn vin)
+// 4x4 ordered dither thresholds, used to dissolve trees as they fade out.
+static const float gDitherThresholds[16] =
 {
-	VertexOut vout;
+	 0.0f / 16.0f,  8.0f / 16.0f,  2.0f / 16.0f, 10.0f / 16.0f,
+	12.0f / 16.0f,  4.0f / 16.0f, 14.0f / 16.0f,  6.0f / 16.0f,
+	 3.0f / 16.0f, 11.0f / 16.0f,  1.0f / 16.0f,  9.0f / 16.0f,
+	15.0f / 16.0f,  7.0f / 16.0f, 13.0f / 16.0f,  5.0f / 16.0f
+};
 
-	// Just pass data over to geometry shader.
-	vout.CenterW = vin.PosW;
-	vout.SizeW   = vin.SizeW;
+// Each instance is a tree, drawn as a four vertex triangle strip.
+VertexOut VS(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+	TreeData tree = gVisibleTrees[instanceID];
 
-	return vout;
-}
- 
-//step4
- // We expand each point into a quad (4 vertices), so the maximum number of vertices
- // we output per geometry shader invocation is 4.
-[maxvertexcount(4)]
-void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumElements]-> one vertex for a point, two for aline, threefor atriangle, four for line with adjacency, and six for a triangle with adjacency.
-        uint primID : SV_PrimitiveID, //inout StreamOutputObject<OutputVertexType>
-        inout TriangleStream<GeoOut> triStream)  //OutputName
-{	
 	//
 	// Compute the local coordinate system of the sprite relative to the world
 	// space such that the billboard is aligned with the y-axis and faces the eye.
 	//
 
 	float3 up = float3(0.0f, 1.0f, 0.0f);
-	float3 look = gEyePosW - gin[0].CenterW;
+	float3 look = gEyePosW - tree.PosW;
 	look.y = 0.0f; // y-axis aligned, so project to xz-plane
 	look = normalize(look);
 	float3 right = cross(up, look);
 
-	//
-	// Compute triangle strip vertices (quad) in world space.
-	//
-	float halfWidth  = 0.5f*gin[0].SizeW.x;
-	float halfHeight = 0.5f*gin[0].SizeW.y;
-	
-	float4 v[4];
-	v[0] = float4(gin[0].CenterW + halfWidth*right - halfHeight*up, 1.0f);
-	v[1] = float4(gin[0].CenterW + halfWidth*right + halfHeight*up, 1.0f);
-	v[2] = float4(gin[0].CenterW - halfWidth*right - halfHeight*up, 1.0f);
-	v[3] = float4(gin[0].CenterW - halfWidth*right + halfHeight*up, 1.0f);
+	// Strip order: right bottom, right top, left bottom, left top.
+	float2 corner = float2((vertexID & 2) ? -1.0f : 1.0f, (vertexID & 1) ? 1.0f : -1.0f);
+	float3 posW = tree.PosW + (0.5f*tree.SizeW.x*corner.x)*right + (0.5f*tree.SizeW.y*corner.y)*up;
 
-	//
-	// Transform quad vertices to world space and output 
-	// them as a triangle strip.
-	//
-	
-	float2 texC[4] = 
-	{
-		float2(0.0f, 1.0f),
-		float2(0.0f, 0.0f),
-		float2(1.0f, 1.0f),
-		float2(1.0f, 0.0f)
-	};
-	
-	GeoOut gout;
-	[unroll]
-	for(int i = 0; i < 4; ++i)
-	{
-		gout.PosH     = mul(v[i], gViewProj);
-		gout.PosW     = v[i].xyz;
-		gout.NormalW  = look;
-		gout.TexC     = texC[i];
-		gout.PrimID   = primID;
-		
-		triStream.Append(gout);
-	}
+	VertexOut vout;
+	vout.PosH     = mul(float4(posW, 1.0f), gViewProj);
+	vout.PosW     = posW;
+	vout.NormalW  = look;
+	vout.TexC     = float2((vertexID & 2) ? 1.0f : 0.0f, (vertexID & 1) ? 0.0f : 1.0f);
+	vout.TexIndex = tree.TextureIndex;
+	vout.Fade     = tree.Fade;
+
+	return vout;
 }
 
 //step6
-float4 PS(GeoOut pin) : SV_Target
+float4 PS(VertexOut pin) : SV_Target
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
-    float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+	// Dissolve fading trees with a screen space dither, so they need no blending.
+	uint2 ditherPos = uint2(pin.PosH.xy) % 4;
+	clip(pin.Fade - gDitherThresholds[ditherPos.y * 4 + ditherPos.x] - 1e-3f);
+
+	MaterialData matData = gMaterialData[gObjectData[gObjectIndex].MaterialIndex];
 
-    //using dynamic indexing
-    //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+	float3 uvw = float3(pin.TexC, pin.TexIndex);
+    float4 diffuseAlbedo = gTextureArrayMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, uvw) * matData.DiffuseAlbedo;
 
 	
 #ifdef ALPHA_TEST
@@ -195,11 +183,14 @@ float4 PS(GeoOut pin) : SV_Target
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
-    const float shininess = 1.0f - gRoughness;
-    Material mat = { diffuseAlbedo, gFresnelR0, shininess };
+    const float shininess = 1.0f - matData.Roughness;
+    Material mat = { diffuseAlbedo, matData.FresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+    float viewZ = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint clusterIndex = ComputeClusterIndex(pin.PosH.xy, viewZ, gRenderTargetSize, gNearZ, gFarZ);
+    float4 directLight = ComputeLightingClustered(gLights, gNumDirLights, gNumPointLights,
+        gClusterLightCounts, gClusterLightIndices, clusterIndex,
+        mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
 
     float4 litColor = ambient + directLight;
 
@@ -0,0 +1,177 @@
+//***************************************************************************************
+// SpatialIndex.cpp
+//***************************************************************************************
+
+#include "SpatialIndex.h"
+
+using namespace DirectX;
+
+template<typename NodeTest, typename Visit>
+void SpatialIndex::Traverse(NodeTest nodeTest, Visit visit)const
+{
+	assert(mBuilt);
+	if(mNodes.empty())
+		return;
+
+	// The tree is balanced, so its depth stays far below the size of the stack.
+	UINT stack[64];
+	UINT stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize > 0)
+	{
+		const UINT nodeIndex = stack[--stackSize];
+		const Node& node = mNodes[nodeIndex];
+		if(!nodeTest(node.Bounds))
+			continue;
+
+		if(node.Count == 0)
+		{
+			stack[stackSize++] = node.SecondChild;
+			stack[stackSize++] = nodeIndex + 1;
+			continue;
+		}
+
+		for(UINT i = node.First; i < node.First + node.Count; ++i)
+		{
+			if(nodeTest(mEntries[i].Bounds) && !visit(mEntries[i]))
+				return;
+		}
+	}
+}
+
+void SpatialIndex::Clear()
+{
+	mEntries.clear();
+	mNodes.clear();
+	mBuilt = false;
+}
+
+void SpatialIndex::Add(const BoundingBox& bounds, UINT id)
+{
+	Entry entry;
+	entry.Bounds = bounds;
+	entry.Id = id;
+	mEntries.push_back(entry);
+	mBuilt = false;
+}
+
+void SpatialIndex::Build()
+{
+	mNodes.clear();
+	if(!mEntries.empty())
+	{
+		// A binary tree with leaves of at least one entry has fewer than 2n nodes.
+		mNodes.reserve(2 * mEntries.size());
+		BuildNode(0, (UINT)mEntries.size());
+	}
+	mBuilt = true;
+}
+
+UINT SpatialIndex::Count()const
+{
+	return (UINT)mEntries.size();
+}
+
+void SpatialIndex::Query(const XMFLOAT3& point, std::vector<UINT>& ids)const
+{
+	XMVECTOR p = XMLoadFloat3(&point);
+	Traverse(
+		[p](const BoundingBox& bounds) { return bounds.Contains(p) != DirectX::DISJOINT; },
+		[&ids](const Entry& entry) { ids.push_back(entry.Id); return true; });
+}
+
+void SpatialIndex::Query(const BoundingBox& box, std::vector<UINT>& ids)const
+{
+	Traverse(
+		[&box](const BoundingBox& bounds) { return bounds.Intersects(box); },
+		[&ids](const Entry& entry) { ids.push_back(entry.Id); return true; });
+}
+
+bool SpatialIndex::Intersects(const BoundingSphere& sphere)const
+{
+	bool hit = false;
+	Traverse(
+		[&sphere](const BoundingBox& bounds) { return bounds.Intersects(sphere); },
+		[&hit](const Entry&) { hit = true; return false; });
+	return hit;
+}
+
+bool SpatialIndex::RayCast(FXMVECTOR origin, FXMVECTOR direction, UINT& id, float& distance)const
+{
+	// Nodes farther along the ray than the nearest hit so far cannot hold a nearer one.
+	float nearest = FLT_MAX;
+	bool hit = false;
+	Traverse(
+		[&](const BoundingBox& bounds)
+		{
+			float nodeDistance = 0.0f;
+			return bounds.Intersects(origin, direction, nodeDistance) && nodeDistance < nearest;
+		},
+		[&](const Entry& entry)
+		{
+			float entryDistance = 0.0f;
+			if(entry.Bounds.Intersects(origin, direction, entryDistance) && entryDistance < nearest)
+			{
+				nearest = entryDistance;
+				id = entry.Id;
+				hit = true;
+			}
+			return true;
+		});
+
+	if(hit)
+		distance = nearest;
+	return hit;
+}
+
+UINT SpatialIndex::BuildNode(UINT first, UINT count)
+{
+	const UINT nodeIndex = (UINT)mNodes.size();
+	mNodes.emplace_back();
+
+	BoundingBox bounds = mEntries[first].Bounds;
+	XMVECTOR centerMin = XMLoadFloat3(&bounds.Center);
+	XMVECTOR centerMax = centerMin;
+	for(UINT i = first + 1; i < first + count; ++i)
+	{
+		BoundingBox::CreateMerged(bounds, bounds, mEntries[i].Bounds);
+
+		XMVECTOR center = XMLoadFloat3(&mEntries[i].Bounds.Center);
+		centerMin = XMVectorMin(centerMin, center);
+		centerMax = XMVectorMax(centerMax, center);
+	}
+	mNodes[nodeIndex].Bounds = bounds;
+
+	if(count <= MaxLeafEntries)
+	{
+		mNodes[nodeIndex].First = first;
+		mNodes[nodeIndex].Count = count;
+		return nodeIndex;
+	}
+
+	// Split along the axis the centers spread the most over.
+	XMFLOAT3 spread;
+	XMStoreFloat3(&spread, centerMax - centerMin);
+	int axis = 0;
+	if(spread.y > spread.x)
+		axis = 1;
+	if(spread.z > (axis == 0 ? spread.x : spread.y))
+		axis = 2;
+
+	auto center = [axis](const Entry& entry)
+	{
+		return axis == 0 ? entry.Bounds.Center.x : axis == 1 ? entry.Bounds.Center.y : entry.Bounds.Center.z;
+	};
+
+	const UINT half = count / 2;
+	std::nth_element(mEntries.begin() + first, mEntries.begin() + first + half, mEntries.begin() + first + count,
+		[&center](const Entry& a, const Entry& b) { return center(a) < center(b); });
+
+	// mNodes may grow while the children are built, so the node is indexed again after.
+	BuildNode(first, half);
+	UINT secondChild = BuildNode(first + half, count - half);
+	mNodes[nodeIndex].SecondChild = secondChild;
+
+	return nodeIndex;
+}
@@ -0,0 +1,79 @@
+//***************************************************************************************
+// SpatialIndex.h
+//
+// Bounding volume hierarchy over world space boxes, for point, box, sphere and ray
+// queries against static geometry.  The tree is built top down by splitting each node's
+// boxes at the median of their centers along the longest axis, so it stays balanced
+// and a query visits O(log n) nodes plus the boxes it actually touches.  The tree is
+// rebuilt from scratch by Build; boxes cannot be moved or removed in place.
+//***************************************************************************************
+
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include "../../Common/d3dUtil.h"
+
+class SpatialIndex
+{
+public:
+	SpatialIndex() = default;
+	SpatialIndex(const SpatialIndex& rhs) = delete;
+	SpatialIndex& operator=(const SpatialIndex& rhs) = delete;
+	~SpatialIndex() = default;
+
+	// Removes every box.
+	void Clear();
+
+	// Queues a box under a caller chosen id.  Queries do not see it until Build.
+	void Add(const DirectX::BoundingBox& bounds, UINT id);
+
+	// Builds the tree over every box added since the last Clear.
+	void Build();
+
+	UINT Count()const;
+
+	// Appends the ids of the boxes that contain point, or that intersect box, to ids.
+	void Query(const DirectX::XMFLOAT3& point, std::vector<UINT>& ids)const;
+	void Query(const DirectX::BoundingBox& box, std::vector<UINT>& ids)const;
+
+	// Whether any box intersects sphere.  Stops at the first box found.
+	bool Intersects(const DirectX::BoundingSphere& sphere)const;
+
+	// Finds the nearest box hit by the ray, with direction normalized.  Returns false
+	// if the ray misses every box.
+	bool RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, UINT& id, float& distance)const;
+
+private:
+	struct Entry
+	{
+		DirectX::BoundingBox Bounds;
+		UINT Id = 0;
+	};
+
+	// Leaves hold Entries [First, First + Count).  An inner node has Count 0; its
+	// first child follows it and its second child is at SecondChild.
+	struct Node
+	{
+		DirectX::BoundingBox Bounds;
+		UINT First = 0;
+		UINT Count = 0;
+		UINT SecondChild = 0;
+	};
+
+	UINT BuildNode(UINT first, UINT count);
+
+	// Visits the entries of every leaf whose node passes nodeTest, depth first.  Stops
+	// as soon as visit returns false.
+	template<typename NodeTest, typename Visit>
+	void Traverse(NodeTest nodeTest, Visit visit)const;
+
+private:
+	// Leaves are split until they hold at most this many boxes.
+	static const UINT MaxLeafEntries = 4;
+
+	std::vector<Entry> mEntries;
+	std::vector<Node> mNodes;
+	bool mBuilt = false;
+};
+
+#endif // SPATIALINDEX_H
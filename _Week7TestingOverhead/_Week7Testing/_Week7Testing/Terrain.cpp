@@ -0,0 +1,280 @@
+//***************************************************************************************
+// Terrain.cpp
+//***************************************************************************************
+
+#include "Terrain.h"
+
+using namespace DirectX;
+
+Terrain::Terrain(float width, float depth, UINT chunkCountX, UINT chunkCountZ, UINT chunkQuadCount, float lodDistance)
+	: mWidth(width), mDepth(depth),
+	mChunkCountX(chunkCountX), mChunkCountZ(chunkCountZ),
+	mChunkQuadCount(chunkQuadCount), mLodDistance(lodDistance)
+{
+	assert(chunkQuadCount > 0 && (chunkQuadCount & (chunkQuadCount - 1)) == 0);
+
+	// The coarsest LOD draws each chunk as a single quad.
+	mLodCount = 1;
+	while((1u << (mLodCount - 1)) < mChunkQuadCount)
+		mLodCount++;
+
+	mChunkLods.assign(ChunkCount(), 0);
+	mChunkStitchMasks.assign(ChunkCount(), 0);
+}
+
+std::unique_ptr<MeshGeometry> Terrain::BuildGeometry(const std::string& name,
+	const std::function<float(float, float)>& height)
+{
+	const UINT chunkVertexCount = (mChunkQuadCount + 1) * (mChunkQuadCount + 1);
+	const float dx = mWidth / (mChunkCountX * mChunkQuadCount);
+	const float dz = mDepth / (mChunkCountZ * mChunkQuadCount);
+
+	// Border vertices are repeated in every chunk that touches them, so each chunk's
+	// vertices are contiguous and its indices never leave the chunk.
+	std::vector<Vertex> vertices(ChunkCount() * chunkVertexCount);
+	mChunkBounds.resize(ChunkCount());
+	for(UINT cz = 0; cz < mChunkCountZ; ++cz)
+	{
+		for(UINT cx = 0; cx < mChunkCountX; ++cx)
+		{
+			const UINT chunk = cz * mChunkCountX + cx;
+			Vertex* chunkVertices = &vertices[chunk * chunkVertexCount];
+
+			for(UINT i = 0; i <= mChunkQuadCount; ++i)
+			{
+				for(UINT j = 0; j <= mChunkQuadCount; ++j)
+				{
+					// Same orientation and texture coordinates as GeometryGenerator::CreateGrid.
+					const UINT column = cx * mChunkQuadCount + j;
+					const UINT row = cz * mChunkQuadCount + i;
+					float x = -0.5f * mWidth + column * dx;
+					float z = 0.5f * mDepth - row * dz;
+
+					// Central differences of the height give the normal.
+					XMVECTOR n = XMVectorSet(
+						-(height(x + dx, z) - height(x - dx, z)) / (2.0f * dx),
+						1.0f,
+						-(height(x, z + dz) - height(x, z - dz)) / (2.0f * dz),
+						0.0f);
+
+					Vertex& v = chunkVertices[i * (mChunkQuadCount + 1) + j];
+					v.Pos = XMFLOAT3(x, height(x, z), z);
+					XMStoreFloat3(&v.Normal, XMVector3Normalize(n));
+					v.TexC = XMFLOAT2((float)column / (mChunkCountX * mChunkQuadCount), (float)row / (mChunkCountZ * mChunkQuadCount));
+				}
+			}
+
+			BoundingBox::CreateFromPoints(mChunkBounds[chunk], chunkVertexCount, &chunkVertices[0].Pos, sizeof(Vertex));
+		}
+	}
+
+	std::vector<std::uint32_t> indices;
+	BuildPatterns(indices);
+
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = name;
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
+	// Indices are relative to a chunk, so 16 bits suffice unless a chunk alone has more
+	// vertices than that.
+	if(chunkVertexCount <= 0x10000)
+	{
+		std::vector<std::uint16_t> indices16(indices.begin(), indices.end());
+		const UINT ibByteSize = (UINT)indices16.size() * sizeof(std::uint16_t);
+
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices16.data(), ibByteSize);
+
+		geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
+	}
+	else
+	{
+		const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
+
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+
+		geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
+	}
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
+
+	geo->DrawArgs["terrain"] = submesh;
+
+	return geo;
+}
+
+UINT Terrain::ChunkCount()const
+{
+	return mChunkCountX * mChunkCountZ;
+}
+
+UINT Terrain::LodCount()const
+{
+	return mLodCount;
+}
+
+const BoundingBox& Terrain::ChunkBounds(UINT chunk)const
+{
+	return mChunkBounds[chunk];
+}
+
+void Terrain::SelectLods(const XMFLOAT3& eyePosW)
+{
+	XMVECTOR eye = XMLoadFloat3(&eyePosW);
+
+	for(UINT chunk = 0; chunk < ChunkCount(); ++chunk)
+	{
+		// Distance from the eye to the nearest point of the chunk.
+		XMVECTOR center = XMLoadFloat3(&mChunkBounds[chunk].Center);
+		XMVECTOR extents = XMLoadFloat3(&mChunkBounds[chunk].Extents);
+		XMVECTOR offset = XMVectorMax(XMVectorAbs(eye - center) - extents, XMVectorZero());
+		float distance = XMVectorGetX(XMVector3Length(offset));
+
+		UINT lod = 0;
+		for(float lodStart = mLodDistance; lod + 1 < mLodCount && distance >= lodStart; lodStart *= 2.0f)
+			lod++;
+
+		mChunkLods[chunk] = lod;
+	}
+
+	// Refine chunks that are more than one level coarser than a neighbour until none
+	// are.  LODs only decrease, so this terminates.
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(UINT cz = 0; cz < mChunkCountZ; ++cz)
+		{
+			for(UINT cx = 0; cx < mChunkCountX; ++cx)
+			{
+				UINT& lod = mChunkLods[cz * mChunkCountX + cx];
+
+				UINT finest = lod;
+				if(cx > 0)                 finest = (std::min)(finest, mChunkLods[cz * mChunkCountX + cx - 1]);
+				if(cx + 1 < mChunkCountX)  finest = (std::min)(finest, mChunkLods[cz * mChunkCountX + cx + 1]);
+				if(cz > 0)                 finest = (std::min)(finest, mChunkLods[(cz - 1) * mChunkCountX + cx]);
+				if(cz + 1 < mChunkCountZ)  finest = (std::min)(finest, mChunkLods[(cz + 1) * mChunkCountX + cx]);
+
+				if(lod > finest + 1)
+				{
+					lod = finest + 1;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for(UINT cz = 0; cz < mChunkCountZ; ++cz)
+	{
+		for(UINT cx = 0; cx < mChunkCountX; ++cx)
+		{
+			const UINT lod = mChunkLods[cz * mChunkCountX + cx];
+
+			UINT mask = 0;
+			if(cx > 0 && mChunkLods[cz * mChunkCountX + cx - 1] > lod)                mask |= StitchLeft;
+			if(cx + 1 < mChunkCountX && mChunkLods[cz * mChunkCountX + cx + 1] > lod) mask |= StitchRight;
+			if(cz > 0 && mChunkLods[(cz - 1) * mChunkCountX + cx] > lod)              mask |= StitchTop;
+			if(cz + 1 < mChunkCountZ && mChunkLods[(cz + 1) * mChunkCountX + cx] > lod) mask |= StitchBottom;
+
+			mChunkStitchMasks[cz * mChunkCountX + cx] = mask;
+		}
+	}
+}
+
+UINT Terrain::ChunkLod(UINT chunk)const
+{
+	return mChunkLods[chunk];
+}
+
+SubmeshGeometry Terrain::ChunkDrawArgs(UINT chunk, const SubmeshGeometry& terrainArgs)const
+{
+	const Pattern& pattern = mPatterns[mChunkLods[chunk] * StitchMaskCount + mChunkStitchMasks[chunk]];
+	const UINT chunkVertexCount = (mChunkQuadCount + 1) * (mChunkQuadCount + 1);
+
+	SubmeshGeometry args;
+	args.IndexCount = pattern.IndexCount;
+	args.StartIndexLocation = terrainArgs.StartIndexLocation + pattern.StartIndex;
+	args.BaseVertexLocation = terrainArgs.BaseVertexLocation + (INT)(chunk * chunkVertexCount);
+	args.Bounds = mChunkBounds[chunk];
+	return args;
+}
+
+void Terrain::BuildPatterns(std::vector<std::uint32_t>& indices)
+{
+	mPatterns.assign(mLodCount * StitchMaskCount, Pattern());
+
+	for(UINT lod = 0; lod < mLodCount; ++lod)
+	{
+		const UINT step = 1u << lod;
+
+		// Neighbours are never coarser than the coarsest LOD.
+		const UINT maskCount = lod + 1 < mLodCount ? StitchMaskCount : 1;
+		for(UINT mask = 0; mask < maskCount; ++mask)
+		{
+			Pattern& pattern = mPatterns[lod * StitchMaskCount + mask];
+			pattern.StartIndex = (UINT)indices.size();
+
+			// Same winding as GeometryGenerator::CreateGrid.  Collapsed vertices leave
+			// degenerate triangles along stitched edges, which are dropped.
+			for(UINT i = 0; i < mChunkQuadCount; i += step)
+			{
+				for(UINT j = 0; j < mChunkQuadCount; j += step)
+				{
+					UINT a = StitchedVertex(i, j, step, mask);
+					UINT b = StitchedVertex(i, j + step, step, mask);
+					UINT c = StitchedVertex(i + step, j, step, mask);
+					UINT d = StitchedVertex(i + step, j + step, step, mask);
+
+					if(a != b && b != c && a != c)
+					{
+						indices.push_back(a);
+						indices.push_back(b);
+						indices.push_back(c);
+					}
+
+					if(c != b && b != d && c != d)
+					{
+						indices.push_back(c);
+						indices.push_back(b);
+						indices.push_back(d);
+					}
+				}
+			}
+
+			pattern.IndexCount = (UINT)indices.size() - pattern.StartIndex;
+		}
+
+		for(UINT mask = maskCount; mask < StitchMaskCount; ++mask)
+			mPatterns[lod * StitchMaskCount + mask] = mPatterns[lod * StitchMaskCount];
+	}
+}
+
+UINT Terrain::StitchedVertex(UINT i, UINT j, UINT step, UINT stitchMask)const
+{
+	// A coarser neighbour only has the even vertices of the shared edge, so the odd
+	// ones are moved onto the even vertex before them.  Corners are always even.
+	if((stitchMask & StitchLeft) != 0 && j == 0 && (i / step) % 2 == 1)
+		i -= step;
+	if((stitchMask & StitchRight) != 0 && j == mChunkQuadCount && (i / step) % 2 == 1)
+		i -= step;
+	if((stitchMask & StitchTop) != 0 && i == 0 && (j / step) % 2 == 1)
+		j -= step;
+	if((stitchMask & StitchBottom) != 0 && i == mChunkQuadCount && (j / step) % 2 == 1)
+		j -= step;
+
+	return i * (mChunkQuadCount + 1) + j;
+}
@@ -0,0 +1,89 @@
+//***************************************************************************************
+// Terrain.h
+//
+// Height field terrain split into square chunks, each drawn at a level of detail picked
+// from its distance to the eye.  LOD l draws every 2^l-th vertex of the chunk.  All
+// chunks share one index buffer holding a pattern per LOD and stitch mask, and each
+// chunk's vertices are addressed through BaseVertexLocation, so indices stay within a
+// chunk and the terrain can grow past the 16-bit limit.  Neighbouring chunks differ by
+// at most one LOD; the edges a chunk shares with coarser neighbours collapse their odd
+// vertices onto the even ones, so the two edges meet without cracks.
+//***************************************************************************************
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "../../Common/d3dUtil.h"
+#include "FrameResource.h"
+#include <functional>
+
+class Terrain
+{
+public:
+	// Stitch mask bits: set for each edge whose neighbour is one LOD coarser.
+	static const UINT StitchLeft = 0x1;
+	static const UINT StitchRight = 0x2;
+	static const UINT StitchTop = 0x4;
+	static const UINT StitchBottom = 0x8;
+	static const UINT StitchMaskCount = 16;
+
+	// chunkQuadCount is the number of quads along a chunk side at LOD 0 and must be a
+	// power of two.  Chunks switch to LOD l beyond lodDistance * 2^(l-1) from the eye.
+	Terrain(float width, float depth, UINT chunkCountX, UINT chunkCountZ, UINT chunkQuadCount, float lodDistance);
+	Terrain(const Terrain& rhs) = delete;
+	Terrain& operator=(const Terrain& rhs) = delete;
+	~Terrain() = default;
+
+	// Builds the vertices of every chunk and the shared index patterns.  height(x, z)
+	// gives the terrain height.  The single "terrain" draw arg spans the whole
+	// geometry; pass it to ChunkDrawArgs once the geometry is in its final buffers.
+	std::unique_ptr<MeshGeometry> BuildGeometry(const std::string& name,
+		const std::function<float(float, float)>& height);
+
+	UINT ChunkCount()const;
+	UINT LodCount()const;
+
+	// World space bounds of a chunk.
+	const DirectX::BoundingBox& ChunkBounds(UINT chunk)const;
+
+	// Picks the LOD of every chunk for an eye at eyePosW, refining chunks as needed so
+	// neighbours differ by at most one level, and the stitch mask of every chunk.
+	void SelectLods(const DirectX::XMFLOAT3& eyePosW);
+
+	UINT ChunkLod(UINT chunk)const;
+
+	// Draw arguments of chunk at its selected LOD.  terrainArgs is the "terrain" draw
+	// arg of the geometry, which locates the terrain within pooled buffers.
+	SubmeshGeometry ChunkDrawArgs(UINT chunk, const SubmeshGeometry& terrainArgs)const;
+
+private:
+	struct Pattern
+	{
+		UINT StartIndex = 0;
+		UINT IndexCount = 0;
+	};
+
+	void BuildPatterns(std::vector<std::uint32_t>& indices);
+
+	// Vertex (i, j) of a chunk, row i along -z and column j along +x, after collapsing
+	// the odd vertices of stitched edges at step.
+	UINT StitchedVertex(UINT i, UINT j, UINT step, UINT stitchMask)const;
+
+private:
+	float mWidth = 0.0f;
+	float mDepth = 0.0f;
+	UINT mChunkCountX = 0;
+	UINT mChunkCountZ = 0;
+	UINT mChunkQuadCount = 0;
+	UINT mLodCount = 0;
+	float mLodDistance = 0.0f;
+
+	// Indexed by lod * StitchMaskCount + stitch mask.
+	std::vector<Pattern> mPatterns;
+
+	std::vector<DirectX::BoundingBox> mChunkBounds;
+	std::vector<UINT> mChunkLods;
+	std::vector<UINT> mChunkStitchMasks;
+};
+
+#endif // TERRAIN_H
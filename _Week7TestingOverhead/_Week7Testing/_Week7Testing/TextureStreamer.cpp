@@ -0,0 +1,710 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+#include "../../Common/DDSTextureLoader.h"
+#include <algorithm>
+#include <cmath>
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device, UploadRing* uploadRing, int numFrameResources, UINT64 budgetBytes)
+{
+	md3dDevice = device;
+	mUploadRing = uploadRing;
+	mNumFrameResources = numFrameResources;
+	mBudgetBytes = budgetBytes;
+
+	// Streaming mips needs the shader LOD clamp, which comes with tier 2.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	if(SUCCEEDED(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))))
+		mTiledResourcesSupported = options.TiledResourcesTier >= D3D12_TILED_RESOURCES_TIER_2;
+
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+	ID3D12CommandAllocator* alloc = NextCopyAllocator();
+	ThrowIfFailed(md3dDevice->CreateCommandList(
+		0,
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		alloc,
+		nullptr,
+		IID_PPV_ARGS(mCopyList.GetAddressOf())));
+
+	// Start off in a closed state.  Update resets it before recording.
+	mCopyList->Close();
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// The workers and the copy queue still reference the jobs, tile heaps and upload heaps.
+	mLoadTasks.wait();
+
+	if(mFence != nullptr)
+		WaitForCopies();
+}
+
+void TextureStreamer::LoadPlaceholder(ID3D12GraphicsCommandList* cmdList, const std::wstring& filename)
+{
+	mPlaceholder.Name = "placeholderTex";
+	mPlaceholder.Filename = filename;
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice,
+		cmdList, mPlaceholder.Filename.c_str(),
+		mPlaceholder.Resource, mPlaceholder.UploadHeap));
+}
+
+void TextureStreamer::BuildDescriptors(ID3D12DescriptorHeap* srvHeap, UINT placeholderHeapIndex, UINT descriptorSize)
+{
+	mSrvHeap = srvHeap;
+	mPlaceholderHeapIndex = placeholderHeapIndex;
+	mDescriptorSize = descriptorSize;
+
+	CreateSrv(mPlaceholder.Resource.Get(), D3D12_SRV_DIMENSION_TEXTURE2D, mPlaceholderHeapIndex);
+	CreateSrv(mPlaceholder.Resource.Get(), D3D12_SRV_DIMENSION_TEXTURE2DARRAY, mPlaceholderHeapIndex + 1);
+}
+
+void TextureStreamer::Request(Texture* tex, UINT srvHeapIndex, D3D12_SRV_DIMENSION viewDimension)
+{
+	auto streamed = std::make_unique<StreamedTexture>();
+	streamed->Tex = tex;
+	streamed->Filename = tex->Filename;
+	streamed->SrvHeapIndex = srvHeapIndex;
+	streamed->ViewDimension = viewDimension;
+	streamed->Reserved = mTiledResourcesSupported && viewDimension == D3D12_SRV_DIMENSION_TEXTURE2D;
+	streamed->Busy = true;
+
+	auto job = std::make_unique<StreamJob>();
+	job->Tex = streamed.get();
+	job->Initial = true;
+
+	mTexturesBySlot[srvHeapIndex] = streamed.get();
+	mTextures.push_back(std::move(streamed));
+
+	StartJob(std::move(job));
+}
+
+void TextureStreamer::ReportScreenSize(UINT srvHeapIndex, float pixelsPerRepeat)
+{
+	auto it = mTexturesBySlot.find(srvHeapIndex);
+	if(it != mTexturesBySlot.end())
+		it->second->PixelsPerRepeat = std::max(it->second->PixelsPerRepeat, pixelsPerRepeat);
+}
+
+UINT TextureStreamer::Update()
+{
+	std::vector<std::unique_ptr<StreamJob>> ready;
+	{
+		std::lock_guard<std::mutex> lock(mReadyMutex);
+		ready.swap(mReady);
+	}
+
+	bool signal = false;
+
+	// Unmap the evicted mips that no recorded frame can sample any more.
+	for(auto& e : mEvictions)
+	{
+		if(e.FramesLeft > 0 && --e.FramesLeft == 0)
+		{
+			MapTiles(*e.Tex, e.Mip, nullptr);
+			e.Fence = mCurrentFence + 1;
+			signal = true;
+		}
+	}
+
+	if(!ready.empty())
+	{
+		SubmitJobs(ready);
+		signal = true;
+	}
+
+	if(signal)
+		ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), ++mCurrentFence));
+
+	// Publish every job the copy queue has finished.
+	UINT64 completedFence = mFence->GetCompletedValue();
+
+	UINT publishedCount = 0;
+	for(size_t i = 0; i < mInFlight.size(); )
+	{
+		if(mInFlight[i]->Fence <= completedFence)
+		{
+			if(mInFlight[i]->Initial)
+				++publishedCount;
+
+			Publish(*mInFlight[i]);
+			mInFlight[i] = std::move(mInFlight.back());
+			mInFlight.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	// Release the heaps of the mips that are unmapped.
+	for(size_t i = 0; i < mEvictions.size(); )
+	{
+		Eviction& e = mEvictions[i];
+		if(e.FramesLeft == 0 && e.Fence <= completedFence)
+		{
+			UINT64 bytes = MipBytes(*e.Tex, e.Mip);
+			mResidentBytes -= bytes;
+			e.Tex->ResidentBytes -= bytes;
+			e.Tex->Busy = false;
+			UpdateTextureInfo(*e.Tex);
+
+			mEvictions[i] = std::move(mEvictions.back());
+			mEvictions.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	ScheduleStreaming();
+
+	return publishedCount;
+}
+
+void TextureStreamer::Flush()
+{
+	mLoadTasks.wait();
+	Update();
+	WaitForCopies();
+	Update();
+}
+
+UINT TextureStreamer::ResolveSrvHeapIndex(UINT srvHeapIndex)const
+{
+	auto it = mTexturesBySlot.find(srvHeapIndex);
+	if(it == mTexturesBySlot.end() || it->second->Published)
+		return srvHeapIndex;
+
+	return it->second->ViewDimension == D3D12_SRV_DIMENSION_TEXTURE2DARRAY ? mPlaceholderHeapIndex + 1 : mPlaceholderHeapIndex;
+}
+
+float TextureStreamer::MinLod(UINT srvHeapIndex)const
+{
+	auto it = mTexturesBySlot.find(srvHeapIndex);
+	if(it == mTexturesBySlot.end() || !it->second->Published)
+		return 0.0f;
+
+	return (float)it->second->ResidentMip;
+}
+
+UINT TextureStreamer::PendingCount()const
+{
+	UINT count = 0;
+	for(auto& tex : mTextures)
+	{
+		if(!tex->Published && !tex->Failed)
+			++count;
+	}
+
+	return count;
+}
+
+UINT64 TextureStreamer::ResidentBytes()const
+{
+	return mResidentBytes;
+}
+
+UINT64 TextureStreamer::BudgetBytes()const
+{
+	return mBudgetBytes;
+}
+
+bool TextureStreamer::TiledResourcesSupported()const
+{
+	return mTiledResourcesSupported;
+}
+
+void TextureStreamer::StartJob(std::unique_ptr<StreamJob> job)
+{
+	// The worker hands ownership back through mReady when it is done.
+	StreamJob* j = job.release();
+	mLoadTasks.run([this, j]()
+	{
+		RunJob(*j);
+
+		std::lock_guard<std::mutex> lock(mReadyMutex);
+		mReady.push_back(std::unique_ptr<StreamJob>(j));
+	});
+}
+
+void TextureStreamer::RunJob(StreamJob& job)
+{
+	// Runs on a worker thread: only the device, which is free threaded, and the parts
+	// of the texture that do not change while a job is running are used here.
+	try
+	{
+		if(!job.Initial)
+			LoadReservedMip(job);
+		else if(job.Tex->Reserved)
+			LoadReservedInitial(job);
+		else
+			LoadCommitted(job);
+	}
+	catch(DxException& e)
+	{
+		// The texture keeps drawing with the placeholder, or with the mips it has.
+		OutputDebugString((L"Texture streaming failed: " + e.ToString() + L"\n").c_str());
+		job.Failed = true;
+		job.Resource = nullptr;
+		job.Heaps.clear();
+		job.UploadHeap = nullptr;
+
+		// Nothing was submitted, so the ring can reuse the memory right away.
+		if(job.Upload.Id != 0)
+			mUploadRing->Free(job.Upload, nullptr, 0);
+		job.Upload = UploadRing::Allocation();
+	}
+}
+
+void TextureStreamer::LoadCommitted(StreamJob& job)
+{
+	// The file is memory-mapped and its mips are copied straight into the upload
+	// heap, so the file contents are never held in a separate system memory copy.
+	// Textures in the COMMON state are promoted to COPY_DEST by the copy queue and
+	// to PIXEL_SHADER_RESOURCE by the direct queue, so no barriers are needed.
+	BYTE* mappedData = nullptr;
+	auto allocateUpload = [&](UINT64 uploadBufferSize)
+	{
+		return AllocateUpload(job, uploadBufferSize, mappedData);
+	};
+
+	HRESULT hr = DirectX::CreateDDSTextureFromFileMapped12(md3dDevice,
+		job.Tex->Filename.c_str(), job.Resource, job.Layouts, allocateUpload);
+
+	if(mappedData != nullptr)
+		job.UploadHeap->Unmap(0, nullptr);
+
+	ThrowIfFailed(hr);
+
+	job.Desc = job.Resource->GetDesc();
+	job.FirstMip = 0;
+	job.NumMips = (UINT)job.Layouts.size();
+}
+
+void TextureStreamer::LoadReservedInitial(StreamJob& job)
+{
+	// Only the header is read to create the reserved texture.
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> noLayouts;
+	ThrowIfFailed(DirectX::LoadDDSMipsFromFileMapped12(md3dDevice,
+		job.Tex->Filename.c_str(), job.Desc, 0, 0, noLayouts, nullptr));
+
+	D3D12_RESOURCE_DESC reservedDesc = job.Desc;
+	reservedDesc.Layout = D3D12_TEXTURE_LAYOUT_64KB_UNDEFINED_SWIZZLE;
+	ThrowIfFailed(md3dDevice->CreateReservedResource(
+		&reservedDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&job.Resource)));
+	job.Desc = reservedDesc;
+
+	UINT numTiles = 0;
+	D3D12_PACKED_MIP_INFO packedMipInfo;
+	D3D12_TILE_SHAPE tileShape;
+	UINT numTilings = job.Desc.MipLevels;
+	std::vector<D3D12_SUBRESOURCE_TILING> tilings(numTilings);
+	md3dDevice->GetResourceTiling(job.Resource.Get(), &numTiles, &packedMipInfo, &tileShape,
+		&numTilings, 0, tilings.data());
+
+	job.NumStandardMips = packedMipInfo.NumStandardMips;
+	job.PackedMipTileCount = packedMipInfo.NumPackedMips > 0 ? packedMipInfo.NumTilesForPackedMips : 0;
+	job.MipTileCounts.resize(job.NumStandardMips);
+	for(UINT m = 0; m < job.NumStandardMips; ++m)
+		job.MipTileCounts[m] = tilings[m].WidthInTiles * tilings[m].HeightInTiles * tilings[m].DepthInTiles;
+
+	// Start with the standard mips no larger than CoarseMipSize and the packed tail.
+	UINT coarseMip = 0;
+	while(coarseMip < job.NumStandardMips &&
+		std::max(job.Desc.Width >> coarseMip, (UINT64)job.Desc.Height >> coarseMip) > CoarseMipSize)
+	{
+		++coarseMip;
+	}
+	job.CoarseMip = std::min(coarseMip, (UINT)job.Desc.MipLevels - 1);
+
+	for(UINT m = job.CoarseMip; m < job.NumStandardMips; ++m)
+		CreateTileHeap(job.MipTileCounts[m], job);
+	if(job.PackedMipTileCount > 0)
+		CreateTileHeap(job.PackedMipTileCount, job);
+
+	job.FirstMip = job.CoarseMip;
+	job.NumMips = job.Desc.MipLevels - job.CoarseMip;
+
+	BYTE* mappedData = nullptr;
+	auto allocateUpload = [&](UINT64 uploadBufferSize)
+	{
+		return AllocateUpload(job, uploadBufferSize, mappedData);
+	};
+
+	D3D12_RESOURCE_DESC desc;
+	HRESULT hr = DirectX::LoadDDSMipsFromFileMapped12(md3dDevice,
+		job.Tex->Filename.c_str(), desc, job.FirstMip, job.NumMips, job.Layouts, allocateUpload);
+
+	if(mappedData != nullptr)
+		job.UploadHeap->Unmap(0, nullptr);
+
+	ThrowIfFailed(hr);
+}
+
+void TextureStreamer::LoadReservedMip(StreamJob& job)
+{
+	CreateTileHeap(job.Tex->MipTileCounts[job.FirstMip], job);
+
+	BYTE* mappedData = nullptr;
+	auto allocateUpload = [&](UINT64 uploadBufferSize)
+	{
+		return AllocateUpload(job, uploadBufferSize, mappedData);
+	};
+
+	D3D12_RESOURCE_DESC desc;
+	HRESULT hr = DirectX::LoadDDSMipsFromFileMapped12(md3dDevice,
+		job.Tex->Filename.c_str(), desc, job.FirstMip, job.NumMips, job.Layouts, allocateUpload);
+
+	if(mappedData != nullptr)
+		job.UploadHeap->Unmap(0, nullptr);
+
+	ThrowIfFailed(hr);
+}
+
+ID3D12Heap* TextureStreamer::CreateTileHeap(UINT tileCount, StreamJob& job)
+{
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = (UINT64)tileCount * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+	heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	heapDesc.Alignment = 0;
+	heapDesc.Flags = D3D12_HEAP_FLAG_DENY_BUFFERS | D3D12_HEAP_FLAG_DENY_RT_DS_TEXTURES;
+
+	ComPtr<ID3D12Heap> heap;
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+	job.Heaps.push_back(heap);
+	return heap.Get();
+}
+
+uint8_t* TextureStreamer::AllocateUpload(StreamJob& job, UINT64 uploadSize, BYTE*& mappedData)
+{
+	if(mUploadRing->TryAllocate(uploadSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, job.Upload))
+	{
+		job.UploadHeap = job.Upload.Resource;
+		job.UploadOffset = job.Upload.Offset;
+		return job.Upload.CpuAddress;
+	}
+
+	// Larger than what the ring has free; mappedData tells the caller to unmap it.
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&job.UploadHeap)));
+
+	ThrowIfFailed(job.UploadHeap->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+	return mappedData;
+}
+
+void TextureStreamer::SubmitJobs(std::vector<std::unique_ptr<StreamJob>>& jobs)
+{
+	ThrowIfFailed(mCopyList->Reset(NextCopyAllocator(), nullptr));
+
+	for(auto& job : jobs)
+	{
+		StreamedTexture& tex = *job->Tex;
+
+		if(job->Failed)
+		{
+			// A failed initial load keeps the placeholder; a failed mip stops the
+			// texture from streaming any finer.
+			if(job->Initial)
+			{
+				tex.Failed = true;
+			}
+			else
+			{
+				mPendingBytes -= MipBytes(tex, job->FirstMip);
+				tex.FinestMip = tex.ResidentMip;
+			}
+			tex.Busy = false;
+			continue;
+		}
+
+		// The texture is not published yet, so nothing else reads these.
+		if(job->Initial)
+		{
+			tex.Resource = job->Resource;
+			tex.MipLevels = job->Desc.MipLevels;
+			tex.Width = (UINT)job->Desc.Width;
+			tex.Height = job->Desc.Height;
+			tex.NumStandardMips = job->NumStandardMips;
+			tex.MipTileCounts = job->MipTileCounts;
+			tex.PackedMipTileCount = job->PackedMipTileCount;
+			tex.CoarseMip = job->CoarseMip;
+			if(tex.Reserved)
+				tex.MipHeaps.resize(tex.NumStandardMips + 1);
+		}
+
+		// Tile mappings are queue operations, so they happen before the copies
+		// executed below.
+		if(tex.Reserved)
+		{
+			size_t h = 0;
+			for(UINT m = job->FirstMip; m < job->FirstMip + job->NumMips && m < tex.NumStandardMips; ++m)
+			{
+				tex.MipHeaps[m] = job->Heaps[h++];
+				MapTiles(tex, m, tex.MipHeaps[m].Get());
+			}
+
+			if(job->Initial && tex.PackedMipTileCount > 0)
+			{
+				tex.MipHeaps[tex.NumStandardMips] = job->Heaps[h++];
+				MapTiles(tex, tex.NumStandardMips, tex.MipHeaps[tex.NumStandardMips].Get());
+			}
+		}
+
+		for(UINT i = 0; i < (UINT)job->Layouts.size(); ++i)
+		{
+			D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = job->Layouts[i];
+			layout.Offset += job->UploadOffset;
+
+			CD3DX12_TEXTURE_COPY_LOCATION dst(tex.Resource.Get(), job->FirstMip + i);
+			CD3DX12_TEXTURE_COPY_LOCATION src(job->UploadHeap.Get(), layout);
+			mCopyList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+
+		// Update signals this value after the copies.
+		job->Fence = mCurrentFence + 1;
+		if(job->Upload.Id != 0)
+			mUploadRing->Free(job->Upload, mFence.Get(), job->Fence);
+		mInFlight.push_back(std::move(job));
+	}
+
+	ThrowIfFailed(mCopyList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCopyList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	mCopyAllocators.back().Fence = mCurrentFence + 1;
+}
+
+void TextureStreamer::MapTiles(StreamedTexture& tex, UINT mip, ID3D12Heap* heap)
+{
+	// The packed tail is addressed through its first mip.
+	bool packed = mip >= tex.NumStandardMips;
+
+	D3D12_TILED_RESOURCE_COORDINATE coord = {};
+	coord.Subresource = packed ? tex.NumStandardMips : mip;
+
+	D3D12_TILE_REGION_SIZE regionSize = {};
+	regionSize.NumTiles = packed ? tex.PackedMipTileCount : tex.MipTileCounts[mip];
+	regionSize.UseBox = FALSE;
+
+	// A null heap unmaps the tiles.
+	D3D12_TILE_RANGE_FLAGS rangeFlags = heap ? D3D12_TILE_RANGE_FLAG_NONE : D3D12_TILE_RANGE_FLAG_NULL;
+	UINT heapRangeStart = 0;
+	UINT rangeTileCount = regionSize.NumTiles;
+
+	mCopyQueue->UpdateTileMappings(tex.Resource.Get(), 1, &coord, &regionSize,
+		heap, 1, &rangeFlags, heap ? &heapRangeStart : nullptr, &rangeTileCount,
+		D3D12_TILE_MAPPING_FLAG_NONE);
+}
+
+void TextureStreamer::Publish(StreamJob& job)
+{
+	StreamedTexture& tex = *job.Tex;
+
+	if(job.Initial)
+	{
+		// Nothing recorded so far references this slot, so the SRV can be written now.
+		CreateSrv(tex.Resource.Get(), tex.ViewDimension, tex.SrvHeapIndex);
+
+		tex.Tex->Resource = tex.Resource;
+		tex.Tex->UploadHeap = nullptr;
+		tex.Published = true;
+
+		tex.ResidentMip = job.FirstMip;
+		tex.FinestMip = 0;
+		if(tex.Reserved)
+		{
+			tex.ResidentBytes = 0;
+			for(UINT m = job.FirstMip; m <= tex.NumStandardMips; ++m)
+				tex.ResidentBytes += MipBytes(tex, m);
+		}
+		else
+		{
+			tex.ResidentBytes = md3dDevice->GetResourceAllocationInfo(0, 1, &job.Desc).SizeInBytes;
+		}
+		mResidentBytes += tex.ResidentBytes;
+	}
+	else
+	{
+		// The finer mip is sampled from the next recorded frame on.
+		UINT64 bytes = MipBytes(tex, job.FirstMip);
+		mPendingBytes -= bytes;
+		mResidentBytes += bytes;
+		tex.ResidentBytes += bytes;
+		tex.ResidentMip = job.FirstMip;
+	}
+
+	tex.Busy = false;
+	UpdateTextureInfo(tex);
+}
+
+void TextureStreamer::ScheduleStreaming()
+{
+	// Stream in for the textures that are furthest from the detail they need first.
+	std::vector<std::pair<UINT, StreamedTexture*>> candidates;
+	for(auto& t : mTextures)
+	{
+		StreamedTexture& tex = *t;
+		UINT desired = DesiredMip(tex);
+		tex.PixelsPerRepeat = 0.0f;
+
+		if(!tex.Reserved || !tex.Published || tex.Busy)
+			continue;
+
+		// Keep one mip more than needed so a texture near a threshold does not thrash.
+		if(desired > tex.ResidentMip + 1 && tex.ResidentMip < tex.CoarseMip)
+			Evict(tex);
+		else if(desired < tex.ResidentMip)
+			candidates.push_back(std::make_pair(tex.ResidentMip - desired, &tex));
+	}
+
+	std::sort(candidates.begin(), candidates.end(),
+		[](const std::pair<UINT, StreamedTexture*>& a, const std::pair<UINT, StreamedTexture*>& b)
+	{
+		return a.first > b.first;
+	});
+
+	UINT started = 0;
+	for(auto& c : candidates)
+	{
+		if(started == MaxStreamJobsPerUpdate)
+			break;
+
+		StreamedTexture& tex = *c.second;
+		UINT mip = tex.ResidentMip - 1;
+
+		// Smaller mips of other textures may still fit.
+		UINT64 bytes = MipBytes(tex, mip);
+		if(mResidentBytes + mPendingBytes + bytes > mBudgetBytes)
+			continue;
+
+		auto job = std::make_unique<StreamJob>();
+		job->Tex = &tex;
+		job->FirstMip = mip;
+		job->NumMips = 1;
+
+		tex.Busy = true;
+		mPendingBytes += bytes;
+		StartJob(std::move(job));
+		++started;
+	}
+}
+
+void TextureStreamer::Evict(StreamedTexture& tex)
+{
+	// Shaders are clamped to the next mip from now on; the tiles are unmapped once the
+	// frames recorded with the old clamp are done.
+	Eviction e;
+	e.Tex = &tex;
+	e.Mip = tex.ResidentMip;
+	e.Heap = std::move(tex.MipHeaps[e.Mip]);
+	e.FramesLeft = mNumFrameResources;
+	mEvictions.push_back(e);
+
+	tex.ResidentMip++;
+	tex.Busy = true;
+	UpdateTextureInfo(tex);
+}
+
+UINT TextureStreamer::DesiredMip(const StreamedTexture& tex)const
+{
+	// Textures not seen this frame only keep their coarse mips.
+	UINT desired = tex.CoarseMip;
+	if(tex.PixelsPerRepeat > 0.0f)
+	{
+		float lod = log2f((float)std::max(tex.Width, tex.Height) / tex.PixelsPerRepeat);
+		desired = lod <= 0.0f ? 0 : std::min((UINT)lod, tex.CoarseMip);
+	}
+
+	return std::max(desired, tex.FinestMip);
+}
+
+UINT64 TextureStreamer::MipBytes(const StreamedTexture& tex, UINT mip)const
+{
+	UINT tiles = mip < tex.NumStandardMips ? tex.MipTileCounts[mip] : tex.PackedMipTileCount;
+	return (UINT64)tiles * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+}
+
+void TextureStreamer::UpdateTextureInfo(StreamedTexture& tex)
+{
+	tex.Tex->MipLevels = tex.MipLevels;
+	tex.Tex->ResidentMip = tex.ResidentMip;
+	tex.Tex->ResidentBytes = tex.ResidentBytes;
+}
+
+void TextureStreamer::CreateSrv(ID3D12Resource* resource, D3D12_SRV_DIMENSION viewDimension, UINT heapIndex)
+{
+	auto desc = resource->GetDesc();
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = viewDimension;
+	if(viewDimension == D3D12_SRV_DIMENSION_TEXTURE2DARRAY)
+	{
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.MipLevels = -1;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = desc.DepthOrArraySize;
+	}
+	else
+	{
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = -1;
+	}
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvHeap->GetCPUDescriptorHandleForHeapStart(), heapIndex, mDescriptorSize);
+	md3dDevice->CreateShaderResourceView(resource, &srvDesc, hDescriptor);
+}
+
+ID3D12CommandAllocator* TextureStreamer::NextCopyAllocator()
+{
+	// Reuse an allocator whose commands the copy queue has finished.
+	UINT64 completedFence = mFence->GetCompletedValue();
+	for(size_t i = 0; i < mCopyAllocators.size(); ++i)
+	{
+		if(mCopyAllocators[i].Fence <= completedFence)
+		{
+			// Keep the allocator in use at the back so SubmitJobs can tag it.
+			std::swap(mCopyAllocators[i], mCopyAllocators.back());
+			ThrowIfFailed(mCopyAllocators.back().Allocator->Reset());
+			return mCopyAllocators.back().Allocator.Get();
+		}
+	}
+
+	CopyAllocator alloc;
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(alloc.Allocator.GetAddressOf())));
+	mCopyAllocators.push_back(alloc);
+	return mCopyAllocators.back().Allocator.Get();
+}
+
+void TextureStreamer::WaitForCopies()
+{
+	if(mFence->GetCompletedValue() < mCurrentFence)
+	{
+		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
+		WaitForSingleObject(eventHandle, INFINITE);
+		CloseHandle(eventHandle);
+	}
+}
@@ -0,0 +1,237 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures in the background.  Files are read and decoded into upload heaps
+// on PPL worker threads, the copies into the default heap textures are submitted on a
+// dedicated copy queue, and a texture's SRV is only written once the copy queue fence
+// has passed.  Until then the texture's heap slot resolves to a placeholder texture.
+//
+// Where tiled resources are supported, 2D textures are reserved resources: only the
+// mips down to CoarseMipSize are loaded at first, and finer mips are streamed in and
+// out one at a time from screen size feedback, keeping the resident total under a
+// budget.  Shaders clamp sampling to the resident mips with the material's MinLod.
+//***************************************************************************************
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/UploadRing.h"
+#include <memory>
+#include <mutex>
+#include <ppl.h>
+
+class TextureStreamer
+{
+public:
+	// One placeholder view for Texture2D and one for Texture2DArray slots.
+	static const UINT PlaceholderDescriptorCount = 2;
+
+	// Mips larger than this are only streamed in when the texture needs them.
+	static const UINT CoarseMipSize = 128;
+
+	// Maximum number of finer mips started per Update.
+	static const UINT MaxStreamJobsPerUpdate = 4;
+
+	// Texture data is staged in uploadRing, or in upload heaps of their own when it
+	// is full.  A mip that was evicted stays mapped for numFrameResources more
+	// frames, since frames already recorded may still sample it.
+	TextureStreamer(ID3D12Device* device, UploadRing* uploadRing, int numFrameResources, UINT64 budgetBytes);
+	TextureStreamer(const TextureStreamer& rhs) = delete;
+	TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+	~TextureStreamer();
+
+	// Loads the placeholder texture with cmdList.  It is small and is resident
+	// once the initialization commands have executed.
+	void LoadPlaceholder(ID3D12GraphicsCommandList* cmdList, const std::wstring& filename);
+
+	// Writes the placeholder SRVs at placeholderHeapIndex in srvHeap.  Streamed
+	// textures are published into their own slots of the same heap.
+	void BuildDescriptors(ID3D12DescriptorHeap* srvHeap, UINT placeholderHeapIndex, UINT descriptorSize);
+
+	// Starts loading tex->Filename on a worker thread.  Once it is resident its SRV
+	// is written at srvHeapIndex and tex->Resource is set.
+	void Request(Texture* tex, UINT srvHeapIndex, D3D12_SRV_DIMENSION viewDimension);
+
+	// Reports that the texture at srvHeapIndex covers about pixelsPerRepeat screen
+	// pixels per repeat of the texture this frame.  The largest report since the
+	// last Update decides which mips the texture needs.
+	void ReportScreenSize(UINT srvHeapIndex, float pixelsPerRepeat);
+
+	// Submits the texture data read since the last call to the copy queue, publishes
+	// what the copy queue has finished, and starts streaming mips in or out from the
+	// screen size feedback.  Call once per frame from the main thread, after waiting
+	// on the frame resource and before any command list is recorded.  Returns the
+	// number of textures published.
+	UINT Update();
+
+	// Blocks until every requested texture is published.
+	void Flush();
+
+	// Heap slot to bind for srvHeapIndex: the placeholder while that texture is not
+	// resident yet, or if it failed to load, otherwise srvHeapIndex itself.
+	UINT ResolveSrvHeapIndex(UINT srvHeapIndex)const;
+
+	// Most detailed mip that may be sampled at srvHeapIndex.
+	float MinLod(UINT srvHeapIndex)const;
+
+	// Textures still loading.  Those that failed to load are not counted.
+	UINT PendingCount()const;
+	UINT64 ResidentBytes()const;
+	UINT64 BudgetBytes()const;
+	bool TiledResourcesSupported()const;
+
+private:
+	struct StreamedTexture
+	{
+		Texture* Tex = nullptr;
+		std::wstring Filename;
+		UINT SrvHeapIndex = 0;
+		D3D12_SRV_DIMENSION ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+
+		// Reserved textures stream their standard mips; committed ones are fully resident.
+		bool Reserved = false;
+		bool Published = false;
+
+		// The initial load failed, so the texture is never published and keeps the
+		// placeholder.
+		bool Failed = false;
+
+		// A job for this texture is running or waiting for the copy queue.
+		bool Busy = false;
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
+		UINT MipLevels = 0;
+		UINT Width = 0;
+		UINT Height = 0;
+
+		// Tiling of a reserved texture.  Mips [NumStandardMips, MipLevels) share one
+		// packed tail, which is always resident.  MipHeaps holds one heap per standard
+		// mip (null when not resident) followed by the heap of the packed tail.
+		UINT NumStandardMips = 0;
+		std::vector<UINT> MipTileCounts;
+		UINT PackedMipTileCount = 0;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> MipHeaps;
+
+		// Mips [ResidentMip, MipLevels) are resident.  Streaming keeps ResidentMip
+		// within [FinestMip, CoarseMip].
+		UINT ResidentMip = 0;
+		UINT CoarseMip = 0;
+		UINT FinestMip = 0;
+		UINT64 ResidentBytes = 0;
+
+		// Largest screen size reported since the last Update.
+		float PixelsPerRepeat = 0.0f;
+	};
+
+	// Moves through the stages: worker thread -> mReady -> copy queue -> published.
+	struct StreamJob
+	{
+		StreamedTexture* Tex = nullptr;
+
+		// The first job of a texture creates it; later jobs add one finer mip.
+		bool Initial = false;
+		bool Failed = false;
+
+		// Mips [FirstMip, FirstMip + NumMips) are copied from the upload heap.
+		UINT FirstMip = 0;
+		UINT NumMips = 0;
+
+		// Created by the initial job.
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
+		D3D12_RESOURCE_DESC Desc;
+		UINT NumStandardMips = 0;
+		std::vector<UINT> MipTileCounts;
+		UINT PackedMipTileCount = 0;
+		UINT CoarseMip = 0;
+
+		// Heaps for the copied mips, in mip order.  The packed tail's heap is last.
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Heap>> Heaps;
+
+		// Layouts are relative to UploadOffset in UploadHeap, which is the upload
+		// ring's heap unless the ring was full.
+		UploadRing::Allocation Upload;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
+		UINT64 UploadOffset = 0;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Layouts;
+
+		// Copy queue fence value that marks the copy as complete.
+		UINT64 Fence = 0;
+	};
+
+	// A mip that is no longer sampled and is unmapped once recorded frames are done.
+	struct Eviction
+	{
+		StreamedTexture* Tex = nullptr;
+		UINT Mip = 0;
+		Microsoft::WRL::ComPtr<ID3D12Heap> Heap = nullptr;
+		int FramesLeft = 0;
+		UINT64 Fence = 0;
+	};
+
+	struct CopyAllocator
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> Allocator = nullptr;
+		UINT64 Fence = 0;
+	};
+
+	void RunJob(StreamJob& job);
+	void LoadCommitted(StreamJob& job);
+	void LoadReservedInitial(StreamJob& job);
+	void LoadReservedMip(StreamJob& job);
+	ID3D12Heap* CreateTileHeap(UINT tileCount, StreamJob& job);
+	uint8_t* AllocateUpload(StreamJob& job, UINT64 uploadSize, BYTE*& mappedData);
+
+	void SubmitJobs(std::vector<std::unique_ptr<StreamJob>>& jobs);
+	void MapTiles(StreamedTexture& tex, UINT mip, ID3D12Heap* heap);
+	void Publish(StreamJob& job);
+	void ScheduleStreaming();
+	void StartJob(std::unique_ptr<StreamJob> job);
+	void Evict(StreamedTexture& tex);
+
+	UINT DesiredMip(const StreamedTexture& tex)const;
+	UINT64 MipBytes(const StreamedTexture& tex, UINT mip)const;
+	void UpdateTextureInfo(StreamedTexture& tex);
+
+	void CreateSrv(ID3D12Resource* resource, D3D12_SRV_DIMENSION viewDimension, UINT heapIndex);
+	ID3D12CommandAllocator* NextCopyAllocator();
+	void WaitForCopies();
+
+private:
+	ID3D12Device* md3dDevice = nullptr;
+	UploadRing* mUploadRing = nullptr;
+	int mNumFrameResources = 0;
+	bool mTiledResourcesSupported = false;
+
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCopyList;
+	std::vector<CopyAllocator> mCopyAllocators;
+
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	UINT64 mCurrentFence = 0;
+
+	ID3D12DescriptorHeap* mSrvHeap = nullptr;
+	UINT mDescriptorSize = 0;
+	UINT mPlaceholderHeapIndex = 0;
+
+	Texture mPlaceholder;
+
+	std::vector<std::unique_ptr<StreamedTexture>> mTextures;
+	std::unordered_map<UINT, StreamedTexture*> mTexturesBySlot;
+
+	// Bytes of the resident mips, and of the mips being streamed in.
+	UINT64 mBudgetBytes = 0;
+	UINT64 mResidentBytes = 0;
+	UINT64 mPendingBytes = 0;
+
+	// Jobs move from the workers to mReady (guarded by mReadyMutex), then to
+	// mInFlight once their copies are submitted.
+	concurrency::task_group mLoadTasks;
+	std::mutex mReadyMutex;
+	std::vector<std::unique_ptr<StreamJob>> mReady;
+	std::vector<std::unique_ptr<StreamJob>> mInFlight;
+
+	std::vector<Eviction> mEvictions;
+};
+
+#endif // TEXTURESTREAMER_H
@@ -0,0 +1,129 @@
+//***************************************************************************************
+// TransformStore.cpp
+//***************************************************************************************
+
+#include "TransformStore.h"
+#include <intrin.h>
+#include <ppl.h>
+
+using namespace DirectX;
+
+TransformStore::TransformStore(UINT frameResourceCount)
+	: mFrameResourceCount(frameResourceCount),
+	mDirtyWords(frameResourceCount)
+{
+}
+
+UINT TransformStore::Add(FXMMATRIX world, CXMMATRIX texTransform, UINT materialIndex)
+{
+	const UINT handle = Count();
+
+	mWorld.emplace_back();
+	mTexTransform.emplace_back();
+	XMStoreFloat4x4(&mWorld.back(), world);
+	XMStoreFloat4x4(&mTexTransform.back(), texTransform);
+	mDisplacementMapTexelSize.push_back(XMFLOAT2(1.0f, 1.0f));
+	mGridSpatialStep.push_back(1.0f);
+	mMaterialIndex.push_back(materialIndex);
+
+	if(handle % 64 == 0)
+	{
+		for(auto& words : mDirtyWords)
+			words.push_back(0);
+	}
+
+	MarkDirty(handle);
+	return handle;
+}
+
+UINT TransformStore::Count()const
+{
+	return (UINT)mWorld.size();
+}
+
+const XMFLOAT4X4& TransformStore::World(UINT handle)const
+{
+	return mWorld[handle];
+}
+
+const XMFLOAT4X4& TransformStore::TexTransform(UINT handle)const
+{
+	return mTexTransform[handle];
+}
+
+void TransformStore::SetWorld(UINT handle, FXMMATRIX world)
+{
+	XMStoreFloat4x4(&mWorld[handle], world);
+	MarkDirty(handle);
+}
+
+void TransformStore::SetTexTransform(UINT handle, FXMMATRIX texTransform)
+{
+	XMStoreFloat4x4(&mTexTransform[handle], texTransform);
+	MarkDirty(handle);
+}
+
+void TransformStore::SetDisplacementMap(UINT handle, const XMFLOAT2& texelSize, float gridSpatialStep)
+{
+	mDisplacementMapTexelSize[handle] = texelSize;
+	mGridSpatialStep[handle] = gridSpatialStep;
+	MarkDirty(handle);
+}
+
+void TransformStore::Update(UINT frameIndex, UploadBuffer<ObjectData>& objectBuffer)
+{
+	assert(frameIndex < mFrameResourceCount);
+
+	std::vector<UINT64>& words = mDirtyWords[frameIndex];
+	const UINT wordCount = (UINT)words.size();
+
+	if(Count() < ParallelUpdateThreshold)
+	{
+		UpdateWords(words.data(), 0, wordCount, objectBuffer);
+		return;
+	}
+
+	// Blocks write disjoint ranges of the object buffer and of the bitset.
+	const UINT blockCount = (wordCount + ParallelBlockWords - 1) / ParallelBlockWords;
+	concurrency::parallel_for(0u, blockCount, [&](UINT block)
+	{
+		UINT firstWord = block * ParallelBlockWords;
+		UpdateWords(words.data(), firstWord, (std::min)(firstWord + ParallelBlockWords, wordCount), objectBuffer);
+	});
+}
+
+void TransformStore::MarkDirty(UINT handle)
+{
+	const UINT64 bit = 1ull << (handle % 64);
+	for(auto& words : mDirtyWords)
+		words[handle / 64] |= bit;
+}
+
+void TransformStore::UpdateWords(UINT64* dirtyWords, UINT firstWord, UINT endWord, UploadBuffer<ObjectData>& objectBuffer)const
+{
+	for(UINT word = firstWord; word < endWord; ++word)
+	{
+		UINT64 bits = dirtyWords[word];
+		if(bits == 0)
+			continue;
+
+		dirtyWords[word] = 0;
+		while(bits != 0)
+		{
+			unsigned long bit = 0;
+			_BitScanForward64(&bit, bits);
+			bits &= bits - 1;
+
+			const UINT handle = word * 64 + bit;
+
+			ObjectData objData;
+			XMStoreFloat4x4(&objData.World, XMMatrixTranspose(XMLoadFloat4x4(&mWorld[handle])));
+			XMStoreFloat4x4(&objData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&mTexTransform[handle])));
+			objData.DisplacementMapTexelSize = mDisplacementMapTexelSize[handle];
+			objData.GridSpatialStep = mGridSpatialStep[handle];
+			objData.MaterialIndex = mMaterialIndex[handle];
+
+			objectBuffer.CopyData(handle, objData);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+//***************************************************************************************
+// TransformStore.h
+//
+// Per-object data of the render items, packed in arrays indexed by handle.  A handle
+// is also the index of the object's data in the frame resources' object buffers.  Each
+// frame resource has its own dirty bitset, with one bit per object.  Updating a frame's
+// object buffer is then a linear scan over the bitset, 64 objects per word, that only
+// touches the objects that changed.  Large stores split the scan across worker
+// threads.
+//***************************************************************************************
+
+#ifndef TRANSFORMSTORE_H
+#define TRANSFORMSTORE_H
+
+#include "../../Common/d3dUtil.h"
+#include "FrameResource.h"
+
+class TransformStore
+{
+public:
+	explicit TransformStore(UINT frameResourceCount);
+	TransformStore(const TransformStore& rhs) = delete;
+	TransformStore& operator=(const TransformStore& rhs) = delete;
+	~TransformStore() = default;
+
+	// Adds an object, dirty in every frame resource, and returns its handle.  Handles
+	// are handed out in order from 0.  materialIndex is the object's element in the
+	// material buffer.
+	UINT Add(DirectX::FXMMATRIX world, DirectX::CXMMATRIX texTransform, UINT materialIndex);
+
+	UINT Count()const;
+
+	const DirectX::XMFLOAT4X4& World(UINT handle)const;
+	const DirectX::XMFLOAT4X4& TexTransform(UINT handle)const;
+
+	// Each marks the object dirty in every frame resource.
+	void SetWorld(UINT handle, DirectX::FXMMATRIX world);
+	void SetTexTransform(UINT handle, DirectX::FXMMATRIX texTransform);
+	void SetDisplacementMap(UINT handle, const DirectX::XMFLOAT2& texelSize, float gridSpatialStep);
+
+	// Writes the objects that changed since frameIndex was last updated to
+	// objectBuffer and clears their dirty bits for that frame.
+	void Update(UINT frameIndex, UploadBuffer<ObjectData>& objectBuffer);
+
+private:
+	void MarkDirty(UINT handle);
+
+	// Writes the dirty objects of words [firstWord, endWord) of a frame's bitset.
+	void UpdateWords(UINT64* dirtyWords, UINT firstWord, UINT endWord, UploadBuffer<ObjectData>& objectBuffer)const;
+
+private:
+	// Stores with at least this many objects update in parallel, in blocks of
+	// ParallelBlockWords bitset words.
+	static const UINT ParallelUpdateThreshold = 16384;
+	static const UINT ParallelBlockWords = 64;
+
+	UINT mFrameResourceCount = 0;
+
+	std::vector<DirectX::XMFLOAT4X4> mWorld;
+	std::vector<DirectX::XMFLOAT4X4> mTexTransform;
+	std::vector<DirectX::XMFLOAT2> mDisplacementMapTexelSize;
+	std::vector<float> mGridSpatialStep;
+	std::vector<UINT> mMaterialIndex;
+
+	// One bitset per frame resource, 64 objects per word.
+	std::vector<std::vector<UINT64>> mDirtyWords;
+};
+
+#endif // TRANSFORMSTORE_H
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <xmmintrin.h>
 
 using namespace DirectX;
 
@@ -27,28 +29,34 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mX.resize(n);
+    mZ.resize(m);
 
-    // Generate grid vertices in system memory.
+    mPrevHeights.assign(m*n, 0.0f);
+    mCurrHeights.assign(m*n, 0.0f);
+    mNormalX.assign(m*n, 0.0f);
+    mNormalY.assign(m*n, 1.0f);
+    mNormalZ.assign(m*n, 0.0f);
+
+    // Generate grid coordinates in system memory.
 
     float halfWidth = (n - 1)*dx*0.5f;
     float halfDepth = (m - 1)*dx*0.5f;
     for(int i = 0; i < m; ++i)
-    {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
-
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
-    }
+        mZ[i] = halfDepth - i*dx;
+
+    for(int j = 0; j < n; ++j)
+        mX[j] = -halfWidth + j*dx;
+
+    // Derive tex-coords from position by 
+    // mapping [-w/2,w/2] --> [0,1]
+    mTexU.resize(n);
+    mTexV.resize(m);
+    for(int j = 0; j < n; ++j)
+        mTexU[j] = 0.5f + mX[j] / Width();
+
+    for(int i = 0; i < m; ++i)
+        mTexV[i] = 0.5f - mZ[i] / Depth();
 }
 
 Waves::~Waves()
@@ -85,73 +93,143 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+XMFLOAT3 Waves::TangentX(int i)const
 {
-	static float t = 0;
+	int row = i / mNumCols;
+	int col = i % mNumCols;
+
+	// Boundary points never move.
+	if(row == 0 || row == mNumRows - 1 || col == 0 || col == mNumCols - 1)
+		return XMFLOAT3(1.0f, 0.0f, 0.0f);
+
+	float l = mCurrHeights[i - 1];
+	float r = mCurrHeights[i + 1];
+
+	XMFLOAT3 tangent;
+	XMStoreFloat3(&tangent, XMVector3Normalize(XMVectorSet(2.0f*mSpatialStep, r - l, 0.0f, 0.0f)));
+	return tangent;
+}
 
+int Waves::Update(float dt, int maxSteps)
+{
 	// Accumulate time.
-	t += dt;
+	mTimeSinceStep += dt;
+
+	// Run the fixed time steps that fit in the accumulated time, up to maxSteps.
+	// Time beyond that is dropped, so a long or skipped frame is not followed
+	// by a burst of catch-up steps.
+	int steps = 0;
+	while(mTimeSinceStep >= mTimeStep && steps < maxSteps)
+	{
+		Step();
+		mTimeSinceStep -= mTimeStep;
+		++steps;
+	}
+
+	if(mTimeSinceStep >= mTimeStep)
+		mTimeSinceStep = 0.0f;
+
+	// The normals only depend on the latest solution.
+	if(steps > 0)
+		ComputeNormals();
+
+	return steps;
+}
+
+void Waves::Step()
+{
+	const __m128 k1 = _mm_set1_ps(mK1);
+	const __m128 k2 = _mm_set1_ps(mK2);
+	const __m128 k3 = _mm_set1_ps(mK3);
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	// Only update interior points; we use zero boundary conditions.
+	concurrency::parallel_for(1, mNumRows - 1, [&](int i)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element) 
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to 
+		// keep consistent with our row indices going down.
+		float* prev = &mPrevHeights[i*mNumCols];
+		const float* curr = &mCurrHeights[i*mNumCols];
+		const float* up = curr - mNumCols;
+		const float* down = curr + mNumCols;
+
+		int j = 1;
+		for(; j + 4 <= mNumCols - 1; j += 4)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
-		});
-
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
-
-		t = 0.0f; // reset time
-
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+			__m128 neighbors = _mm_add_ps(
+				_mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)),
+				_mm_add_ps(_mm_loadu_ps(curr + j + 1), _mm_loadu_ps(curr + j - 1)));
+
+			__m128 h = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(k1, _mm_loadu_ps(prev + j)), _mm_mul_ps(k2, _mm_loadu_ps(curr + j))),
+				_mm_mul_ps(k3, neighbors));
+
+			_mm_storeu_ps(prev + j, h);
+		}
+
+		// Remaining points of the row.
+		for(; j < mNumCols - 1; ++j)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
-			}
-		});
-	}
+			prev[j] = mK1*prev[j] + mK2*curr[j] +
+				mK3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
+		}
+	});
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::ComputeNormals()
+{
+	//
+	// Compute normals using finite difference scheme.
+	//
+	const __m128 ny = _mm_set1_ps(2.0f*mSpatialStep);
+	const __m128 ny2 = _mm_mul_ps(ny, ny);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	concurrency::parallel_for(1, mNumRows - 1, [&](int i)
+	{
+		const float* curr = &mCurrHeights[i*mNumCols];
+		const float* up = curr - mNumCols;
+		const float* down = curr + mNumCols;
+		float* normalX = &mNormalX[i*mNumCols];
+		float* normalY = &mNormalY[i*mNumCols];
+		float* normalZ = &mNormalZ[i*mNumCols];
+
+		int j = 1;
+		for(; j + 4 <= mNumCols - 1; j += 4)
+		{
+			__m128 nx = _mm_sub_ps(_mm_loadu_ps(curr + j - 1), _mm_loadu_ps(curr + j + 1));
+			__m128 nz = _mm_sub_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz)), ny2);
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+			_mm_storeu_ps(normalX + j, _mm_mul_ps(nx, invLength));
+			_mm_storeu_ps(normalY + j, _mm_mul_ps(ny, invLength));
+			_mm_storeu_ps(normalZ + j, _mm_mul_ps(nz, invLength));
+		}
+
+		// Remaining points of the row.
+		for(; j < mNumCols - 1; ++j)
+		{
+			float nx = curr[j-1] - curr[j+1];
+			float nz = down[j] - up[j];
+			float invLength = 1.0f / sqrtf(nx*nx + nz*nz + 4.0f*mSpatialStep*mSpatialStep);
+
+			normalX[j] = nx*invLength;
+			normalY[j] = 2.0f*mSpatialStep*invLength;
+			normalZ[j] = nz*invLength;
+		}
+	});
 }
 
 void Waves::Disturb(int i, int j, float magnitude)
@@ -163,10 +241,9 @@ void Waves::Disturb(int i, int j, float magnitude)
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeights[i*mNumCols+j]     += magnitude;
+	mCurrHeights[i*mNumCols+j+1]   += halfMag;
+	mCurrHeights[i*mNumCols+j-1]   += halfMag;
+	mCurrHeights[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeights[(i-1)*mNumCols+j] += halfMag;
 }
-	
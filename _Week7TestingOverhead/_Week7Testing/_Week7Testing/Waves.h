@@ -4,12 +4,17 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// The solution is stored as a structure of arrays: only the heights change, so they
+// are kept in their own float arrays and the stencil and normal passes run four grid
+// points at a time with SSE.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
 #include <vector>
+#include <ppl.h>
 #include <DirectXMath.h>
 
 class Waves
@@ -28,17 +33,51 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+    DirectX::XMFLOAT3 Position(int i)const
+	{
+		return DirectX::XMFLOAT3(mX[i % mNumCols], mCurrHeights[i], mZ[i / mNumCols]);
+	}
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    DirectX::XMFLOAT3 Normal(int i)const
+	{
+		return DirectX::XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]);
+	}
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    DirectX::XMFLOAT3 TangentX(int i)const;
 
-	void Update(float dt);
+	// Advances the simulation by dt seconds in fixed time steps, running at most
+	// maxSteps of them; time left over beyond that is dropped.  Returns the number
+	// of steps taken.
+	int Update(float dt, int maxSteps = 4);
 	void Disturb(int i, int j, float magnitude);
 
+	// Writes the current solution as VertexCount() vertices with Pos, Normal and TexC
+	// members straight into dst, which is normally mapped upload heap memory.  Rows are
+	// written in parallel, each vertex once and in order.
+	template<typename VertexT>
+	void WriteVertices(VertexT* dst)const
+	{
+		concurrency::parallel_for(0, mNumRows, [this, dst](int i)
+		{
+			VertexT* row = dst + i*mNumCols;
+			const int rowStart = i*mNumCols;
+			for(int j = 0; j < mNumCols; ++j)
+			{
+				VertexT v;
+				v.Pos = DirectX::XMFLOAT3(mX[j], mCurrHeights[rowStart + j], mZ[i]);
+				v.Normal = DirectX::XMFLOAT3(mNormalX[rowStart + j], mNormalY[rowStart + j], mNormalZ[rowStart + j]);
+				v.TexC = DirectX::XMFLOAT2(mTexU[j], mTexV[i]);
+				row[j] = v;
+			}
+		});
+	}
+
+private:
+    void Step();
+    void ComputeNormals();
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -52,12 +91,23 @@ private:
     float mK3 = 0.0f;
 
     float mTimeStep = 0.0f;
+    float mTimeSinceStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Grid x coordinate of each column and z coordinate of each row.
+    std::vector<float> mX;
+    std::vector<float> mZ;
+
+    // Texture coordinates of each column and row; [-w/2,w/2] maps to [0,1].
+    std::vector<float> mTexU;
+    std::vector<float> mTexV;
+
+    // Heights and normal components of every grid point, row by row.
+    std::vector<float> mPrevHeights;
+    std::vector<float> mCurrHeights;
+    std::vector<float> mNormalX;
+    std::vector<float> mNormalY;
+    std::vector<float> mNormalZ;
 };
 
 #endif // WAVES_H
\ No newline at end of file
@@ -0,0 +1,159 @@
+//***************************************************************************************
+// WavesBenchmark.cpp
+//***************************************************************************************
+
+#include "WavesBenchmark.h"
+#include "Waves.h"
+#include <ppl.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// The solver as it was before the structure-of-arrays layout, kept as the baseline.
+	// Its tangent pass is left out, as the solver it is compared against computes
+	// tangents on demand in TangentX.
+	class AosWaves
+	{
+	public:
+		AosWaves(int m, int n, float dx, float dt, float speed, float damping)
+			: mNumRows(m), mNumCols(n), mSpatialStep(dx)
+		{
+			float d = damping*dt + 2.0f;
+			float e = (speed*speed)*(dt*dt) / (dx*dx);
+			mK1 = (damping*dt - 2.0f) / d;
+			mK2 = (4.0f - 8.0f*e) / d;
+			mK3 = (2.0f*e) / d;
+
+			mPrevSolution.assign(m*n, XMFLOAT3(0.0f, 0.0f, 0.0f));
+			mCurrSolution.assign(m*n, XMFLOAT3(0.0f, 0.0f, 0.0f));
+			mNormals.assign(m*n, XMFLOAT3(0.0f, 1.0f, 0.0f));
+		}
+
+		void Step()
+		{
+			concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+			{
+				for(int j = 1; j < mNumCols-1; ++j)
+				{
+					mPrevSolution[i*mNumCols+j].y =
+						mK1*mPrevSolution[i*mNumCols+j].y +
+						mK2*mCurrSolution[i*mNumCols+j].y +
+						mK3*(mCurrSolution[(i+1)*mNumCols+j].y +
+						     mCurrSolution[(i-1)*mNumCols+j].y +
+						     mCurrSolution[i*mNumCols+j+1].y +
+						     mCurrSolution[i*mNumCols+j-1].y);
+				}
+			});
+
+			std::swap(mPrevSolution, mCurrSolution);
+
+			concurrency::parallel_for(1, mNumRows - 1, [this](int i)
+			{
+				for(int j = 1; j < mNumCols-1; ++j)
+				{
+					float l = mCurrSolution[i*mNumCols+j-1].y;
+					float r = mCurrSolution[i*mNumCols+j+1].y;
+					float t = mCurrSolution[(i-1)*mNumCols+j].y;
+					float b = mCurrSolution[(i+1)*mNumCols+j].y;
+					mNormals[i*mNumCols+j].x = -r+l;
+					mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
+					mNormals[i*mNumCols+j].z = b-t;
+
+					XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
+					XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+				}
+			});
+		}
+
+		void Disturb(int i, int j, float magnitude)
+		{
+			float halfMag = 0.5f*magnitude;
+
+			mCurrSolution[i*mNumCols+j].y     += magnitude;
+			mCurrSolution[i*mNumCols+j+1].y   += halfMag;
+			mCurrSolution[i*mNumCols+j-1].y   += halfMag;
+			mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
+			mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+		}
+
+		float Height(int i)const { return mCurrSolution[i].y; }
+
+	private:
+		int mNumRows = 0;
+		int mNumCols = 0;
+		float mK1 = 0.0f;
+		float mK2 = 0.0f;
+		float mK3 = 0.0f;
+		float mSpatialStep = 0.0f;
+
+		std::vector<XMFLOAT3> mPrevSolution;
+		std::vector<XMFLOAT3> mCurrSolution;
+		std::vector<XMFLOAT3> mNormals;
+	};
+
+	// Average milliseconds per call of step().
+	template<typename Fn>
+	double TimeSteps(int stepCount, Fn step)
+	{
+		// Warm up the caches and the thread pool.
+		step();
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int k = 0; k < stepCount; ++k)
+			step();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>(end - start).count() / stepCount;
+	}
+}
+
+std::string RunWavesBenchmark(const char* reportPath)
+{
+	// Same simulation constants as the water in the scene.
+	const float dx = 1.0f;
+	const float dt = 0.03f;
+	const float speed = 4.0f;
+	const float damping = 0.2f;
+
+	const int gridSizes[] = { 256, 1024, 2048 };
+	const int stepCounts[] = { 200, 40, 10 };
+
+	std::ostringstream report;
+	report << "grid\taos parallel_for (ms/step)\tsoa sse (ms/step)\tspeedup\tmax height diff\n";
+
+	for(int s = 0; s < _countof(gridSizes); ++s)
+	{
+		const int n = gridSizes[s];
+
+		Waves soa(n, n, dx, dt, speed, damping);
+		AosWaves aos(n, n, dx, dt, speed, damping);
+
+		soa.Disturb(n / 2, n / 2, 1.0f);
+		aos.Disturb(n / 2, n / 2, 1.0f);
+
+		// Every call advances one time step.
+		double aosMs = TimeSteps(stepCounts[s], [&]() { aos.Step(); });
+		double soaMs = TimeSteps(stepCounts[s], [&]() { soa.Update(dt); });
+
+		// Both ran the same number of steps, so the solutions must agree.
+		float maxDiff = 0.0f;
+		for(int i = 0; i < n*n; ++i)
+			maxDiff = (std::max)(maxDiff, fabsf(soa.Position(i).y - aos.Height(i)));
+
+		report << n << "x" << n << "\t" << aosMs << "\t" << soaMs << "\t"
+			<< (aosMs / soaMs) << "x\t" << maxDiff << "\n";
+	}
+
+	std::ofstream file(reportPath);
+	file << report.str();
+
+	return report.str();
+}
@@ -0,0 +1,17 @@
+//***************************************************************************************
+// WavesBenchmark.h
+//
+// Times the Waves solver against the original array-of-structures parallel_for loop
+// on large grids.  Run the app with -wavesbench to write the results to
+// WavesBenchmark.txt instead of opening the window.
+//***************************************************************************************
+
+#ifndef WAVESBENCHMARK_H
+#define WAVESBENCHMARK_H
+
+#include <string>
+
+// Returns the report that was written to reportPath.
+std::string RunWavesBenchmark(const char* reportPath);
+
+#endif // WAVESBENCHMARK_H
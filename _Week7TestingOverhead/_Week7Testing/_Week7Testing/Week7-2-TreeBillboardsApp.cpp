@@ -5,10 +5,35 @@
 #include "../../Common/d3dApp.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "../../Common/UploadRing.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "BindlessHeap.h"
+#include "CameraPath.h"
+#include "DrawCuller.h"
+#include "Forest.h"
+#include "FrameProfiler.h"
 #include "FrameResource.h"
+#include "GeometryPool.h"
+#include "GpuWaves.h"
+#include "HiZBuffer.h"
+#include "LightCuller.h"
+#include "LightManager.h"
+#include "PipelineCache.h"
+#include "ResourceRegistry.h"
+#include "SceneCompiler.h"
+#include "SceneFile.h"
+#include "ShaderPermutations.h"
+#include "SpatialIndex.h"
+#include "Terrain.h"
+#include "TextureStreamer.h"
+#include "TransformStore.h"
 #include "Waves.h"
+#include "WavesBenchmark.h"
+#include <ppl.h>
+#include <iomanip>
+#include <map>
+#include <fstream>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,38 +42,127 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
+// Frames the CPU may record ahead of the GPU.  Set once at startup from -frames, as
+// every per-frame buffer is sized from it.
+int gNumFrameResources = 3;
+const int gMaxFrameResources = 8;
+
+// Maximum number of render items recorded by one worker command list.  Larger
+// layers are split into several chunks that are recorded in parallel.
+const int gDrawJobChunkSize = 16;
+
+// Size of each frame resource's light buffer.
+const UINT gMaxSceneLights = 256;
+
+// Descriptors in the shader visible heap.
+const UINT gSrvHeapCapacity = 128;
+
+// Descriptors each of the two texture tables spans from the start of the heap, so the
+// texture SRVs are allocated before any other.  The pixel shader sees both tables and
+// the root SRVs, and resource binding tier 1 allows it 128 SRVs in all.
+const UINT gTextureTableSize = 60;
+
+// Default heap memory that streamed texture mips may occupy.
+const UINT64 gTextureBudgetBytes = 256ull * 1024 * 1024;
+
+// Size of the upload heap shared by the geometry, texture and per-frame uploads.
+const UINT64 gUploadRingBytes = 64ull * 1024 * 1024;
+
+// Occluders farther than this from the eye are left out of the Hi-Z pre-pass.
+const float gOccluderDistance = 180.0f;
+
+// Billboarded trees around the castle.  They dissolve between the fade start and the
+// maximum distance from the eye and are culled beyond it.
+const UINT gTreeCount = 16384;
+const float gTreeFadeStart = 200.0f;
+const float gTreeMaxDistance = 300.0f;
+
+// The land is split into gTerrainChunkCount x gTerrainChunkCount chunks of
+// gTerrainChunkQuads x gTerrainChunkQuads quads.  Chunks drop a level of detail each
+// time their distance doubles past gTerrainLodDistance.
+const UINT gTerrainChunkCount = 16;
+const UINT gTerrainChunkQuads = 32;
+const float gTerrainLodDistance = 60.0f;
+
+// The castle and the maze are loaded from gScenePath, which is compiled from
+// gSceneSourcePath whenever the source changes.  Regions within gSceneStreamDistance of
+// the eye are loaded at startup, and the rest as the camera comes near them, at most
+// gSceneRegionsPerFrame a frame.
+const wchar_t* const gSceneSourcePath = L"Scenes\\Castle.scene";
+const wchar_t* const gScenePath = L"Scenes\\Castle.scnb";
+const float gSceneStreamDistance = 300.0f;
+const UINT gSceneRegionsPerFrame = 1;
+
+// Unless no-clip is on, the camera is kept gCameraCollisionRadius away from the castle
+// and maze.
+const float gCameraCollisionRadius = 1.0f;
+
+// Compiled shaders and PSOs are kept between runs, so only what changed since the last
+// run is compiled at startup.
+const wchar_t* const gShaderCacheDirectory = L"ShaderCache";
+const wchar_t* const gPipelineCachePath = L"PipelineCache.bin";
+
+// The profiler keeps the last gProfilerHistory frames of every timer.  With -profile N
+// its percentiles are written to gProfilerCsvPath after N frames and the app exits.
+const UINT gMaxGpuTimers = 256;
+const UINT gProfilerHistory = 512;
+const char* const gProfilerCsvPath = "FrameProfile.csv";
+int gProfileFrames = 0;
+
+// -benchmark flies the camera along BuildBenchmarkPath with a fixed time step and
+// random seed, writes gBenchmarkReportPath and exits.  The first gBenchmarkWarmup
+// seconds hold the first view and are left out of the report.
+bool gBenchmark = false;
+unsigned int gBenchmarkSeed = 1;
+const double gBenchmarkDeltaTime = 1.0 / 60.0;
+const float gBenchmarkWarmup = 2.0f;
+const char* const gBenchmarkReportPath = "Benchmark.csv";
+
+// -scenescale N multiplies the maze walls, trees and point lights by N and the wave
+// grid resolution by N on each side.  The wave solver's step limits N to 4.
+UINT gSceneScale = 1;
+const UINT gMaxSceneScale = 4;
 
 // Lightweight structure stores parameters to draw a shape.  This will
-// vary from app-to-app.
+// vary from app-to-app.  Items are referred to by handle, their index in
+// mRitems.  The world and texture transforms are kept in the TransformStore under
+// the same handle, which is also the index of the item's data in the frame's
+// ObjectBuffer.
 struct RenderItem
 {
 	RenderItem() = default;
 
-    // World matrix of the shape that describes the object's local space
-    // relative to the world space, which defines the position, orientation,
-    // and scale of the object in the world.
-    XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need to update the constant buffer.
-	// Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource.  Thus, when we modify obect data we should set 
-	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = gNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
-
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 
+	// Per-instance transforms for hardware instanced items.  They are copied into the
+	// frame's InstanceBuffer starting at InstanceBufferOffset.  Items without instances
+	// are drawn once using their ObjectBuffer data.
+	std::vector<InstanceData> Instances;
+	UINT InstanceBufferOffset = 0;
+
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
+	// Bounding box of the geometry in local space, used for frustum culling.
+	BoundingBox Bounds;
+
+	// Set each frame by the culling pass; invisible items are not drawn.
+	bool Visible = true;
+
+	// Culled and drawn by the GPU instead when GPU-driven mode is on.
+	bool GpuDriven = false;
+
+	// Large, solid GPU-driven items drawn into the Hi-Z pyramid before the main pass.
+	bool Occluder = false;
+
+	// Items in a layer are drawn in ascending key order so that items sharing
+	// geometry and material are adjacent and their binds can be skipped.
+	UINT64 SortKey = 0;
+
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
+    UINT InstanceCount = 1;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
 };
@@ -56,12 +170,59 @@ struct RenderItem
 enum class RenderLayer : int
 {
 	Opaque = 0,
+	Terrain,
 	Transparent,
 	AlphaTested,
 	AlphaTestedTreeSprites,
+	AlphaTestedInstanced,
+	GpuWaves,
 	Count
 };
 
+// A contiguous range of one render layer that is recorded on its own command list.
+struct DrawJob
+{
+	RenderLayer Layer = RenderLayer::Opaque;
+	ID3D12PipelineState* PSO = nullptr;
+	size_t FirstItem = 0;
+	size_t ItemCount = 0;
+
+	// Profiler timer around the job's draws.  The jobs of a layer share its name.
+	UINT GpuTimer = 0;
+};
+
+// The GPU-driven items of one layer, drawn with one ExecuteIndirect.
+struct IndirectBatch
+{
+	RenderLayer Layer = RenderLayer::Opaque;
+	UINT Batch = 0;
+};
+
+// A layer PSO whose pixel shader follows the tightest variant of Program for the
+// scene's lights.  Desc is the PSO's desc; its pixel shader is replaced by the variant.
+struct PsoVariant
+{
+	std::string Pso;
+	std::string Program;
+	UINT Features = 0;
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc = {};
+
+	// Variant key and PSO the layer draws with now.
+	UINT Key = 0;
+	ID3D12PipelineState* Current = nullptr;
+
+	// Key of a variant whose shader or PSO failed, so it is not waited for again.
+	UINT FailedKey = UINT_MAX;
+};
+
+// Layers drawn by the DrawCuller in GPU-driven mode.  Their items must be static
+// triangle lists; instanced items are drawn one indirect command per instance.
+static bool IsGpuDrivenLayer(RenderLayer layer)
+{
+	return layer == RenderLayer::Opaque || layer == RenderLayer::AlphaTested ||
+		layer == RenderLayer::AlphaTestedInstanced;
+}
+
 class TreeBillboardsApp : public D3DApp
 {
 public:
@@ -83,11 +244,21 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void UpdateCamera(const GameTimer& gt);
+	void PickRenderItem(int x, int y);
+	void UpdateBenchmark(const GameTimer& gt);
+	void WriteBenchmarkReport();
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
-	void UpdateMaterialCBs(const GameTimer& gt);
+	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt); 
+	void UpdateWavesGpu(const GameTimer& gt);
+	void UpdateVisibility(const GameTimer& gt);
+	void UpdateTerrainLods(const GameTimer& gt);
+	void UpdatePsoVariants(const GameTimer& gt);
+	void UpdateSceneStreaming(const GameTimer& gt);
+	void ReportTextureScreenSize(const RenderItem* ri, const BoundingBox& worldBounds, const XMFLOAT4X4& texTransform);
+	void SortTransparentItems(const GameTimer& gt);
 
 	// Castle rendering functions
 	void BuildCastleGeometry();
@@ -99,18 +270,41 @@ private:
 
 	void LoadTextures();
     void BuildRootSignature();
+	void BuildLightCullRootSignature();
+	void BuildWavesRootSignature();
+	void BuildDrawCullRootSignature();
+	void BuildHiZRootSignature();
+	void BuildTreeCullRootSignature();
+	void CreateRootSignature(const CD3DX12_ROOT_SIGNATURE_DESC& desc, ComPtr<ID3D12RootSignature>& rootSignature);
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayouts();
     void BuildLandGeometry();
     void BuildWavesGeometry();
+	void BuildGpuWavesGeometry();
 	void BuildBoxGeometry();
-	void BuildTreeSpritesGeometry();
-	void BuildMazePart(float sX, float sZ, float pX, float pZ, int index);
+	void BuildForest();
+	void LoadScene();
+	UINT LoadSceneRegions(const XMFLOAT3& eyePosW, float maxDistance, UINT maxRegions);
+	void LoadSceneRegion(UINT region);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
+	void BuildLights();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	UINT AddRenderItem(Material* mat, FXMMATRIX world, CXMMATRIX texTransform);
+	void BuildSortKeys();
+	void BuildSpatialIndex();
+	void BuildIndirectDraws();
+	void BuildProfiler();
+	void BuildBenchmarkPath();
+	void BuildDrawJobs();
+	void BuildWorkerCommandLists();
+	void RecordDrawJob(const DrawJob& job, ID3D12CommandAllocator* cmdListAlloc, ID3D12GraphicsCommandList* cmdList);
+    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& ritems,
+		size_t firstItem = 0, size_t itemCount = SIZE_MAX);
+	void DrawIndirectBatches(ID3D12GraphicsCommandList* cmdList, RenderLayer layer);
+	void DrawOccluders(ID3D12GraphicsCommandList* cmdList);
+	void DrawForest(ID3D12GraphicsCommandList* cmdList);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
@@ -119,6 +313,9 @@ private:
 
 private:
 
+	// Declared first so it outlives everything that suballocates from it.
+	std::unique_ptr<UploadRing> mUploadRing;
+
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
     FrameResource* mCurrFrameResource = nullptr;
     int mCurrFrameResourceIndex = 0;
@@ -126,32 +323,184 @@ private:
     UINT mCbvSrvDescriptorSize = 0;
 
     ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
-
-	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
-
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	ComPtr<ID3D12RootSignature> mLightCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mWavesRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mDrawCullRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mHiZRootSignature = nullptr;
+	ComPtr<ID3D12RootSignature> mTreeCullRootSignature = nullptr;
+
+	std::unique_ptr<BindlessHeap> mSrvHeap;
+
+	// Heap index of the first texture SRV; the textures' SRVs follow it in load order.
+	UINT mTextureSrvBase = 0;
+
+	// Holds the vertex and index buffers of the static geometries below.
+	std::unique_ptr<GeometryPool> mGeometryPool;
+	ResourceRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	ResourceRegistry<std::unique_ptr<Texture>> mTextures;
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	ResourceRegistry<ComPtr<ID3DBlob>> mShaders;
+	std::unique_ptr<ShaderPermutations> mShaderPermutations;
+	UINT mTextureShaderFeatures = 0;
+	std::vector<PsoVariant> mPsoVariants;
+	PsoRegistry mPSOs;
+	std::unique_ptr<PipelineCache> mPipelineCache;
+
+	// Handles follow MatCBIndex, so the materials are in material buffer order.
+	ResourceRegistry<std::unique_ptr<Material>> mMaterials;
+	ResourceRegistry<std::unique_ptr<Material>>::Handle mWaterMaterial;
+
+	// PSOs bound every frame, resolved once by BuildPSOs.
+	PsoRegistry::Handle mOpaquePso;
+	PsoRegistry::Handle mLightCullPso;
+	PsoRegistry::Handle mTreeCullPso;
+	PsoRegistry::Handle mDrawCullPso;
+	PsoRegistry::Handle mHiZCopyPso;
+	PsoRegistry::Handle mHiZDownsamplePso;
+	PsoRegistry::Handle mWavesDisturbPso;
+	PsoRegistry::Handle mWavesUpdatePso;
+	PsoRegistry::Handle mOccluderDepthPso;
+	PsoRegistry::Handle mOccluderDepthInstancedPso;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
-	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
-    RenderItem* mWavesRitem = nullptr;
+    UINT mWavesRitem = 0;
+	UINT mGpuWavesRitem = 0;
+
+	// Stands in for the forest on the CPU: its bounds are frustum tested and its
+	// material streamed like any other item, but the trees are drawn by mForest.
+	UINT mForestRitem = 0;
+	std::unique_ptr<Forest> mForest;
+
+	// One render item per terrain chunk, in chunk order.  Their draw arguments follow
+	// the chunk LODs picked each frame, within the whole terrain's draw arguments.
+	std::unique_ptr<Terrain> mTerrain;
+	std::vector<UINT> mTerrainRitems;
+	SubmeshGeometry mTerrainDrawArgs;
+
+	// Total number of instances across all instanced render items, and the number the
+	// instance buffers are sized for once every scene region is loaded.
+	UINT mInstanceCount = 0;
+	UINT mInstanceCapacity = 0;
+
+	// All the render items, indexed by handle: the ones built in code, then those of
+	// the scene regions in the order they are loaded.  Items are only ever appended,
+	// so handles stay valid as the array grows.
+	std::vector<RenderItem> mRitems;
+	std::unique_ptr<TransformStore> mTransforms;
+	UINT mObjectCapacity = 0;
+
+	// The scene file stays mapped so regions can be loaded from it at any time.
+	SceneFile mScene;
+	std::vector<bool> mSceneRegionLoaded;
+
+	// Layer, geometry and material of the scene's names and materials, resolved once.
+	std::vector<int> mSceneLayers;
+	std::vector<MeshGeometry*> mSceneGeometries;
+	std::vector<Material*> mSceneMaterials;
+
+	// Scene items of each layer not loaded yet.  The draw jobs leave room for them.
+	size_t mSceneUnloadedItems[(int)RenderLayer::Count] = {};
+
+	// World bounds of the loaded scene items, one entry per instance of instanced
+	// items, for camera collision and picking.  An entry's id indexes mSpatialItems,
+	// which holds its render item and instance (UINT_MAX for items without any).
+	// Scene items are the render items from mSceneFirstRitem on.
+	SpatialIndex mSpatialIndex;
+	std::vector<std::pair<UINT, UINT>> mSpatialItems;
+	UINT mSceneFirstRitem = 0;
+
+	// Render item under the cursor at the last right click, UINT_MAX if there was none.
+	UINT mPickedRitem = UINT_MAX;
+
+	// Handles of the render items divided by PSO.
+	std::vector<UINT> mRitemLayer[(int)RenderLayer::Count];
+
+	// Small ids for each MeshGeometry, used in the render item sort keys.
+	std::unordered_map<MeshGeometry*, UINT> mGeoSortIds;
+
+	// Draw jobs in submission order, and the command list each one is recorded on.
+	std::vector<DrawJob> mDrawJobs;
+	std::vector<ComPtr<ID3D12GraphicsCommandList>> mWorkerCmdLists;
+	ComPtr<ID3D12GraphicsCommandList> mPostCmdList;
 
-	// List of all the render items.
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	std::unique_ptr<Waves> mWaves;
+	std::unique_ptr<GpuWaves> mGpuWaves;
 
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
+	// Keys 5/6 switch between the GPU and the CPU wave simulation.
+	bool mGpuWavesEnabled = true;
+	float mGpuWavesDisturbTime = 0.0f;
 
-	std::unique_ptr<Waves> mWaves;
+	// The CPU waves are solved on a worker task while the frame is recorded and
+	// uploaded the next frame, so the solution drawn is always one frame old.
+	concurrency::task_group mWavesTasks;
+	float mWavesDisturbTime = 0.0f;
 
     PassConstants mMainPassCB;
 
+	std::unique_ptr<LightManager> mLightManager;
+	std::unique_ptr<LightCuller> mLightCuller;
+
+	// Keys 7/8 switch the GPU-driven layers between ExecuteIndirect and the CPU loop.
+	std::unique_ptr<DrawCuller> mDrawCuller;
+	std::vector<IndirectBatch> mIndirectBatches;
+	bool mGpuDrivenEnabled = false;
+
+	// Regions streamed in after startup rebuild the DrawCuller at the start of the next
+	// Draw.  Replaced cullers are kept until the fence value of the last frame that used
+	// them has passed.
+	bool mIndirectDrawsDirty = false;
+	std::vector<std::pair<UINT64, std::unique_ptr<DrawCuller>>> mRetiredDrawCullers;
+
+	// Keys 9/0 switch the Hi-Z occlusion test of the GPU-driven items on and off.
+	std::unique_ptr<HiZBuffer> mHiZ;
+	bool mOcclusionCullingEnabled = true;
+
+	// Key P writes the profiler's percentiles to gProfilerCsvPath.
+	std::unique_ptr<FrameProfiler> mProfiler;
+	bool mProfilerKeyDown = false;
+	int mProfiledFrames = 0;
+
+	UINT mGpuFrameTimer = 0;
+	UINT mGpuLightCullTimer = 0;
+	UINT mGpuTreeCullTimer = 0;
+	UINT mGpuWavesTimer = 0;
+	UINT mGpuOccludersTimer = 0;
+	UINT mGpuDrawCullTimer = 0;
+
+	UINT mCpuUpdateTimer = 0;
+	UINT mCpuObjectCBsTimer = 0;
+	UINT mCpuUpdateWavesTimer = 0;
+	UINT mCpuWavesSolveTimer = 0;
+	UINT mCpuDrawTimer = 0;
+	UINT mCpuRecordTimer = 0;
+
+	// The benchmark times whole frames by the wall clock, as its game clock is fixed.
+	CameraPath mBenchmarkPath;
+	UINT mCpuFrameIntervalTimer = 0;
+	std::chrono::high_resolution_clock::time_point mLastFrameTime;
+	bool mBenchmarkMeasuring = false;
+	bool mBenchmarkDone = false;
+
+	// Camera matrices the pass constants were last built from.
+	XMFLOAT4X4 mPassView = {};
+	XMFLOAT4X4 mPassProj = {};
+
 	Camera mCamera;
 
+	// View space frustum of the camera, rebuilt when the projection changes, and the
+	// world space frustum it was last culled with.
+	BoundingFrustum mCamFrustum;
+	BoundingFrustum mWorldFrustum;
+	bool mFrustumCullingEnabled = true;
+
+	// Number of render items and instances that passed/failed the frustum test this frame.
+	UINT mVisibleCount = 0;
+	UINT mCulledCount = 0;
+
+	// Window caption before the culling stats are appended.
+	std::wstring mBaseCaption;
+
     POINT mLastMousePos;
 
 	bool bNoClip = false;
@@ -168,7 +517,40 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 
     try
     {
+		// Time the CPU wave solver on large grids instead of running the demo.
+		if(strstr(cmdLine, "-wavesbench") != nullptr)
+		{
+			std::string report = RunWavesBenchmark("WavesBenchmark.txt");
+			::OutputDebugStringA(report.c_str());
+			return 0;
+		}
+
+		// -frames N sets the frames in flight, -latency N the frames queued on the swap
+		// chain, -vsync starts with vsync on and -profile N profiles N frames.
+		if(const char* frames = strstr(cmdLine, "-frames "))
+			gNumFrameResources = (std::max)(1, (std::min)(atoi(frames + 8), gMaxFrameResources));
+
+		if(const char* scale = strstr(cmdLine, "-scenescale "))
+			gSceneScale = (UINT)(std::max)(1, (std::min)(atoi(scale + 12), (int)gMaxSceneScale));
+
+		// The scene is built on this thread, so seeding it makes the trees, lights and
+		// wave disturbances the same on every run.
+		if(strstr(cmdLine, "-benchmark") != nullptr)
+		{
+			gBenchmark = true;
+			if(const char* seed = strstr(cmdLine, "-seed "))
+				gBenchmarkSeed = (unsigned int)strtoul(seed + 6, nullptr, 10);
+			srand(gBenchmarkSeed);
+		}
+
         TreeBillboardsApp theApp(hInstance);
+		if(const char* latency = strstr(cmdLine, "-latency "))
+			theApp.SetMaxFrameLatency((UINT)(std::max)(1, atoi(latency + 9)));
+		if(strstr(cmdLine, "-vsync") != nullptr)
+			theApp.SetVsyncState(true);
+		if(const char* profile = strstr(cmdLine, "-profile "))
+			gProfileFrames = (std::max)(0, atoi(profile + 9));
+
         if(!theApp.Initialize())
             return 0;
 
@@ -184,10 +566,16 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 TreeBillboardsApp::TreeBillboardsApp(HINSTANCE hInstance)
     : D3DApp(hInstance)
 {
+	mBaseCaption = mMainWndCaption;
 }
 
 TreeBillboardsApp::~TreeBillboardsApp()
 {
+	mWavesTasks.wait();
+
+	// PSOs still being created read the input layouts and shaders declared after it.
+	mPipelineCache.reset();
+
     if(md3dDevice != nullptr)
         FlushCommandQueue();
 }
@@ -204,27 +592,63 @@ bool TreeBillboardsApp::Initialize()
 	// so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-    mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.03f, 4.0f, 0.2f);
+	// Uploads recorded on the initialization command list are freed against
+	// mCurrentFence + 1, the value FlushCommandQueue signals once they have executed.
+	mUploadRing = std::make_unique<UploadRing>(md3dDevice.Get(), gUploadRingBytes);
+
+	// Scaling the scene refines the wave grids without growing them.
+	const int wavesGridSize = 128 * gSceneScale;
+	const float wavesSpatialStep = 1.0f / gSceneScale;
+    mWaves = std::make_unique<Waves>(wavesGridSize, wavesGridSize, wavesSpatialStep, 0.03f, 4.0f, 0.2f);
+	mGpuWaves = std::make_unique<GpuWaves>(md3dDevice.Get(), mCommandList.Get(),
+		wavesGridSize, wavesGridSize, wavesSpatialStep, 0.03f, 4.0f, 0.2f);
+	mHiZ = std::make_unique<HiZBuffer>(md3dDevice.Get(), mClientWidth, mClientHeight);
  
+	mGeometryPool = std::make_unique<GeometryPool>();
+	mSrvHeap = std::make_unique<BindlessHeap>(md3dDevice.Get(), gSrvHeapCapacity);
+
 	LoadTextures();
     BuildRootSignature();
+	BuildLightCullRootSignature();
+	BuildWavesRootSignature();
+	BuildDrawCullRootSignature();
+	BuildHiZRootSignature();
+	BuildTreeCullRootSignature();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayouts();
 	BuildCastleGeometry();
     BuildLandGeometry();
     BuildWavesGeometry();
+	BuildGpuWavesGeometry();
 	BuildBoxGeometry();
-	BuildTreeSpritesGeometry();
+	BuildForest();
+	mGeometryPool->Build(md3dDevice.Get(), mCommandList.Get(), *mUploadRing, mFence.Get(), mCurrentFence + 1);
+	LoadScene();
 	BuildMaterials();
-    BuildRenderItems();
-    BuildFrameResources();
-    BuildPSOs();
+	BuildLights();
 
-	// Init camera
+	// Init camera.  The scene regions near it are loaded with the render items.
 	mCamera.SetPosition(0.0f, 15.0f, -80.0f);
 	mCamera.UpdateViewMatrix();
 	prevCamPos = mCamera.GetPosition3f();
 
+    BuildRenderItems();
+	BuildSortKeys();
+	BuildSpatialIndex();
+	BuildIndirectDraws();
+    BuildPSOs();
+	BuildBenchmarkPath();
+	BuildProfiler();
+	BuildDrawJobs();
+    BuildFrameResources();
+	BuildWorkerCommandLists();
+
+	if(gBenchmark)
+	{
+		mTimer.SetFixedDeltaTime(gBenchmarkDeltaTime);
+		mBenchmarkPath.Apply(0.0f, mCamera);
+	}
+
 	// Set background color
 	mMainPassCB.FogColor = { 0.0f, 1.0f, 1.0f, 0.5f };
 
@@ -244,12 +668,26 @@ void TreeBillboardsApp::OnResize()
     D3DApp::OnResize();
 
 	mCamera.SetLens(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
+
+	// Called once by D3DApp::Initialize before the pyramid exists.
+	if(mHiZ != nullptr)
+		mHiZ->OnResize(mClientWidth, mClientHeight);
 }
 
 void TreeBillboardsApp::Update(const GameTimer& gt)
 {
-    OnKeyboardInput(gt);
-	UpdateCamera(gt);
+	// The benchmark takes no input.
+	if(gBenchmark)
+	{
+		UpdateBenchmark(gt);
+	}
+	else
+	{
+		OnKeyboardInput(gt);
+		UpdateCamera(gt);
+	}
 
     // Cycle through the circular frame resource array.
     mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
@@ -257,23 +695,48 @@ void TreeBillboardsApp::Update(const GameTimer& gt)
 
     // Has the GPU finished processing the commands of the current frame resource?
     // If not, wait until the GPU has completed commands up to this fence point.
-    if(mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
-    {
-        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-        WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-    }
+    if(mCurrFrameResource->Fence != 0)
+        WaitForFence(mCurrFrameResource->Fence);
+
+	// The frame resource's timestamps are ready now that its fence has passed.
+	mProfiler->BeginFrame(mCurrFrameResourceIndex);
+	ScopedCpuTimer updateTimer(*mProfiler, mCpuUpdateTimer);
+
+	if(gProfileFrames > 0 && ++mProfiledFrames == gProfileFrames)
+	{
+		mProfiler->WriteCsv(gProfilerCsvPath);
+		PostQuitMessage(0);
+	}
+
+	// Return the upload memory of copies that have executed to the ring.
+	mUploadRing->Reclaim();
+
+	// Publish the textures that finished streaming before anything is recorded.
+	mTextureStreamer->Update();
+
+	// Free the DrawCullers that no frame in flight uses any more.
+	const UINT64 completedFence = mFence->GetCompletedValue();
+	mRetiredDrawCullers.erase(std::remove_if(mRetiredDrawCullers.begin(), mRetiredDrawCullers.end(),
+		[completedFence](const std::pair<UINT64, std::unique_ptr<DrawCuller>>& retired) { return retired.first <= completedFence; }),
+		mRetiredDrawCullers.end());
+
+	UpdateSceneStreaming(gt);
 
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
-	UpdateMaterialCBs(gt);
+	UpdateTerrainLods(gt);
+	UpdateVisibility(gt);
+	SortTransparentItems(gt);
+	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
     UpdateWaves(gt);
+	UpdatePsoVariants(gt);
 }
 
 void TreeBillboardsApp::Draw(const GameTimer& gt)
 {
+	ScopedCpuTimer drawTimer(*mProfiler, mCpuDrawTimer);
+
     auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
     // Reuse the memory associated with command recording.
@@ -282,10 +745,17 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
 
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs[mOpaquePso].Get()));
+
+	// Ended on the post command list, so it spans everything submitted this frame.
+	mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuFrameTimer);
 
-    mCommandList->RSSetViewports(1, &mScreenViewport);
-    mCommandList->RSSetScissorRects(1, &mScissorRect);
+	// Upload the items of the regions streamed in this frame before they are culled.
+	if(mIndirectDrawsDirty)
+	{
+		BuildIndirectDraws();
+		mIndirectDrawsDirty = false;
+	}
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -295,42 +765,96 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
     mCommandList->ClearRenderTargetView(CurrentBackBufferView(), (float*)&mMainPassCB.FogColor, 0, nullptr);
     mCommandList->ClearDepthStencilView(DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
-    // Specify the buffers we are going to render to.
-    mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap->GetHeap() };
 	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	// Bin the point and spot lights into clusters before any draw reads them.
+	mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuLightCullTimer);
+	mLightCuller->Execute(mCommandList.Get(), mLightCullRootSignature.Get(), mPSOs[mLightCullPso].Get(),
+		mCurrFrameResource->PassCB->GpuVirtualAddress(),
+		mCurrFrameResource->LightBuffer->GpuVirtualAddress());
+	mProfiler->EndGpuTimer(mCommandList.Get(), mGpuLightCullTimer);
+
+	// Cull the trees and write the instance count of the forest's draw.
+	mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuTreeCullTimer);
+	mForest->Execute(mCommandList.Get(), mTreeCullRootSignature.Get(), mPSOs[mTreeCullPso].Get(),
+		mWorldFrustum, mCamera.GetPosition3f(), gTreeFadeStart, gTreeMaxDistance, mFrustumCullingEnabled);
+	mProfiler->EndGpuTimer(mCommandList.Get(), mGpuTreeCullTimer);
+
+	if(mGpuWavesEnabled)
+	{
+		mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuWavesTimer);
+		UpdateWavesGpu(gt);
+		mProfiler->EndGpuTimer(mCommandList.Get(), mGpuWavesTimer);
+	}
+
+	// Cull the GPU-driven items and build their indirect arguments.  With occlusion
+	// culling on, the nearby occluders are drawn into the Hi-Z pyramid first and the
+	// items are then also tested against it.
+	if(mGpuDrivenEnabled)
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS passCB = mCurrFrameResource->PassCB->GpuVirtualAddress();
+		D3D12_GPU_VIRTUAL_ADDRESS objectBuffer = mCurrFrameResource->ObjectBuffer->GpuVirtualAddress();
+
+		if(mOcclusionCullingEnabled)
+		{
+			mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuOccludersTimer);
+
+			mDrawCuller->CullOccluders(mCommandList.Get(), mDrawCullRootSignature.Get(), mPSOs[mDrawCullPso].Get(),
+				passCB, objectBuffer, mWorldFrustum, gOccluderDistance, mHiZ->Srv());
+
+			DrawOccluders(mCommandList.Get());
+
+			mHiZ->BuildPyramid(mCommandList.Get(), mHiZRootSignature.Get(),
+				mPSOs[mHiZCopyPso].Get(), mPSOs[mHiZDownsamplePso].Get());
 
-	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+			mProfiler->EndGpuTimer(mCommandList.Get(), mGpuOccludersTimer);
+		}
 
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+		mProfiler->BeginGpuTimer(mCommandList.Get(), mGpuDrawCullTimer);
+		mDrawCuller->Execute(mCommandList.Get(), mDrawCullRootSignature.Get(), mPSOs[mDrawCullPso].Get(),
+			passCB, objectBuffer, mWorldFrustum, mFrustumCullingEnabled,
+			mHiZ->Srv(), mOcclusionCullingEnabled);
+		mProfiler->EndGpuTimer(mCommandList.Get(), mGpuDrawCullTimer);
+	}
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+    // Done recording the clear, culling and wave simulation commands.
+    ThrowIfFailed(mCommandList->Close());
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	// Record the draw jobs on worker threads.  Each job owns its command list and
+	// allocator, and only reads shared scene state, so no locking is needed.
+	{
+		ScopedCpuTimer recordTimer(*mProfiler, mCpuRecordTimer);
+		concurrency::parallel_for(0, (int)mDrawJobs.size(), [this](int i)
+		{
+			RecordDrawJob(mDrawJobs[i], mCurrFrameResource->WorkerCmdListAllocs[i].Get(), mWorkerCmdLists[i].Get());
+		});
+	}
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+	auto postCmdListAlloc = mCurrFrameResource->PostCmdListAlloc;
+	ThrowIfFailed(postCmdListAlloc->Reset());
+	ThrowIfFailed(mPostCmdList->Reset(postCmdListAlloc.Get(), nullptr));
 
     // Indicate a state transition on the resource usage.
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+	mPostCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
-    // Done recording commands.
-    ThrowIfFailed(mCommandList->Close());
+	mProfiler->EndGpuTimer(mPostCmdList.Get(), mGpuFrameTimer);
+	mProfiler->ResolveGpuTimers(mPostCmdList.Get());
 
-    // Add the command list to the queue for execution.
-    ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-    mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+    ThrowIfFailed(mPostCmdList->Close());
+
+    // Submit everything in layer order with a single call.
+	std::vector<ID3D12CommandList*> cmdsLists;
+	cmdsLists.reserve(mWorkerCmdLists.size() + 2);
+	cmdsLists.push_back(mCommandList.Get());
+	for(auto& cmdList : mWorkerCmdLists)
+		cmdsLists.push_back(cmdList.Get());
+	cmdsLists.push_back(mPostCmdList.Get());
+    mCommandQueue->ExecuteCommandLists((UINT)cmdsLists.size(), cmdsLists.data());
 
     // Swap the back and front buffers
-    ThrowIfFailed(mSwapChain->Present(0, 0));
-	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+    PresentFrame();
 
     // Advance the fence value to mark commands up to this fence point.
     mCurrFrameResource->Fence = ++mCurrentFence;
@@ -341,11 +865,68 @@ void TreeBillboardsApp::Draw(const GameTimer& gt)
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 }
 
+void TreeBillboardsApp::RecordDrawJob(const DrawJob& job, ID3D12CommandAllocator* cmdListAlloc, ID3D12GraphicsCommandList* cmdList)
+{
+	ThrowIfFailed(cmdListAlloc->Reset());
+	ThrowIfFailed(cmdList->Reset(cmdListAlloc, job.PSO));
+
+	// Command lists do not inherit state from each other, so every job sets up
+	// the full pipeline state it draws with.
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE backBufferView = CurrentBackBufferView();
+	D3D12_CPU_DESCRIPTOR_HANDLE depthStencilView = DepthStencilView();
+	cmdList->OMSetRenderTargets(1, &backBufferView, true, &depthStencilView);
+
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvHeap->GetHeap() };
+	cmdList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+	// The shaders index the textures and the materials themselves, so these are bound
+	// once for the whole job.
+	cmdList->SetGraphicsRootDescriptorTable(0, mSrvHeap->GpuHandle(0));
+	cmdList->SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB->GpuVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(3, mCurrFrameResource->MaterialBuffer->GpuVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(4, mCurrFrameResource->InstanceBuffer->GpuVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(5, mCurrFrameResource->LightBuffer->GpuVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(6, mLightCuller->ClusterLightCounts()->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(7, mLightCuller->ClusterLightIndices()->GetGPUVirtualAddress());
+	cmdList->SetGraphicsRootDescriptorTable(8, mGpuWaves->DisplacementMap());
+	cmdList->SetGraphicsRootShaderResourceView(9, mCurrFrameResource->ObjectBuffer->GpuVirtualAddress());
+
+	mProfiler->BeginGpuTimer(cmdList, job.GpuTimer);
+
+	if(job.Layer == RenderLayer::AlphaTestedTreeSprites)
+	{
+		if(mRitems[mForestRitem].Visible)
+			DrawForest(cmdList);
+	}
+	else if(mGpuDrivenEnabled && IsGpuDrivenLayer(job.Layer))
+	{
+		// The layer's first job draws all of its batches; the others stay empty.
+		if(job.FirstItem == 0)
+			DrawIndirectBatches(cmdList, job.Layer);
+	}
+	else
+	{
+		DrawRenderItems(cmdList, mRitemLayer[(int)job.Layer], job.FirstItem, job.ItemCount);
+	}
+
+	mProfiler->EndGpuTimer(cmdList, job.GpuTimer);
+
+	ThrowIfFailed(cmdList->Close());
+}
+
 void TreeBillboardsApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
+	if((btnState & MK_RBUTTON) != 0 && !gBenchmark)
+		PickRenderItem(x, y);
+
     SetCapture(mhMainWnd);
 }
 
@@ -356,7 +937,7 @@ void TreeBillboardsApp::OnMouseUp(WPARAM btnState, int x, int y)
 
 void TreeBillboardsApp::OnMouseMove(WPARAM btnState, int x, int y)
 {
-	if ((btnState & MK_LBUTTON) != 0)
+	if ((btnState & MK_LBUTTON) != 0 && !gBenchmark)
 	{
 		// Make each pixel correspond to a quarter of a degree.
 		float dx = XMConvertToRadians(0.25f * static_cast<float>(x - mLastMousePos.x));
@@ -403,45 +984,130 @@ void TreeBillboardsApp::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState('2') & 0x8000)
 		bNoClip = false;
 
+	if (GetAsyncKeyState('3') & 0x8000)
+		mFrustumCullingEnabled = true;
+
+	if (GetAsyncKeyState('4') & 0x8000)
+		mFrustumCullingEnabled = false;
+
+	if (GetAsyncKeyState('5') & 0x8000)
+		mGpuWavesEnabled = true;
+
+	if (GetAsyncKeyState('6') & 0x8000)
+		mGpuWavesEnabled = false;
+
+	if (GetAsyncKeyState('7') & 0x8000)
+		mGpuDrivenEnabled = true;
+
+	if (GetAsyncKeyState('8') & 0x8000)
+		mGpuDrivenEnabled = false;
+
+	if (GetAsyncKeyState('9') & 0x8000)
+		mOcclusionCullingEnabled = true;
+
+	if (GetAsyncKeyState('0') & 0x8000)
+		mOcclusionCullingEnabled = false;
+
+	// Keys V/B switch vsync on and off.
+	if (GetAsyncKeyState('V') & 0x8000)
+		SetVsyncState(true);
+
+	if (GetAsyncKeyState('B') & 0x8000)
+		SetVsyncState(false);
+
+	// Write the profile once per press of P.
+	bool profilerKeyDown = (GetAsyncKeyState('P') & 0x8000) != 0;
+	if (profilerKeyDown && !mProfilerKeyDown)
+		mProfiler->WriteCsv(gProfilerCsvPath);
+	mProfilerKeyDown = profilerKeyDown;
+
 	mCamera.UpdateViewMatrix();
 	
 }
  
 void TreeBillboardsApp::UpdateCamera(const GameTimer& gt)
 {
-	/*if (!bNoClip)
+	if(bNoClip)
+		return;
+
+	// Undo a move into the castle or maze.  A camera that starts the move inside, as
+	// after turning no-clip off in a wall, is let through so it can get out.
+	BoundingSphere camera(mCamera.GetPosition3f(), gCameraCollisionRadius);
+	BoundingSphere prevCamera(prevCamPos, gCameraCollisionRadius);
+	if(mSpatialIndex.Intersects(camera) && !mSpatialIndex.Intersects(prevCamera))
 	{
-		for (size_t i = 0; i < mAllRitems.size(); ++i)
-		{
-			RenderItem ri = *mAllRitems[i];
-			float xPos = ri.World(0, 3);
-			float yPos = ri.World(1, 3);
-			float zPos = ri.World(2, 3);
-			float xMin = xPos - ri.World(0, 0);
-			float xMax = xPos + ri.World(0, 0);
-			float yMin = yPos - ri.World(1, 1);
-			float yMax = yPos + ri.World(1, 1);
-			float zMin = zPos - ri.World(2, 2);
-			float zMax = zPos + ri.World(2, 2);
-
-			if ((mCamera.GetPosition3f().x >= xMin && mCamera.GetPosition3f().x <= xMax) &&
-				(mCamera.GetPosition3f().y >= yMin && mCamera.GetPosition3f().y <= yMax) &&
-				(mCamera.GetPosition3f().z >= zMin && mCamera.GetPosition3f().z <= zMax))
-			{
-				mCamera.SetPosition(prevCamPos);
-				mCamera.UpdateViewMatrix();
-			}
+		mCamera.SetPosition(prevCamPos);
+		mCamera.UpdateViewMatrix();
+	}
+}
+
+void TreeBillboardsApp::PickRenderItem(int x, int y)
+{
+	// The ray through the pixel in view space, then in world space.
+	XMFLOAT4X4 proj = mCamera.GetProj4x4f();
+	float vx = (+2.0f * x / mClientWidth - 1.0f) / proj(0, 0);
+	float vy = (-2.0f * y / mClientHeight + 1.0f) / proj(1, 1);
 
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	XMVECTOR rayOrigin = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invView);
+	XMVECTOR rayDir = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
 
-		}
+	UINT id = 0;
+	float distance = 0.0f;
+	mPickedRitem = mSpatialIndex.RayCast(rayOrigin, rayDir, id, distance) ? mSpatialItems[id].first : UINT_MAX;
+}
+
+void TreeBillboardsApp::UpdateBenchmark(const GameTimer& gt)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	if(mBenchmarkMeasuring)
+		mProfiler->AddCpuTime(mCpuFrameIntervalTimer, std::chrono::duration<double, std::milli>(now - mLastFrameTime).count());
+	mLastFrameTime = now;
+
+	// Start from empty statistics once the warmup is over, so pipeline creation and
+	// texture streaming at startup do not skew them.
+	float pathTime = gt.TotalTime() - gBenchmarkWarmup;
+	if(pathTime >= 0.0f && !mBenchmarkMeasuring)
+	{
+		mProfiler->Clear();
+		mBenchmarkMeasuring = true;
+	}
+
+	mBenchmarkPath.Apply(pathTime, mCamera);
+
+	if(pathTime >= mBenchmarkPath.Duration() && !mBenchmarkDone)
+	{
+		WriteBenchmarkReport();
+		mBenchmarkDone = true;
+		PostQuitMessage(0);
+	}
+}
 
-	}*/
+void TreeBillboardsApp::WriteBenchmarkReport()
+{
+	// The settings the run was made with, then one row per timer.
+	std::ofstream file(gBenchmarkReportPath);
+	file << "# seed=" << gBenchmarkSeed <<
+		" scenescale=" << gSceneScale <<
+		" duration_s=" << mBenchmarkPath.Duration() <<
+		" fixed_dt_ms=" << 1000.0 * gBenchmarkDeltaTime <<
+		" resolution=" << mClientWidth << "x" << mClientHeight <<
+		" frames_in_flight=" << gNumFrameResources <<
+		" max_frame_latency=" << GetMaxFrameLatency() <<
+		" vsync=" << (GetVsyncState() ? "on" : "off") <<
+		" gpu_driven=" << (mGpuDrivenEnabled ? "on" : "off") <<
+		" occlusion=" << (mOcclusionCullingEnabled ? "on" : "off") <<
+		" trees=" << mForest->TreeCount() <<
+		" point_lights=" << mLightManager->LightCount(LightType::Point) <<
+		" maze_walls=" << mInstanceCount << "\n";
+	mProfiler->WriteCsv(file);
 }
 
 void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water"].get();
+	auto waterMat = mMaterials[mWaterMaterial].get();
 
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
@@ -464,36 +1130,269 @@ void TreeBillboardsApp::AnimateMaterials(const GameTimer& gt)
 
 void TreeBillboardsApp::UpdateObjectCBs(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	ScopedCpuTimer timer(*mProfiler, mCpuObjectCBsTimer);
+
+	// Only the objects that changed since this frame resource was last used are
+	// written; the store tracks that per frame resource.
+	mTransforms->Update(mCurrFrameResourceIndex, *mCurrFrameResource->ObjectBuffer);
+}
+
+void TreeBillboardsApp::UpdatePsoVariants(const GameTimer& gt)
+{
+	// The tightest variant leaves out the light types the scene has none of, and
+	// unrolls the directional lights when there are few enough.
+	UINT lightFeatures = 0;
+	if(mLightManager->LightCount(LightType::Point) == 0)
+		lightFeatures |= ShaderPermutations::NoPointLights;
+	if(mLightManager->LightCount(LightType::Spot) == 0)
+		lightFeatures |= ShaderPermutations::NoSpotLights;
+
+	const UINT dirLightCount = mLightManager->LightCount(LightType::Directional);
+
+	bool pending = false;
+	for(auto& variant : mPsoVariants)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		const UINT features = variant.Features | lightFeatures;
+		const UINT key = dirLightCount <= ShaderPermutations::MaxSpecializedDirLights ?
+			ShaderPermutations::MakeKey(features, dirLightCount) : ShaderPermutations::MakeKey(features);
+		if(key == variant.Key || key == variant.FailedKey)
+			continue;
+
+		// The layer keeps drawing with its current PSO until the variant has compiled
+		// and its PSO has been created, both on background tasks.
+		ComPtr<ID3DBlob> pixelShader = mShaderPermutations->Request(variant.Program, key);
+		if(pixelShader == nullptr)
+		{
+			if(mShaderPermutations->Failed(variant.Program, key))
+				variant.FailedKey = key;
+			else
+				pending = true;
+			continue;
+		}
+
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC desc = variant.Desc;
+		desc.PS =
+		{
+			reinterpret_cast<BYTE*>(pixelShader->GetBufferPointer()),
+			pixelShader->GetBufferSize()
+		};
+
+		// Every variant PSO has its own name, so those the frames in flight still use
+		// stay alive.
+		const std::string name = variant.Pso + "_" + std::to_string(key);
+		ComPtr<ID3D12PipelineState> variantPso = mPipelineCache->RequestGraphics(name, desc);
+		if(variantPso == nullptr)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			if(mPipelineCache->RequestFailed(name))
+				variant.FailedKey = key;
+			else
+				pending = true;
+			continue;
+		}
+		mPSOs.Add(name, variantPso);
+
+		ID3D12PipelineState* pso = variantPso.Get();
+		for(auto& job : mDrawJobs)
+		{
+			if(job.PSO == variant.Current)
+				job.PSO = pso;
+		}
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+		variant.Key = key;
+		variant.Current = pso;
+	}
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	// The library file is rewritten once the variants have all arrived or failed, not
+	// per PSO.
+	if(!pending && !mPipelineCache->RequestsPending())
+		mPipelineCache->Save();
+}
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+void TreeBillboardsApp::UpdateSceneStreaming(const GameTimer& gt)
+{
+	if(LoadSceneRegions(mCamera.GetPosition3f(), gSceneStreamDistance, gSceneRegionsPerFrame) == 0)
+		return;
+
+	// Sort the new items in with the rest; Draw hands them to the DrawCuller.
+	BuildSortKeys();
+	BuildSpatialIndex();
+	mIndirectDrawsDirty = true;
+}
+
+void TreeBillboardsApp::UpdateVisibility(const GameTimer& gt)
+{
+	XMMATRIX view = mCamera.GetView();
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	// Bring the camera frustum into world space once, then test world space bounds against it.
+	mCamFrustum.Transform(mWorldFrustum, invView);
+	const BoundingFrustum& worldFrustum = mWorldFrustum;
+
+	mVisibleCount = 0;
+	mCulledCount = 0;
+
+	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+	for(UINT handle = 0; handle < (UINT)mRitems.size(); ++handle)
+	{
+		RenderItem* e = &mRitems[handle];
+		const XMFLOAT4X4& world = mTransforms->World(handle);
+		const XMFLOAT4X4& texTransform = mTransforms->TexTransform(handle);
+
+		if(e->GpuDriven && mGpuDrivenEnabled)
+		{
+			// Culled by the DrawCuller.  Its result stays on the GPU, so the streamer is
+			// asked for every item's textures as if they were visible.
+			BoundingBox worldBounds;
+			if(e->Instances.empty())
+			{
+				e->Bounds.Transform(worldBounds, XMLoadFloat4x4(&world));
+				ReportTextureScreenSize(e, worldBounds, texTransform);
+			}
+
+			for(auto& instance : e->Instances)
+			{
+				e->Bounds.Transform(worldBounds, XMLoadFloat4x4(&instance.World));
+				ReportTextureScreenSize(e, worldBounds, instance.TexTransform);
+			}
+			continue;
+		}
+
+		if(e->Instances.empty())
+		{
+			BoundingBox worldBounds;
+			e->Bounds.Transform(worldBounds, XMLoadFloat4x4(&world));
+
+			e->Visible = !mFrustumCullingEnabled || (worldFrustum.Contains(worldBounds) != DirectX::DISJOINT);
+			if(e->Visible)
+			{
+				++mVisibleCount;
+				ReportTextureScreenSize(e, worldBounds, texTransform);
+			}
+			else
+			{
+				++mCulledCount;
+			}
+			continue;
+		}
+
+		// The set of visible instances changes as the camera moves, so the instance
+		// buffer is rewritten every frame with only the instances that pass the test.
+		UINT visibleInstanceCount = 0;
+		for(UINT i = 0; i < (UINT)e->Instances.size(); ++i)
+		{
+			XMMATRIX instWorld = XMLoadFloat4x4(&e->Instances[i].World);
+
+			BoundingBox worldBounds;
+			e->Bounds.Transform(worldBounds, instWorld);
+
+			if(mFrustumCullingEnabled && worldFrustum.Contains(worldBounds) == DirectX::DISJOINT)
+			{
+				++mCulledCount;
+				continue;
+			}
+
+			XMMATRIX instTexTransform = XMLoadFloat4x4(&e->Instances[i].TexTransform);
+
+			InstanceData instData;
+			XMStoreFloat4x4(&instData.World, XMMatrixTranspose(instWorld));
+			XMStoreFloat4x4(&instData.TexTransform, XMMatrixTranspose(instTexTransform));
+
+			currInstanceBuffer->CopyData(e->InstanceBufferOffset + visibleInstanceCount++, instData);
+			++mVisibleCount;
+
+			ReportTextureScreenSize(e, worldBounds, e->Instances[i].TexTransform);
 		}
+
+		e->InstanceCount = visibleInstanceCount;
+		e->Visible = visibleInstanceCount > 0;
+	}
+
+	UINT terrainTriangles = 0;
+	for(auto handle : mTerrainRitems)
+		terrainTriangles += mRitems[handle].Visible ? mRitems[handle].IndexCount / 3 : 0;
+
+	FrameProfiler::TimerStats gpuFrame = mProfiler->GetStats("frame", true);
+	FrameProfiler::TimerStats cpuUpdate = mProfiler->GetStats("Update", false);
+	FrameProfiler::TimerStats cpuDraw = mProfiler->GetStats("Draw", false);
+
+	std::wostringstream outs;
+	outs << mBaseCaption <<
+		L"    visible: " << mVisibleCount <<
+		L"    terrain tris: " << terrainTriangles <<
+		L"    culled: " << mCulledCount <<
+		L"    gpu-driven: " << (mGpuDrivenEnabled ? mDrawCuller->ItemCount() : 0) <<
+		L"    occlusion: " << (mGpuDrivenEnabled && mOcclusionCullingEnabled ? L"on" : L"off") <<
+		L"    textures: " << mTextureStreamer->ResidentBytes() / (1024 * 1024) << L" MB" <<
+		L"    upload peak: " << mUploadRing->GetStatistics().HighWaterBytes / 1024 << L" KB" <<
+		L"    frames: " << gNumFrameResources << L"/" << GetMaxFrameLatency() <<
+		L"    vsync: " << (GetVsyncState() ? L"on" : L"off") << std::fixed << std::setprecision(2) <<
+		L"    gpu p50/p95: " << gpuFrame.P50 << L"/" << gpuFrame.P95 << L" ms" <<
+		L"    update/draw p95: " << cpuUpdate.P95 << L"/" << cpuDraw.P95 << L" ms" <<
+		L"    picked: " << (mPickedRitem != UINT_MAX ? AnsiToWString(mRitems[mPickedRitem].Mat->Name) : L"none");
+	mMainWndCaption = outs.str();
+}
+
+void TreeBillboardsApp::UpdateTerrainLods(const GameTimer& gt)
+{
+	mTerrain->SelectLods(mCamera.GetPosition3f());
+
+	for(UINT chunk = 0; chunk < (UINT)mTerrainRitems.size(); ++chunk)
+	{
+		SubmeshGeometry args = mTerrain->ChunkDrawArgs(chunk, mTerrainDrawArgs);
+
+		RenderItem* ri = &mRitems[mTerrainRitems[chunk]];
+		ri->IndexCount = args.IndexCount;
+		ri->StartIndexLocation = args.StartIndexLocation;
+		ri->BaseVertexLocation = args.BaseVertexLocation;
 	}
 }
 
-void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
+void TreeBillboardsApp::ReportTextureScreenSize(const RenderItem* ri, const BoundingBox& worldBounds, const XMFLOAT4X4& texTransform)
+{
+	if(ri->Mat == nullptr)
+		return;
+
+	// Approximate the projected size of the bounding sphere at its nearest point.
+	XMVECTOR center = XMLoadFloat3(&worldBounds.Center);
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Extents)));
+	float distance = XMVectorGetX(XMVector3Length(center - mCamera.GetPosition())) - radius;
+	distance = std::max(distance, 1.0f);
+
+	XMFLOAT4X4 proj = mCamera.GetProj4x4f();
+	float pixels = radius / distance * proj._22 * mClientHeight;
+
+	// The texture repeats this many times across the item.
+	float repeat = std::max(std::max(fabsf(texTransform._11), fabsf(texTransform._22)), 1e-3f);
+
+	mTextureStreamer->ReportScreenSize(ri->Mat->DiffuseSrvHeapIndex, pixels / repeat);
+}
+
+void TreeBillboardsApp::UpdateMaterialBuffer(const GameTimer& gt)
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
+	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
 	for(auto& e : mMaterials)
 	{
 		// Only update the cbuffer data if the constants have changed.  If the cbuffer
 		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
+		Material* mat = e.get();
+
+		// The resident mips of a streamed texture change without the material changing.
+		float minLod = mTextureStreamer->MinLod(mat->DiffuseSrvHeapIndex);
+		if(minLod != mat->MinLod)
+		{
+			mat->MinLod = minLod;
+			mat->NumFramesDirty = gNumFrameResources;
+		}
+
+		// So does the SRV the shaders read, which is the placeholder until the texture
+		// is resident.
+		UINT diffuseMapIndex = mTextureStreamer->ResolveSrvHeapIndex(mat->DiffuseSrvHeapIndex);
+		if(diffuseMapIndex != mat->DiffuseMapIndex)
+		{
+			mat->DiffuseMapIndex = diffuseMapIndex;
+			mat->NumFramesDirty = gNumFrameResources;
+		}
+
 		if(mat->NumFramesDirty > 0)
 		{
 			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
@@ -502,9 +1401,11 @@ void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
 			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
 			matConstants.FresnelR0 = mat->FresnelR0;
 			matConstants.Roughness = mat->Roughness;
+			matConstants.MinLod = mat->MinLod;
+			matConstants.DiffuseMapIndex = mat->DiffuseMapIndex;
 			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+			currMaterialBuffer->CopyData(mat->MatCBIndex, matConstants);
 
 			// Next FrameResource need to be updated too.
 			mat->NumFramesDirty--;
@@ -514,94 +1415,74 @@ void TreeBillboardsApp::UpdateMaterialCBs(const GameTimer& gt)
 
 void TreeBillboardsApp::UpdateMainPassCB(const GameTimer& gt)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX proj = mCamera.GetProj();
+	// The camera matrices and their inverses only change when the camera moves or
+	// the window is resized, so only then redo the inversions.
+	XMFLOAT4X4 view4x4 = mCamera.GetView4x4f();
+	XMFLOAT4X4 proj4x4 = mCamera.GetProj4x4f();
+	if(memcmp(&view4x4, &mPassView, sizeof(XMFLOAT4X4)) != 0 ||
+		memcmp(&proj4x4, &mPassProj, sizeof(XMFLOAT4X4)) != 0)
+	{
+		mPassView = view4x4;
+		mPassProj = proj4x4;
+
+		XMMATRIX view = XMLoadFloat4x4(&view4x4);
+		XMMATRIX proj = XMLoadFloat4x4(&proj4x4);
+
+		XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+		XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
+		XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+		XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
+		XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
+		XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
+		XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
+		XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
+		XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
+		mMainPassCB.EyePosW = mCamera.GetPosition3f();
+		mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
+		mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
+		mMainPassCB.NearZ = 1.0f;
+		mMainPassCB.FarZ = 1000.0f;
+	}
 
-	XMMATRIX viewProj = XMMatrixMultiply(view, proj);
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-	XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
-	XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
-
-	XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
-	XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
-	XMStoreFloat4x4(&mMainPassCB.Proj, XMMatrixTranspose(proj));
-	XMStoreFloat4x4(&mMainPassCB.InvProj, XMMatrixTranspose(invProj));
-	XMStoreFloat4x4(&mMainPassCB.ViewProj, XMMatrixTranspose(viewProj));
-	XMStoreFloat4x4(&mMainPassCB.InvViewProj, XMMatrixTranspose(invViewProj));
-	mMainPassCB.EyePosW = mCamera.GetPosition3f();
-	mMainPassCB.RenderTargetSize = XMFLOAT2((float)mClientWidth, (float)mClientHeight);
-	mMainPassCB.InvRenderTargetSize = XMFLOAT2(1.0f / mClientWidth, 1.0f / mClientHeight);
-	mMainPassCB.NearZ = 1.0f;
-	mMainPassCB.FarZ = 1000.0f;
 	mMainPassCB.TotalTime = gt.TotalTime();
 	mMainPassCB.DeltaTime = gt.DeltaTime();
-	mMainPassCB.AmbientLight = { 1.25f, 0.5f, 0.35f, 1.0f };
-	
-	mMainPassCB.Lights[0].Direction = { 0.57735f, -0.57735f, 2.57735f };
-	mMainPassCB.Lights[0].Strength = { 0.3f, 0.3f, 0.3f };
-	mMainPassCB.Lights[1].Direction = { -0.57735f, -0.57735f, 0.57735f };
-	mMainPassCB.Lights[1].Strength = { 0.3f, 0.3f, 0.3f };
-	mMainPassCB.Lights[2].Direction = { -0.707f, -0.707f, -5.707f };
-	mMainPassCB.Lights[2].Strength = { 0.15f, 0.15f, 0.15f };
-
-	// Point Lights
-	mMainPassCB.Lights[3].Position = { 0.0f, 30.0f, 10.0f };
-	mMainPassCB.Lights[3].Strength = { 0.0f, 1.0f, 0.0f };
-	mMainPassCB.Lights[3].FalloffStart = 5.0f;
-	mMainPassCB.Lights[3].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[4].Position = { -30.0f, 100.0f, -35.0f };
-	mMainPassCB.Lights[4].Strength = { 0.0f, 1.0f, 0.0f };
-	mMainPassCB.Lights[4].FalloffStart = 5.0f;
-	mMainPassCB.Lights[4].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[5].Position = { 30.0f, 100.0f, -35.0f };
-	mMainPassCB.Lights[5].Strength = { 0.0f, 1.0f, 0.0f };
-	mMainPassCB.Lights[5].FalloffStart = 5.0f;
-	mMainPassCB.Lights[5].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[6].Position = { -30.0f, 100.0f, 35.0f };
-	mMainPassCB.Lights[6].Strength = { 0.0f, 1.0f, 0.0f };
-	mMainPassCB.Lights[6].FalloffStart = 5.0f;
-	mMainPassCB.Lights[6].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[7].Position = { 30.0f, 100.0f, 35.0f };
-	mMainPassCB.Lights[7].Strength = { 0.0f, 1.0f, 0.0f };
-	mMainPassCB.Lights[7].FalloffStart = 5.0f;
-	mMainPassCB.Lights[7].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[8].Position = { -10.0f, 40.0f, -42.0f };
-	mMainPassCB.Lights[8].Strength = { 0.0f, 0.0f, 1.0f };
-	mMainPassCB.Lights[8].FalloffStart = 5.0f;
-	mMainPassCB.Lights[8].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[9].Position = { 0.0f, 15.0f, 100.0f };
-	mMainPassCB.Lights[9].Strength = { 0.0f, 0.0f, 1.0f };
-	mMainPassCB.Lights[9].FalloffStart = 5.0f;
-	mMainPassCB.Lights[9].FalloffEnd = 50.0f;
-
-	mMainPassCB.Lights[10].Position = { -20.0f, 40.0f, -10.0f };
-	mMainPassCB.Lights[10].Strength = { 0.0f, 0.0f, 1.0f };
-	mMainPassCB.Lights[10].FalloffStart = 5.0f;
-	mMainPassCB.Lights[10].FalloffEnd = 50.0f;
-	
-	mMainPassCB.Lights[11].Position = { 20.0f, 40.0f, -10.0f };
-	mMainPassCB.Lights[11].Strength = { 0.0f, 0.0f, 1.0f };
-	mMainPassCB.Lights[11].FalloffStart = 5.0f;
-	mMainPassCB.Lights[11].FalloffEnd = 50.0f;
-	
+
+	mLightManager->Update(mCurrFrameResource, mMainPassCB);
 
 	auto currPassCB = mCurrFrameResource->PassCB.get();
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
+
 void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 {
+	ScopedCpuTimer timer(*mProfiler, mCpuUpdateWavesTimer);
+
+	// Wait for the step started last frame before touching the solution.
+	mWavesTasks.wait();
+
+	// Only one of the two wave items is drawn.  The GPU waves are simulated in Draw.
+	if(mGpuWavesEnabled)
+	{
+		mRitems[mWavesRitem].Visible = false;
+		return;
+	}
+	mRitems[mGpuWavesRitem].Visible = false;
+
+	// Update the wave vertex buffer with the solution computed last frame,
+	// written straight into the mapped upload memory.
+	auto currWavesVB = mCurrFrameResource->WavesVB.get();
+	mWaves->WriteVertices(currWavesVB->MappedData());
+
+	// Set the dynamic VB of the wave renderitem to the current frame VB.
+	mRitems[mWavesRitem].Geo->VertexBufferGPU = currWavesVB->Resource();
+
 	// Every quarter second, generate a random wave.
-	static float t_base = 0.0f;
-	if((mTimer.TotalTime() - t_base) >= 0.25f)
+	if((mTimer.TotalTime() - mWavesDisturbTime) >= 0.25f)
 	{
-		t_base += 0.25f;
+		mWavesDisturbTime += 0.25f;
 
 		int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
 		int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
@@ -611,28 +1492,15 @@ void TreeBillboardsApp::UpdateWaves(const GameTimer& gt)
 		mWaves->Disturb(i, j, r);
 	}
 
-	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
-
-	// Update the wave vertex buffer with the new solution.
-	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	// Start the fixed step simulation for next frame.  While the waves are off
+	// screen no steps are run; the accumulated time is dropped instead.
+	float dt = gt.DeltaTime();
+	int maxSteps = mRitems[mWavesRitem].Visible ? 4 : 0;
+	mWavesTasks.run([this, dt, maxSteps]()
 	{
-		Vertex v;
-
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
-
-		currWavesVB->CopyData(i, v);
-	}
-
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+		ScopedCpuTimer solveTimer(*mProfiler, mCpuWavesSolveTimer);
+		mWaves->Update(dt, maxSteps);
+	});
 }
 
 void TreeBillboardsApp::BuildCastleGeometry()
@@ -673,12 +1541,6 @@ void TreeBillboardsApp::BuildCastleCorners()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -688,10 +1550,12 @@ void TreeBillboardsApp::BuildCastleCorners()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["corner"] = submesh;
 
-	mGeometries["cornerGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("cornerGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildCastleWalls()
@@ -723,12 +1587,6 @@ void TreeBillboardsApp::BuildCastleWalls()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -738,10 +1596,12 @@ void TreeBillboardsApp::BuildCastleWalls()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["wall"] = submesh;
 
-	mGeometries["wallGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("wallGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildCone()
@@ -773,12 +1633,6 @@ void TreeBillboardsApp::BuildCone()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -788,10 +1642,12 @@ void TreeBillboardsApp::BuildCone()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["cone"] = submesh;
 
-	mGeometries["coneGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("coneGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildPyramid()
@@ -823,12 +1679,6 @@ void TreeBillboardsApp::BuildPyramid()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -838,10 +1688,12 @@ void TreeBillboardsApp::BuildPyramid()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["pyramid"] = submesh;
 
-	mGeometries["pyramidGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("pyramidGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildDiamond()
@@ -873,12 +1725,6 @@ void TreeBillboardsApp::BuildDiamond()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -888,212 +1734,331 @@ void TreeBillboardsApp::BuildDiamond()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["diamond"] = submesh;
 
-	mGeometries["diamondGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("diamondGeo", std::move(geo));
+}
+
+void TreeBillboardsApp::UpdateWavesGpu(const GameTimer& gt)
+{
+	// Every quarter second, generate a random wave.
+	if((mTimer.TotalTime() - mGpuWavesDisturbTime) >= 0.25f)
+	{
+		mGpuWavesDisturbTime += 0.25f;
+
+		int i = MathHelper::Rand(4, mGpuWaves->RowCount() - 5);
+		int j = MathHelper::Rand(4, mGpuWaves->ColumnCount() - 5);
+
+		float r = MathHelper::RandF(0.2f, 0.5f);
+
+		mGpuWaves->Disturb(mCommandList.Get(), mWavesRootSignature.Get(), mPSOs[mWavesDisturbPso].Get(), i, j, r);
+	}
+
+	// Update the wave simulation.
+	mGpuWaves->Update(gt, mCommandList.Get(), mWavesRootSignature.Get(), mPSOs[mWavesUpdatePso].Get());
 }
 
 void TreeBillboardsApp::LoadTextures()
 {
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"../../Textures/greengrass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
-
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../../Textures/water.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-
-	auto brickTex = std::make_unique<Texture>();
-	brickTex->Name = "brickTex";
-	brickTex->Filename = L"../../Textures/brick.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), brickTex->Filename.c_str(),
-		brickTex->Resource, brickTex->UploadHeap));
-
-	auto marbleTex = std::make_unique<Texture>();
-	marbleTex->Name = "marbleTex";
-	marbleTex->Filename = L"../../Textures/marble.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), marbleTex->Filename.c_str(),
-		marbleTex->Resource, marbleTex->UploadHeap));
-
-	auto woodTex = std::make_unique<Texture>();
-	woodTex->Name = "woodTex";
-	woodTex->Filename = L"../../Textures/wood.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), woodTex->Filename.c_str(),
-		woodTex->Resource, woodTex->UploadHeap));
-
-	auto crystalTex = std::make_unique<Texture>();
-	crystalTex->Name = "crystalTex";
-	crystalTex->Filename = L"../../Textures/crystal.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), crystalTex->Filename.c_str(),
-		crystalTex->Resource, crystalTex->UploadHeap));
-
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../../Textures/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
+	// The textures are read on worker threads and uploaded on the streamer's copy
+	// queue; only the placeholder is loaded with the initialization commands.  Each
+	// texture's SRV is written into mSrvHeap once the texture is resident.
+	mTextureStreamer = std::make_unique<TextureStreamer>(md3dDevice.Get(), mUploadRing.get(), gNumFrameResources, gTextureBudgetBytes);
+	mTextureStreamer->LoadPlaceholder(mCommandList.Get(), L"../../Textures/white1x1.dds");
 
-	
+	struct TextureSource
+	{
+		const char* Name;
+		const wchar_t* Filename;
+		D3D12_SRV_DIMENSION ViewDimension;
+	};
 
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[brickTex->Name] = std::move(brickTex);
-	mTextures[marbleTex->Name] = std::move(marbleTex);
-	mTextures[woodTex->Name] = std::move(woodTex);
-	mTextures[crystalTex->Name] = std::move(crystalTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
-	
+	// The position in this table is the texture's SRV heap index past mTextureSrvBase.
+	const TextureSource sources[] =
+	{
+		{ "grassTex", L"../../Textures/greengrass.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "waterTex", L"../../Textures/water.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "brickTex", L"../../Textures/brick.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "marbleTex", L"../../Textures/marble.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "woodTex", L"../../Textures/wood.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "crystalTex", L"../../Textures/crystal.dds", D3D12_SRV_DIMENSION_TEXTURE2D },
+		{ "treeArrayTex", L"../../Textures/treeArray.dds", D3D12_SRV_DIMENSION_TEXTURE2DARRAY },
+	};
+
+	mTextureSrvBase = mSrvHeap->Allocate(_countof(sources));
+	assert(mTextureSrvBase + _countof(sources) <= gTextureTableSize);
+
+	for(UINT i = 0; i < _countof(sources); ++i)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = sources[i].Name;
+		tex->Filename = sources[i].Filename;
+
+		mTextureStreamer->Request(tex.get(), mTextureSrvBase + i, sources[i].ViewDimension);
+		mTextures.Add(tex->Name, std::move(tex));
+	}
 }
 
+
 void TreeBillboardsApp::BuildRootSignature()
 {
-	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+	// Both ranges span the start of the SRV heap, once as 2D textures and once as
+	// texture arrays; the materials pick the textures by heap index.
+	CD3DX12_DESCRIPTOR_RANGE texTable[2];
+	texTable[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, gTextureTableSize, 0, 2, 0);
+	texTable[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, gTextureTableSize, 0, 3, 0);
+
+	CD3DX12_DESCRIPTOR_RANGE displacementMapTable;
+	displacementMapTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);
 
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[10];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
-	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0);
+	slotRootParameter[0].InitAsDescriptorTable(_countof(texTable), texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[1].InitAsConstants(1, 0);
     slotRootParameter[2].InitAsConstantBufferView(1);
-    slotRootParameter[3].InitAsConstantBufferView(2);
+	slotRootParameter[3].InitAsShaderResourceView(5, 1);
+	slotRootParameter[4].InitAsShaderResourceView(0, 1);
+	slotRootParameter[5].InitAsShaderResourceView(1, 1);
+	slotRootParameter[6].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[7].InitAsShaderResourceView(3, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[8].InitAsDescriptorTable(1, &displacementMapTable, D3D12_SHADER_VISIBILITY_VERTEX);
+	slotRootParameter[9].InitAsShaderResourceView(4, 1);
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(10, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
-    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
-    ComPtr<ID3DBlob> serializedRootSig = nullptr;
-    ComPtr<ID3DBlob> errorBlob = nullptr;
-    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+	CreateRootSignature(rootSigDesc, mRootSignature);
+}
 
-    if(errorBlob != nullptr)
-    {
-        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
-    }
-    ThrowIfFailed(hr);
+void TreeBillboardsApp::BuildLightCullRootSignature()
+{
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-    ThrowIfFailed(md3dDevice->CreateRootSignature(
-		0,
-        serializedRootSig->GetBufferPointer(),
-        serializedRootSig->GetBufferSize(),
-        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+	slotRootParameter[0].InitAsConstantBufferView(1);
+	slotRootParameter[1].InitAsShaderResourceView(1, 1);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
+	slotRootParameter[3].InitAsUnorderedAccessView(1);
+
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	CreateRootSignature(rootSigDesc, mLightCullRootSignature);
 }
 
-void TreeBillboardsApp::BuildDescriptorHeaps()
+void TreeBillboardsApp::BuildWavesRootSignature()
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 8;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+	CD3DX12_DESCRIPTOR_RANGE uavTable0;
+	uavTable0.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto brickTex = mTextures["brickTex"]->Resource;
-	auto marbleTex = mTextures["marbleTex"]->Resource;
-	auto woodTex = mTextures["woodTex"]->Resource;
-	auto crystalTex = mTextures["crystalTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-	
+	CD3DX12_DESCRIPTOR_RANGE uavTable1;
+	uavTable1.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 1);
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = grassTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
+	CD3DX12_DESCRIPTOR_RANGE uavTable2;
+	uavTable2.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 2);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// Root parameter can be a table, root descriptor or root constants.
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-	srvDesc.Format = waterTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsConstants(6, 0);
+	slotRootParameter[1].InitAsDescriptorTable(1, &uavTable0);
+	slotRootParameter[2].InitAsDescriptorTable(1, &uavTable1);
+	slotRootParameter[3].InitAsDescriptorTable(1, &uavTable2);
+
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	CreateRootSignature(rootSigDesc, mWavesRootSignature);
+}
+
+void TreeBillboardsApp::BuildDrawCullRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE hiZTable;
+	hiZTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 3);
+
+	CD3DX12_ROOT_PARAMETER slotRootParameter[8];
+
+	// Six frustum planes, the item count, the culling flags and the occluder distance.
+	slotRootParameter[0].InitAsConstants(28, 0);
+	slotRootParameter[1].InitAsConstantBufferView(1);
+	slotRootParameter[2].InitAsShaderResourceView(0);
+	slotRootParameter[3].InitAsShaderResourceView(1);
+	slotRootParameter[4].InitAsShaderResourceView(2);
+	slotRootParameter[5].InitAsUnorderedAccessView(0);
+	slotRootParameter[6].InitAsUnorderedAccessView(1);
+	slotRootParameter[7].InitAsDescriptorTable(1, &hiZTable);
+
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(8, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+	CreateRootSignature(rootSigDesc, mDrawCullRootSignature);
+}
 
-	srvDesc.Format = brickTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(brickTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildHiZRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE srvTable;
+	srvTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
 
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	CD3DX12_DESCRIPTOR_RANGE uavTable;
+	uavTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
 
-	srvDesc.Format = marbleTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(marbleTex.Get(), &srvDesc, hDescriptor);
+	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
 
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// The mip read from and the mip written to.
+	slotRootParameter[0].InitAsDescriptorTable(1, &srvTable);
+	slotRootParameter[1].InitAsDescriptorTable(1, &uavTable);
 
-	srvDesc.Format = woodTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(woodTex.Get(), &srvDesc, hDescriptor);
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	CreateRootSignature(rootSigDesc, mHiZRootSignature);
+}
 
-	srvDesc.Format = crystalTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(crystalTex.Get(), &srvDesc, hDescriptor);
+void TreeBillboardsApp::BuildTreeCullRootSignature()
+{
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-    // next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// Six frustum planes, the eye position, the tree count and the fade distances.
+	slotRootParameter[0].InitAsConstants(30, 0);
+	slotRootParameter[1].InitAsShaderResourceView(0);
+	slotRootParameter[2].InitAsUnorderedAccessView(0);
+	slotRootParameter[3].InitAsUnorderedAccessView(1);
 
-	auto desc = treeArrayTex->GetDesc();
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
-	srvDesc.Format = treeArrayTex->GetDesc().Format;
-	srvDesc.Texture2DArray.MostDetailedMip = 0;
-	srvDesc.Texture2DArray.MipLevels = -1;
-	srvDesc.Texture2DArray.FirstArraySlice = 0;
-	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
-	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+	// A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+		0, nullptr,
+		D3D12_ROOT_SIGNATURE_FLAG_NONE);
 
-	
+	CreateRootSignature(rootSigDesc, mTreeCullRootSignature);
+}
+
+// Serializes desc and creates rootSignature from it.  Serialization errors are written
+// to the debugger output before they are thrown.
+void TreeBillboardsApp::CreateRootSignature(const CD3DX12_ROOT_SIGNATURE_DESC& desc,
+	ComPtr<ID3D12RootSignature>& rootSignature)
+{
+	ComPtr<ID3DBlob> serializedRootSig = nullptr;
+	ComPtr<ID3DBlob> errorBlob = nullptr;
+	HRESULT hr = D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1,
+		serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+	if(errorBlob != nullptr)
+	{
+		::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+	}
+	ThrowIfFailed(hr);
+
+	ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+		serializedRootSig->GetBufferPointer(),
+		serializedRootSig->GetBufferSize(),
+		IID_PPV_ARGS(rootSignature.ReleaseAndGetAddressOf())));
+}
+
+void TreeBillboardsApp::BuildDescriptorHeaps()
+{
+	// mSrvHeap was created before the textures took their SRVs from it; the other
+	// systems take theirs here.  The texture SRVs are written by the streamer once
+	// each texture is resident.
+
+	// The placeholder bound in place of textures that are still streaming.  The
+	// texture tables reach it, so it follows the textures.
+	const UINT placeholderSrvHeapIndex = mSrvHeap->Allocate(TextureStreamer::PlaceholderDescriptorCount);
+	assert(placeholderSrvHeapIndex + TextureStreamer::PlaceholderDescriptorCount <= gTextureTableSize);
+	mTextureStreamer->BuildDescriptors(mSrvHeap->GetHeap(), placeholderSrvHeapIndex, mSrvHeap->DescriptorSize());
+
+	// The wave simulation textures.
+	const UINT wavesSrvHeapIndex = mSrvHeap->Allocate(mGpuWaves->DescriptorCount());
+	mGpuWaves->BuildDescriptors(
+		mSrvHeap->CpuHandle(wavesSrvHeapIndex),
+		mSrvHeap->GpuHandle(wavesSrvHeapIndex),
+		mSrvHeap->DescriptorSize());
+
+	// The Hi-Z pyramid.
+	const UINT hiZSrvHeapIndex = mSrvHeap->Allocate(mHiZ->DescriptorCount());
+	mHiZ->BuildDescriptors(
+		mSrvHeap->CpuHandle(hiZSrvHeapIndex),
+		mSrvHeap->GpuHandle(hiZSrvHeapIndex),
+		mSrvHeap->DescriptorSize());
 }
 
 void TreeBillboardsApp::BuildShadersAndInputLayouts()
 {
-	const D3D_SHADER_MACRO defines[] =
+	mShaderPermutations = std::make_unique<ShaderPermutations>(gShaderCacheDirectory);
+
+	mShaderPermutations->AddProgram("defaultVS", L"Shaders\\Default.hlsl", "VS", "vs_5_1");
+	mShaderPermutations->AddProgram("defaultPS", L"Shaders\\Default.hlsl", "PS", "ps_5_1");
+	mShaderPermutations->AddProgram("treeSpriteVS", L"Shaders\\TreeSprite.hlsl", "VS", "vs_5_1");
+	mShaderPermutations->AddProgram("treeSpritePS", L"Shaders\\TreeSprite.hlsl", "PS", "ps_5_1");
+
+	mShaderPermutations->AddProgram("lightCullCS", L"Shaders\\LightCulling.hlsl", "CS", "cs_5_1");
+	mShaderPermutations->AddProgram("drawCullCS", L"Shaders\\DrawCulling.hlsl", "CS", "cs_5_1");
+	mShaderPermutations->AddProgram("treeCullCS", L"Shaders\\TreeCulling.hlsl", "CS", "cs_5_1");
+	mShaderPermutations->AddProgram("hiZCopyCS", L"Shaders\\HiZ.hlsl", "CopyDepthCS", "cs_5_1");
+	mShaderPermutations->AddProgram("hiZDownsampleCS", L"Shaders\\HiZ.hlsl", "DownsampleCS", "cs_5_1");
+	mShaderPermutations->AddProgram("wavesUpdateCS", L"Shaders\\WaveSim.hlsl", "UpdateWavesCS", "cs_5_1");
+	mShaderPermutations->AddProgram("wavesDisturbCS", L"Shaders\\WaveSim.hlsl", "DisturbWavesCS", "cs_5_1");
+
+	// Shaders clamp sampling to the resident mips when textures are streamed.
+	mTextureShaderFeatures = mTextureStreamer->TiledResourcesSupported() ? ShaderPermutations::MinLodClamp : 0;
+
+	// The general variants, which take the light counts from the pass constants.  The
+	// lit pixel shaders are specialized for the scene later, see UpdatePsoVariants.
+	struct ShaderVariant
 	{
-		//"FOG", "1",
-		NULL, NULL
+		std::string Shader;
+		std::string Program;
+		UINT Features;
 	};
-
-	const D3D_SHADER_MACRO alphaTestDefines[] =
+	const ShaderVariant shaders[] =
 	{
-		//"FOG", "1",
-		"ALPHA_TEST", "1",
-		NULL, NULL
+		{ "standardVS", "defaultVS", 0 },
+		{ "instancedVS", "defaultVS", ShaderPermutations::Instanced },
+		{ "wavesVS", "defaultVS", ShaderPermutations::DisplacementMap },
+		{ "occluderDepthVS", "defaultVS", ShaderPermutations::DepthOnly },
+		{ "occluderDepthInstancedVS", "defaultVS", ShaderPermutations::Instanced | ShaderPermutations::DepthOnly },
+		{ "opaquePS", "defaultPS", mTextureShaderFeatures },
+		{ "alphaTestedPS", "defaultPS", ShaderPermutations::AlphaTest | mTextureShaderFeatures },
+
+		{ "treeSpriteVS", "treeSpriteVS", 0 },
+		{ "treeSpritePS", "treeSpritePS", ShaderPermutations::AlphaTest | mTextureShaderFeatures },
+
+		{ "lightCullCS", "lightCullCS", 0 },
+		{ "drawCullCS", "drawCullCS", 0 },
+		{ "treeCullCS", "treeCullCS", 0 },
+		{ "hiZCopyCS", "hiZCopyCS", 0 },
+		{ "hiZDownsampleCS", "hiZDownsampleCS", 0 },
+
+		{ "wavesUpdateCS", "wavesUpdateCS", 0 },
+		{ "wavesDisturbCS", "wavesDisturbCS", 0 },
 	};
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	// Loaded from the shader cache when unchanged since the last run and compiled
+	// otherwise, on worker threads.
+	std::vector<ShaderPermutations::Variant> variants;
+	for(auto& shader : shaders)
+		variants.push_back({ shader.Program, ShaderPermutations::MakeKey(shader.Features) });
+	mShaderPermutations->Compile(variants);
 
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	for(auto& shader : shaders)
+		mShaders.Add(shader.Shader, mShaderPermutations->Get(shader.Program, ShaderPermutations::MakeKey(shader.Features)));
 
     mStdInputLayout =
     {
@@ -1101,82 +2066,30 @@ void TreeBillboardsApp::BuildShadersAndInputLayouts()
         { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
-
-	mTreeSpriteInputLayout =
-	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "SIZE", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
 }
 
-void TreeBillboardsApp::BuildLandGeometry()
-{
-    GeometryGenerator geoGen;
-    GeometryGenerator::MeshData grid = geoGen.CreateGrid(720.0f, 720.0f, 225, 225);
-
-    //
-    // Extract the vertex elements we are interested and apply the height function to
-    // each vertex.  In addition, color the vertices based on their height so we have
-    // sandy looking beaches, grassy low hills, and snow mountain peaks.
-    //
-
-    std::vector<Vertex> vertices(grid.Vertices.size());
-    for(size_t i = 0; i < grid.Vertices.size(); ++i)
-    {
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		if (abs(p.x) > 175 && abs(p.x) < 999 && abs(p.z) < 999 || abs(p.z) > 200 && abs(p.z) < 999 && abs(p.x) < 999)
-		{
-			vertices[i].Pos.y = -10.0f;
-		}
-		else
-		{
-			vertices[i].Pos.y = 6.0f; //GetHillsHeight(p.x, p.z);
-		}
+void TreeBillboardsApp::BuildLandGeometry()
+{
+	mTerrain = std::make_unique<Terrain>(720.0f, 720.0f,
+		gTerrainChunkCount, gTerrainChunkCount, gTerrainChunkQuads, gTerrainLodDistance);
 
-		vertices[i].Normal = XMFLOAT3(p.x, 1.0f, p.y); //GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
-    }
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-
-    std::vector<std::uint16_t> indices = grid.GetIndices16();
-    const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["grid"] = submesh;
-
-	mGeometries["landGeo"] = std::move(geo);
+	// A flat island around the castle, dropping under the water past its shore.
+	auto geo = mTerrain->BuildGeometry("landGeo", [](float x, float z)
+	{
+		if (abs(x) > 175 || abs(z) > 200)
+			return -10.0f;
+
+		return 6.0f; //GetHillsHeight(x, z);
+	});
+
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("landGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	// 32-bit indices, as scaled scenes refine the grid past the 16-bit limit.
+    std::vector<std::uint32_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 
     // Iterate over each quad.
     int m = mWaves->RowCount();
@@ -1199,7 +2112,7 @@ void TreeBillboardsApp::BuildWavesGeometry()
     }
 
 	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint32_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = "waterGeo";
@@ -1212,11 +2125,62 @@ void TreeBillboardsApp::BuildWavesGeometry()
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indices.data(), ibByteSize, *mUploadRing, mFence.Get(), mCurrentFence + 1);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
+
+	// The vertices are animated, so bound the grid with some slack for the wave heights.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f*mWaves->Width(), 2.0f, 0.5f*mWaves->Depth());
+
+	geo->DrawArgs["grid"] = submesh;
+
+	mGeometries.Add("waterGeo", std::move(geo));
+}
+
+void TreeBillboardsApp::BuildGpuWavesGeometry()
+{
+	// A flat grid; the heights come from the displacement map in the vertex shader,
+	// so the vertex buffer never changes.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(
+		(mGpuWaves->ColumnCount() - 1)*mGpuWaves->SpatialStep(),
+		(mGpuWaves->RowCount() - 1)*mGpuWaves->SpatialStep(),
+		mGpuWaves->RowCount(), mGpuWaves->ColumnCount());
+
+	std::vector<Vertex> vertices(grid.Vertices.size());
+	for(size_t i = 0; i < grid.Vertices.size(); ++i)
+	{
+		vertices[i].Pos = grid.Vertices[i].Position;
+		vertices[i].Normal = grid.Vertices[i].Normal;
+		vertices[i].TexC = grid.Vertices[i].TexC;
+	}
+
+	std::vector<std::uint32_t> indices = grid.Indices32;
+
+	UINT vbByteSize = mGpuWaves->VertexCount()*sizeof(Vertex);
+	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint32_t);
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "gpuWaterGeo";
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
@@ -1224,9 +2188,14 @@ void TreeBillboardsApp::BuildWavesGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// Same slack for the wave heights as the CPU waves.
+	submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	submesh.Bounds.Extents = XMFLOAT3(0.5f*mGpuWaves->Width(), 2.0f, 0.5f*mGpuWaves->Depth());
+
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["waterGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("gpuWaterGeo", std::move(geo));
 }
 
 void TreeBillboardsApp::BuildBoxGeometry()
@@ -1257,12 +2226,6 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
@@ -1272,138 +2235,62 @@ void TreeBillboardsApp::BuildBoxGeometry()
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["box"] = submesh;
 
-	mGeometries["boxGeo"] = std::move(geo);
+	mGeometryPool->Add(geo.get());
+	mGeometries.Add("boxGeo", std::move(geo));
 }
 
-void TreeBillboardsApp::BuildTreeSpritesGeometry()
+void TreeBillboardsApp::BuildForest()
 {
-	//step5
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
-
-	static const int treeCount = 64;
-	std::array<TreeSpriteVertex, 64> vertices;
+	// Scatter the trees over the four strips of land around the castle, leaving the
+	// approach to the gate clear.
+	const UINT treeCount = gTreeCount * gSceneScale;
+	std::vector<Forest::Tree> trees(treeCount);
 	for(UINT i = 0; i < treeCount; ++i)
 	{
+		float x, z;
 		if (i < treeCount / 4)
 		{
-			float x = MathHelper::RandF(-150.0f, -120.0f);
-			float z = MathHelper::RandF(-180.0f, 180.0f);
-			float y = 24.0f; //GetHillsHeight(x, z);
-
-			vertices[i].Pos = XMFLOAT3(x, y, z);
-			vertices[i].Size = XMFLOAT2(40.0f, 40.0f);
+			x = MathHelper::RandF(-150.0f, -120.0f);
+			z = MathHelper::RandF(-180.0f, 180.0f);
 		}
 		else if (i < treeCount / 2)
 		{
-			float x = MathHelper::RandF(120.0f, 150.0f);
-			float z = MathHelper::RandF(-180.0f, 180.0f);
-			float y = 24.0f; //GetHillsHeight(x, z);
-
-			vertices[i].Pos = XMFLOAT3(x, y, z);
-			vertices[i].Size = XMFLOAT2(40.0f, 40.0f);
+			x = MathHelper::RandF(120.0f, 150.0f);
+			z = MathHelper::RandF(-180.0f, 180.0f);
 		}
 		else if (i < (3 * treeCount) / 4)
 		{
-			if (i % 2 == 0)
-			{
-				float x = MathHelper::RandF(-130.0f, -10.0f);
-				float z = MathHelper::RandF(-180.0f, -160.0f);
-				float y = 24.0f; //GetHillsHeight(x, z);
-
-				vertices[i].Pos = XMFLOAT3(x, y, z);
-				vertices[i].Size = XMFLOAT2(40.0f, 40.0f);
-			}
-			else
-			{
-				float x = MathHelper::RandF(10.0f, 130.0f);
-				float z = MathHelper::RandF(-180.0f, -160.0f);
-				float y = 24.0f; //GetHillsHeight(x, z);
-
-				vertices[i].Pos = XMFLOAT3(x, y, z);
-				vertices[i].Size = XMFLOAT2(40.0f, 40.0f);
-			}
+			x = (i % 2 == 0) ? MathHelper::RandF(-130.0f, -10.0f) : MathHelper::RandF(10.0f, 130.0f);
+			z = MathHelper::RandF(-180.0f, -160.0f);
 		}
 		else
 		{
-			float x = MathHelper::RandF(-100.0f, 100.0f);
-			float z = MathHelper::RandF(160.0f, 180.0f);
-			float y = 24.0f; //GetHillsHeight(x, z);
-
-			vertices[i].Pos = XMFLOAT3(x, y, z);
-			vertices[i].Size = XMFLOAT2(40.0f, 40.0f);
+			x = MathHelper::RandF(-100.0f, 100.0f);
+			z = MathHelper::RandF(160.0f, 180.0f);
 		}
-	}
 
-	std::array<std::uint16_t, 64> indices =
-	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15,
-		16, 17, 18, 19, 20, 21, 22, 23,
-		24, 25, 26, 27, 28, 29, 30, 31,
-		32, 33, 34, 35, 36, 37, 38, 39,
-		40, 41, 42, 43, 44, 45, 46, 47, 
-		48, 49, 50, 51, 52, 53, 54, 55, 
-		56, 57, 58, 59, 60, 61, 62, 63
-	};
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+		// Vary the size a little, keeping every trunk on the ground.
+		float size = MathHelper::RandF(30.0f, 50.0f);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["points"] = submesh;
+		trees[i].Position = XMFLOAT3(x, 4.0f + 0.5f * size, z);
+		trees[i].Size = XMFLOAT2(size, size);
+		trees[i].TextureIndex = i % 3;
+	}
 
-	mGeometries["treeSpritesGeo"] = std::move(geo);
+	mForest = std::make_unique<Forest>(md3dDevice.Get());
+	mForest->Build(mCommandList.Get(), *mUploadRing, mFence.Get(), mCurrentFence + 1, trees);
 }
 
-void TreeBillboardsApp::BuildMazePart(float sX, float sZ, float pX, float pZ, int index)
-{
-	// Build the individual wall of the maze
-	auto tempRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&tempRitem->TexTransform, (XMMatrixScaling(6.0f, 4.0f, 4.0f)));
-	XMStoreFloat4x4(&tempRitem->World, (XMMatrixScaling(sX, 30.0f, sZ) * XMMatrixTranslation(pX, 25.0f, pZ)));
-	tempRitem->ObjCBIndex = index++;
-	tempRitem->Mat = mMaterials["grass"].get();
-	tempRitem->Geo = mGeometries["wallGeo"].get();
-	tempRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	tempRitem->IndexCount = tempRitem->Geo->DrawArgs["wall"].IndexCount;
-	tempRitem->StartIndexLocation = tempRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-	tempRitem->BaseVertexLocation = tempRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(tempRitem.get());	mAllRitems.push_back(std::move(tempRitem));
-}
-
 void TreeBillboardsApp::BuildPSOs()
 {
+	// The descs are queued, then the PSOs loaded from the pipeline library or created
+	// on worker threads.
+	mPipelineCache = std::make_unique<PipelineCache>(md3dDevice.Get(), gPipelineCachePath);
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
 	//
@@ -1437,7 +2324,7 @@ void TreeBillboardsApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    mPipelineCache->AddGraphics("opaque", opaquePsoDesc);
 
 	//
 	// PSO for transparent objects
@@ -1460,7 +2347,18 @@ void TreeBillboardsApp::BuildPSOs()
 	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	mPipelineCache->AddGraphics("transparent", transparentPsoDesc);
+
+	//
+	// PSO for the GPU waves, displaced in the vertex shader
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC gpuWavesPsoDesc = transparentPsoDesc;
+	gpuWavesPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesVS"]->GetBufferPointer()),
+		mShaders["wavesVS"]->GetBufferSize()
+	};
+	mPipelineCache->AddGraphics("gpuWaves", gpuWavesPsoDesc);
 
 	//
 	// PSO for alpha tested objects
@@ -1473,7 +2371,18 @@ void TreeBillboardsApp::BuildPSOs()
 		mShaders["alphaTestedPS"]->GetBufferSize()
 	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	mPipelineCache->AddGraphics("alphaTested", alphaTestedPsoDesc);
+
+	//
+	// PSO for hardware instanced alpha tested objects
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedInstancedPsoDesc = alphaTestedPsoDesc;
+	alphaTestedInstancedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["instancedVS"]->GetBufferPointer()),
+		mShaders["instancedVS"]->GetBufferSize()
+	};
+	mPipelineCache->AddGraphics("alphaTestedInstanced", alphaTestedInstancedPsoDesc);
 
 	//
 	// PSO for tree sprites
@@ -1484,488 +2393,835 @@ void TreeBillboardsApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
 		mShaders["treeSpriteVS"]->GetBufferSize()
 	};
-	treeSpritePsoDesc.GS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
-	};
 	treeSpritePsoDesc.PS =
 	{
 		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
 		mShaders["treeSpritePS"]->GetBufferSize()
 	};
 	//step1
-	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
-	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
+	// The quads are expanded from SV_VertexID, so there is no vertex input.
+	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	treeSpritePsoDesc.InputLayout = { nullptr, 0 };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	mPipelineCache->AddGraphics("treeSprites", treeSpritePsoDesc);
+
+	//
+	// PSO for clustered light culling
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC lightCullPsoDesc = {};
+	lightCullPsoDesc.pRootSignature = mLightCullRootSignature.Get();
+	lightCullPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["lightCullCS"]->GetBufferPointer()),
+		mShaders["lightCullCS"]->GetBufferSize()
+	};
+	lightCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("lightCull", lightCullPsoDesc);
+
+	//
+	// PSO for culling the GPU-driven render items
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC drawCullPsoDesc = {};
+	drawCullPsoDesc.pRootSignature = mDrawCullRootSignature.Get();
+	drawCullPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["drawCullCS"]->GetBufferPointer()),
+		mShaders["drawCullCS"]->GetBufferSize()
+	};
+	drawCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("drawCull", drawCullPsoDesc);
+
+	//
+	// PSO for culling the forest
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC treeCullPsoDesc = {};
+	treeCullPsoDesc.pRootSignature = mTreeCullRootSignature.Get();
+	treeCullPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["treeCullCS"]->GetBufferPointer()),
+		mShaders["treeCullCS"]->GetBufferSize()
+	};
+	treeCullPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("treeCull", treeCullPsoDesc);
+
+	//
+	// PSOs for the Hi-Z occluder depth and pyramid
+	//
+	// The depth only vertex shaders skip the material, which DrawOccluders never binds.
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC occluderDepthPsoDesc = opaquePsoDesc;
+	occluderDepthPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["occluderDepthVS"]->GetBufferPointer()),
+		mShaders["occluderDepthVS"]->GetBufferSize()
+	};
+	occluderDepthPsoDesc.PS = {};
+	occluderDepthPsoDesc.NumRenderTargets = 0;
+	occluderDepthPsoDesc.RTVFormats[0] = DXGI_FORMAT_UNKNOWN;
+	occluderDepthPsoDesc.SampleDesc.Count = 1;
+	occluderDepthPsoDesc.SampleDesc.Quality = 0;
+	occluderDepthPsoDesc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+	mPipelineCache->AddGraphics("occluderDepth", occluderDepthPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC occluderDepthInstancedPsoDesc = occluderDepthPsoDesc;
+	occluderDepthInstancedPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["occluderDepthInstancedVS"]->GetBufferPointer()),
+		mShaders["occluderDepthInstancedVS"]->GetBufferSize()
+	};
+	mPipelineCache->AddGraphics("occluderDepthInstanced", occluderDepthInstancedPsoDesc);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC hiZCopyPsoDesc = {};
+	hiZCopyPsoDesc.pRootSignature = mHiZRootSignature.Get();
+	hiZCopyPsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["hiZCopyCS"]->GetBufferPointer()),
+		mShaders["hiZCopyCS"]->GetBufferSize()
+	};
+	hiZCopyPsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("hiZCopy", hiZCopyPsoDesc);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC hiZDownsamplePsoDesc = hiZCopyPsoDesc;
+	hiZDownsamplePsoDesc.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["hiZDownsampleCS"]->GetBufferPointer()),
+		mShaders["hiZDownsampleCS"]->GetBufferSize()
+	};
+	mPipelineCache->AddCompute("hiZDownsample", hiZDownsamplePsoDesc);
+
+	//
+	// PSOs for the wave simulation
+	//
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesDisturbPSO = {};
+	wavesDisturbPSO.pRootSignature = mWavesRootSignature.Get();
+	wavesDisturbPSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesDisturbCS"]->GetBufferPointer()),
+		mShaders["wavesDisturbCS"]->GetBufferSize()
+	};
+	wavesDisturbPSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("wavesDisturb", wavesDisturbPSO);
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC wavesUpdatePSO = {};
+	wavesUpdatePSO.pRootSignature = mWavesRootSignature.Get();
+	wavesUpdatePSO.CS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["wavesUpdateCS"]->GetBufferPointer()),
+		mShaders["wavesUpdateCS"]->GetBufferSize()
+	};
+	wavesUpdatePSO.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+	mPipelineCache->AddCompute("wavesUpdate", wavesUpdatePSO);
+
+	mPipelineCache->Build(mPSOs);
+	mPipelineCache->Save();
+
+	mOpaquePso = mPSOs.Get("opaque");
+	mLightCullPso = mPSOs.Get("lightCull");
+	mTreeCullPso = mPSOs.Get("treeCull");
+	mDrawCullPso = mPSOs.Get("drawCull");
+	mHiZCopyPso = mPSOs.Get("hiZCopy");
+	mHiZDownsamplePso = mPSOs.Get("hiZDownsample");
+	mWavesDisturbPso = mPSOs.Get("wavesDisturb");
+	mWavesUpdatePso = mPSOs.Get("wavesUpdate");
+	mOccluderDepthPso = mPSOs.Get("occluderDepth");
+	mOccluderDepthInstancedPso = mPSOs.Get("occluderDepthInstanced");
+
+	// The lit layers start with the general pixel shaders built above.
+	struct LitPso
+	{
+		std::string Pso;
+		std::string Program;
+		UINT Features;
+		const D3D12_GRAPHICS_PIPELINE_STATE_DESC& Desc;
+	};
+	const LitPso litPsos[] =
+	{
+		{ "opaque", "defaultPS", mTextureShaderFeatures, opaquePsoDesc },
+		{ "transparent", "defaultPS", mTextureShaderFeatures, transparentPsoDesc },
+		{ "gpuWaves", "defaultPS", mTextureShaderFeatures, gpuWavesPsoDesc },
+		{ "alphaTested", "defaultPS", ShaderPermutations::AlphaTest | mTextureShaderFeatures, alphaTestedPsoDesc },
+		{ "alphaTestedInstanced", "defaultPS", ShaderPermutations::AlphaTest | mTextureShaderFeatures, alphaTestedInstancedPsoDesc },
+		{ "treeSprites", "treeSpritePS", ShaderPermutations::AlphaTest | mTextureShaderFeatures, treeSpritePsoDesc },
+	};
+
+	mPsoVariants.clear();
+	for(auto& litPso : litPsos)
+	{
+		PsoVariant variant;
+		variant.Pso = litPso.Pso;
+		variant.Program = litPso.Program;
+		variant.Features = litPso.Features;
+		variant.Desc = litPso.Desc;
+		variant.Key = ShaderPermutations::MakeKey(litPso.Features);
+		variant.Current = mPSOs[litPso.Pso].Get();
+		mPsoVariants.push_back(variant);
+	}
 }
 
 void TreeBillboardsApp::BuildFrameResources()
 {
     for(int i = 0; i < gNumFrameResources; ++i)
     {
-        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(), *mUploadRing,
+            1, mObjectCapacity, (std::max)(mInstanceCapacity, 1u), mMaterials.Count(),
+			mLightManager->Capacity(), mWaves->VertexCount(), (UINT)mDrawJobs.size()));
     }
 }
 
+void TreeBillboardsApp::BuildProfiler()
+{
+	// A benchmark keeps every frame of its path.
+	UINT history = gProfilerHistory;
+	if(gBenchmark)
+		history = (std::max)(history, (UINT)(mBenchmarkPath.Duration() / gBenchmarkDeltaTime) + 1);
+
+	mProfiler = std::make_unique<FrameProfiler>(md3dDevice.Get(), mCommandQueue.Get(),
+		gNumFrameResources, gMaxGpuTimers, history);
+
+	// The draw jobs add a timer per job, named after their layer, in BuildDrawJobs.
+	mGpuFrameTimer = mProfiler->AddGpuTimer("frame");
+	mGpuLightCullTimer = mProfiler->AddGpuTimer("lightCull");
+	mGpuTreeCullTimer = mProfiler->AddGpuTimer("treeCull");
+	mGpuWavesTimer = mProfiler->AddGpuTimer("gpuWavesSim");
+	mGpuOccludersTimer = mProfiler->AddGpuTimer("occluders");
+	mGpuDrawCullTimer = mProfiler->AddGpuTimer("drawCull");
+
+	mCpuUpdateTimer = mProfiler->AddCpuTimer("Update");
+	mCpuObjectCBsTimer = mProfiler->AddCpuTimer("UpdateObjectCBs");
+	mCpuUpdateWavesTimer = mProfiler->AddCpuTimer("UpdateWaves");
+	mCpuWavesSolveTimer = mProfiler->AddCpuTimer("Waves::Update");
+	mCpuDrawTimer = mProfiler->AddCpuTimer("Draw");
+	mCpuRecordTimer = mProfiler->AddCpuTimer("RecordDrawJobs");
+	mCpuFrameIntervalTimer = mProfiler->AddCpuTimer("frameInterval");
+}
+
+void TreeBillboardsApp::BuildBenchmarkPath()
+{
+	// Up to the gate, through it and over the maze, past the pyramid, out over the back
+	// wall and around the outside to the start.
+	mBenchmarkPath.AddKey(0.0f, { 0.0f, 30.0f, -260.0f }, { 0.0f, 20.0f, 0.0f });
+	mBenchmarkPath.AddKey(6.0f, { 0.0f, 18.0f, -150.0f }, { 0.0f, 18.0f, -100.0f });
+	mBenchmarkPath.AddKey(10.0f, { 0.0f, 16.0f, -110.0f }, { 0.0f, 16.0f, -60.0f });
+	mBenchmarkPath.AddKey(16.0f, { 0.0f, 22.0f, -70.0f }, { 20.0f, 16.0f, -20.0f });
+	mBenchmarkPath.AddKey(22.0f, { 0.0f, 70.0f, 0.0f }, { 0.0f, 0.0f, 60.0f });
+	mBenchmarkPath.AddKey(28.0f, { 0.0f, 45.0f, 70.0f }, { 0.0f, 20.0f, 100.0f });
+	mBenchmarkPath.AddKey(34.0f, { 0.0f, 120.0f, 220.0f }, { 0.0f, 20.0f, 0.0f });
+	mBenchmarkPath.AddKey(42.0f, { -220.0f, 90.0f, 0.0f }, { 0.0f, 20.0f, 0.0f });
+	mBenchmarkPath.AddKey(50.0f, { 0.0f, 60.0f, -260.0f }, { 0.0f, 20.0f, 0.0f });
+}
+
+void TreeBillboardsApp::BuildDrawJobs()
+{
+	// Layers in the order they are drawn, with the PSO they are drawn with and the
+	// name of their profiler timer.
+	struct LayerPass
+	{
+		RenderLayer Layer;
+		std::string PSO;
+		std::string TimerName;
+	};
+	const LayerPass layers[] =
+	{
+		{ RenderLayer::Opaque, "opaque", "opaque" },
+		{ RenderLayer::Terrain, "opaque", "terrain" },
+		{ RenderLayer::AlphaTested, "alphaTested", "alphaTested" },
+		{ RenderLayer::AlphaTestedInstanced, "alphaTestedInstanced", "alphaTestedInstanced" },
+		{ RenderLayer::AlphaTestedTreeSprites, "treeSprites", "treeSprites" },
+		{ RenderLayer::GpuWaves, "gpuWaves", "gpuWaves" },
+		{ RenderLayer::Transparent, "transparent", "transparent" },
+	};
+
+	mDrawJobs.clear();
+	for(auto& layer : layers)
+	{
+		// Room is left for the scene items still to be streamed in, as the jobs and
+		// their command lists are only created here.
+		const size_t layerSize = mRitemLayer[(int)layer.Layer].size() + mSceneUnloadedItems[(int)layer.Layer];
+		for(size_t first = 0; first < layerSize; first += gDrawJobChunkSize)
+		{
+			DrawJob job;
+			job.Layer = layer.Layer;
+			job.PSO = mPSOs[layer.PSO].Get();
+			job.FirstItem = first;
+			job.ItemCount = (std::min)((size_t)gDrawJobChunkSize, layerSize - first);
+			job.GpuTimer = mProfiler->AddGpuTimer(layer.TimerName);
+			mDrawJobs.push_back(job);
+		}
+	}
+}
+
+void TreeBillboardsApp::BuildWorkerCommandLists()
+{
+	// Command lists are created open, so close them until their first Reset in Draw.
+	mWorkerCmdLists.resize(mDrawJobs.size());
+	for(size_t i = 0; i < mDrawJobs.size(); ++i)
+	{
+		ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+			mFrameResources[0]->WorkerCmdListAllocs[i].Get(), nullptr,
+			IID_PPV_ARGS(mWorkerCmdLists[i].GetAddressOf())));
+		ThrowIfFailed(mWorkerCmdLists[i]->Close());
+	}
+
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+		mFrameResources[0]->PostCmdListAlloc.Get(), nullptr,
+		IID_PPV_ARGS(mPostCmdList.GetAddressOf())));
+	ThrowIfFailed(mPostCmdList->Close());
+}
+
 void TreeBillboardsApp::BuildMaterials()
 {
-	auto grass = std::make_unique<Material>();
-	grass->Name = "grass";
-	grass->MatCBIndex = 0;
-	grass->DiffuseSrvHeapIndex = 0;
-	grass->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	grass->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	grass->Roughness = 0.125f;
-
-	// This is not a good water material definition, but we do not have all the rendering
-	// tools we need (transparency, environment reflection), so we fake it for now.
-	auto water = std::make_unique<Material>();
-	water->Name = "water";
-	water->MatCBIndex = 1;
-	water->DiffuseSrvHeapIndex = 1;
-	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
-	water->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
-	water->Roughness = 0.0f;
-
-	auto brick = std::make_unique<Material>();
-	brick->Name = "brick";
-	brick->MatCBIndex = 2;
-	brick->DiffuseSrvHeapIndex = 2;
-	brick->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	brick->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	brick->Roughness = 0.25f;
-
-	auto marble = std::make_unique<Material>();
-	marble->Name = "marble";
-	marble->MatCBIndex = 3;
-	marble->DiffuseSrvHeapIndex = 3;
-	marble->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	marble->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	marble->Roughness = 0.25f;
-
-	auto wood = std::make_unique<Material>();
-	wood->Name = "wood";
-	wood->MatCBIndex = 4;
-	wood->DiffuseSrvHeapIndex = 4;
-	wood->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	wood->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	wood->Roughness = 0.25f;
-
-	auto crystal = std::make_unique<Material>();
-	crystal->Name = "crystal";
-	crystal->MatCBIndex = 5;
-	crystal->DiffuseSrvHeapIndex = 5;
-	crystal->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	crystal->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	crystal->Roughness = 0.25f;
-
-	auto treeSprites = std::make_unique<Material>();
-	treeSprites->Name = "treeSprites";
-	treeSprites->MatCBIndex = 6;
-	treeSprites->DiffuseSrvHeapIndex = 6;
-	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprites->Roughness = 0.125f;
+	// The constant buffer index of each material is its place in the scene file.
+	const SceneFile::Header& header = mScene.GetHeader();
+	mSceneMaterials.resize(header.MaterialCount);
+	for(UINT i = 0; i < header.MaterialCount; ++i)
+	{
+		const SceneFile::Material& record = mScene.Materials()[i];
+
+		auto material = std::make_unique<Material>();
+		material->Name = mScene.Name(record.Name);
+		material->MatCBIndex = i;
+		material->DiffuseSrvHeapIndex = mTextureSrvBase + record.DiffuseSrvHeapIndex;
+		material->DiffuseAlbedo = record.DiffuseAlbedo;
+		material->FresnelR0 = record.FresnelR0;
+		material->Roughness = record.Roughness;
+
+		mSceneMaterials[i] = material.get();
+		assert(mMaterials.Count() == i);
+		mMaterials.Add(material->Name, std::move(material));
+	}
 
-	
+	mWaterMaterial = mMaterials.Get("water");
+}
 
-	mMaterials["grass"] = std::move(grass);
-	mMaterials["water"] = std::move(water);
-	mMaterials["brick"] = std::move(brick);
-	mMaterials["marble"] = std::move(marble);
-	mMaterials["wood"] = std::move(wood);
-	mMaterials["crystal"] = std::move(crystal);
-	mMaterials["treeSprites"] = std::move(treeSprites);
-	
+void TreeBillboardsApp::BuildLights()
+{
+	mLightManager = std::make_unique<LightManager>(gNumFrameResources, gMaxSceneLights);
+	mLightCuller = std::make_unique<LightCuller>(md3dDevice.Get());
+
+	mMainPassCB.AmbientLight = { 1.25f, 0.5f, 0.35f, 1.0f };
+
+	mLightManager->AddDirectionalLight({ 0.57735f, -0.57735f, 2.57735f }, { 0.3f, 0.3f, 0.3f });
+	mLightManager->AddDirectionalLight({ -0.57735f, -0.57735f, 0.57735f }, { 0.3f, 0.3f, 0.3f });
+	mLightManager->AddDirectionalLight({ -0.707f, -0.707f, -5.707f }, { 0.15f, 0.15f, 0.15f });
+
+	// Point Lights
+	mLightManager->AddPointLight({ 0.0f, 30.0f, 10.0f }, { 0.0f, 1.0f, 0.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ -30.0f, 100.0f, -35.0f }, { 0.0f, 1.0f, 0.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ 30.0f, 100.0f, -35.0f }, { 0.0f, 1.0f, 0.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ -30.0f, 100.0f, 35.0f }, { 0.0f, 1.0f, 0.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ 30.0f, 100.0f, 35.0f }, { 0.0f, 1.0f, 0.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ -10.0f, 40.0f, -42.0f }, { 0.0f, 0.0f, 1.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ 0.0f, 15.0f, 100.0f }, { 0.0f, 0.0f, 1.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ -20.0f, 40.0f, -10.0f }, { 0.0f, 0.0f, 1.0f }, 5.0f, 50.0f);
+	mLightManager->AddPointLight({ 20.0f, 40.0f, -10.0f }, { 0.0f, 0.0f, 1.0f }, 5.0f, 50.0f);
+
+	// Scaled scenes scatter extra lights inside the castle walls.
+	const UINT basePointLights = mLightManager->LightCount(LightType::Point);
+	for(UINT i = basePointLights; i < basePointLights * gSceneScale; ++i)
+	{
+		XMFLOAT3 position(MathHelper::RandF(-90.0f, 90.0f), MathHelper::RandF(10.0f, 60.0f), MathHelper::RandF(-120.0f, 120.0f));
+		XMFLOAT3 strength(MathHelper::RandF(), MathHelper::RandF(), MathHelper::RandF());
+		mLightManager->AddPointLight(position, strength, 5.0f, 50.0f);
+	}
 }
 
 void TreeBillboardsApp::BuildRenderItems()
 {
-	// Create a single ObjCBIndex int to count each object being drawn
-	int funcCBIndex = 0;
-
-	auto wavesRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wavesRitem->World, XMMatrixScaling(6.0f, 1.0f, 6.0f));
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(30.0f, 30.0f, 1.0f));
-	wavesRitem->ObjCBIndex = funcCBIndex++;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mWavesRitem = wavesRitem.get();
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
-
-	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	gridRitem->ObjCBIndex = funcCBIndex++;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-
-	auto boxRitem = std::make_unique<RenderItem>();
-	
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixTranslation(3.0f, 30.0f, -9.0f));
-	//boxRitem->ObjCBIndex = funcCBIndex++;
-	boxRitem->Mat = mMaterials["brick"].get();
-	boxRitem->Geo = mGeometries["boxGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-
-	//mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());
-
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = funcCBIndex++;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
-
-
-
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
-
-	mAllRitems.push_back(std::move(wavesRitem));
-	mAllRitems.push_back(std::move(gridRitem));
-	//mAllRitems.push_back(std::move(boxRitem));
-	mAllRitems.push_back(std::move(treeSpritesRitem));
-
-	// Build the base of the castle
-	auto baseRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&baseRitem->TexTransform, (XMMatrixScaling(11.0f, 11.0f, 11.0f)));
-	XMStoreFloat4x4(&baseRitem->World, (XMMatrixScaling(220.0f, 8.0f, 280.0f) * XMMatrixTranslation(0.0f, 6.0f, 0.0f)));
-	baseRitem->ObjCBIndex = funcCBIndex++;
-	baseRitem->Mat = mMaterials["brick"].get();
-	baseRitem->Geo = mGeometries["wallGeo"].get();
-	baseRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	baseRitem->IndexCount = baseRitem->Geo->DrawArgs["wall"].IndexCount;
-	baseRitem->StartIndexLocation = baseRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-	baseRitem->BaseVertexLocation = baseRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(baseRitem.get());	mAllRitems.push_back(std::move(baseRitem));
-
-	// Build the drawbridge
-	auto bridgeRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&bridgeRitem->World, (XMMatrixScaling(30.0f, 6.0f, 45.0f) * XMMatrixTranslation(0.0f, 9.0f, -137.5f)));
-	bridgeRitem->ObjCBIndex = funcCBIndex++;
-	bridgeRitem->Mat = mMaterials["wood"].get();
-	bridgeRitem->Geo = mGeometries["wallGeo"].get();
-	bridgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	bridgeRitem->IndexCount = bridgeRitem->Geo->DrawArgs["wall"].IndexCount;
-	bridgeRitem->StartIndexLocation = bridgeRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-	bridgeRitem->BaseVertexLocation = bridgeRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(bridgeRitem.get());	mAllRitems.push_back(std::move(bridgeRitem));
-
-	// Build the pyramid inside the castle
-	auto pyramidRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&pyramidRitem->World, (XMMatrixScaling(20.0f, 12.0f, 20.0f) * XMMatrixTranslation(0.0f, 16.0f, 100.0f)));
-	pyramidRitem->ObjCBIndex = funcCBIndex++;
-	pyramidRitem->Mat = mMaterials["crystal"].get();
-	pyramidRitem->Geo = mGeometries["pyramidGeo"].get();
-	pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-	pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(pyramidRitem.get());	mAllRitems.push_back(std::move(pyramidRitem));
+	mTransforms = std::make_unique<TransformStore>(gNumFrameResources);
+	mRitems.clear();
+	mRitems.reserve(mScene.GetHeader().ItemCount + mTerrain->ChunkCount() + 3);
+
+	mWavesRitem = AddRenderItem(mMaterials["water"].get(), XMMatrixScaling(6.0f, 1.0f, 6.0f), XMMatrixScaling(30.0f, 30.0f, 1.0f));
+	RenderItem& wavesRitem = mRitems[mWavesRitem];
+	wavesRitem.Geo = mGeometries["waterGeo"].get();
+	wavesRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	wavesRitem.IndexCount = wavesRitem.Geo->DrawArgs["grid"].IndexCount;
+	wavesRitem.StartIndexLocation = wavesRitem.Geo->DrawArgs["grid"].StartIndexLocation;
+	wavesRitem.BaseVertexLocation = wavesRitem.Geo->DrawArgs["grid"].BaseVertexLocation;
+	wavesRitem.Bounds = wavesRitem.Geo->DrawArgs["grid"].Bounds;
+
+	mRitemLayer[(int)RenderLayer::Transparent].push_back(mWavesRitem);
+
+	mGpuWavesRitem = AddRenderItem(mMaterials["water"].get(), XMMatrixScaling(6.0f, 1.0f, 6.0f), XMMatrixScaling(30.0f, 30.0f, 1.0f));
+	mTransforms->SetDisplacementMap(mGpuWavesRitem,
+		XMFLOAT2(1.0f / mGpuWaves->ColumnCount(), 1.0f / mGpuWaves->RowCount()), mGpuWaves->SpatialStep());
+	RenderItem& gpuWavesRitem = mRitems[mGpuWavesRitem];
+	gpuWavesRitem.Geo = mGeometries["gpuWaterGeo"].get();
+	gpuWavesRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	gpuWavesRitem.IndexCount = gpuWavesRitem.Geo->DrawArgs["grid"].IndexCount;
+	gpuWavesRitem.StartIndexLocation = gpuWavesRitem.Geo->DrawArgs["grid"].StartIndexLocation;
+	gpuWavesRitem.BaseVertexLocation = gpuWavesRitem.Geo->DrawArgs["grid"].BaseVertexLocation;
+	gpuWavesRitem.Bounds = gpuWavesRitem.Geo->DrawArgs["grid"].Bounds;
+
+	mRitemLayer[(int)RenderLayer::GpuWaves].push_back(mGpuWavesRitem);
+
+	// Each terrain chunk starts at its finest LOD; UpdateTerrainLods picks the rest.
+	mTerrainRitems.clear();
+	mTerrainDrawArgs = mGeometries["landGeo"]->DrawArgs["terrain"];
+	for(UINT chunk = 0; chunk < mTerrain->ChunkCount(); ++chunk)
+	{
+		UINT handle = AddRenderItem(mMaterials["grass"].get(), XMMatrixIdentity(), XMMatrixScaling(5.0f, 5.0f, 1.0f));
+		RenderItem& chunkRitem = mRitems[handle];
+		chunkRitem.Geo = mGeometries["landGeo"].get();
+		chunkRitem.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+		SubmeshGeometry args = mTerrain->ChunkDrawArgs(chunk, mTerrainDrawArgs);
+		chunkRitem.IndexCount = args.IndexCount;
+		chunkRitem.StartIndexLocation = args.StartIndexLocation;
+		chunkRitem.BaseVertexLocation = args.BaseVertexLocation;
+		chunkRitem.Bounds = args.Bounds;
+
+		mTerrainRitems.push_back(handle);
+		mRitemLayer[(int)RenderLayer::Terrain].push_back(handle);
+	}
+
+	mForestRitem = AddRenderItem(mMaterials["treeSprites"].get(), XMMatrixIdentity(), XMMatrixIdentity());
+	RenderItem& treeSpritesRitem = mRitems[mForestRitem];
+	treeSpritesRitem.Geo = nullptr;
+	treeSpritesRitem.Bounds = mForest->Bounds();
+
+	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(mForestRitem);
+
+	// The castle and the maze come from the scene.  The benchmark loads all of it up
+	// front, so streaming does not change what its frames draw.
+	mObjectCapacity = (UINT)mRitems.size() + mScene.GetHeader().ItemCount;
 
-	// This loop draws 3 of the 4 main castle walls, specifically the ones without the gate
-	for (int i = 0; i < 3; i++)
+	mInstanceCount = 0;
+	for(auto& e : mRitems)
 	{
-		auto wallRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&wallRitem->TexTransform, (XMMatrixScaling(10.0f, 2.0f, 1.0f)));
-		XMStoreFloat4x4(&wallRitem->World, (XMMatrixScaling(12.0f + (168.0f * (i % 2)), 40.0f, 12.0f + (228.0f * (1.0f - (i % 2)))) * XMMatrixTranslation(-90.0f + (i * 90.0f), 30.0f, 120.0f - 120.0f * (1 - (i % 2)))));
-		//XMStoreFloat4x4(&wallRitem->TexTransform, (XMMatrixScaling(x, y, z)));
-		wallRitem->ObjCBIndex = funcCBIndex++;
-		wallRitem->Mat = mMaterials["brick"].get();
-		wallRitem->Geo = mGeometries["wallGeo"].get();
-		wallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		wallRitem->IndexCount = wallRitem->Geo->DrawArgs["wall"].IndexCount;
-		wallRitem->StartIndexLocation = wallRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		wallRitem->BaseVertexLocation = wallRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(wallRitem.get());
-		mAllRitems.push_back(std::move(wallRitem));
+		e.InstanceBufferOffset = mInstanceCount;
+		mInstanceCount += (UINT)e.Instances.size();
 	}
 
-	// This loop draws the walls surrounding the castle's gate
-	for (int i = 0; i < 3; i++)
+	mInstanceCapacity = mInstanceCount;
+	for(UINT i = 0; i < mScene.GetHeader().ItemCount; ++i)
 	{
-		auto gateRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&gateRitem->TexTransform, (XMMatrixScaling(6.0f, 2.0f, 1.0f)));
-		XMStoreFloat4x4(&gateRitem->World, (XMMatrixScaling(80.0f - (50.0f * (i % 2)), 40.0f - 25.0f * (1.0f * (i % 2)), 10.0f) * XMMatrixTranslation(-55.0f + (55.0f * i), 30.0f + 12.5f * (i % 2), -120.0f)));
-		gateRitem->ObjCBIndex = funcCBIndex++;
-		gateRitem->Mat = mMaterials["brick"].get();
-		gateRitem->Geo = mGeometries["wallGeo"].get();
-		gateRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		gateRitem->IndexCount = gateRitem->Geo->DrawArgs["wall"].IndexCount;
-		gateRitem->StartIndexLocation = gateRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		gateRitem->BaseVertexLocation = gateRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(gateRitem.get());
-		mAllRitems.push_back(std::move(gateRitem));
+		const SceneFile::Item& item = mScene.Items()[i];
+		if((item.Flags & SceneFile::ItemInstanced) != 0)
+			mInstanceCapacity += item.TransformCount * gSceneScale;
 	}
 
-	// Build castle merlons
-	for (int i = 0; i < 5; i++)
-	{
-		// Left side
-		auto leftRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&leftRitem->TexTransform, (XMMatrixScaling(0.5f, 0.25f, 1.0f)));
-		XMStoreFloat4x4(&leftRitem->World, (XMMatrixScaling(12.0f, 5.0f, 15.0f) * XMMatrixTranslation(-90.0f, 52.5f, 80.0f - 40.0f * i)));
-		leftRitem->ObjCBIndex = funcCBIndex++;
-		leftRitem->Mat = mMaterials["brick"].get();
-		leftRitem->Geo = mGeometries["wallGeo"].get();
-		leftRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftRitem->IndexCount = leftRitem->Geo->DrawArgs["wall"].IndexCount;
-		leftRitem->StartIndexLocation = leftRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		leftRitem->BaseVertexLocation = leftRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(leftRitem.get());
-		mAllRitems.push_back(std::move(leftRitem));
-
-		// Right side
-		auto rightRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&rightRitem->TexTransform, (XMMatrixScaling(0.5f, 0.25f, 1.0f)));
-		XMStoreFloat4x4(&rightRitem->World, (XMMatrixScaling(12.0f, 5.0f, 15.0f) * XMMatrixTranslation(90.0f, 52.5f, 80.0f - 40.0f * i)));
-		rightRitem->ObjCBIndex = funcCBIndex++;
-		rightRitem->Mat = mMaterials["brick"].get();
-		rightRitem->Geo = mGeometries["wallGeo"].get();
-		rightRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightRitem->IndexCount = rightRitem->Geo->DrawArgs["wall"].IndexCount;
-		rightRitem->StartIndexLocation = rightRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		rightRitem->BaseVertexLocation = rightRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(rightRitem.get());
-		mAllRitems.push_back(std::move(rightRitem));
-
-		// Front
-		auto frontRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&frontRitem->TexTransform, (XMMatrixScaling(0.5f, 0.25f, 1.0f)));
-		XMStoreFloat4x4(&frontRitem->World, (XMMatrixScaling(15.0f, 5.0f, 10.0f) * XMMatrixTranslation(-60.0f + 30.0f * i, 52.5f, -120.0f)));
-		frontRitem->ObjCBIndex = funcCBIndex++;
-		frontRitem->Mat = mMaterials["brick"].get();
-		frontRitem->Geo = mGeometries["wallGeo"].get();
-		frontRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		frontRitem->IndexCount = frontRitem->Geo->DrawArgs["wall"].IndexCount;
-		frontRitem->StartIndexLocation = frontRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		frontRitem->BaseVertexLocation = frontRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(frontRitem.get());
-		mAllRitems.push_back(std::move(frontRitem));
-
-		// Back
-		auto backRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&backRitem->TexTransform, (XMMatrixScaling(0.5f, 0.25f, 1.0f)));
-		XMStoreFloat4x4(&backRitem->World, (XMMatrixScaling(15.0f, 5.0f, 12.0f) * XMMatrixTranslation(-60.0f + 30.0f * i, 52.5f, 120.0f)));
-		backRitem->ObjCBIndex = funcCBIndex++;
-		backRitem->Mat = mMaterials["brick"].get();
-		backRitem->Geo = mGeometries["wallGeo"].get();
-		backRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		backRitem->IndexCount = backRitem->Geo->DrawArgs["wall"].IndexCount;
-		backRitem->StartIndexLocation = backRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-		backRitem->BaseVertexLocation = backRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(backRitem.get());
-		mAllRitems.push_back(std::move(backRitem));
+	mSceneFirstRitem = (UINT)mRitems.size();
+	LoadSceneRegions(mCamera.GetPosition3f(), gBenchmark ? FLT_MAX : gSceneStreamDistance, UINT_MAX);
+}
 
-	}
+UINT TreeBillboardsApp::AddRenderItem(Material* mat, FXMMATRIX world, CXMMATRIX texTransform)
+{
+	assert(mRitems.size() == mTransforms->Count());
 
-	// Build the corners of the castle walls
-	for (int i = 0; i < 4; i++)
-	{
-		auto cornerRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&cornerRitem->World, (XMMatrixScaling(10.0f, 70.0f, 10.0f) * XMMatrixTranslation(-90.0f + 180.0f * (i % 2), 30.0f, 120.0f - 240.0f * (i / 2))));
-		cornerRitem->ObjCBIndex = funcCBIndex++;
-		cornerRitem->Mat = mMaterials["marble"].get();
-		cornerRitem->Geo = mGeometries["cornerGeo"].get();
-		cornerRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		cornerRitem->IndexCount = cornerRitem->Geo->DrawArgs["corner"].IndexCount;
-		cornerRitem->StartIndexLocation = cornerRitem->Geo->DrawArgs["corner"].StartIndexLocation;
-		cornerRitem->BaseVertexLocation = cornerRitem->Geo->DrawArgs["corner"].BaseVertexLocation;
+	// The shaders find the item's material through its object data.
+	mRitems.emplace_back();
+	mRitems.back().Mat = mat;
+	return mTransforms->Add(world, texTransform, mat->MatCBIndex);
+}
 
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(cornerRitem.get());
-		mAllRitems.push_back(std::move(cornerRitem));
+// Render layers by the names scene files use for them.  Terrain, trees and waves are
+// built in code, so their layers are not among them.
+static int SceneLayerFromName(const std::string& name)
+{
+	static const std::pair<const char*, RenderLayer> layers[] =
+	{
+		{ "opaque", RenderLayer::Opaque },
+		{ "transparent", RenderLayer::Transparent },
+		{ "alphaTested", RenderLayer::AlphaTested },
+		{ "alphaTestedInstanced", RenderLayer::AlphaTestedInstanced },
+	};
+
+	for(auto& layer : layers)
+	{
+		if(name == layer.first)
+			return (int)layer.second;
 	}
+	return -1;
+}
 
-	// Build the tips of the wall's towers
-	for (int i = 0; i < 4; i++)
-	{
-		auto tipRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&tipRitem->World, (XMMatrixScaling(9.0f, 20.0f, 9.0f) * XMMatrixTranslation(-90.0f + 180.0f * (i % 2), 75.0f, 120.0f - 240.0f * (i / 2))));
-		tipRitem->ObjCBIndex = funcCBIndex++;
-		tipRitem->Mat = mMaterials["marble"].get();
-		tipRitem->Geo = mGeometries["coneGeo"].get();
-		tipRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		tipRitem->IndexCount = tipRitem->Geo->DrawArgs["cone"].IndexCount;
-		tipRitem->StartIndexLocation = tipRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-		tipRitem->BaseVertexLocation = tipRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(tipRitem.get());
-		mAllRitems.push_back(std::move(tipRitem));
+void TreeBillboardsApp::LoadScene()
+{
+	SceneCompiler::CompileIfStale(gSceneSourcePath, gScenePath);
+
+	mScene.Open(gScenePath);
+
+	// Resolve the names once, and check every material and item before any region is
+	// loaded.
+	const SceneFile::Header& header = mScene.GetHeader();
+	for(UINT i = 0; i < header.MaterialCount; ++i)
+	{
+		// The slot indexes the textures' SRV range, so it must name a texture.
+		const INT32 slot = mScene.Materials()[i].DiffuseSrvHeapIndex;
+		if(slot < 0 || (UINT)slot >= mTextures.Count())
+		{
+			std::string message = "Scene material " + std::to_string(i) + " has an unknown texture slot.\n";
+			OutputDebugStringA(message.c_str());
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+		}
 	}
 
-	// Build the diamonds above the tips of the wall's towers
-	for (int i = 0; i < 4; i++)
-	{
-		auto diamondRitem = std::make_unique<RenderItem>();
-		XMStoreFloat4x4(&diamondRitem->World, (XMMatrixScaling(5.0f, 8.0f, 5.0f) * XMMatrixTranslation(-90.0f + 180.0f * (i % 2), 100.0f, 120.0f - 240.0f * (i / 2))));
-		diamondRitem->ObjCBIndex = funcCBIndex++;
-		diamondRitem->Mat = mMaterials["crystal"].get();
-		diamondRitem->Geo = mGeometries["diamondGeo"].get();
-		diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-		diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-		diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-
-		mRitemLayer[(int)RenderLayer::AlphaTested].push_back(diamondRitem.get());
-		mAllRitems.push_back(std::move(diamondRitem));
+	mSceneLayers.assign(header.NameCount, -1);
+	mSceneGeometries.assign(header.NameCount, nullptr);
+	for(UINT name = 0; name < header.NameCount; ++name)
+	{
+		mSceneLayers[name] = SceneLayerFromName(mScene.Name(name));
+
+		auto geo = mGeometries.Find(mScene.Name(name));
+		if(geo.IsValid())
+			mSceneGeometries[name] = mGeometries[geo].get();
 	}
 
-	// Build the diamond above the pyramid
-	auto diamondRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&diamondRitem->World, (XMMatrixScaling(7.5f, 12.0f, 7.5f) * XMMatrixTranslation(0.0f, 30.0f, 100.0f)));
-	diamondRitem->ObjCBIndex = funcCBIndex++;
-	diamondRitem->Mat = mMaterials["crystal"].get();
-	diamondRitem->Geo = mGeometries["diamondGeo"].get();
-	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(diamondRitem.get());
-	mAllRitems.push_back(std::move(diamondRitem));
-
-
-	// Build the maze, wall by wall
-	// Outer walls
-	BuildMazePart(54.0f, 1.5f, 40.0f, -90.0f, funcCBIndex++);
-	BuildMazePart(54.0f, 1.5f, -40.0f, -90.0f, funcCBIndex++);
-	BuildMazePart(54.0f, 1.5f, 40.0f, 90.0f, funcCBIndex++);
-	BuildMazePart(54.0f, 1.5f, -40.0f, 90.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 180.0f, 67.0f, 0.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 180.0f, -67.0f, 0.0f, funcCBIndex++);
-	
-	BuildMazePart(20.0f, 1.5f, 21.0f, -80.0f, funcCBIndex++);
-	BuildMazePart(22.0f, 1.5f, 56.0f, -80.0f, funcCBIndex++);
-	BuildMazePart(42.0f, 1.5f, -34.0f, -80.0f, funcCBIndex++);
-	
-	BuildMazePart(1.5f, 31.5f, 45.0f, -65.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 41.5f, 31.0f, -60.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 31.5f, -13.0f, -65.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 31.5f, -55.0f, -65.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 26.5f, -16.0f, -103.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 26.5f, 16.0f, -103.0f, funcCBIndex++);
-	
-	BuildMazePart(30.0f, 1.5f, -40.0f, -60.0f, funcCBIndex++);
-	BuildMazePart(10.0f, 1.5f, 50.0f, -65.0f, funcCBIndex++);
-	BuildMazePart(42.5f, 1.5f, -46.0f, -30.0f, funcCBIndex++);
-	BuildMazePart(67.5f, 1.5f, 20.0f, -30.0f, funcCBIndex++);
-	
-	BuildMazePart(1.5f, 31.5f, -25.0f, -45.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 35.5f, 12.0f, -48.0f, funcCBIndex++);
-	BuildMazePart(20.0f, 1.5f, 21.5f, -55.0f, funcCBIndex++);
-	
-	BuildMazePart(42.5f, 1.5f, -46.0f, 0.0f, funcCBIndex++);
-	BuildMazePart(42.5f, 1.5f, -34.0f, -15.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 31.5f, -13.0f, -15.0f, funcCBIndex++);
-	
-	BuildMazePart(1.5f, 41.5f, 31.0f, 5.0f, funcCBIndex++);
-	BuildMazePart(24.0f, 1.5f, 55.0f, -15.0f, funcCBIndex++); 
-	BuildMazePart(24.0f, 1.5f, 43.0f, 0.0f, funcCBIndex++);
-	BuildMazePart(24.0f, 1.5f, 19.0f, -15.0f, funcCBIndex++);
-	BuildMazePart(36.0f, 1.5f, 49.0f, 25.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 15.0f, 49.0f, 7.5f, funcCBIndex++);
-	
-	BuildMazePart(32.5f, 1.5f, 2.5f, 0.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 30.0f, 0.0f, 15.0f, funcCBIndex++);
-	
-	BuildMazePart(32.5f, 1.5f, -41.0f, 80.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 20.0f, -41.0f, 70.0f, funcCBIndex++);
-	BuildMazePart(13.5f, 1.5f, -47.0f, 60.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -53.0f, 66.0f, funcCBIndex++);
-	
-	BuildMazePart(13.5f, 1.5f, -27.0f, 57.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -33.0f, 63.0f, funcCBIndex++);
-	BuildMazePart(13.5f, 1.5f, -27.0f, 69.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -21.0f, 63.0f, funcCBIndex++);
-	
-	BuildMazePart(32.5f, 1.5f, -41.0f, 35.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 20.0f, -41.0f, 25.0f, funcCBIndex++);
-	BuildMazePart(13.5f, 1.5f, -47.0f, 15.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -53.0f, 21.0f, funcCBIndex++);
-	
-	BuildMazePart(17.5f, 1.5f, -20.0f, 9.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -28.0f, 15.0f, funcCBIndex++);
-	BuildMazePart(17.5f, 1.5f, -20.0f, 21.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 11.5f, -12.0f, 15.0f, funcCBIndex++);
-	
-	BuildMazePart(35.0f, 1.5f, -49.0f, 47.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 61.5f, -13.0f, 60.0f, funcCBIndex++);
-	BuildMazePart(13.5f, 1.5f, -6.0f, 30.0f, funcCBIndex++);
-	
-	BuildMazePart(1.5f, 31.5f, 13.0f, 75.0f, funcCBIndex++);
-	BuildMazePart(36.5f, 1.5f, 6.0f, 45.0f, funcCBIndex++);
-	BuildMazePart(16.5f, 1.5f, 23.0f, 25.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 21.5f, 24.0f, 55.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 15.0f, 24.0f, 82.5f, funcCBIndex++);
-	BuildMazePart(27.5f, 1.5f, 37.0f, 65.0f, funcCBIndex++);
-	BuildMazePart(1.5f, 15.0f, 39.0f, 72.5f, funcCBIndex++);
-	BuildMazePart(1.5f, 25.0f, 42.0f, 37.5f, funcCBIndex++);
-	BuildMazePart(12.5f, 1.5f, 48.0f, 40.0f, funcCBIndex++);
+	for(UINT i = 0; i < header.ItemCount; ++i)
+	{
+		const SceneFile::Item& item = mScene.Items()[i];
+		MeshGeometry* geo = mSceneGeometries[item.Geometry];
+		if(mSceneLayers[item.Layer] < 0 || geo == nullptr || geo->DrawArgs.count(mScene.Name(item.Submesh)) == 0)
+		{
+			std::string message = "Scene item " + std::to_string(i) + " has an unknown layer, geometry or submesh.\n";
+			OutputDebugStringA(message.c_str());
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+		}
 
-	
+		mSceneUnloadedItems[mSceneLayers[item.Layer]]++;
+	}
+
+	mSceneRegionLoaded.assign(header.RegionCount, false);
+}
+
+UINT TreeBillboardsApp::LoadSceneRegions(const XMFLOAT3& eyePosW, float maxDistance, UINT maxRegions)
+{
+	XMVECTOR eye = XMLoadFloat3(&eyePosW);
+
+	UINT loadedCount = 0;
+	while(loadedCount < maxRegions)
+	{
+		// The nearest region within maxDistance that is not loaded yet, by the distance
+		// from the eye to the nearest point of its bounds.
+		UINT nearest = UINT_MAX;
+		float nearestDistance = maxDistance;
+		for(UINT region = 0; region < (UINT)mSceneRegionLoaded.size(); ++region)
+		{
+			if(mSceneRegionLoaded[region])
+				continue;
+
+			const SceneFile::Region& record = mScene.Regions()[region];
+			XMVECTOR offset = XMVectorMax(XMVectorAbs(eye - XMLoadFloat3(&record.Center)) - XMLoadFloat3(&record.Extents), XMVectorZero());
+			float distance = XMVectorGetX(XMVector3Length(offset));
+			if(distance <= nearestDistance)
+			{
+				nearest = region;
+				nearestDistance = distance;
+			}
+		}
+
+		if(nearest == UINT_MAX)
+			break;
+
+		LoadSceneRegion(nearest);
+		++loadedCount;
+	}
+
+	return loadedCount;
+}
+
+void TreeBillboardsApp::LoadSceneRegion(UINT region)
+{
+	const SceneFile::Region& record = mScene.Regions()[region];
+
+	for(UINT i = 0; i < record.ItemCount; ++i)
+	{
+		const UINT itemIndex = record.FirstItem + i;
+		const SceneFile::Item& item = mScene.Items()[itemIndex];
+		const SceneFile::Transform* transforms = mScene.Transforms() + item.FirstTransform;
+		const int layer = mSceneLayers[item.Layer];
+
+		// Instanced items draw with their instances' transforms only.
+		const bool instanced = (item.Flags & SceneFile::ItemInstanced) != 0;
+		Material* mat = mSceneMaterials[item.Material];
+		const UINT handle = instanced ?
+			AddRenderItem(mat, XMMatrixIdentity(), XMMatrixIdentity()) :
+			AddRenderItem(mat, SceneFile::World(transforms[0]), SceneFile::TexTransform(transforms[0]));
+
+		RenderItem& ri = mRitems[handle];
+		ri.Geo = mSceneGeometries[item.Geometry];
+		ri.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ri.Occluder = (item.Flags & SceneFile::ItemOccluder) != 0;
+
+		const SubmeshGeometry& submesh = ri.Geo->DrawArgs[mScene.Name(item.Submesh)];
+		ri.IndexCount = submesh.IndexCount;
+		ri.StartIndexLocation = submesh.StartIndexLocation;
+		ri.BaseVertexLocation = submesh.BaseVertexLocation;
+		ri.Bounds = submesh.Bounds;
+
+		if(instanced)
+		{
+			// Scaled scenes stack copies of the instances on top of them.
+			ri.Instances.resize(item.TransformCount * gSceneScale);
+			for(UINT copy = 0; copy < gSceneScale; ++copy)
+			{
+				for(UINT t = 0; t < item.TransformCount; ++t)
+				{
+					InstanceData& instance = ri.Instances[copy * item.TransformCount + t];
+					XMStoreFloat4x4(&instance.World, SceneFile::World(transforms[t]));
+					XMStoreFloat4x4(&instance.TexTransform, SceneFile::TexTransform(transforms[t]));
+					instance.World._42 += 30.0f * copy;
+				}
+			}
+
+			ri.InstanceCount = (UINT)ri.Instances.size();
+			ri.InstanceBufferOffset = mInstanceCount;
+			mInstanceCount += ri.InstanceCount;
+		}
+
+		mRitemLayer[layer].push_back(handle);
+		mSceneUnloadedItems[layer]--;
+	}
+
+	mSceneRegionLoaded[region] = true;
+}
 
+// Sort key layout, most significant first: layer (8 bits), depth (24 bits),
+// geometry (16 bits), material (16 bits).  Layers built once leave the depth at
+// zero so they sort purely by state; SortTransparentItems fills it in per frame.
+static UINT64 MakeSortKey(RenderLayer layer, UINT depth, UINT geoId, UINT matId)
+{
+	return ((UINT64)layer << 56) | ((UINT64)(depth & 0xffffff) << 32) |
+		((UINT64)(geoId & 0xffff) << 16) | (UINT64)(matId & 0xffff);
 }
 
-void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void TreeBillboardsApp::BuildSortKeys()
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	// Pooled geometries that share their buffers share an id, so the items drawn
+	// from one IA binding sort together.
+	mGeoSortIds.clear();
+	std::map<std::pair<ID3D12Resource*, ID3D12Resource*>, UINT> bufferIds;
+	for(auto& e : mGeometries)
+	{
+		MeshGeometry* geo = e.get();
+		auto buffers = std::make_pair(geo->VertexBufferGPU.Get(), geo->IndexBufferGPU.Get());
 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+		auto it = bufferIds.find(buffers);
+		if(it == bufferIds.end())
+			it = bufferIds.insert(std::make_pair(buffers, (UINT)bufferIds.size())).first;
+
+		mGeoSortIds[geo] = it->second;
+	}
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& ritems = mRitemLayer[layer];
+		for(auto handle : ritems)
+		{
+			RenderItem& ri = mRitems[handle];
+			ri.SortKey = MakeSortKey((RenderLayer)layer, 0, ri.Geo != nullptr ? mGeoSortIds[ri.Geo] : 0, ri.Mat->MatCBIndex);
+		}
+
+		std::stable_sort(ritems.begin(), ritems.end(),
+			[this](UINT a, UINT b) { return mRitems[a].SortKey < mRitems[b].SortKey; });
+	}
+}
+
+void TreeBillboardsApp::BuildSpatialIndex()
+{
+	// Rebuilt whenever a region loads.  Even the full scene is only a few hundred
+	// boxes, so this is cheaper than keeping the tree balanced under insertion.
+	mSpatialIndex.Clear();
+	mSpatialItems.clear();
+	for(UINT handle = mSceneFirstRitem; handle < (UINT)mRitems.size(); ++handle)
+	{
+		const RenderItem& ri = mRitems[handle];
+
+		BoundingBox worldBounds;
+		if(ri.Instances.empty())
+		{
+			ri.Bounds.Transform(worldBounds, XMLoadFloat4x4(&mTransforms->World(handle)));
+			mSpatialIndex.Add(worldBounds, (UINT)mSpatialItems.size());
+			mSpatialItems.push_back(std::make_pair(handle, UINT_MAX));
+		}
+
+		for(UINT i = 0; i < (UINT)ri.Instances.size(); ++i)
+		{
+			ri.Bounds.Transform(worldBounds, XMLoadFloat4x4(&ri.Instances[i].World));
+			mSpatialIndex.Add(worldBounds, (UINT)mSpatialItems.size());
+			mSpatialItems.push_back(std::make_pair(handle, i));
+		}
+	}
+	mSpatialIndex.Build();
+}
+
+void TreeBillboardsApp::BuildIndirectDraws()
+{
+	// The command signature sets the object index root constant (slot 1) and the
+	// instance data SRV (slot 4) per draw.
+	if(mDrawCuller != nullptr)
+		mRetiredDrawCullers.push_back(std::make_pair(mCurrentFence, std::move(mDrawCuller)));
+	mDrawCuller = std::make_unique<DrawCuller>(md3dDevice.Get(), mRootSignature.Get(), 1, 4);
+	mIndirectBatches.clear();
+
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if(!IsGpuDrivenLayer((RenderLayer)layer))
+			continue;
+
+		if(mRitemLayer[layer].empty())
+			continue;
+
+		// The shaders read each item's material through its object index, so the
+		// whole layer is one batch whatever materials its items use.
+		IndirectBatch batch;
+		batch.Layer = (RenderLayer)layer;
+		batch.Batch = mDrawCuller->AddBatch();
+		mIndirectBatches.push_back(batch);
+
+		for(auto handle : mRitemLayer[layer])
+		{
+			RenderItem* ri = &mRitems[handle];
+			assert(ri->PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+			DrawCuller::DrawItem item;
+			item.VertexBufferView = ri->Geo->VertexBufferView();
+			item.IndexBufferView = ri->Geo->IndexBufferView();
+			item.ObjectIndex = handle;
+			item.IndexCount = ri->IndexCount;
+			item.StartIndexLocation = ri->StartIndexLocation;
+			item.BaseVertexLocation = ri->BaseVertexLocation;
+			item.Bounds = ri->Bounds;
+			item.Occluder = ri->Occluder;
+
+			if(ri->Instances.empty())
+				mDrawCuller->AddItem(batch.Batch, item);
+			else
+				mDrawCuller->AddInstancedItem(batch.Batch, item, ri->Instances);
+
+			ri->GpuDriven = true;
+		}
+	}
+
+	mDrawCuller->Build(mCommandList.Get(), *mUploadRing, mFence.Get(), mCurrentFence + 1);
+}
+
+void TreeBillboardsApp::SortTransparentItems(const GameTimer& gt)
+{
+	// Blending needs back to front order, so the depth bits are filled in with the
+	// inverted view space depth and take priority over the state bits.
+	auto& ritems = mRitemLayer[(int)RenderLayer::Transparent];
+	if(ritems.size() < 2)
+		return;
+
+	XMMATRIX view = mCamera.GetView();
+	for(auto handle : ritems)
+	{
+		RenderItem* ri = &mRitems[handle];
+		XMMATRIX world = XMLoadFloat4x4(&mTransforms->World(handle));
+		XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&ri->Bounds.Center), world * view);
+		float depth = MathHelper::Clamp(XMVectorGetZ(center) / mCamera.GetFarZ(), 0.0f, 1.0f);
+
+		UINT invDepth = 0xffffff - (UINT)(depth * 0xffffff);
+		ri->SortKey = MakeSortKey(RenderLayer::Transparent, invDepth, mGeoSortIds[ri->Geo], ri->Mat->MatCBIndex);
+	}
+
+	std::stable_sort(ritems.begin(), ritems.end(),
+		[this](UINT a, UINT b) { return mRitems[a].SortKey < mRitems[b].SortKey; });
+}
+
+void TreeBillboardsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<UINT>& ritems,
+	size_t firstItem, size_t itemCount)
+{
+	D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = mCurrFrameResource->InstanceBuffer->GpuVirtualAddress();
+
+	const size_t lastItem = (std::min)(ritems.size(), firstItem + (std::min)(itemCount, ritems.size()));
+
+	// State already bound on this command list.  Items are sorted by geometry, so runs
+	// of items sharing one only bind it once.  The shaders read the material through
+	// the object index, so materials are never bound.
+	MeshGeometry* boundGeo = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
 
     // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
+    for(size_t i = firstItem; i < lastItem; ++i)
     {
-        auto ri = ritems[i];
+        auto ri = &mRitems[ritems[i]];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-		//step3
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		if(!ri->Visible)
+			continue;
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+		if(ri->Geo != boundGeo)
+		{
+			// Pooled geometries share their buffers, so often only the geometry changes.
+			if(boundGeo == nullptr || ri->Geo->VertexBufferGPU != boundGeo->VertexBufferGPU ||
+				ri->Geo->VertexByteStride != boundGeo->VertexByteStride)
+			{
+				cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+			}
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+			if(boundGeo == nullptr || ri->Geo->IndexBufferGPU != boundGeo->IndexBufferGPU)
+				cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+			boundGeo = ri->Geo;
+		}
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+		//step3
+		if(ri->PrimitiveType != boundTopology)
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			boundTopology = ri->PrimitiveType;
+		}
+
+		// The shaders read the item's data from the frame's ObjectBuffer at this index.
+		cmdList->SetGraphicsRoot32BitConstant(1, ritems[i], 0);
+
+		// SV_InstanceID always starts at zero, so bind the buffer at this item's first instance.
+		if(!ri->Instances.empty())
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS instanceAddress = instanceBufferAddress + ri->InstanceBufferOffset*sizeof(InstanceData);
+			cmdList->SetGraphicsRootShaderResourceView(4, instanceAddress);
+		}
+
+        cmdList->DrawIndexedInstanced(ri->IndexCount, ri->InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
     }
 }
 
+void TreeBillboardsApp::DrawIndirectBatches(ID3D12GraphicsCommandList* cmdList, RenderLayer layer)
+{
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// The indirect commands set the buffers and the object index, which is all the
+	// shaders need to find the material.
+	for(auto& batch : mIndirectBatches)
+	{
+		if(batch.Layer == layer)
+			mDrawCuller->DrawBatch(cmdList, batch.Batch);
+	}
+}
+
+void TreeBillboardsApp::DrawOccluders(ID3D12GraphicsCommandList* cmdList)
+{
+	cmdList->RSSetViewports(1, &mScreenViewport);
+	cmdList->RSSetScissorRects(1, &mScissorRect);
+
+	cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+	cmdList->SetGraphicsRootConstantBufferView(2, mCurrFrameResource->PassCB->GpuVirtualAddress());
+	cmdList->SetGraphicsRootShaderResourceView(9, mCurrFrameResource->ObjectBuffer->GpuVirtualAddress());
+
+	mHiZ->BeginOccluders(cmdList);
+
+	cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// The depth only vertex shaders read no material, so none is bound.
+	for(auto& batch : mIndirectBatches)
+	{
+		bool instanced = batch.Layer == RenderLayer::AlphaTestedInstanced;
+		cmdList->SetPipelineState(mPSOs[instanced ? mOccluderDepthInstancedPso : mOccluderDepthPso].Get());
+
+		mDrawCuller->DrawOccluderBatch(cmdList, batch.Batch);
+	}
+}
+
+void TreeBillboardsApp::DrawForest(ID3D12GraphicsCommandList* cmdList)
+{
+	// The pixel shader reads the forest's material through its object data.
+	cmdList->SetGraphicsRoot32BitConstant(1, mForestRitem, 0);
+
+	// The visible trees take the place of the instance data.
+	mForest->Draw(cmdList, 4);
+}
+
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TreeBillboardsApp::GetStaticSamplers()
 {
 	// Applications usually only need a handful of samplers.  So just define them all up front